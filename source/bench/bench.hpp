@@ -0,0 +1,71 @@
+#pragma once
+
+#include <common/log.hpp>
+#include <common/time.hpp>
+#include <common/tools.hpp>
+#include <common/t_types.hpp>
+
+struct voxel_t;
+
+// Small stand-alone benchmarks for the core data structures (run with vkPhysics_bench [name])
+
+// Loads a map into g_game (needs to be called before every benchmark which works on map data)
+void bench_load_map(const char *map_path);
+// Loads the map again, on top of a freshly initialised g_game (for runs which need to start from the same terrain)
+// The benchmarks share g_game: one which changes the terrain or forces a kernel puts back the map as it was loaded (with this) and
+// the default kernels before returning
+void bench_reload_map(const char *map_path);
+
+// Checks which fail make vkPhysics_bench return 1 (after all the benchmarks ran)
+extern uint32_t bench_failure_count;
+
+#define BENCH_FAILV(str, ...)                   \
+    ++bench_failure_count;                      \
+    LOG_ERRORV(str, __VA_ARGS__)
+
+#define BENCH_FAIL(str)                         \
+    ++bench_failure_count;                      \
+    LOG_ERROR(str)
+
+float bench_random_float(float min, float max);
+vector3_t bench_random_vector(float min, float max);
+
+// Whether the chunks have the same voxels (the backing store, packets and map files don't keep the colour of empty voxels)
+bool bench_same_voxels(const voxel_t *a, const voxel_t *b);
+
+// Hash of the voxels of all the loaded chunks, and of their modification history if include_history is set (doesn't depend on
+// the order of the chunks)
+uint32_t bench_hash_world(bool include_history);
+
+// Accumulates the time spent between start() and stop() over several runs
+struct bench_timer_t {
+    time_stamp_t start_time;
+    float total;
+
+    void start();
+    void stop();
+
+    float ms() const;
+    float us_per(uint32_t count) const;
+    float ns_per(uint32_t count) const;
+};
+
+void bench_chunk_index();
+void bench_chunk_storage();
+void bench_terrain_occupancy();
+void bench_voxel_layout();
+void bench_chunk_residency();
+void bench_dirty_bricks();
+void bench_terraform_kernel();
+void bench_world_generation();
+void bench_procedural_terrain();
+void bench_terraform_queue();
+void bench_terrain_raycast();
+void bench_collision_mesh();
+void bench_collision_bvh();
+void bench_collision_kernel();
+void bench_projectile_batch();
+void bench_projectile_store();
+void bench_player_broadphase();
+void bench_rewind_history();
+void bench_server_timestep();
@@ -0,0 +1,228 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/containers.hpp>
+#include <common/game_packet.hpp>
+
+// This is the hash that game_t::chunk_indices used to use (10 bits per axis - coordinates alias after 1024 chunks)
+static uint32_t s_legacy_hash_chunk_coord(
+    const ivector3_t &coord) {
+    struct {
+        union {
+            struct {
+                uint32_t padding: 2;
+                uint32_t x: 10;
+                uint32_t y: 10;
+                uint32_t z: 10;
+            };
+            uint32_t value;
+        };
+    } hasher;
+
+    hasher.value = 0;
+
+    hasher.x = *(uint32_t *)(&coord.x);
+    hasher.y = *(uint32_t *)(&coord.y);
+    hasher.z = *(uint32_t *)(&coord.z);
+
+    return (uint32_t)hasher.value;
+}
+
+static hash_table_t<uint32_t, 1500, 30, 10> legacy_table;
+static open_hash_table_t<uint32_t> open_table;
+
+static const uint32_t ITERATION_COUNT = 200;
+
+void bench_chunk_index() {
+    bench_load_map("ice.map");
+
+    uint32_t chunk_count;
+    chunk_t **chunks = g_game->get_active_chunks(&chunk_count);
+
+    // Queries look like the ones the mesher / collision do: every chunk + its 26 neighbours (hits and misses)
+    uint32_t query_count = 0;
+    ivector3_t *queries = FL_MALLOC(ivector3_t, chunk_count * 27);
+
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        if (chunks[i]) {
+            for (int32_t z = -1; z <= 1; ++z) {
+                for (int32_t y = -1; y <= 1; ++y) {
+                    for (int32_t x = -1; x <= 1; ++x) {
+                        queries[query_count++] = chunks[i]->chunk_coord + ivector3_t(x, y, z);
+                    }
+                }
+            }
+        }
+    }
+
+    bench_timer_t legacy_insert_timer = {}, open_insert_timer = {};
+    bench_timer_t legacy_query_timer = {}, open_query_timer = {};
+    uint64_t legacy_found = 0, open_found = 0;
+
+    open_table.init(CHUNK_MAX_LOADED_COUNT * 2);
+    legacy_table.init();
+
+    for (uint32_t it = 0; it < ITERATION_COUNT; ++it) {
+        legacy_table.clear();
+        open_table.clear();
+
+        legacy_insert_timer.start();
+        for (uint32_t i = 0; i < chunk_count; ++i) {
+            if (chunks[i]) {
+                legacy_table.insert(s_legacy_hash_chunk_coord(chunks[i]->chunk_coord), i);
+            }
+        }
+        legacy_insert_timer.stop();
+
+        open_insert_timer.start();
+        for (uint32_t i = 0; i < chunk_count; ++i) {
+            if (chunks[i]) {
+                open_table.insert(chunk_coord_key(chunks[i]->chunk_coord), i);
+            }
+        }
+        open_insert_timer.stop();
+
+        legacy_query_timer.start();
+        for (uint32_t q = 0; q < query_count; ++q) {
+            uint32_t *index = legacy_table.get(s_legacy_hash_chunk_coord(queries[q]));
+            legacy_found += index ? *index + 1 : 0;
+        }
+        legacy_query_timer.stop();
+
+        open_query_timer.start();
+        for (uint32_t q = 0; q < query_count; ++q) {
+            uint32_t *index = open_table.get(chunk_coord_key(queries[q]));
+            open_found += index ? *index + 1 : 0;
+        }
+        open_query_timer.stop();
+    }
+
+    uint32_t insert_count = chunk_count * ITERATION_COUNT;
+    uint32_t lookup_count = query_count * ITERATION_COUNT;
+
+    LOG_INFOV("%d chunks, %d queries per iteration, %d iterations\n", chunk_count, query_count, ITERATION_COUNT);
+    LOG_INFOV("hash_table_t:      insert %.2f ns, lookup %.2f ns\n",
+        legacy_insert_timer.ns_per(insert_count), legacy_query_timer.ns_per(lookup_count));
+    LOG_INFOV("open_hash_table_t: insert %.2f ns, lookup %.2f ns (capacity %d)\n",
+        open_insert_timer.ns_per(insert_count), open_query_timer.ns_per(lookup_count), open_table.capacity);
+
+    if (legacy_found != open_found) {
+        LOG_WARNING("Tables disagree on lookups (the legacy hash aliases coordinates)\n");
+    }
+
+    // Make sure removal (backward shift) leaves every other chunk reachable
+    for (uint32_t i = 0; i < chunk_count; i += 2) {
+        if (chunks[i]) {
+            open_table.remove(chunk_coord_key(chunks[i]->chunk_coord));
+        }
+    }
+
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        if (chunks[i]) {
+            uint32_t *index = open_table.get(chunk_coord_key(chunks[i]->chunk_coord));
+            if ((i % 2 == 0) == (index != NULL) || (index && *index != i)) {
+                BENCH_FAILV("open_hash_table_t lookup failed after removal for chunk %d\n", i);
+            }
+        }
+    }
+
+    // chunk_t::neighbours has to agree with game_t::chunk_indices
+    uint32_t neighbour_mismatch_count = 0;
+    bench_timer_t neighbour_timer = {};
+    uint64_t neighbour_found = 0;
+
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        if (chunks[i]) {
+            for (int32_t z = -1; z <= 1; ++z) {
+                for (int32_t y = -1; y <= 1; ++y) {
+                    for (int32_t x = -1; x <= 1; ++x) {
+                        chunk_t *expected = g_game->access_chunk(chunks[i]->chunk_coord + ivector3_t(x, y, z));
+                        neighbour_mismatch_count += get_chunk_neighbour(chunks[i], x, y, z) != expected;
+                    }
+                }
+            }
+        }
+    }
+
+    neighbour_timer.start();
+    for (uint32_t it = 0; it < ITERATION_COUNT; ++it) {
+        for (uint32_t i = 0; i < chunk_count; ++i) {
+            if (chunks[i]) {
+                for (uint32_t n = 0; n < 27; ++n) {
+                    neighbour_found += chunks[i]->neighbours[n] != NULL;
+                }
+            }
+        }
+    }
+    neighbour_timer.stop();
+
+    LOG_INFOV("chunk_t::neighbours: lookup %.2f ns (%d neighbours found)\n",
+        neighbour_timer.ns_per(lookup_count), (uint32_t)(neighbour_found / ITERATION_COUNT));
+
+    if (neighbour_mismatch_count) {
+        BENCH_FAILV("%d chunk neighbours don't match game_t::chunk_indices\n", neighbour_mismatch_count);
+    }
+
+    // Chunks far from the origin (1024 chunks apart used to alias) have to keep their own keys and survive packets
+    static const uint32_t FAR_CHUNK_COUNT = 4096;
+    ivector3_t *far_coords = FL_MALLOC(ivector3_t, FAR_CHUNK_COUNT);
+    uint64_t *far_keys = FL_MALLOC(uint64_t, FAR_CHUNK_COUNT);
+    uint32_t key_collision_count = 0, roundtrip_mismatch_count = 0;
+
+    srand(0);
+    for (uint32_t i = 0; i < FAR_CHUNK_COUNT; ++i) {
+        // Runs of neighbouring chunks (like the chunk packets) scattered around the whole addressable range
+        if (i % 8 == 0) {
+            far_coords[i] = ivector3_t(rand() % (1 << 21) - (1 << 20), rand() % (1 << 21) - (1 << 20), rand() % (1 << 21) - (1 << 20));
+        }
+        else {
+            far_coords[i] = far_coords[i - 1] + ivector3_t(1, (i % 3) == 0, -((i % 5) == 0));
+        }
+
+        if (i % 64 == 1) {
+            far_coords[i] = far_coords[i - 1] + ivector3_t(1024, 0, 0);
+        }
+
+        far_coords[i] = glm::clamp(far_coords[i], ivector3_t(-(1 << 20)), ivector3_t((1 << 20) - 1));
+        far_keys[i] = chunk_coord_key(far_coords[i]);
+    }
+
+    for (uint32_t i = 0; i < FAR_CHUNK_COUNT; ++i) {
+        for (uint32_t j = i + 1; j < FAR_CHUNK_COUNT; ++j) {
+            key_collision_count += far_keys[i] == far_keys[j] && far_coords[i] != far_coords[j];
+        }
+    }
+
+    serialiser_t serialiser = {};
+    serialiser.init(FAR_CHUNK_COUNT * PACKED_CHUNK_COORD_MAX_SIZE);
+
+    chunk_coord_packer_t packer = {};
+    for (uint32_t i = 0; i < FAR_CHUNK_COUNT; ++i) {
+        serialise_chunk_coord(far_coords[i], &packer, &serialiser);
+    }
+
+    uint32_t packed_size = serialiser.data_buffer_head;
+    serialiser.data_buffer_head = 0;
+
+    packer = {};
+    for (uint32_t i = 0; i < FAR_CHUNK_COUNT; ++i) {
+        roundtrip_mismatch_count += deserialise_chunk_coord(&packer, &serialiser) != far_coords[i];
+    }
+
+    LOG_INFOV("Chunk coordinates in packets: %.2f bytes per chunk (int16 coordinates took 6)\n", (float)packed_size / (float)FAR_CHUNK_COUNT);
+
+    if (key_collision_count) {
+        BENCH_FAILV("%d chunk keys collided\n", key_collision_count);
+    }
+
+    if (roundtrip_mismatch_count) {
+        BENCH_FAILV("%d chunk coordinates changed going through a packet\n", roundtrip_mismatch_count);
+    }
+
+    FL_FREE(far_keys);
+    FL_FREE(far_coords);
+    open_table.destroy();
+    FL_FREE(queries);
+}
@@ -0,0 +1,126 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/player.hpp>
+#include <common/allocators.hpp>
+
+static const uint32_t TICK_COUNT = 2000;
+static const uint32_t PLAYER_COUNT = 3;
+static const uint32_t WRITES_PER_TICK = 8;
+
+// Reloads the map with chunk paging
+static void s_reload_paged_map(const char *map_path) {
+    g_game->init_memory();
+    g_game->flags.page_chunks = 1;
+    g_game->residency.radius = 1;
+    g_game->residency.max_resident_count = 96;
+    g_game->residency.max_flushes_per_tick = CHUNK_MAX_FLUSHES_PER_TICK;
+    g_game->configure_map(map_path);
+    g_game->start_session();
+}
+
+void bench_chunk_residency() {
+    bench_load_map("ice.map");
+
+    // Reference copy of every chunk (in linear order) which gets the same writes as the paged chunks
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    uint32_t chunk_count = 0;
+    ivector3_t *coords = FL_MALLOC(ivector3_t, active_count);
+    voxel_t *reference = FL_MALLOC(voxel_t, active_count * CHUNK_VOXEL_COUNT);
+    ivector3_t min_coord = ivector3_t(INT32_MAX), max_coord = ivector3_t(INT32_MIN);
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        if (active[i]) {
+            voxel_t *dst = &reference[chunk_count * CHUNK_VOXEL_COUNT];
+            const voxel_t *voxels = get_chunk_voxels_linear(active[i], dst);
+            if (voxels != dst) {
+                memcpy(dst, voxels, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+            }
+
+            coords[chunk_count++] = active[i]->chunk_coord;
+            min_coord = glm::min(min_coord, active[i]->chunk_coord);
+            max_coord = glm::max(max_coord, active[i]->chunk_coord);
+        }
+    }
+
+    s_reload_paged_map("ice.map");
+
+    player_t *players[PLAYER_COUNT];
+    srand(0);
+    for (uint32_t p = 0; p < PLAYER_COUNT; ++p) {
+        players[p] = g_game->add_player();
+        players[p]->chunk_coord = coords[rand() % chunk_count];
+    }
+
+    uint32_t peak_resident_count = 0;
+    bench_timer_t update_timer = {};
+
+    for (uint32_t t = 0; t < TICK_COUNT; ++t) {
+        // Players wander around the map
+        for (uint32_t p = 0; p < PLAYER_COUNT; ++p) {
+            ivector3_t step = ivector3_t(rand() % 3 - 1, rand() % 3 - 1, rand() % 3 - 1);
+            players[p]->chunk_coord = glm::clamp(players[p]->chunk_coord + step, min_coord, max_coord);
+        }
+
+        // Terraforming anywhere on the map (pages chunks in on demand)
+        for (uint32_t w = 0; w < WRITES_PER_TICK; ++w) {
+            uint32_t c = rand() % chunk_count;
+            uint32_t index = rand() % CHUNK_VOXEL_COUNT;
+            uint8_t value = (uint8_t)(rand() % CHUNK_MAX_VOXEL_VALUE_I);
+
+            chunk_t *chunk = g_game->get_chunk(coords[c]);
+            set_chunk_voxel_value(chunk, index, value);
+            reference[c * CHUNK_VOXEL_COUNT + voxel_index_to_linear(index)].value = value;
+        }
+
+        update_timer.start();
+        update_chunk_residency();
+        update_timer.stop();
+
+        peak_resident_count = MAX(peak_resident_count, g_game->chunks.data_count - g_game->chunks.removed_count);
+
+        g_game->timestep_end();
+        LN_CLEAR();
+    }
+
+    chunk_residency_t *residency = &g_game->residency;
+    LOG_INFOV("%d chunks, peak of %d resident (budget %d): %d paged in, %d evicted, %d flushed (%.2f KB spill file)\n",
+        chunk_count, peak_resident_count, residency->max_resident_count,
+        residency->paged_in_count, residency->evicted_count, residency->flushed_count,
+        (float)residency->spill_file_size / 1024.0f);
+    LOG_INFOV("update_chunk_residency: %.2f us per tick\n", update_timer.us_per(TICK_COUNT));
+
+    // Whatever got evicted has to come back with the same voxels
+    uint32_t mismatch_count = 0;
+    voxel_t *scratch = FL_MALLOC(voxel_t, CHUNK_VOXEL_COUNT);
+
+    for (uint32_t c = 0; c < chunk_count; ++c) {
+        chunk_t *chunk = g_game->get_chunk(coords[c]);
+        const voxel_t *voxels = get_chunk_voxels_linear(chunk, scratch);
+
+        mismatch_count += !bench_same_voxels(voxels, &reference[c * CHUNK_VOXEL_COUNT]);
+
+        // Keeps the number of resident chunks down
+        if (c % 32 == 31) {
+            g_game->timestep_end();
+            update_chunk_residency();
+        }
+    }
+
+    if (mismatch_count) {
+        BENCH_FAILV("%d chunks lost modifications after getting paged out\n", mismatch_count);
+    }
+
+    g_game->clear_players();
+    end_chunk_residency();
+    bench_reload_map("ice.map");
+
+    FL_FREE(scratch);
+    FL_FREE(reference);
+    FL_FREE(coords);
+}
@@ -0,0 +1,176 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+
+static const uint32_t DECODE_ITERATION_COUNT = 20;
+static const uint32_t RANDOM_ACCESS_COUNT = 1 << 22;
+
+struct storage_timings_t {
+    bench_timer_t decode_timer;
+    bench_timer_t access_timer;
+    uint64_t checksum;
+};
+
+static storage_timings_t s_time_storage(chunk_t **chunks, uint32_t chunk_count, const uint32_t *access_indices) {
+    storage_timings_t timings = {};
+    voxel_t *scratch = FL_MALLOC(voxel_t, CHUNK_VOXEL_COUNT);
+
+    // Full decode (what the mesher / serialiser do)
+    timings.decode_timer.start();
+    for (uint32_t it = 0; it < DECODE_ITERATION_COUNT; ++it) {
+        for (uint32_t i = 0; i < chunk_count; ++i) {
+            const voxel_t *voxels = get_chunk_voxels(chunks[i], scratch);
+            timings.checksum += voxels[(i * 97) % CHUNK_VOXEL_COUNT].value;
+        }
+    }
+    timings.decode_timer.stop();
+
+    // Random access (what the collision does)
+    timings.access_timer.start();
+    for (uint32_t a = 0; a < RANDOM_ACCESS_COUNT; ++a) {
+        chunk_t *c = chunks[a % chunk_count];
+        timings.checksum += get_chunk_voxel(c, access_indices[a & 0xFFFF]).value;
+    }
+    timings.access_timer.stop();
+
+    FL_FREE(scratch);
+
+    return timings;
+}
+
+static uint32_t s_storage_bytes(const chunk_t *c) {
+    switch (c->storage) {
+    case CS_DENSE: return sizeof(voxel_t) * CHUNK_VOXEL_COUNT;
+    case CS_PALETTE: return chunk_palette_size(c->palette->bits);
+    default: return 0;
+    }
+}
+
+static void s_log_storage(const char *name, chunk_t **chunks, uint32_t chunk_count) {
+    uint32_t mode_counts[3] = {};
+    uint32_t bits_counts[CHUNK_PALETTE_MAX_BITS + 1] = {};
+    uint64_t bytes = 0;
+
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        ++mode_counts[chunks[i]->storage];
+        bytes += s_storage_bytes(chunks[i]);
+
+        if (chunks[i]->storage == CS_PALETTE) {
+            ++bits_counts[chunks[i]->palette->bits];
+        }
+    }
+
+    LOG_INFOV("%s: %d uniform, %d dense, %d palette (1/2/4/8 bits: %d/%d/%d/%d) - %.2f KB of voxel storage\n",
+        name, mode_counts[CS_UNIFORM], mode_counts[CS_DENSE], mode_counts[CS_PALETTE],
+        bits_counts[1], bits_counts[2], bits_counts[4], bits_counts[8], (float)bytes / 1024.0f);
+}
+
+// Checks every voxel of every chunk against a decoded copy of the map
+static bool s_verify(chunk_t **chunks, uint32_t chunk_count, const voxel_t *reference) {
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        for (uint32_t v = 0; v < CHUNK_VOXEL_COUNT; ++v) {
+            if (get_chunk_voxel(chunks[i], v) != reference[i * CHUNK_VOXEL_COUNT + v]) {
+                BENCH_FAILV("Chunk %d voxel %d doesn't match the reference\n", i, v);
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+void bench_chunk_storage() {
+    bench_load_map("ice.map");
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    uint32_t chunk_count = 0;
+    chunk_t **chunks = FL_MALLOC(chunk_t *, active_count);
+    for (uint32_t i = 0; i < active_count; ++i) {
+        if (active[i]) {
+            chunks[chunk_count++] = active[i];
+        }
+    }
+
+    voxel_t *reference = FL_MALLOC(voxel_t, chunk_count * CHUNK_VOXEL_COUNT);
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        voxel_t *dst = &reference[i * CHUNK_VOXEL_COUNT];
+        const voxel_t *voxels = get_chunk_voxels(chunks[i], dst);
+        if (voxels != dst) {
+            memcpy(dst, voxels, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+        }
+    }
+
+    voxel_t *original = FL_MALLOC(voxel_t, chunk_count * CHUNK_VOXEL_COUNT);
+    memcpy(original, reference, sizeof(voxel_t) * chunk_count * CHUNK_VOXEL_COUNT);
+
+    uint32_t *access_indices = FL_MALLOC(uint32_t, 0x10000);
+    srand(0);
+    for (uint32_t a = 0; a < 0x10000; ++a) {
+        access_indices[a] = rand() % CHUNK_VOXEL_COUNT;
+    }
+
+    uint32_t decode_count = chunk_count * DECODE_ITERATION_COUNT;
+
+    // Uniform / dense only (client configuration)
+    s_log_storage("uniform+dense ", chunks, chunk_count);
+    storage_timings_t dense = s_time_storage(chunks, chunk_count, access_indices);
+
+    // Uniform / palette (server configuration)
+    g_game->flags.palette_chunks = 1;
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        compress_chunk_storage(chunks[i]);
+    }
+
+    s_log_storage("uniform+palette", chunks, chunk_count);
+    storage_timings_t palette = s_time_storage(chunks, chunk_count, access_indices);
+
+    LOG_INFOV("uniform+dense:   decode %.2f us/chunk, random access %.2f ns\n",
+        dense.decode_timer.us_per(decode_count), dense.access_timer.ns_per(RANDOM_ACCESS_COUNT));
+    LOG_INFOV("uniform+palette: decode %.2f us/chunk, random access %.2f ns\n",
+        palette.decode_timer.us_per(decode_count), palette.access_timer.ns_per(RANDOM_ACCESS_COUNT));
+
+    if (dense.checksum != palette.checksum || !s_verify(chunks, chunk_count, reference)) {
+        BENCH_FAIL("Palette encoding changed the voxels of the map\n");
+    }
+
+    // Writes which grow the palette all the way up to a voxel array (transcodes 1 -> 2 -> 4 -> 8 bits -> dense)
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        for (uint32_t w = 0; w < 300; ++w) {
+            uint32_t index = (w * 131 + i) % CHUNK_VOXEL_COUNT;
+            voxel_t voxel = { (uint8_t)(w & 0xFF), (uint8_t)(w * 7 + i) };
+
+            set_chunk_voxel(chunks[i], index, voxel);
+            reference[i * CHUNK_VOXEL_COUNT + index] = voxel;
+        }
+    }
+
+    s_log_storage("after writes  ", chunks, chunk_count);
+
+    if (!s_verify(chunks, chunk_count, reference)) {
+        BENCH_FAIL("Palette writes / transcoding changed the voxels of the map\n");
+    }
+
+    g_game->flags.palette_chunks = 0;
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        compress_chunk_storage(chunks[i]);
+    }
+
+    if (!s_verify(chunks, chunk_count, reference)) {
+        BENCH_FAIL("Palette -> dense conversion changed the voxels of the map\n");
+    }
+
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        memcpy(get_chunk_voxels_for_write(chunks[i]), &original[i * CHUNK_VOXEL_COUNT], sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+        compress_chunk_storage(chunks[i]);
+    }
+
+    FL_FREE(original);
+    FL_FREE(access_indices);
+    FL_FREE(reference);
+    FL_FREE(chunks);
+}
@@ -0,0 +1,222 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/allocators.hpp>
+
+static const uint32_t SWEEP_COUNT = 2000;
+static const uint32_t EDIT_ROUND_COUNT = 4;
+static const uint32_t EDITS_PER_ROUND = 40;
+// Walking players, balls, fast balls and meteorites
+static const float SWEEP_LENGTHS[] = { 0.5f, 2.0f, 8.0f, 32.0f };
+static const uint32_t SWEEP_LENGTH_COUNT = sizeof(SWEEP_LENGTHS) / sizeof(SWEEP_LENGTHS[0]);
+
+// Whether the box (center +/- extent) touches the triangle's bounds somewhere on the segment
+static bool s_sweep_touches_triangle(const vector3_t &start, const vector3_t &displacement, const vector3_t &extent, const collision_triangle_t *triangle) {
+    vector3_t lo = glm::min(glm::min(triangle->v.a, triangle->v.b), triangle->v.c) - extent;
+    vector3_t hi = glm::max(glm::max(triangle->v.a, triangle->v.b), triangle->v.c) + extent;
+    float enter = 0.0f, exit = 1.0f;
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        if (displacement[i] == 0.0f) {
+            if (start[i] < lo[i] || start[i] > hi[i]) {
+                return 0;
+            }
+        }
+        else {
+            float t0 = (lo[i] - start[i]) / displacement[i];
+            float t1 = (hi[i] - start[i]) / displacement[i];
+            enter = glm::max(enter, glm::min(t0, t1));
+            exit = glm::min(exit, glm::max(t0, t1));
+        }
+    }
+
+    return enter <= exit;
+}
+
+static bool s_contains_triangle(const collision_triangle_t *triangles, uint32_t count, const collision_triangle_t *triangle) {
+    for (uint32_t t = 0; t < count; ++t) {
+        if (!memcmp(&triangles[t], triangle, sizeof(collision_triangle_t))) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Every triangle of the box around the sweep which the sweep touches has to come out of the BVH
+static uint32_t s_check_sweeps(const vector3_t *starts, const vector3_t *displacements) {
+    uint32_t miss_count = 0;
+
+    for (uint32_t s = 0; s < SWEEP_COUNT; ++s) {
+        vector3_t size = vector3_t(PLAYER_SCALE);
+        vector3_t box_center = starts[s] + displacements[s] * 0.5f;
+        vector3_t box_size = glm::abs(displacements[s]) * 0.5f + size + vector3_t(1.0f);
+
+        uint32_t box_count, sweep_count;
+        collision_triangle_t *box_triangles = gather_collision_triangles(&box_count, box_center, box_size);
+        collision_triangle_t *sweep_triangles = sweep_collision_triangles(&sweep_count, starts[s], size, displacements[s]);
+
+        for (uint32_t t = 0; t < box_count; ++t) {
+            if (s_sweep_touches_triangle(starts[s], displacements[s], size, &box_triangles[t]) &&
+                !s_contains_triangle(sweep_triangles, sweep_count, &box_triangles[t])) {
+                ++miss_count;
+                break;
+            }
+        }
+
+        LN_CLEAR();
+    }
+
+    return miss_count;
+}
+
+void bench_collision_bvh() {
+    bench_load_map("ice.map");
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    uint32_t surface_chunk_count = 0;
+    ivector3_t *surface_chunks = FL_MALLOC(ivector3_t, active_count);
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        if (active[i] && (active[i]->solid_bricks & active[i]->air_bricks)) {
+            surface_chunks[surface_chunk_count++] = active[i]->chunk_coord;
+        }
+    }
+
+    vector3_t *starts = FL_MALLOC(vector3_t, SWEEP_COUNT);
+    vector3_t *directions = FL_MALLOC(vector3_t, SWEEP_COUNT);
+    vector3_t *displacements = FL_MALLOC(vector3_t, SWEEP_COUNT);
+    srand(12);
+
+    for (uint32_t s = 0; s < SWEEP_COUNT; ++s) {
+        vector3_t chunk_origin = space_chunk_to_world(surface_chunks[rand() % surface_chunk_count]);
+        starts[s] = chunk_origin + vector3_t(
+            bench_random_float(0.0f, CHUNK_EDGE_LENGTH),
+            bench_random_float(0.0f, CHUNK_EDGE_LENGTH),
+            bench_random_float(0.0f, CHUNK_EDGE_LENGTH));
+        directions[s] = glm::normalize(vector3_t(bench_random_float(-1.0f, 1.0f), bench_random_float(-1.0f, 0.5f), bench_random_float(-1.0f, 1.0f)));
+        displacements[s] = directions[s] * SWEEP_LENGTHS[s % SWEEP_LENGTH_COUNT];
+    }
+
+    // The BVH gets refitted after the terrain gets modified
+    uint32_t miss_count = s_check_sweeps(starts, displacements);
+
+    for (uint32_t r = 0; r < EDIT_ROUND_COUNT; ++r) {
+        for (uint32_t e = 0; e < EDITS_PER_ROUND; ++e) {
+            terraform_package_t package = {};
+            package.ray_hit_terrain = 1;
+            package.ws_position = glm::round(starts[rand() % SWEEP_COUNT]);
+            package.color = (voxel_color_t)(rand() % 256);
+
+            terraform((rand() & 1) ? TT_DESTROY : TT_BUILD, package, PLAYER_TERRAFORMING_RADIUS, PLAYER_TERRAFORMING_SPEED, 1.0f / 60.0f);
+        }
+
+        apply_terraform_commands();
+        g_game->reset_modification_tracker();
+        LN_CLEAR();
+
+        miss_count += s_check_sweeps(starts, displacements);
+    }
+
+    if (miss_count) {
+        BENCH_FAILV("%d / %d sweeps didn't get all the triangles they touch\n", miss_count, SWEEP_COUNT * (EDIT_ROUND_COUNT + 1));
+    }
+
+    // Builds the meshes of the chunks around the sweeps so that only the queries get timed
+    s_check_sweeps(starts, displacements);
+
+    // Brute force: every triangle of the box around the sweep, against the triangles the BVH keeps
+    for (uint32_t l = 0; l < SWEEP_LENGTH_COUNT; ++l) {
+        uint32_t box_triangle_count = 0, sweep_triangle_count = 0, query_count = 0;
+
+        bench_timer_t box_timer = {}, sweep_timer = {}, slide_timer = {};
+
+        box_timer.start();
+        for (uint32_t s = l; s < SWEEP_COUNT; s += SWEEP_LENGTH_COUNT) {
+            uint32_t count;
+            gather_collision_triangles(&count, starts[s] + displacements[s] * 0.5f, glm::abs(displacements[s]) * 0.5f + vector3_t(PLAYER_SCALE));
+            box_triangle_count += count;
+            ++query_count;
+            LN_CLEAR();
+        }
+        box_timer.stop();
+
+        sweep_timer.start();
+        for (uint32_t s = l; s < SWEEP_COUNT; s += SWEEP_LENGTH_COUNT) {
+            uint32_t count;
+            sweep_collision_triangles(&count, starts[s], vector3_t(PLAYER_SCALE), displacements[s]);
+            sweep_triangle_count += count;
+            LN_CLEAR();
+        }
+        sweep_timer.stop();
+
+        // Balls moving by that much in one collide_and_slide
+        slide_timer.start();
+        for (uint32_t s = l; s < SWEEP_COUNT; s += SWEEP_LENGTH_COUNT) {
+            terrain_collision_t collision = {};
+            collision.ws_size = vector3_t(PLAYER_SCALE);
+            collision.ws_position = starts[s];
+            collision.ws_velocity = displacements[s];
+            collision.es_position = collision.ws_position / collision.ws_size;
+            collision.es_velocity = collision.ws_velocity / collision.ws_size;
+
+            collide_and_slide(&collision);
+            LN_CLEAR();
+        }
+        slide_timer.stop();
+
+        LOG_INFOV("Sweeps of %.1f: box %.2f us (%.1f triangles), BVH %.2f us (%.1f triangles), collide_and_slide %.2f us\n",
+            SWEEP_LENGTHS[l],
+            box_timer.us_per(query_count), (float)box_triangle_count / (float)query_count,
+            sweep_timer.us_per(query_count), (float)sweep_triangle_count / (float)query_count,
+            slide_timer.us_per(query_count));
+    }
+
+    // Refitting after a brush vs building the whole mesh
+    uint32_t refit_chunk_count = 0;
+    bench_timer_t refit_timer = {}, build_timer = {};
+
+    for (uint32_t e = 0; e < EDITS_PER_ROUND; ++e) {
+        terraform_package_t package = {};
+        package.ray_hit_terrain = 1;
+        package.ws_position = glm::round(starts[rand() % SWEEP_COUNT]);
+
+        terraform(TT_DESTROY, package, PLAYER_TERRAFORMING_RADIUS, PLAYER_TERRAFORMING_SPEED, 1.0f / 60.0f);
+        apply_terraform_commands();
+
+        uint32_t modified_count;
+        chunk_t **modified = g_game->get_modified_chunks(&modified_count);
+
+        for (uint32_t c = 0; c < modified_count; ++c) {
+            refit_timer.start();
+            get_chunk_collision_mesh(modified[c]);
+            refit_timer.stop();
+
+            modified[c]->collision_dirty_bricks = ~0ull;
+
+            build_timer.start();
+            get_chunk_collision_mesh(modified[c]);
+            build_timer.stop();
+
+            ++refit_chunk_count;
+        }
+
+        g_game->reset_modification_tracker();
+        LN_CLEAR();
+    }
+
+    LOG_INFOV("Collision mesh after a brush: %.2f us updating the dirty bricks, %.2f us rebuilding the chunk\n",
+        refit_timer.us_per(refit_chunk_count), build_timer.us_per(refit_chunk_count));
+
+    bench_reload_map("ice.map");
+
+    FL_FREE(displacements);
+    FL_FREE(directions);
+    FL_FREE(starts);
+    FL_FREE(surface_chunks);
+}
@@ -0,0 +1,229 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/allocators.hpp>
+#include <common/collision_kernel.hpp>
+
+static const uint32_t FUZZ_CASE_COUNT = 100000;
+static const uint32_t MAX_FUZZ_TRIANGLES = 40;
+static const uint32_t SLIDE_COUNT = 20000;
+
+// Triangles around the sphere, with a few of the cases which take other branches (parallel / inside / degenerate triangles)
+static void s_make_fuzz_case(terrain_collision_t *collision, collision_triangle_t *triangles, uint32_t triangle_count) {
+    memset(collision, 0, sizeof(terrain_collision_t));
+    collision->ws_size = vector3_t(1.0f);
+    collision->es_position = bench_random_vector(-2.0f, 2.0f);
+
+    uint32_t velocity_type = rand() % 8;
+    if (velocity_type == 0) {
+        collision->es_velocity = vector3_t(0.0f);
+    }
+    else if (velocity_type == 1) {
+        // Parallel to the flat triangles below
+        collision->es_velocity = vector3_t(bench_random_float(-2.0f, 2.0f), 0.0f, bench_random_float(-2.0f, 2.0f));
+    }
+    else {
+        collision->es_velocity = bench_random_vector(-3.0f, 3.0f);
+    }
+
+    if (glm::dot(collision->es_velocity, collision->es_velocity) == 0.0f) {
+        collision->es_normalised_velocity = vector3_t(0.0f);
+    }
+    else {
+        collision->es_normalised_velocity = glm::normalize(collision->es_velocity);
+    }
+
+    // Contact of previous recursions / calls
+    if (rand() % 4 == 0) {
+        collision->detected = 1;
+        collision->es_nearest_distance = bench_random_float(0.0f, 2.0f);
+    }
+
+    for (uint32_t t = 0; t < triangle_count; ++t) {
+        uint32_t type = rand() % 16;
+        vector3_t center = collision->es_position + bench_random_vector(-3.0f, 3.0f);
+
+        for (uint32_t i = 0; i < 3; ++i) {
+            triangles[t].vertices[i] = center + bench_random_vector(-1.5f, 1.5f);
+        }
+
+        if (type == 0) {
+            // Flat (y = constant, around the sphere)
+            float y = collision->es_position.y + bench_random_float(-1.5f, 1.5f);
+            for (uint32_t i = 0; i < 3; ++i) {
+                triangles[t].vertices[i].y = y;
+            }
+        }
+        else if (type == 1) {
+            // Degenerate
+            triangles[t].vertices[2] = triangles[t].vertices[rand() % 2];
+        }
+        else if (type == 2) {
+            // Big triangle through the sphere
+            for (uint32_t i = 0; i < 3; ++i) {
+                triangles[t].vertices[i] = collision->es_position + bench_random_vector(-8.0f, 8.0f);
+            }
+        }
+    }
+}
+
+static bool s_same_collision(const terrain_collision_t *a, const terrain_collision_t *b) {
+    return !memcmp(a, b, sizeof(terrain_collision_t));
+}
+
+void bench_collision_kernel() {
+    static const char *KERNEL_NAMES[CKT_INVALID] = { "scalar", "sse2", "avx2" };
+
+    // The SIMD kernels have to give exactly the same contacts as the scalar one
+    collision_triangle_t *triangles = FL_MALLOC(collision_triangle_t, MAX_FUZZ_TRIANGLES);
+    uint32_t mismatch_counts[CKT_INVALID] = {};
+    uint32_t hit_count = 0, under_terrain_count = 0;
+    srand(13);
+
+    for (uint32_t f = 0; f < FUZZ_CASE_COUNT; ++f) {
+        uint32_t triangle_count = 1 + rand() % MAX_FUZZ_TRIANGLES;
+
+        terrain_collision_t initial;
+        s_make_fuzz_case(&initial, triangles, triangle_count);
+
+        collision_triangle_batch_t batch;
+        make_collision_triangle_batch(&batch, triangles, triangle_count, initial.ws_size);
+
+        terrain_collision_t reference = initial;
+        set_collision_batch_kernel(CKT_SCALAR);
+        get_collision_batch_kernel()(&reference, &batch);
+
+        hit_count += reference.has_detected_previously;
+        under_terrain_count += reference.under_terrain;
+
+        for (uint32_t k = CKT_SSE2; k < CKT_INVALID; ++k) {
+            if (set_collision_batch_kernel((collision_kernel_type_t)k)) {
+                terrain_collision_t collision = initial;
+                get_collision_batch_kernel()(&collision, &batch);
+
+                mismatch_counts[k] += !s_same_collision(&collision, &reference);
+            }
+        }
+
+        LN_CLEAR();
+    }
+
+    for (uint32_t k = CKT_SSE2; k < CKT_INVALID; ++k) {
+        if (set_collision_batch_kernel((collision_kernel_type_t)k) && mismatch_counts[k]) {
+            BENCH_FAILV("%s kernel: %d / %d fuzz cases didn't give the same contact as the scalar kernel\n", KERNEL_NAMES[k], mismatch_counts[k], FUZZ_CASE_COUNT);
+        }
+    }
+
+    LOG_INFOV("%d fuzz cases (%d hits, %d under the terrain)\n", FUZZ_CASE_COUNT, hit_count, under_terrain_count);
+
+    // Players falling onto the terrain / sliding along it, with each kernel
+    bench_load_map("ice.map");
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    uint32_t surface_chunk_count = 0;
+    ivector3_t *surface_chunks = FL_MALLOC(ivector3_t, active_count);
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        if (active[i] && (active[i]->solid_bricks & active[i]->air_bricks)) {
+            surface_chunks[surface_chunk_count++] = active[i]->chunk_coord;
+        }
+    }
+
+    vector3_t *positions = FL_MALLOC(vector3_t, SLIDE_COUNT);
+    vector3_t *velocities = FL_MALLOC(vector3_t, SLIDE_COUNT);
+    vector3_t *reference_positions = FL_MALLOC(vector3_t, SLIDE_COUNT);
+
+    for (uint32_t s = 0; s < SLIDE_COUNT; ++s) {
+        vector3_t chunk_origin = space_chunk_to_world(surface_chunks[rand() % surface_chunk_count]);
+        positions[s] = chunk_origin + bench_random_vector(0.0f, CHUNK_EDGE_LENGTH);
+        velocities[s] = vector3_t(bench_random_float(-1.0f, 1.0f), -2.0f, bench_random_float(-1.0f, 1.0f)) * (PLAYER_WALKING_SPEED / 60.0f) * bench_random_float(1.0f, 8.0f);
+    }
+
+    // Builds the collision meshes so that only the collisions get timed
+    for (uint32_t s = 0; s < SLIDE_COUNT; ++s) {
+        uint32_t count;
+        sweep_collision_triangles(&count, positions[s], vector3_t(PLAYER_SCALE), velocities[s]);
+        LN_CLEAR();
+    }
+
+    for (uint32_t k = CKT_SCALAR; k < CKT_INVALID; ++k) {
+        if (!set_collision_batch_kernel((collision_kernel_type_t)k)) {
+            LOG_INFOV("%s kernel isn't supported\n", KERNEL_NAMES[k]);
+            continue;
+        }
+
+        uint32_t slide_mismatch_count = 0;
+
+        bench_timer_t slide_timer = {};
+
+        slide_timer.start();
+        for (uint32_t s = 0; s < SLIDE_COUNT; ++s) {
+            terrain_collision_t collision = {};
+            collision.ws_size = vector3_t(PLAYER_SCALE);
+            collision.ws_position = positions[s];
+            collision.ws_velocity = velocities[s];
+            collision.es_position = collision.ws_position / collision.ws_size;
+            collision.es_velocity = collision.ws_velocity / collision.ws_size;
+
+            vector3_t position = collide_and_slide(&collision);
+
+            if (k == CKT_SCALAR) {
+                reference_positions[s] = position;
+            }
+            else {
+                slide_mismatch_count += !!memcmp(&position, &reference_positions[s], sizeof(vector3_t));
+            }
+
+            LN_CLEAR();
+        }
+        slide_timer.stop();
+
+        // Only the triangle checks of the same queries
+        uint32_t triangle_count = 0;
+        bench_timer_t kernel_timer = {};
+
+        for (uint32_t s = 0; s < SLIDE_COUNT; ++s) {
+            terrain_collision_t collision = {};
+            collision.ws_size = vector3_t(PLAYER_SCALE);
+            collision.es_position = positions[s] / collision.ws_size;
+            collision.es_velocity = velocities[s] / collision.ws_size;
+            collision.es_normalised_velocity = glm::normalize(collision.es_velocity);
+
+            uint32_t count;
+            collision_triangle_t *swept = sweep_collision_triangles(&count, positions[s], collision.ws_size, velocities[s]);
+
+            collision_triangle_batch_t batch;
+            make_collision_triangle_batch(&batch, swept, count, collision.ws_size);
+
+            kernel_timer.start();
+            get_collision_batch_kernel()(&collision, &batch);
+            kernel_timer.stop();
+
+            triangle_count += count;
+            LN_CLEAR();
+        }
+
+        if (slide_mismatch_count) {
+            BENCH_FAILV("%s kernel: %d / %d collide_and_slide calls didn't end at the same position as with the scalar kernel\n", KERNEL_NAMES[k], slide_mismatch_count, SLIDE_COUNT);
+        }
+
+        LOG_INFOV("%s kernel: %.2f ns per triangle (%.1f triangles per query), collide_and_slide %.2f us per call\n",
+            KERNEL_NAMES[k], kernel_timer.ns_per(triangle_count), (float)triangle_count / (float)SLIDE_COUNT,
+            slide_timer.us_per(SLIDE_COUNT));
+    }
+
+    if (!set_collision_batch_kernel(CKT_AVX2) && !set_collision_batch_kernel(CKT_SSE2)) {
+        set_collision_batch_kernel(CKT_SCALAR);
+    }
+
+    FL_FREE(reference_positions);
+    FL_FREE(velocities);
+    FL_FREE(positions);
+    FL_FREE(surface_chunks);
+    FL_FREE(triangles);
+}
@@ -0,0 +1,223 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/math.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/allocators.hpp>
+#include <common/triangle_table.inc>
+
+static const uint32_t QUERY_COUNT = 4000;
+static const uint32_t EDIT_ROUND_COUNT = 8;
+static const uint32_t EDITS_PER_ROUND = 40;
+static const uint32_t SLIDE_COUNT = 20000;
+
+// Corners of a cell in the order of APRON_CELL_CORNER_OFFSETS
+static const vector3_t CELL_CORNERS[8] = {
+    vector3_t(0.0f, 0.0f, 0.0f), vector3_t(1.0f, 0.0f, 0.0f), vector3_t(1.0f, 0.0f, 1.0f), vector3_t(0.0f, 0.0f, 1.0f),
+    vector3_t(0.0f, 1.0f, 0.0f), vector3_t(1.0f, 1.0f, 0.0f), vector3_t(1.0f, 1.0f, 1.0f), vector3_t(0.0f, 1.0f, 1.0f)
+};
+
+// Collision triangles before they got cached: marching cubes over every cell of the box (which may have a surface), for every query
+static collision_triangle_t *s_reference_triangles(uint32_t *triangle_count, const vector3_t &ws_center, const vector3_t &ws_size) {
+    ivector3_t vs_max = ivector3_t(glm::ceil(ws_center + ws_size));
+    ivector3_t vs_min = ivector3_t(glm::floor(ws_center - ws_size));
+    ivector3_t range = vs_max - vs_min;
+
+    if (!terrain_may_have_surface(vs_min, vs_max)) {
+        *triangle_count = 0;
+        return NULL;
+    }
+
+    collision_triangle_t *triangles = LN_MALLOC(collision_triangle_t, 5 * range.x * range.y * range.z);
+    uint32_t count = 0;
+
+    for (int32_t z = vs_min.z; z < vs_max.z; ++z) {
+        for (int32_t y = vs_min.y; y < vs_max.y; ++y) {
+            for (int32_t x = vs_min.x; x < vs_max.x; ++x) {
+                ivector3_t vs_cell = ivector3_t(x, y, z);
+                chunk_t *chunk = g_game->access_chunk(space_voxel_to_chunk(vs_cell));
+
+                ivector3_t cs_cell = chunk ? vs_cell - chunk->xs_bottom_corner : ivector3_t(0);
+
+                if (!chunk || !chunk_brick_may_have_surface(chunk, cs_cell / CHUNK_BRICK_EDGE_LENGTH)) {
+                    continue;
+                }
+
+                const voxel_t *cell = &get_chunk_apron(chunk)->voxels[get_apron_index(cs_cell.x, cs_cell.y, cs_cell.z)];
+
+                uint8_t values[8];
+                uint32_t bits = 0;
+                for (uint32_t i = 0; i < 8; ++i) {
+                    values[i] = cell[APRON_CELL_CORNER_OFFSETS[i]].value;
+                    bits |= (uint32_t)(values[i] > CHUNK_SURFACE_LEVEL) << i;
+                }
+
+                const int8_t *entry = TRIANGLE_TABLE[bits];
+                for (uint32_t e = 0; entry[e] != -1; e += 3) {
+                    for (uint32_t i = 0; i < 3; ++i) {
+                        uint8_t c0 = CELL_EDGE_CORNERS[entry[e + i]][0];
+                        uint8_t c1 = CELL_EDGE_CORNERS[entry[e + i]][1];
+
+                        // Interpolate from the lowest value, like the collision code does
+                        if (values[c0] > values[c1]) {
+                            uint8_t tmp = c0;
+                            c0 = c1;
+                            c1 = tmp;
+                        }
+
+                        float t = lerp((float)values[c0], (float)values[c1], (float)CHUNK_SURFACE_LEVEL);
+                        triangles[count].vertices[i] = interpolate(CELL_CORNERS[c0] + vector3_t(vs_cell), CELL_CORNERS[c1] + vector3_t(vs_cell), t);
+                    }
+
+                    ++count;
+                }
+            }
+        }
+    }
+
+    *triangle_count = count;
+
+    return triangles;
+}
+
+// Same triangles, in the same order
+static bool s_same_triangles(const collision_triangle_t *a, uint32_t a_count, const collision_triangle_t *b, uint32_t b_count) {
+    if (a_count != b_count) {
+        return 0;
+    }
+
+    for (uint32_t t = 0; t < a_count; ++t) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            if (glm::length(a[t].vertices[i] - b[t].vertices[i]) > 1e-4f) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+static uint32_t s_check_queries(const vector3_t *centers, const vector3_t *sizes) {
+    uint32_t mismatch_count = 0;
+
+    for (uint32_t q = 0; q < QUERY_COUNT; ++q) {
+        uint32_t count, reference_count;
+        collision_triangle_t *triangles = gather_collision_triangles(&count, centers[q], sizes[q]);
+        collision_triangle_t *reference = s_reference_triangles(&reference_count, centers[q], sizes[q]);
+
+        mismatch_count += !s_same_triangles(triangles, count, reference, reference_count);
+
+        LN_CLEAR();
+    }
+
+    return mismatch_count;
+}
+
+void bench_collision_mesh() {
+    bench_load_map("ice.map");
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    // Queries are around the surface (where players walk and rocks land)
+    uint32_t surface_chunk_count = 0;
+    ivector3_t *surface_chunks = FL_MALLOC(ivector3_t, active_count);
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        if (active[i] && (active[i]->solid_bricks & active[i]->air_bricks)) {
+            surface_chunks[surface_chunk_count++] = active[i]->chunk_coord;
+        }
+    }
+
+    vector3_t *centers = FL_MALLOC(vector3_t, QUERY_COUNT);
+    vector3_t *sizes = FL_MALLOC(vector3_t, QUERY_COUNT);
+    srand(11);
+
+    for (uint32_t q = 0; q < QUERY_COUNT; ++q) {
+        vector3_t chunk_origin = space_chunk_to_world(surface_chunks[rand() % surface_chunk_count]);
+        centers[q] = chunk_origin + vector3_t(
+            bench_random_float(0.0f, CHUNK_EDGE_LENGTH),
+            bench_random_float(0.0f, CHUNK_EDGE_LENGTH),
+            bench_random_float(0.0f, CHUNK_EDGE_LENGTH));
+
+        // Mostly players, a few bigger ellipsoids
+        sizes[q] = (q % 8) ? vector3_t(PLAYER_SCALE) : vector3_t(bench_random_float(1.0f, 3.0f), bench_random_float(1.0f, 3.0f), bench_random_float(1.0f, 3.0f));
+    }
+
+    // The cached triangles have to be the ones marching cubes gives, even after the terrain got modified around them
+    uint32_t mismatch_count = s_check_queries(centers, sizes);
+
+    for (uint32_t r = 0; r < EDIT_ROUND_COUNT; ++r) {
+        for (uint32_t e = 0; e < EDITS_PER_ROUND; ++e) {
+            terraform_package_t package = {};
+            package.ray_hit_terrain = 1;
+            package.ws_position = glm::round(centers[rand() % QUERY_COUNT]);
+            package.color = (voxel_color_t)(rand() % 256);
+
+            terraform((rand() & 1) ? TT_DESTROY : TT_BUILD, package, PLAYER_TERRAFORMING_RADIUS, PLAYER_TERRAFORMING_SPEED, 1.0f / 60.0f);
+        }
+
+        apply_terraform_commands();
+        g_game->reset_modification_tracker();
+        LN_CLEAR();
+
+        mismatch_count += s_check_queries(centers, sizes);
+    }
+
+    if (mismatch_count) {
+        BENCH_FAILV("%d / %d queries didn't get the same triangles as marching cubes\n", mismatch_count, QUERY_COUNT * (EDIT_ROUND_COUNT + 1));
+    }
+
+    // Player sized queries, like the ones of every recursion of collide_and_slide
+    uint32_t reference_triangle_count = 0, cached_triangle_count = 0;
+
+    bench_timer_t reference_timer = {}, cached_timer = {}, slide_timer = {};
+
+    reference_timer.start();
+    for (uint32_t q = 0; q < QUERY_COUNT; ++q) {
+        uint32_t count;
+        s_reference_triangles(&count, centers[q], vector3_t(PLAYER_SCALE));
+        reference_triangle_count += count;
+        LN_CLEAR();
+    }
+    reference_timer.stop();
+
+    cached_timer.start();
+    for (uint32_t q = 0; q < QUERY_COUNT; ++q) {
+        uint32_t count;
+        gather_collision_triangles(&count, centers[q], vector3_t(PLAYER_SCALE));
+        cached_triangle_count += count;
+        LN_CLEAR();
+    }
+    cached_timer.stop();
+
+    LOG_INFOV("Player sized queries: %.2f us re-meshing the cells, %.2f us gathering cached triangles (%d / %d triangles)\n",
+        reference_timer.us_per(QUERY_COUNT), cached_timer.us_per(QUERY_COUNT), cached_triangle_count, reference_triangle_count);
+
+    // Players falling onto the terrain / sliding along it
+    slide_timer.start();
+    for (uint32_t s = 0; s < SLIDE_COUNT; ++s) {
+        uint32_t q = s % QUERY_COUNT;
+
+        terrain_collision_t collision = {};
+        collision.ws_size = vector3_t(PLAYER_SCALE);
+        collision.ws_position = centers[q];
+        collision.ws_velocity = vector3_t(bench_random_float(-1.0f, 1.0f), -2.0f, bench_random_float(-1.0f, 1.0f)) * (PLAYER_WALKING_SPEED / 60.0f);
+        collision.es_position = collision.ws_position / collision.ws_size;
+        collision.es_velocity = collision.ws_velocity / collision.ws_size;
+
+        collide_and_slide(&collision);
+        LN_CLEAR();
+    }
+    slide_timer.stop();
+
+    LOG_INFOV("collide_and_slide: %.2f us per call\n", slide_timer.us_per(SLIDE_COUNT));
+
+    bench_reload_map("ice.map");
+
+    FL_FREE(sizes);
+    FL_FREE(centers);
+    FL_FREE(surface_chunks);
+}
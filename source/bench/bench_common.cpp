@@ -0,0 +1,76 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/allocators.hpp>
+
+uint32_t bench_failure_count = 0;
+
+float bench_random_float(float min, float max) {
+    return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+vector3_t bench_random_vector(float min, float max) {
+    return vector3_t(bench_random_float(min, max), bench_random_float(min, max), bench_random_float(min, max));
+}
+
+bool bench_same_voxels(const voxel_t *a, const voxel_t *b) {
+    for (uint32_t i = 0; i < CHUNK_VOXEL_COUNT; ++i) {
+        if (a[i].value != b[i].value || (a[i].value && a[i].color != b[i].color)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+uint32_t bench_hash_world(bool include_history) {
+    uint32_t hash = 0;
+    voxel_t *scratch = FL_MALLOC(voxel_t, CHUNK_VOXEL_COUNT);
+
+    for (uint32_t i = 0; i < g_game->chunks.data_count; ++i) {
+        chunk_t *chunk = g_game->chunks[i];
+
+        if (chunk) {
+            uint32_t chunk_hash = (uint32_t)chunk_coord_key(chunk->chunk_coord);
+            const voxel_t *voxels = get_chunk_voxels_linear(chunk, scratch);
+
+            for (uint32_t v = 0; v < CHUNK_VOXEL_COUNT; ++v) {
+                chunk_hash = chunk_hash * 31 + (voxels[v].value | (voxels[v].color << 8));
+            }
+
+            if (include_history && chunk->history) {
+                for (int32_t m = 0; m < chunk->history->modification_count; ++m) {
+                    int16_t index = chunk->history->modification_stack[m];
+                    chunk_hash = chunk_hash * 31 + voxel_index_to_linear(index) + (chunk->history->modification_pool[index] << 16);
+                }
+            }
+
+            hash += chunk_hash;
+        }
+    }
+
+    FL_FREE(scratch);
+
+    return hash;
+}
+
+void bench_timer_t::start() {
+    start_time = current_time();
+}
+
+void bench_timer_t::stop() {
+    total += time_difference(current_time(), start_time);
+}
+
+float bench_timer_t::ms() const {
+    return total * 1e3f;
+}
+
+float bench_timer_t::us_per(uint32_t count) const {
+    return total * 1e6f / (float)count;
+}
+
+float bench_timer_t::ns_per(uint32_t count) const {
+    return total * 1e9f / (float)count;
+}
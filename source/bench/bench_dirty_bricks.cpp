@@ -0,0 +1,150 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/allocators.hpp>
+
+static const uint32_t STROKE_COUNT = 2000;
+static const int32_t BRUSH_RADIUS = 4;
+
+// Chunks around the brush (their cells are the only ones which can read the modified voxels)
+struct stroke_chunks_t {
+    chunk_t *chunks[27];
+    voxel_t *aprons[27];
+};
+
+// Sphere brush like terraform() - writes through set_chunk_voxel_value
+static void s_apply_brush(const ivector3_t &vs_center, int32_t direction) {
+    for (int32_t z = -BRUSH_RADIUS; z <= BRUSH_RADIUS; ++z) {
+        for (int32_t y = -BRUSH_RADIUS; y <= BRUSH_RADIUS; ++y) {
+            for (int32_t x = -BRUSH_RADIUS; x <= BRUSH_RADIUS; ++x) {
+                int32_t distance2 = x * x + y * y + z * z;
+
+                if (distance2 <= BRUSH_RADIUS * BRUSH_RADIUS) {
+                    ivector3_t vs_position = vs_center + ivector3_t(x, y, z);
+                    chunk_t *chunk = g_game->access_chunk(space_voxel_to_chunk(vs_position));
+
+                    if (chunk) {
+                        ivector3_t local = space_voxel_to_local_chunk(vs_position);
+                        uint32_t index = get_voxel_index(local.x, local.y, local.z);
+
+                        int32_t value = (int32_t)get_chunk_voxel(chunk, index).value + direction * 8 * (BRUSH_RADIUS * BRUSH_RADIUS - distance2);
+                        set_chunk_voxel_value(chunk, index, (uint8_t)glm::clamp(value, 0, (int32_t)CHUNK_MAX_VOXEL_VALUE_I));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Every cell whose corners changed has to be in a dirty brick - returns the number of cells which were missed
+static uint32_t s_check_dirty_cells(stroke_chunks_t *stroke, voxel_t *apron, uint32_t *dirty_cell_count) {
+    uint32_t missed_count = 0;
+
+    for (uint32_t i = 0; i < 27; ++i) {
+        chunk_t *chunk = stroke->chunks[i];
+        if (!chunk) {
+            continue;
+        }
+
+        fill_chunk_apron(chunk, apron);
+
+        for (int32_t z = 0; z < CHUNK_EDGE_LENGTH; ++z) {
+            for (int32_t y = 0; y < CHUNK_EDGE_LENGTH; ++y) {
+                for (int32_t x = 0; x < CHUNK_EDGE_LENGTH; ++x) {
+                    uint32_t cell = get_apron_index(x, y, z);
+                    bool changed = 0;
+
+                    for (uint32_t c = 0; c < 8; ++c) {
+                        changed |= apron[cell + APRON_CELL_CORNER_OFFSETS[c]] != stroke->aprons[i][cell + APRON_CELL_CORNER_OFFSETS[c]];
+                    }
+
+                    uint32_t brick = (x >> 2) | ((y >> 2) << 2) | ((z >> 2) << 4);
+                    missed_count += changed && !(chunk->dirty_bricks & (1ull << brick));
+                }
+            }
+        }
+
+        *dirty_cell_count += (pop_count((uint32_t)chunk->dirty_bricks) + pop_count((uint32_t)(chunk->dirty_bricks >> 32))) * CHUNK_BRICK_EDGE_LENGTH * CHUNK_BRICK_EDGE_LENGTH * CHUNK_BRICK_EDGE_LENGTH;
+    }
+
+    return missed_count;
+}
+
+void bench_dirty_bricks() {
+    bench_load_map("ice.map");
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    // Brushes get centered in chunks which have a surface
+    uint32_t surface_chunk_count = 0;
+    chunk_t **surface_chunks = FL_MALLOC(chunk_t *, active_count);
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        voxel_t uniform_voxel;
+        if (active[i] && !is_chunk_uniform(active[i], &uniform_voxel)) {
+            surface_chunks[surface_chunk_count++] = active[i];
+        }
+    }
+
+    stroke_chunks_t stroke = {};
+    for (uint32_t i = 0; i < 27; ++i) {
+        stroke.aprons[i] = FL_MALLOC(voxel_t, CHUNK_APRON_VOXEL_COUNT);
+    }
+
+    voxel_t *apron = FL_MALLOC(voxel_t, CHUNK_APRON_VOXEL_COUNT);
+
+    uint32_t missed_count = 0, dirty_cell_count = 0, touched_chunk_count = 0;
+    bench_timer_t marking_timer = {};
+
+    srand(3);
+
+    for (uint32_t s = 0; s < STROKE_COUNT; ++s) {
+        chunk_t *center_chunk = surface_chunks[rand() % surface_chunk_count];
+        ivector3_t vs_center = center_chunk->xs_bottom_corner +
+            ivector3_t(rand() % CHUNK_EDGE_LENGTH, rand() % CHUNK_EDGE_LENGTH, rand() % CHUNK_EDGE_LENGTH);
+
+        // Brush reaches at most one chunk away
+        for (uint32_t i = 0; i < 27; ++i) {
+            ivector3_t offset = ivector3_t(i % 3, (i / 3) % 3, i / 9) - ivector3_t(1);
+            chunk_t *chunk = stroke.chunks[i] = g_game->access_chunk(center_chunk->chunk_coord + offset);
+
+            if (chunk) {
+                fill_chunk_apron(chunk, stroke.aprons[i]);
+                chunk->dirty_bricks = 0;
+            }
+        }
+
+        marking_timer.start();
+        s_apply_brush(vs_center, (s & 1) ? 1 : -1);
+        marking_timer.stop();
+
+        missed_count += s_check_dirty_cells(&stroke, apron, &dirty_cell_count);
+
+        for (uint32_t i = 0; i < 27; ++i) {
+            touched_chunk_count += stroke.chunks[i] && stroke.chunks[i]->flags.has_to_update_vertices;
+
+            if (stroke.chunks[i]) {
+                stroke.chunks[i]->flags.has_to_update_vertices = 0;
+            }
+        }
+    }
+
+    LOG_INFOV("%.1f cells re-meshed per stroke instead of %.1f (whole chunks), brush takes %.2f us\n",
+        (float)dirty_cell_count / (float)STROKE_COUNT,
+        (float)(touched_chunk_count * CHUNK_VOXEL_COUNT) / (float)STROKE_COUNT,
+        marking_timer.us_per(STROKE_COUNT));
+
+    if (missed_count) {
+        BENCH_FAILV("%d modified cells weren't in a dirty brick\n", missed_count);
+    }
+
+    FL_FREE(apron);
+    for (uint32_t i = 0; i < 27; ++i) {
+        FL_FREE(stroke.aprons[i]);
+    }
+    FL_FREE(surface_chunks);
+}
@@ -0,0 +1,86 @@
+#include "bench.hpp"
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/files.hpp>
+#include <common/allocators.hpp>
+#include <common/thread_pool.hpp>
+
+struct bench_entry_t {
+    const char *name;
+    void (* proc)();
+};
+
+static bench_entry_t benches[] = {
+    { "chunk_index", bench_chunk_index },
+    { "chunk_storage", bench_chunk_storage },
+    { "terrain_occupancy", bench_terrain_occupancy },
+    { "voxel_layout", bench_voxel_layout },
+    { "chunk_residency", bench_chunk_residency },
+    { "dirty_bricks", bench_dirty_bricks },
+    { "terraform_kernel", bench_terraform_kernel },
+    { "world_generation", bench_world_generation },
+    { "procedural_terrain", bench_procedural_terrain },
+    { "terraform_queue", bench_terraform_queue },
+    { "terrain_raycast", bench_terrain_raycast },
+    { "collision_mesh", bench_collision_mesh },
+    { "collision_bvh", bench_collision_bvh },
+    { "collision_kernel", bench_collision_kernel },
+    { "projectile_batch", bench_projectile_batch },
+    { "projectile_store", bench_projectile_store },
+    { "player_broadphase", bench_player_broadphase },
+    { "rewind_history", bench_rewind_history },
+    { "server_timestep", bench_server_timestep },
+};
+
+static const uint32_t BENCH_COUNT = sizeof(benches) / sizeof(benches[0]);
+
+static bool map_loaded = 0;
+
+void bench_load_map(const char *map_path) {
+    if (!map_loaded) {
+        g_game->init_memory();
+        g_game->configure_map(map_path);
+        g_game->start_session();
+
+        map_loaded = 1;
+    }
+}
+
+void bench_reload_map(const char *map_path) {
+    map_loaded = 0;
+    bench_load_map(map_path);
+}
+
+int32_t main(
+    int32_t argc,
+    char *argv[]) {
+    global_linear_allocator_init((uint32_t)megabytes(30));
+    files_init();
+    game_allocate();
+
+    bool ran_bench = 0;
+
+    for (uint32_t i = 0; i < BENCH_COUNT; ++i) {
+        // Without arguments, run everything
+        if (argc < 2 || !strcmp(argv[1], benches[i].name)) {
+            LOG_INFOV("Running %s benchmark\n", benches[i].name);
+            benches[i].proc();
+            ran_bench = 1;
+        }
+    }
+
+    if (!ran_bench) {
+        LOG_ERRORV("Unknown benchmark %s\n", argv[1]);
+        return 1;
+    }
+
+    end_thread_pool();
+
+    if (bench_failure_count) {
+        LOG_ERRORV("%d checks failed\n", bench_failure_count);
+        return 1;
+    }
+
+    return 0;
+}
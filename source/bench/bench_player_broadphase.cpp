@@ -0,0 +1,126 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <common/log.hpp>
+#include <common/player.hpp>
+#include <common/weapon.hpp>
+#include <common/constant.hpp>
+#include <common/allocators.hpp>
+#include <common/player_broadphase.hpp>
+
+static const uint32_t TICK_COUNT = 200;
+static const uint32_t ROCK_COUNT = PROJECTILE_MAX_ROCK_COUNT;
+
+// Whether the rock hits a player (same checks as check_projectile_players_collision)
+static bool s_hits_player(const player_t *players, const uint32_t *candidates, uint32_t candidate_count, const vector3_t &rock) {
+    for (uint32_t i = 0; i < candidate_count; ++i) {
+        if (collide_sphere_with_player(&players[candidates[i]], rock, rock_t::RADIUS)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void bench_player_broadphase() {
+    player_t *players = FL_MALLOC(player_t, PLAYER_MAX_COUNT);
+    player_bounds_t *bounds = FL_MALLOC(player_bounds_t, PLAYER_MAX_COUNT);
+    vector3_t *rocks = FL_MALLOC(vector3_t, ROCK_COUNT);
+    uint32_t *everyone = FL_MALLOC(uint32_t, PLAYER_MAX_COUNT);
+
+    player_broadphase_t broadphase;
+    broadphase.init(PLAYER_MAX_COUNT);
+
+    srand(16);
+
+    // Spread out over the map, then a big fight where everyone is around the same spot
+    static const char *LAYOUT_NAMES[] = { "spread out", "clustered" };
+    static const float LAYOUT_SIZES[] = { 200.0f, 6.0f };
+
+    for (uint32_t l = 0; l < 2; ++l) {
+        uint32_t mismatch_count = 0, hit_count = 0, missed_by_chunk_count = 0, candidate_total = 0;
+        bench_timer_t brute_timer = {}, broadphase_timer = {};
+
+        for (uint32_t t = 0; t < TICK_COUNT; ++t) {
+            vector3_t center = bench_random_vector(-100.0f, 100.0f);
+
+            for (uint32_t p = 0; p < PLAYER_MAX_COUNT; ++p) {
+                players[p] = player_t{};
+                players[p].local_id = p;
+                players[p].ws_position = center + bench_random_vector(-LAYOUT_SIZES[l], LAYOUT_SIZES[l]);
+                players[p].ws_up_vector = glm::normalize(bench_random_vector(-1.0f, 1.0f));
+                players[p].flags.interaction_mode = (rand() % 3) ? PIM_STANDING : PIM_BALL;
+                everyone[p] = p;
+            }
+
+            // Rocks flying around the players (a lot of them right next to one)
+            for (uint32_t r = 0; r < ROCK_COUNT; ++r) {
+                rocks[r] = (r % 2) ?
+                    players[rand() % PLAYER_MAX_COUNT].ws_position + bench_random_vector(-2.0f, 2.0f) :
+                    center + bench_random_vector(-LAYOUT_SIZES[l] - 4.0f, LAYOUT_SIZES[l] + 4.0f);
+            }
+
+            brute_timer.start();
+            uint32_t brute_hit_count = 0;
+            for (uint32_t r = 0; r < ROCK_COUNT; ++r) {
+                brute_hit_count += s_hits_player(players, everyone, PLAYER_MAX_COUNT, rocks[r]);
+            }
+            brute_timer.stop();
+
+            broadphase_timer.start();
+            for (uint32_t p = 0; p < PLAYER_MAX_COUNT; ++p) {
+                bounds[p] = make_player_bounds(&players[p]);
+            }
+
+            broadphase.build(bounds, PLAYER_MAX_COUNT);
+
+            uint32_t broadphase_hit_count = 0;
+            for (uint32_t r = 0; r < ROCK_COUNT; ++r) {
+                uint32_t candidates[PLAYER_MAX_COUNT];
+                uint32_t candidate_count = broadphase.query_sphere(rocks[r], rock_t::RADIUS, candidates);
+                broadphase_hit_count += s_hits_player(players, candidates, candidate_count, rocks[r]);
+                candidate_total += candidate_count;
+            }
+            broadphase_timer.stop();
+
+            // Same hits rock by rock, and the players that only looking at the chunk of the rock would miss
+            for (uint32_t r = 0; r < ROCK_COUNT; ++r) {
+                uint32_t candidates[PLAYER_MAX_COUNT];
+                uint32_t candidate_count = broadphase.query_sphere(rocks[r], rock_t::RADIUS, candidates);
+
+                for (uint32_t p = 0; p < PLAYER_MAX_COUNT; ++p) {
+                    if (collide_sphere_with_player(&players[p], rocks[r], rock_t::RADIUS)) {
+                        bool found = 0;
+                        for (uint32_t c = 0; c < candidate_count; ++c) {
+                            found |= candidates[c] == p;
+                        }
+
+                        mismatch_count += !found;
+                        ++hit_count;
+
+                        ivector3_t rock_chunk = space_voxel_to_chunk(space_world_to_voxel(rocks[r]));
+                        ivector3_t player_chunk = space_voxel_to_chunk(space_world_to_voxel(players[p].ws_position));
+                        missed_by_chunk_count += rock_chunk != player_chunk;
+                    }
+                }
+            }
+
+            mismatch_count += brute_hit_count != broadphase_hit_count;
+        }
+
+        if (mismatch_count) {
+            BENCH_FAILV("%s: %d player hits weren't found with the broadphase\n", LAYOUT_NAMES[l], mismatch_count);
+        }
+
+        LOG_INFOV("%s: %d players / %d rocks per tick: %.2f us checking every player, %.2f us with the broadphase (%.2f candidates per rock)\n",
+            LAYOUT_NAMES[l], PLAYER_MAX_COUNT, ROCK_COUNT, brute_timer.us_per(TICK_COUNT), broadphase_timer.us_per(TICK_COUNT),
+            (float)candidate_total / (float)(ROCK_COUNT * TICK_COUNT));
+        LOG_INFOV("%s: %d / %d player hits are in another chunk than the rock\n", LAYOUT_NAMES[l], missed_by_chunk_count, hit_count);
+    }
+
+    broadphase.destroy();
+
+    FL_FREE(everyone);
+    FL_FREE(rocks);
+    FL_FREE(bounds);
+    FL_FREE(players);
+}
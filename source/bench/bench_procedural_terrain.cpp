@@ -0,0 +1,279 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/player.hpp>
+#include <common/serialiser.hpp>
+#include <common/allocators.hpp>
+
+static const uint32_t TERRAIN_SEED = 1234;
+static const uint32_t TICK_COUNT = 600;
+static const uint32_t PLAYER_COUNT = 3;
+static const uint32_t WRITES_PER_TICK = 2;
+
+static uint32_t s_terrain_chunk_count(const terrain_generator_t *generator) {
+    ivector3_t size = generator->max_chunk - generator->min_chunk + ivector3_t(1);
+    return size.x * size.y * size.z;
+}
+
+static ivector3_t s_terrain_chunk_coord(const terrain_generator_t *generator, uint32_t i) {
+    ivector3_t size = generator->max_chunk - generator->min_chunk + ivector3_t(1);
+    return generator->min_chunk + ivector3_t(i % size.x, (i / size.x) % size.y, i / (size.x * size.y));
+}
+
+// Linear voxels of every chunk of the terrain (zeros if the chunk doesn't exist)
+static void s_copy_terrain(const terrain_generator_t *generator, voxel_t *dst, bool page_in) {
+    for (uint32_t i = 0; i < s_terrain_chunk_count(generator); ++i) {
+        ivector3_t coord = s_terrain_chunk_coord(generator, i);
+        voxel_t *chunk_dst = &dst[i * CHUNK_VOXEL_COUNT];
+
+        chunk_t *chunk = page_in ? g_game->access_chunk(coord) : g_game->access_resident_chunk(coord);
+
+        if (chunk) {
+            const voxel_t *voxels = get_chunk_voxels_linear(chunk, chunk_dst);
+            if (voxels != chunk_dst) {
+                memcpy(chunk_dst, voxels, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+            }
+        }
+        else {
+            memset(chunk_dst, 0, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+        }
+
+        // Keeps the number of resident chunks down
+        if (page_in && i % 32 == 31) {
+            g_game->timestep_end();
+            update_chunk_residency();
+            LN_CLEAR();
+        }
+    }
+}
+
+static uint32_t s_count_mismatches(const terrain_generator_t *generator, const voxel_t *a, const voxel_t *b) {
+    uint32_t mismatch_count = 0;
+
+    for (uint32_t i = 0; i < s_terrain_chunk_count(generator); ++i) {
+        mismatch_count += !bench_same_voxels(&a[i * CHUNK_VOXEL_COUNT], &b[i * CHUNK_VOXEL_COUNT]);
+    }
+
+    return mismatch_count;
+}
+
+static void s_begin_terrain(bool page_chunks) {
+    g_game->init_memory();
+    g_game->flags.page_chunks = page_chunks;
+    g_game->residency.radius = 1;
+    g_game->residency.max_resident_count = 200;
+    g_game->residency.max_flushes_per_tick = CHUNK_MAX_FLUSHES_PER_TICK;
+    g_game->configure_procedural_terrain(TERRAIN_SEED);
+    g_game->start_session();
+}
+
+static void s_end_terrain() {
+    g_game->clear_players();
+    unload_map(g_game->current_map_data);
+    g_game->current_map_data = NULL;
+}
+
+struct delta_chunk_t {
+    ivector3_t coord;
+    voxel_t voxels[CHUNK_VOXEL_COUNT];
+};
+
+// What the server sends to new clients (see s_send_game_state_to_new_client)
+static uint32_t s_gather_delta(delta_chunk_t *delta) {
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < g_game->chunks.data_count; ++i) {
+        chunk_t *chunk = g_game->chunks[i];
+
+        if (chunk && is_terrain_chunk_modified(chunk)) {
+            delta[count].coord = chunk->chunk_coord;
+            const voxel_t *voxels = get_chunk_voxels_linear(chunk, delta[count].voxels);
+            if (voxels != delta[count].voxels) {
+                memcpy(delta[count].voxels, voxels, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+            }
+
+            ++count;
+        }
+    }
+
+    open_hash_table_t<chunk_record_t> *records = &g_game->residency.records;
+    for (uint32_t i = 0; i < records->capacity; ++i) {
+        chunk_record_t *record = &records->items[i].value;
+
+        if (records->items[i].key != records->EMPTY_KEY && !g_game->access_resident_chunk(record->chunk_coord)) {
+            delta[count].coord = record->chunk_coord;
+            load_chunk_record(record, delta[count].voxels);
+
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+void bench_procedural_terrain() {
+    terrain_generator_t generator;
+    make_default_terrain_generator(TERRAIN_SEED, &generator);
+
+    uint32_t chunk_count = s_terrain_chunk_count(&generator);
+    voxel_t *reference = FL_MALLOC(voxel_t, chunk_count * CHUNK_VOXEL_COUNT);
+    voxel_t *world = FL_MALLOC(voxel_t, chunk_count * CHUNK_VOXEL_COUNT);
+
+    // Serial reference
+    bench_timer_t serial_timer = {};
+    serial_timer.start();
+    uint32_t filled_count = 0;
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        voxel_t *voxels = &reference[i * CHUNK_VOXEL_COUNT];
+
+        if (generate_terrain_chunk_voxels(&generator, s_terrain_chunk_coord(&generator, i), voxels)) {
+            ++filled_count;
+        }
+        else {
+            memset(voxels, 0, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+        }
+    }
+
+    serial_timer.stop();
+
+    LOG_INFOV("%d chunks in the terrain, %d aren't empty - serial generation: %.2f ms\n",
+        chunk_count, filled_count, serial_timer.ms());
+
+    // Cold cache: everything gets generated on the thread pool
+    char cache_path[64] = {};
+    sprintf(cache_path, "assets/maps/terrain_%08x_server.cache", hash_terrain_generator(&generator));
+    delete_file(cache_path);
+
+    static const char *CACHE_STATES[] = { "cold", "warm", "corrupted" };
+
+    for (uint32_t run = 0; run < 3; ++run) {
+        if (run == 2) {
+            // The size of the first entry (after the 8 byte file header and the chunk coordinate) gets bigger than a chunk
+            uint8_t bad_size[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+            file_handle_t cache_file = create_file(cache_path, FLF_BINARY | FLF_WRITEABLE | FLF_UPDATE);
+            write_file_range(cache_file, 8 + 3 * sizeof(int16_t), bad_size, sizeof(bad_size));
+            free_file(cache_file);
+        }
+
+        s_begin_terrain(0);
+
+        bench_timer_t load_timer = {};
+        load_timer.start();
+        load_all_terrain_chunks();
+        load_timer.stop();
+
+        procedural_terrain_t *terrain = &g_game->terrain;
+        LOG_INFOV("load_all_terrain_chunks (%s cache): %.2f ms, %d generated, %d from the cache (%.2f KB cache file)\n",
+            CACHE_STATES[run], load_timer.ms(), terrain->generated_count, terrain->cache_hit_count,
+            (float)terrain->cache_file_size / 1024.0f);
+
+        s_copy_terrain(&generator, world, 0);
+        uint32_t mismatch_count = s_count_mismatches(&generator, world, reference);
+
+        if (mismatch_count) {
+            BENCH_FAILV("%d chunks loaded with a %s cache differ from the serial generation\n", mismatch_count, CACHE_STATES[run]);
+        }
+
+        if (run == 2 && terrain->cache_hit_count) {
+            BENCH_FAILV("%d chunks were read from a corrupted cache file\n", terrain->cache_hit_count);
+        }
+
+        s_end_terrain();
+    }
+
+    // Server: chunks get generated on demand while players wander around and terraform
+    s_begin_terrain(1);
+
+    player_t *players[PLAYER_COUNT];
+    srand(5);
+    for (uint32_t p = 0; p < PLAYER_COUNT; ++p) {
+        players[p] = g_game->add_player();
+        players[p]->chunk_coord = s_terrain_chunk_coord(&generator, rand() % chunk_count);
+    }
+
+    for (uint32_t t = 0; t < TICK_COUNT; ++t) {
+        for (uint32_t p = 0; p < PLAYER_COUNT && t % 4 == 0; ++p) {
+            ivector3_t step = ivector3_t(rand() % 3 - 1, rand() % 3 - 1, rand() % 3 - 1);
+            players[p]->chunk_coord = glm::clamp(players[p]->chunk_coord + step, generator.min_chunk, generator.max_chunk);
+        }
+
+        // Players only dig around where they are
+        for (uint32_t w = 0; w < WRITES_PER_TICK; ++w) {
+            chunk_t *chunk = g_game->get_chunk(players[rand() % PLAYER_COUNT]->chunk_coord);
+            set_chunk_voxel_value(chunk, rand() % CHUNK_VOXEL_COUNT, (uint8_t)(rand() % CHUNK_MAX_VOXEL_VALUE_I));
+        }
+
+        // Once in a while, a whole chunk gets emptied (has to stay empty on the clients)
+        if (t % 100 == 0) {
+            chunk_t *chunk = g_game->get_chunk(players[rand() % PLAYER_COUNT]->chunk_coord);
+            memset(get_chunk_voxels_for_write(chunk), 0, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+            compress_chunk_storage(chunk);
+        }
+
+        update_chunk_residency();
+        g_game->timestep_end();
+        LN_CLEAR();
+    }
+
+    delta_chunk_t *delta = FL_MALLOC(delta_chunk_t, chunk_count);
+    uint32_t delta_count = s_gather_delta(delta);
+
+    // Size of what gets sent compared to sending every chunk
+    uint8_t *buffer = FL_MALLOC(uint8_t, CHUNK_BYTE_SIZE);
+    uint32_t delta_size = 0, full_size = 0;
+
+    for (uint32_t i = 0; i < delta_count; ++i) {
+        serialiser_t serialiser = {};
+        serialiser.data_buffer = buffer;
+        serialiser.data_buffer_size = CHUNK_BYTE_SIZE;
+        serialise_map_chunk_voxels(&serialiser, delta[i].voxels);
+        delta_size += serialiser.data_buffer_head;
+    }
+
+    s_copy_terrain(&generator, world, 1);
+
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        serialiser_t serialiser = {};
+        serialiser.data_buffer = buffer;
+        serialiser.data_buffer_size = CHUNK_BYTE_SIZE;
+        serialise_map_chunk_voxels(&serialiser, &world[i * CHUNK_VOXEL_COUNT]);
+        full_size += serialiser.data_buffer_head;
+    }
+
+    LOG_INFOV("server: %d generated, %d from the cache, %d paged out - new clients get %d chunks (%.2f KB) instead of %.2f KB\n",
+        g_game->terrain.generated_count, g_game->terrain.cache_hit_count, g_game->residency.evicted_count,
+        delta_count, (float)delta_size / 1024.0f, (float)full_size / 1024.0f);
+
+    s_end_terrain();
+
+    // Client: generates the terrain from the seed and applies the delta
+    s_begin_terrain(0);
+    load_all_terrain_chunks();
+
+    for (uint32_t i = 0; i < delta_count; ++i) {
+        chunk_t *chunk = g_game->get_chunk(delta[i].coord);
+        voxel_t *voxels = get_chunk_voxels_for_write(chunk);
+        memcpy(voxels, delta[i].voxels, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+        reorder_linear_chunk_voxels(voxels);
+        compress_chunk_storage(chunk);
+    }
+
+    s_copy_terrain(&generator, reference, 0);
+    uint32_t mismatch_count = s_count_mismatches(&generator, reference, world);
+
+    if (mismatch_count) {
+        BENCH_FAILV("%d chunks of the client differ from the server's\n", mismatch_count);
+    }
+
+    s_end_terrain();
+
+    bench_reload_map("ice.map");
+
+    FL_FREE(buffer);
+    FL_FREE(delta);
+    FL_FREE(world);
+    FL_FREE(reference);
+}
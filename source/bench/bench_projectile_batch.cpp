@@ -0,0 +1,138 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/weapon.hpp>
+#include <common/projectile.hpp>
+#include <common/constant.hpp>
+#include <common/allocators.hpp>
+
+static const uint32_t TICK_COUNT = 200;
+static const uint32_t RAY_COUNT = 4000;
+
+// Rocks of a full game: fights happen in a few places, so most rocks are in the chunks around a few players
+static void s_spawn_rocks(rock_store_t *rocks, const ivector3_t *chunks, uint32_t chunk_count) {
+    while (rocks->count) {
+        rocks->remove(rocks->count - 1);
+    }
+
+    vector3_t fights[8];
+    for (uint32_t f = 0; f < 8; ++f) {
+        fights[f] = space_chunk_to_world(chunks[rand() % chunk_count]) + vector3_t(bench_random_float(0.0f, CHUNK_EDGE_LENGTH));
+    }
+
+    for (uint32_t r = 0; r < PROJECTILE_MAX_ROCK_COUNT; ++r) {
+        vector3_t position = (r % 4) ?
+            fights[rand() % 8] + vector3_t(bench_random_float(-12.0f, 12.0f), bench_random_float(-4.0f, 8.0f), bench_random_float(-12.0f, 12.0f)) :
+            space_chunk_to_world(chunks[rand() % chunk_count]) + vector3_t(bench_random_float(0.0f, CHUNK_EDGE_LENGTH));
+        vector3_t direction = glm::normalize(vector3_t(bench_random_float(-1.0f, 1.0f), bench_random_float(-1.0f, 0.5f), bench_random_float(-1.0f, 1.0f)));
+
+        rocks->spawn(position, direction * PROJECTILE_ROCK_SPEED, vector3_t(0.0f, 1.0f, 0.0f), 0, 0, 0);
+    }
+
+    rocks->clear_recent();
+}
+
+void bench_projectile_batch() {
+    bench_load_map("ice.map");
+    g_game->dt = 1.0f / 60.0f;
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    uint32_t chunk_count = 0;
+    ivector3_t *chunks = FL_MALLOC(ivector3_t, active_count);
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        if (active[i]) {
+            chunks[chunk_count++] = active[i]->chunk_coord;
+        }
+    }
+
+    rock_store_t rocks;
+    rocks.init(PROJECTILE_MAX_ROCK_COUNT);
+    bool *single_hits = FL_MALLOC(bool, PROJECTILE_MAX_ROCK_COUNT);
+    bool *batch_hits = FL_MALLOC(bool, PROJECTILE_MAX_ROCK_COUNT);
+    srand(14);
+
+    uint32_t mismatch_count = 0, hit_count = 0;
+    bench_timer_t single_timer = {}, batch_timer = {};
+
+    // A tick with every rock slot used, rocks move between the ticks
+    for (uint32_t t = 0; t < TICK_COUNT; ++t) {
+        if (t % 20 == 0) {
+            s_spawn_rocks(&rocks, chunks, chunk_count);
+        }
+
+        single_timer.start();
+        for (uint32_t r = 0; r < rocks.count; ++r) {
+            rock_t rock = rocks.get(r);
+            single_hits[r] = check_projectile_terrain_collision(&rock);
+        }
+        single_timer.stop();
+
+        batch_timer.start();
+        check_projectiles_terrain_collision(&rocks, batch_hits);
+        batch_timer.stop();
+
+        for (uint32_t r = 0; r < rocks.count; ++r) {
+            mismatch_count += single_hits[r] != batch_hits[r];
+            hit_count += single_hits[r];
+        }
+
+        rocks.integrate(g_game->dt);
+
+        LN_CLEAR();
+    }
+
+    if (mismatch_count) {
+        BENCH_FAILV("%d / %d rocks didn't get the same terrain hit as with the check of a single rock\n", mismatch_count, TICK_COUNT * PROJECTILE_MAX_ROCK_COUNT);
+    }
+
+    LOG_INFOV("%d rocks per tick: %.2f us rock by rock, %.2f us batched (%d hits in %d ticks)\n",
+        PROJECTILE_MAX_ROCK_COUNT, single_timer.us_per(TICK_COUNT), batch_timer.us_per(TICK_COUNT), hit_count, TICK_COUNT);
+
+    // Longer rays (which go further than the chunks around the one they start in) have to get the same hits as well
+    terrain_ray_t *rays = FL_MALLOC(terrain_ray_t, RAY_COUNT);
+    bool *detected = FL_MALLOC(bool, RAY_COUNT);
+    terrain_raycast_hit_t *hits = FL_MALLOC(terrain_raycast_hit_t, RAY_COUNT);
+    uint32_t ray_mismatch_count = 0, ray_hit_count = 0;
+
+    for (uint32_t r = 0; r < RAY_COUNT; ++r) {
+        rays[r].ws_start = space_chunk_to_world(chunks[rand() % chunk_count]) + vector3_t(bench_random_float(0.0f, CHUNK_EDGE_LENGTH));
+        rays[r].ws_direction = vector3_t(bench_random_float(-1.0f, 1.0f), bench_random_float(-1.0f, 1.0f), bench_random_float(-1.0f, 1.0f)) * bench_random_float(0.0f, 40.0f);
+        rays[r].max_distance = bench_random_float(0.0f, 40.0f);
+        rays[r].radius = (r & 1) ? rock_t::RADIUS : 0.0f;
+    }
+
+    raycast_terrain_batch(rays, RAY_COUNT, detected, hits);
+
+    for (uint32_t r = 0; r < RAY_COUNT; ++r) {
+        terrain_raycast_hit_t hit;
+        bool single_detected = raycast_terrain_sphere(rays[r].ws_start, rays[r].ws_direction, rays[r].max_distance, rays[r].radius, &hit);
+
+        ray_hit_count += single_detected;
+
+        if (single_detected != detected[r] || (single_detected && memcmp(&hit, &hits[r], sizeof(terrain_raycast_hit_t)))) {
+            ++ray_mismatch_count;
+        }
+    }
+
+    if (ray_mismatch_count) {
+        BENCH_FAILV("%d / %d rays didn't get the same hit as with raycast_terrain_sphere\n", ray_mismatch_count, RAY_COUNT);
+    }
+
+    LOG_INFOV("%d rays of up to 40 checked against raycast_terrain_sphere (%d hits)\n", RAY_COUNT, ray_hit_count);
+
+    LN_CLEAR();
+
+    FL_FREE(hits);
+    FL_FREE(detected);
+    FL_FREE(rays);
+    FL_FREE(batch_hits);
+    FL_FREE(single_hits);
+    rocks.destroy();
+    FL_FREE(chunks);
+}
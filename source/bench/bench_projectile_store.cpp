@@ -0,0 +1,238 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/weapon.hpp>
+#include <common/constant.hpp>
+#include <common/allocators.hpp>
+#include <common/containers.hpp>
+#include <common/projectile.hpp>
+
+static const uint32_t TICK_COUNT = 600;
+static const uint32_t CHURN_COUNT = 200000;
+static const float DT = 1.0f / 60.0f;
+
+// Spawns / removes rocks at random and checks that every handle still points to its rock
+static uint32_t s_check_handles() {
+    rock_store_t rocks;
+    rocks.init(PROJECTILE_MAX_ROCK_COUNT);
+
+    // Rocks which are alive (the tag of a rock is in ref_idx_obj)
+    rock_handle_t *handles = FL_MALLOC(rock_handle_t, PROJECTILE_MAX_ROCK_COUNT);
+    uint32_t *tags = FL_MALLOC(uint32_t, PROJECTILE_MAX_ROCK_COUNT);
+    uint32_t alive_count = 0;
+
+    // Handles of rocks which got removed
+    rock_handle_t *removed = FL_MALLOC(rock_handle_t, CHURN_COUNT);
+    uint32_t removed_count = 0;
+
+    uint32_t error_count = 0, next_tag = 0;
+
+    for (uint32_t c = 0; c < CHURN_COUNT; ++c) {
+        // More spawns than removals at first, so that the store gets full at some point
+        bool spawn = alive_count == 0 || (rand() % 100) < (c < CHURN_COUNT / 4 ? 70 : 50);
+
+        if (spawn) {
+            rock_handle_t handle = rocks.spawn(bench_random_vector(-10.0f, 10.0f), bench_random_vector(-1.0f, 1.0f), vector3_t(0.0f, 1.0f, 0.0f), 0, next_tag, 0);
+
+            if (alive_count == PROJECTILE_MAX_ROCK_COUNT) {
+                error_count += handle != ROCK_INVALID_HANDLE;
+            }
+            else {
+                handles[alive_count] = handle;
+                tags[alive_count++] = next_tag++;
+            }
+        }
+        else {
+            uint32_t a = rand() % alive_count;
+            uint32_t idx = rocks.get_index(handles[a]);
+
+            rocks.remove(idx);
+            removed[removed_count++] = handles[a];
+
+            handles[a] = handles[alive_count - 1];
+            tags[a] = tags[--alive_count];
+        }
+
+        if (c % 1000 == 0) {
+            error_count += rocks.count != alive_count;
+
+            for (uint32_t a = 0; a < alive_count; ++a) {
+                uint32_t idx = rocks.get_index(handles[a]);
+                error_count += idx >= rocks.count || rocks.get(idx).flags.ref_idx_obj != tags[a];
+            }
+
+            for (uint32_t r = 0; r < removed_count; ++r) {
+                error_count += rocks.get_index(removed[r]) != ROCK_INVALID_INDEX;
+            }
+
+            // Every rock which is alive was spawned since the beginning
+            uint32_t recent_alive_count = 0;
+            for (uint32_t r = 0; r < rocks.recent_count; ++r) {
+                recent_alive_count += rocks.get_index(rocks.recent[r]) != ROCK_INVALID_INDEX;
+            }
+
+            error_count += recent_alive_count != alive_count;
+            removed_count = 0;
+        }
+    }
+
+    FL_FREE(removed);
+    FL_FREE(tags);
+    FL_FREE(handles);
+    rocks.destroy();
+
+    return error_count;
+}
+
+// Rocks which get removed before the snapshot still have to get sent, with the state they were removed in
+static uint32_t s_check_recent() {
+    rock_store_t rocks;
+    rocks.init(4);
+
+    uint32_t error_count = 0;
+    vector3_t up = vector3_t(0.0f, 1.0f, 0.0f);
+
+    rock_handle_t a = rocks.spawn(vector3_t(1.0f), vector3_t(2.0f), up, 1, 0, 0);
+    rocks.spawn(vector3_t(3.0f), vector3_t(4.0f), up, 2, 0, 0);
+    rocks.integrate(0.5f);
+
+    vector3_t a_position = rocks.get_position(rocks.get_index(a));
+    rocks.remove(rocks.get_index(a));
+
+    // The slot of the removed rock gets reused
+    rocks.spawn(vector3_t(5.0f), vector3_t(6.0f), up, 3, 0, 0);
+
+    error_count += rocks.recent_count != 3;
+    error_count += rocks.get_recent(0).position != a_position || rocks.get_recent(0).client_id != 1;
+    error_count += rocks.get_recent(1).position != vector3_t(3.0f) + vector3_t(4.0f) * 0.5f || rocks.get_recent(1).client_id != 2;
+    error_count += rocks.get_recent(2).position != vector3_t(5.0f) || rocks.get_recent(2).client_id != 3;
+
+    rocks.clear_recent();
+
+    // Rocks which were spawned before the snapshot don't come back when they get removed
+    rocks.remove(0);
+    rock_handle_t d = rocks.spawn(vector3_t(7.0f), vector3_t(8.0f), up, 4, 0, 0);
+    rocks.remove(rocks.get_index(d));
+
+    error_count += rocks.recent_count != 1 || rocks.get_recent(0).position != vector3_t(7.0f) || rocks.get_recent(0).client_id != 4;
+
+    rocks.destroy();
+
+    return error_count;
+}
+
+void bench_projectile_store() {
+    static const char *KERNEL_NAMES[RKT_INVALID] = { "scalar", "avx2" };
+
+    uint32_t handle_error_count = s_check_handles();
+    if (handle_error_count) {
+        BENCH_FAILV("%d errors with the rock handles\n", handle_error_count);
+    }
+
+    LOG_INFOV("%d spawns / removals checked against the handles\n", CHURN_COUNT);
+
+    uint32_t recent_error_count = s_check_recent();
+    if (recent_error_count) {
+        BENCH_FAILV("%d errors with the rocks spawned since the last snapshot\n", recent_error_count);
+    }
+
+    // The rocks of a big fight, in the old layout (slots of the rocks which hit something are left empty)
+    srand(15);
+    stack_container_t<rock_t> old_rocks;
+    old_rocks.init(PROJECTILE_MAX_ROCK_COUNT);
+    bool *old_active = FL_MALLOC(bool, PROJECTILE_MAX_ROCK_COUNT);
+
+    rock_store_t rocks;
+    rocks.init(PROJECTILE_MAX_ROCK_COUNT);
+
+    for (uint32_t r = 0; r < PROJECTILE_MAX_ROCK_COUNT; ++r) {
+        vector3_t position = bench_random_vector(-50.0f, 50.0f);
+        vector3_t direction = glm::normalize(bench_random_vector(-1.0f, 1.0f)) * PROJECTILE_ROCK_SPEED;
+        vector3_t up = glm::normalize(bench_random_vector(-1.0f, 1.0f));
+
+        uint32_t idx = old_rocks.add();
+        old_rocks[idx] = rock_t(position, direction, up, 0, 0, 0);
+        old_active[idx] = (rand() % 4) != 0;
+
+        if (old_active[idx]) {
+            rocks.spawn(position, direction, up, 0, 0, 0);
+        }
+    }
+
+    // Each kernel has to move the rocks exactly like tick_rock
+    rock_t *reference = FL_MALLOC(rock_t, rocks.count);
+    for (uint32_t r = 0; r < rocks.count; ++r) {
+        reference[r] = rocks.get(r);
+    }
+
+    for (uint32_t t = 0; t < TICK_COUNT; ++t) {
+        for (uint32_t r = 0; r < rocks.count; ++r) {
+            tick_rock(&reference[r], DT);
+        }
+    }
+
+    bench_timer_t old_timer = {};
+    for (uint32_t t = 0; t < TICK_COUNT; ++t) {
+        old_timer.start();
+        for (uint32_t r = 0; r < old_rocks.data_count; ++r) {
+            if (old_active[r]) {
+                tick_rock(&old_rocks[r], DT);
+            }
+        }
+        old_timer.stop();
+    }
+
+    LOG_INFOV("%d rocks (%d slots): %.2f us per tick with tick_rock on each slot\n",
+        rocks.count, old_rocks.data_count, old_timer.us_per(TICK_COUNT));
+
+    // Starting state of the rocks
+    rock_t *initial = FL_MALLOC(rock_t, rocks.count);
+    for (uint32_t r = 0; r < rocks.count; ++r) {
+        initial[r] = rocks.get(r);
+    }
+
+    for (uint32_t k = RKT_SCALAR; k < RKT_INVALID; ++k) {
+        if (!set_rock_integration_kernel((rock_kernel_type_t)k)) {
+            LOG_INFOV("%s kernel isn't supported\n", KERNEL_NAMES[k]);
+            continue;
+        }
+
+        for (uint32_t r = 0; r < rocks.count; ++r) {
+            for (uint32_t i = 0; i < 3; ++i) {
+                rocks.positions[i][r] = initial[r].position[i];
+                rocks.directions[i][r] = initial[r].direction[i];
+            }
+        }
+
+        bench_timer_t kernel_timer = {};
+        kernel_timer.start();
+        for (uint32_t t = 0; t < TICK_COUNT; ++t) {
+            rocks.integrate(DT);
+        }
+        kernel_timer.stop();
+
+        uint32_t mismatch_count = 0;
+        for (uint32_t r = 0; r < rocks.count; ++r) {
+            rock_t rock = rocks.get(r);
+            mismatch_count += memcmp(&rock.position, &reference[r].position, sizeof(vector3_t)) ||
+                memcmp(&rock.direction, &reference[r].direction, sizeof(vector3_t));
+        }
+
+        if (mismatch_count) {
+            BENCH_FAILV("%s kernel: %d / %d rocks didn't end where tick_rock moved them\n", KERNEL_NAMES[k], mismatch_count, rocks.count);
+        }
+
+        LOG_INFOV("%s kernel: %.2f us per tick\n", KERNEL_NAMES[k], kernel_timer.us_per(TICK_COUNT));
+    }
+
+    if (!set_rock_integration_kernel(RKT_AVX2)) {
+        set_rock_integration_kernel(RKT_SCALAR);
+    }
+
+    FL_FREE(initial);
+    FL_FREE(reference);
+    FL_FREE(old_active);
+    old_rocks.destroy();
+    rocks.destroy();
+}
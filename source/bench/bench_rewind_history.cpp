@@ -0,0 +1,159 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/constant.hpp>
+#include <common/containers.hpp>
+#include <common/rewind_history.hpp>
+
+static const uint32_t TICK_COUNT = 1000;
+static const uint32_t QUERY_COUNT = 100000;
+static const uint32_t PLAYER_COUNT = PLAYER_MAX_COUNT;
+
+// Players run around in circles (exact position at any time)
+static vector3_t s_player_position(uint32_t p, double time) {
+    float radius = 5.0f + (float)(p % 7) * 3.0f;
+    // Running speed
+    float angular_speed = PLAYER_WALKING_SPEED / radius;
+    float angle = (float)(time * angular_speed) + (float)p;
+
+    return vector3_t((float)p * 10.0f + radius * cosf(angle), 0.0f, radius * sinf(angle));
+}
+
+void bench_rewind_history() {
+    bench_load_map("ice.map");
+
+    for (uint32_t p = 0; p < PLAYER_COUNT; ++p) {
+        player_t *player = g_game->add_player();
+        player->client_id = (uint16_t)p;
+        player->ws_up_vector = vector3_t(0.0f, 1.0f, 0.0f);
+        player->flags.interaction_mode = PIM_STANDING;
+    }
+
+    rewind_history_t history;
+    history.init();
+
+    // Previous version: a position per snapshot (20 Hz), one ring per player
+    struct snapshot_ring_t {
+        circular_buffer_array_t<vector3_t, 40> positions;
+    };
+
+    snapshot_ring_t *rings = FL_MALLOC(snapshot_ring_t, PLAYER_COUNT);
+    for (uint32_t p = 0; p < PLAYER_COUNT; ++p) {
+        rings[p].positions.init();
+    }
+
+    srand(17);
+
+    // Ticks of the server don't all last as long
+    double *tick_times = FL_MALLOC(double, TICK_COUNT);
+    double time = 0.0;
+    float snapshot_elapsed = 0.0f;
+
+    for (uint32_t t = 0; t < TICK_COUNT; ++t) {
+        float dt = bench_random_float(1.0f / 120.0f, 1.0f / 40.0f);
+        time += (double)dt;
+        tick_times[t] = time;
+
+        for (uint32_t p = 0; p < PLAYER_COUNT; ++p) {
+            g_game->get_player(p)->ws_position = s_player_position(p, time);
+        }
+
+        history.record((uint64_t)t, dt);
+
+        snapshot_elapsed += dt;
+        if (snapshot_elapsed >= NET_SERVER_SNAPSHOT_OUTPUT_INTERVAL) {
+            snapshot_elapsed = 0.0f;
+
+            for (uint32_t p = 0; p < PLAYER_COUNT; ++p) {
+                rings[p].positions.push_item(&g_game->get_player(p)->ws_position);
+            }
+        }
+    }
+
+    // Every tick which is still in the history gives back exactly what was recorded
+    uint32_t first_tick = TICK_COUNT - NET_SERVER_REWIND_FRAME_COUNT;
+    uint32_t mismatch_count = 0;
+
+    for (uint32_t t = first_tick; t < TICK_COUNT; ++t) {
+        rewind_view_t view;
+        history.rewind_world((double)t, &view);
+
+        for (uint32_t p = 0; p < PLAYER_COUNT; ++p) {
+            rewound_player_t rewound;
+            vector3_t expected = s_player_position(p, tick_times[t]);
+
+            if (!history.get_player(&view, p, (uint16_t)p, &rewound) || memcmp(&rewound.ws_position, &expected, sizeof(vector3_t))) {
+                ++mismatch_count;
+            }
+        }
+
+        // Seconds back to that tick
+        double tick = history.get_tick_before((float)(time - tick_times[t]));
+        mismatch_count += fabs(tick - (double)t) > 0.01;
+    }
+
+    if (mismatch_count) {
+        BENCH_FAILV("%d rewinds didn't give back the recorded state\n", mismatch_count);
+    }
+
+    // Lag compensation for random pings: how far the rewound position is from where the player really was
+    float rewind_error = 0.0f, snapshot_error = 0.0f, max_rewind_error = 0.0f, max_snapshot_error = 0.0f;
+    bench_timer_t rewind_timer = {};
+    uint32_t query_count = 0;
+
+    for (uint32_t q = 0; q < QUERY_COUNT; ++q) {
+        uint32_t p = rand() % PLAYER_COUNT;
+        float latency = bench_random_float(0.0f, 0.8f);
+        vector3_t real_position = s_player_position(p, time - (double)latency);
+
+        rewind_timer.start();
+        rewind_view_t view;
+        rewound_player_t rewound;
+        history.rewind_world(history.get_tick_before(latency), &view);
+        history.get_player(&view, p, (uint16_t)p, &rewound);
+        rewind_timer.stop();
+
+        // Same guess as the previous version of the server
+        auto *positions = &rings[p].positions;
+        float snapshot_from_head = latency / NET_SERVER_SNAPSHOT_OUTPUT_INTERVAL;
+        float snapshot_from_head_trunc = floor(snapshot_from_head);
+        float progression = snapshot_from_head - snapshot_from_head_trunc;
+        uint32_t s1_idx = positions->decrement_index(positions->head, (uint32_t)snapshot_from_head_trunc);
+        uint32_t s0_idx = positions->decrement_index(s1_idx);
+        vector3_t snapshot_position = positions->buffer[s0_idx] + (positions->buffer[s1_idx] - positions->buffer[s0_idx]) * progression;
+
+        float error = glm::length(rewound.ws_position - real_position);
+        rewind_error += error;
+        max_rewind_error = glm::max(max_rewind_error, error);
+
+        error = glm::length(snapshot_position - real_position);
+        snapshot_error += error;
+        max_snapshot_error = glm::max(max_snapshot_error, error);
+
+        ++query_count;
+    }
+
+    LOG_INFOV("%d rewinds of up to 0.8s: %.1f ns per rewind, %.3f off on average (%.3f at most), snapshot ring: %.3f off on average (%.3f at most)\n",
+        query_count, rewind_timer.ns_per(query_count),
+        rewind_error / (float)query_count, max_rewind_error,
+        snapshot_error / (float)query_count, max_snapshot_error);
+
+    // A player who leaves and another client who gets the same local id
+    g_game->get_player(0)->client_id = 1000;
+    history.record(TICK_COUNT, 1.0f / 60.0f);
+
+    rewind_view_t view;
+    rewound_player_t rewound;
+    history.rewind_world((double)(TICK_COUNT - 1), &view);
+    if (history.get_player(&view, 0, 1000, &rewound)) {
+        BENCH_FAIL("Player got rewound to a tick before it joined\n");
+    }
+
+    history.destroy();
+    FL_FREE(tick_times);
+    FL_FREE(rings);
+
+    g_game->clear_players();
+}
@@ -0,0 +1,183 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/time.hpp>
+#include <common/game.hpp>
+#include <common/event.hpp>
+#include <common/player.hpp>
+#include <common/constant.hpp>
+#include <common/allocators.hpp>
+
+static const uint32_t FRAME_COUNT = 100000;
+static const uint32_t ACTION_COUNT = 1200;
+
+// Same stream of actions as a client would send (no triggers: rocks and terraforming change the world)
+static void s_make_actions(player_action_t *actions, float action_dt) {
+    srand(25);
+
+    memset(actions, 0, sizeof(player_action_t) * ACTION_COUNT);
+    for (uint32_t i = 0; i < ACTION_COUNT; ++i) {
+        actions[i].move_forward = (rand() % 4) != 0;
+        actions[i].move_left = (rand() % 6) == 0;
+        actions[i].move_right = (rand() % 6) == 0;
+        actions[i].jump = (rand() % 30) == 0;
+        actions[i].switch_shapes = (rand() % 90) == 0;
+        actions[i].next_weapon = 0b111;
+        actions[i].dmouse_x = bench_random_float(-0.5f, 0.5f);
+        actions[i].dmouse_y = bench_random_float(-0.1f, 0.1f);
+        actions[i].dt = action_dt;
+        actions[i].tick = i;
+    }
+}
+
+static void s_remove_from_chunk(player_t *player) {
+    if (player->idx_in_chunk_list != -1) {
+        chunk_t *c = g_game->access_chunk(player->chunk_coord);
+        c->players_in_chunk.remove(player->idx_in_chunk_list);
+        player->idx_in_chunk_list = -1;
+    }
+}
+
+// Executes the actions like the server does, while the game is ticking with server_dt
+static void s_run_actions(player_t *player, const player_t *start, const player_action_t *actions, float server_dt) {
+    s_remove_from_chunk(player);
+    memcpy(player, start, sizeof(player_t));
+
+    for (uint32_t i = 0; i < ACTION_COUNT; ++i) {
+        g_game->timestep_begin(server_dt);
+
+        player_action_t action = actions[i];
+        execute_action(player, &action);
+
+        g_game->timestep_end();
+        LN_CLEAR();
+    }
+}
+
+static bool s_same_state(const player_t *a, const player_t *b) {
+    return !memcmp(&a->ws_position, &b->ws_position, sizeof(vector3_t)) &&
+        !memcmp(&a->ws_view_direction, &b->ws_view_direction, sizeof(vector3_t)) &&
+        !memcmp(&a->ws_up_vector, &b->ws_up_vector, sizeof(vector3_t)) &&
+        !memcmp(&a->ws_velocity, &b->ws_velocity, sizeof(vector3_t)) &&
+        !memcmp(&a->shape_switching_time, &b->shape_switching_time, sizeof(float)) &&
+        a->switching_shapes == b->switching_shapes &&
+        a->flags.u32 == b->flags.u32;
+}
+
+void bench_server_timestep() {
+    // Scheduler: real frames of the server loop last anything between a fraction of a tick and a few ticks
+    tick_scheduler_t scheduler;
+    scheduler.init(NET_SERVER_TICK_RATE, NET_SERVER_MAX_CATCH_UP_TICKS);
+
+    srand(25);
+
+    double real_time = 0.0;
+    uint64_t tick_count = 0;
+    uint32_t max_ticks_per_frame = 0;
+
+    for (uint32_t f = 0; f < FRAME_COUNT; ++f) {
+        float frame_time = bench_random_float(0.1f, 2.5f) * scheduler.tick_dt;
+        real_time += (double)frame_time;
+
+        uint32_t ticks = scheduler.advance(frame_time);
+        tick_count += ticks;
+        max_ticks_per_frame = MAX(max_ticks_per_frame, ticks);
+    }
+
+    // Simulated time has to stay within a tick of real time
+    double simulated_time = (double)tick_count * (double)scheduler.tick_dt;
+    double drift = real_time - simulated_time;
+    if (scheduler.dropped_tick_count || drift < 0.0 || drift > (double)scheduler.tick_dt * 1.01) {
+        BENCH_FAILV("Scheduler drifted: %f s of real time, %f s simulated (%d ticks dropped)\n",
+            real_time, simulated_time, (int32_t)scheduler.dropped_tick_count);
+    }
+
+    LOG_INFOV("%d frames, %.2f s: %d ticks of %.4f s (%d at most per frame), %.6f s behind real time\n",
+        FRAME_COUNT, (float)real_time, (int32_t)tick_count, scheduler.tick_dt, max_ticks_per_frame, (float)drift);
+
+    // A one second hitch: only catches up with a few ticks, the rest get dropped
+    uint32_t ticks_after_hitch = scheduler.advance(1.0f);
+    uint32_t ticks_after = scheduler.advance(0.0f);
+    if (ticks_after_hitch != NET_SERVER_MAX_CATCH_UP_TICKS || ticks_after != 0 || !scheduler.dropped_tick_count) {
+        BENCH_FAILV("Hitch: ran %d ticks then %d (dropped %d)\n", ticks_after_hitch, ticks_after, (int32_t)scheduler.dropped_tick_count);
+    }
+
+    LOG_INFOV("1 s hitch: ran %d ticks, dropped %d\n", ticks_after_hitch, (int32_t)scheduler.dropped_tick_count);
+
+    // Clock going backwards: nothing runs, and the time that was left doesn't change
+    float accumulator_before = scheduler.accumulator;
+    uint32_t ticks_backwards = scheduler.advance(-0.5f);
+    if (ticks_backwards != 0 || scheduler.accumulator != accumulator_before) {
+        BENCH_FAILV("Clock going backwards: ran %u ticks, %f s left instead of %f s\n", ticks_backwards, scheduler.accumulator, accumulator_before);
+    }
+
+    // Determinism: the state of a player only depends on its actions, not on how long the ticks of the server lasted
+    bench_load_map("ice.map");
+
+    // Drops a standing player on top of the first chunk which has some terrain
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+    vector3_t ws_start = vector3_t(0.0f, 100.0f, 0.0f);
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        if (active[i] && (active[i]->solid_bricks & active[i]->air_bricks)) {
+            ws_start = space_chunk_to_world(active[i]->chunk_coord) + vector3_t(CHUNK_EDGE_LENGTH / 2, CHUNK_EDGE_LENGTH + 2, CHUNK_EDGE_LENGTH / 2);
+            break;
+        }
+    }
+
+    player_init_info_t info = {};
+    info.ws_position = ws_start;
+    info.ws_view_direction = vector3_t(0.0f, 0.0f, 1.0f);
+    info.ws_up_vector = vector3_t(0.0f, 1.0f, 0.0f);
+    info.default_speed = PLAYER_WALKING_SPEED;
+
+    player_t *player = g_game->add_player();
+    fill_player_info(player, &info);
+    player->flags.alive_state = PAS_ALIVE;
+    player->flags.interaction_mode = PIM_STANDING;
+
+    player_t *start = FL_MALLOC(player_t, 1);
+    player_t *reference = FL_MALLOC(player_t, 1);
+    player_action_t *actions = FL_MALLOC(player_action_t, ACTION_COUNT);
+    memcpy(start, player, sizeof(player_t));
+
+    s_make_actions(actions, 1.0f / NET_SERVER_TICK_RATE);
+
+    bench_timer_t run_timer = {};
+    run_timer.start();
+    s_run_actions(player, start, actions, 1.0f / NET_SERVER_TICK_RATE);
+    run_timer.stop();
+    memcpy(reference, player, sizeof(player_t));
+
+    // Server ticking at other rates than the client
+    static const float SERVER_RATES[] = { 20.0f, 100.0f, 144.0f };
+    uint32_t mismatch_count = 0;
+
+    for (uint32_t r = 0; r < sizeof(SERVER_RATES) / sizeof(SERVER_RATES[0]); ++r) {
+        s_run_actions(player, start, actions, 1.0f / SERVER_RATES[r]);
+
+        if (!s_same_state(player, reference)) {
+            BENCH_FAILV("Server ticking at %.0f Hz: player ended up at %f %f %f instead of %f %f %f\n",
+                SERVER_RATES[r],
+                player->ws_position.x, player->ws_position.y, player->ws_position.z,
+                reference->ws_position.x, reference->ws_position.y, reference->ws_position.z);
+
+            ++mismatch_count;
+        }
+    }
+
+    LOG_INFOV("%d actions (%.2f us each): same state for %d / %d server tick rates, player at %.2f %.2f %.2f (mode %d)\n",
+        ACTION_COUNT, run_timer.us_per(ACTION_COUNT),
+        (int32_t)(sizeof(SERVER_RATES) / sizeof(SERVER_RATES[0])) - mismatch_count, (int32_t)(sizeof(SERVER_RATES) / sizeof(SERVER_RATES[0])),
+        reference->ws_position.x, reference->ws_position.y, reference->ws_position.z, reference->flags.interaction_mode);
+
+    s_remove_from_chunk(player);
+
+    FL_FREE(actions);
+    FL_FREE(reference);
+    FL_FREE(start);
+
+    g_game->clear_players();
+}
@@ -0,0 +1,176 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/allocators.hpp>
+#include <common/terraform_kernel.hpp>
+
+static const uint32_t STROKE_COUNT = 4000;
+// Like the server: the queued brushes get applied and the modification tracker gets reset every tick
+static const uint32_t STROKES_PER_TICK = 4;
+
+struct stroke_t {
+    terraform_type_t type;
+    terraform_package_t package;
+    float radius;
+    float speed;
+    float dt;
+};
+
+// Per voxel terraforming with history, like terraform() before it got clipped per chunk (results have to be the same)
+static void s_reference_terraform(const stroke_t *stroke) {
+    ivector3_t voxel = space_world_to_voxel(stroke->package.ws_position);
+    float coeff = (stroke->type == TT_DESTROY) ? -1.0f : +1.0f;
+    float radius_squared = stroke->radius * stroke->radius;
+    ivector3_t bottom_corner = voxel - ivector3_t((int32_t)stroke->radius);
+    int32_t diameter = (int32_t)stroke->radius * 2 + 1;
+
+    chunk_t *chunk = g_game->get_chunk(space_voxel_to_chunk(voxel));
+    if (!chunk->flags.made_modification) {
+        g_game->modified_chunks[g_game->modified_chunk_count++] = chunk;
+        chunk->flags.made_modification = 1;
+    }
+
+    for (int32_t z = bottom_corner.z; z < bottom_corner.z + diameter; ++z) {
+        for (int32_t y = bottom_corner.y; y < bottom_corner.y + diameter; ++y) {
+            for (int32_t x = bottom_corner.x; x < bottom_corner.x + diameter; ++x) {
+                vector3_t diff = vector3_t((float)x, (float)y, (float)z) - (vector3_t)voxel;
+                float distance_squared = glm::dot(diff, diff);
+
+                if (distance_squared <= radius_squared) {
+                    ivector3_t vs_position = ivector3_t(x, y, z);
+                    chunk = g_game->get_chunk(space_voxel_to_chunk(vs_position));
+
+                    if (!chunk->flags.made_modification) {
+                        g_game->modified_chunks[g_game->modified_chunk_count++] = chunk;
+                        chunk->flags.made_modification = 1;
+                    }
+
+                    if (chunk->history == NULL) {
+                        activate_chunk_history(chunk);
+                    }
+
+                    ivector3_t local = space_voxel_to_local_chunk(vs_position);
+                    uint32_t voxel_index = get_voxel_index(local.x, local.y, local.z);
+                    voxel_t current = get_chunk_voxel(chunk, voxel_index);
+
+                    float proportion = 1.0f - (distance_squared / radius_squared);
+                    int32_t new_value = (int32_t)(proportion * coeff * stroke->dt * stroke->speed) + (int32_t)current.value;
+                    uint8_t voxel_value = (uint8_t)glm::clamp(new_value, 0, (int32_t)CHUNK_MAX_VOXEL_VALUE_I);
+
+                    uint8_t *vh = &chunk->history->modification_pool[voxel_index];
+                    if (*vh == CHUNK_SPECIAL_VALUE && voxel_value != current.value) {
+                        *vh = current.value;
+                        chunk->history->modification_stack[chunk->history->modification_count++] = voxel_index;
+                    }
+
+                    current.value = voxel_value;
+                    current.color = stroke->package.color;
+                    set_chunk_voxel(chunk, voxel_index, current);
+                }
+            }
+        }
+    }
+}
+
+// Returns the hash of the world after every tick, combined
+static uint32_t s_run_strokes(const stroke_t *strokes, bool reference, bench_timer_t *timer) {
+    bench_reload_map("ice.map");
+
+    uint32_t hash = 0;
+    *timer = {};
+
+    for (uint32_t s = 0; s < STROKE_COUNT; ++s) {
+        bool end_of_tick = s % STROKES_PER_TICK == STROKES_PER_TICK - 1;
+        timer->start();
+
+        if (reference) {
+            s_reference_terraform(&strokes[s]);
+        }
+        else {
+            terraform(strokes[s].type, strokes[s].package, strokes[s].radius, strokes[s].speed, strokes[s].dt);
+
+            if (end_of_tick) {
+                apply_terraform_commands();
+            }
+        }
+
+        timer->stop();
+
+        if (end_of_tick) {
+            hash = hash * 31 + bench_hash_world(1);
+            g_game->reset_modification_tracker();
+            LN_CLEAR();
+        }
+    }
+
+    return hash;
+}
+
+void bench_terraform_kernel() {
+    bench_load_map("ice.map");
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    // Strokes are centered on chunks which have a surface
+    uint32_t surface_chunk_count = 0;
+    ivector3_t *surface_chunks = FL_MALLOC(ivector3_t, active_count);
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        voxel_t uniform_voxel;
+        if (active[i] && !is_chunk_uniform(active[i], &uniform_voxel)) {
+            surface_chunks[surface_chunk_count++] = active[i]->chunk_coord;
+        }
+    }
+
+    stroke_t *strokes = FL_MALLOC(stroke_t, STROKE_COUNT);
+    srand(4);
+
+    for (uint32_t s = 0; s < STROKE_COUNT; ++s) {
+        ivector3_t chunk_coord = surface_chunks[rand() % surface_chunk_count];
+        ivector3_t vs_position = chunk_coord * CHUNK_EDGE_LENGTH +
+            ivector3_t(rand() % CHUNK_EDGE_LENGTH, rand() % CHUNK_EDGE_LENGTH, rand() % CHUNK_EDGE_LENGTH);
+
+        strokes[s].type = (rand() & 1) ? TT_DESTROY : TT_BUILD;
+        strokes[s].package.ray_hit_terrain = 1;
+        strokes[s].package.ws_position = vector3_t(vs_position);
+        strokes[s].package.color = (voxel_color_t)(rand() & 0xFF);
+        // Fractional radii / speeds too, so that rounding differences would show up
+        strokes[s].radius = 2.0f + (float)(rand() % 9) * 0.5f;
+        strokes[s].speed = 50.0f + (float)(rand() % 4000) * 0.37f;
+        strokes[s].dt = 1.0f / 60.0f;
+    }
+
+    bench_timer_t reference_timer;
+    uint32_t reference_hash = s_run_strokes(strokes, 1, &reference_timer);
+    LOG_INFOV("reference (per voxel): %.2f us per stroke\n", reference_timer.us_per(STROKE_COUNT));
+
+    static const char *KERNEL_NAMES[TKT_INVALID] = { "scalar", "sse2", "avx2" };
+
+    for (uint32_t k = 0; k < TKT_INVALID; ++k) {
+        if (!set_terraform_row_kernel((terraform_kernel_type_t)k)) {
+            LOG_INFOV("%s kernel isn't supported\n", KERNEL_NAMES[k]);
+            continue;
+        }
+
+        bench_timer_t timer;
+        uint32_t hash = s_run_strokes(strokes, 0, &timer);
+        LOG_INFOV("%s kernel: %.2f us per stroke\n", KERNEL_NAMES[k], timer.us_per(STROKE_COUNT));
+
+        if (hash != reference_hash) {
+            BENCH_FAILV("%s kernel doesn't give the same terrain as the reference (%u vs %u)\n", KERNEL_NAMES[k], hash, reference_hash);
+        }
+    }
+
+    if (!set_terraform_row_kernel(TKT_AVX2) && !set_terraform_row_kernel(TKT_SSE2)) {
+        set_terraform_row_kernel(TKT_SCALAR);
+    }
+
+    bench_reload_map("ice.map");
+
+    FL_FREE(strokes);
+    FL_FREE(surface_chunks);
+}
@@ -0,0 +1,274 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/net.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/allocators.hpp>
+
+static const uint32_t TICK_COUNT = 500;
+static const uint32_t PLAYER_COUNT = 8;
+// Clients send several actions per server tick
+static const uint32_t STROKES_PER_PLAYER = 3;
+// Enough for the queue to get full during the tick
+static const uint32_t OVERFLOW_STROKES_PER_PLAYER = TERRAFORM_MAX_QUEUED_COMMANDS / PLAYER_COUNT + 8;
+static const uint32_t PENDING_RAY_COUNT = 2000;
+
+// Players dig / build around their own spot - the brushes get applied right away, or once per tick like the game does
+// (both have to give the same terrain)
+static uint32_t s_run_players(const ivector3_t *spots, uint32_t strokes_per_player, bool once_per_tick, bench_timer_t *timer) {
+    bench_reload_map("ice.map");
+
+    uint32_t hash = 0;
+    *timer = {};
+    srand(8);
+
+    for (uint32_t t = 0; t < TICK_COUNT; ++t) {
+        timer->start();
+
+        for (uint32_t p = 0; p < PLAYER_COUNT; ++p) {
+            for (uint32_t s = 0; s < strokes_per_player; ++s) {
+                terraform_package_t package = {};
+                package.ray_hit_terrain = 1;
+                package.ws_position = vector3_t(spots[p] + ivector3_t(rand() % 5 - 2, rand() % 5 - 2, rand() % 5 - 2));
+                package.color = (voxel_color_t)(p * 29);
+
+                terraform((rand() & 1) ? TT_DESTROY : TT_BUILD, package, 3.0f, 80.0f + (float)(rand() % 100), 1.0f / 60.0f);
+
+                if (!once_per_tick) {
+                    apply_terraform_commands();
+                }
+            }
+        }
+
+        apply_terraform_commands();
+
+        timer->stop();
+
+        hash = hash * 31 + bench_hash_world(0);
+        g_game->reset_modification_tracker();
+        LN_CLEAR();
+    }
+
+    return hash;
+}
+
+// The actions of a player cast rays through the terrain of the start of the tick with the player's queued brushes: the rays have to hit
+// where they hit once the brushes are applied
+static uint32_t s_check_pending_raycasts(const ivector3_t *spots) {
+    bench_reload_map("ice.map");
+
+    uint32_t mismatch_count = 0;
+    srand(11);
+
+    for (uint32_t r = 0; r < PENDING_RAY_COUNT; ++r) {
+        uint32_t p = rand() % PLAYER_COUNT;
+
+        begin_player_terraform_commands();
+
+        for (uint32_t s = 0; s < STROKES_PER_PLAYER; ++s) {
+            terraform_package_t package = {};
+            package.ray_hit_terrain = 1;
+            package.ws_position = vector3_t(spots[p] + ivector3_t(rand() % 5 - 2, rand() % 5 - 2, rand() % 5 - 2));
+            package.color = (voxel_color_t)(p * 29);
+
+            terraform((rand() & 1) ? TT_DESTROY : TT_BUILD, package, 3.0f, 80.0f + (float)(rand() % 100), 1.0f / 60.0f);
+        }
+
+        // Aims at the spot from a few voxels away
+        vector3_t start = vector3_t(spots[p]) + bench_random_vector(-6.0f, 6.0f);
+        vector3_t direction = glm::normalize(vector3_t(spots[p]) + bench_random_vector(-2.0f, 2.0f) - start);
+
+        terraform_package_t pending = cast_terrain_ray(start, direction, 12.0f, 0);
+        apply_terraform_commands();
+        terraform_package_t applied = cast_terrain_ray(start, direction, 12.0f, 0);
+
+        if (pending.ray_hit_terrain != applied.ray_hit_terrain ||
+            (pending.ray_hit_terrain && pending.ws_contact_point != applied.ws_contact_point)) {
+            ++mismatch_count;
+        }
+
+        g_game->reset_modification_tracker();
+        LN_CLEAR();
+    }
+
+    return mismatch_count;
+}
+
+static const uint32_t MERGE_ROUND_COUNT = 300;
+static const uint32_t MERGE_PACKET_COUNT = 12;
+static const uint32_t MERGE_CHUNK_COUNT = 8;
+// Voxels which can get modified in a chunk (below MAX_PREDICTED_VOXEL_MODIFICATIONS_PER_CHUNK, nothing gets dropped)
+static const uint32_t MERGE_VOXEL_RANGE = 200;
+
+struct reference_voxel_t {
+    bool modified;
+    uint8_t initial_value;
+    uint8_t final_value;
+    voxel_color_t color;
+};
+
+// Random packets like the ones clients send (voxels are unique in a chunk, in history order) merged over a snapshot interval
+static uint32_t s_check_merge(bench_timer_t *timer) {
+    chunk_modifications_t *dst = FL_MALLOC(chunk_modifications_t, MAX_PREDICTED_CHUNK_MODIFICATIONS);
+    chunk_modifications_t *src = FL_MALLOC(chunk_modifications_t, MERGE_CHUNK_COUNT);
+    reference_voxel_t *reference = FL_MALLOC(reference_voxel_t, MERGE_CHUNK_COUNT * MERGE_VOXEL_RANGE);
+    uint16_t voxel_indices[MERGE_VOXEL_RANGE];
+
+    uint32_t mismatch_count = 0;
+    *timer = {};
+    srand(9);
+
+    for (uint32_t r = 0; r < MERGE_ROUND_COUNT; ++r) {
+        uint32_t dst_count = 0;
+        memset(reference, 0, sizeof(reference_voxel_t) * MERGE_CHUNK_COUNT * MERGE_VOXEL_RANGE);
+
+        for (uint32_t p = 0; p < MERGE_PACKET_COUNT; ++p) {
+            uint32_t src_count = 0;
+
+            for (uint32_t c = 0; c < MERGE_CHUNK_COUNT; ++c) {
+                if (rand() % 3) {
+                    continue;
+                }
+
+                chunk_modifications_t *m = &src[src_count++];
+                m->x = c;
+                m->y = -(int32_t)c;
+                m->z = 1;
+                m->modified_voxels_count = 1 + rand() % 60;
+
+                for (uint32_t v = 0; v < MERGE_VOXEL_RANGE; ++v) {
+                    voxel_indices[v] = (uint16_t)v;
+                }
+
+                for (uint32_t v = 0; v < m->modified_voxels_count; ++v) {
+                    uint32_t pick = v + rand() % (MERGE_VOXEL_RANGE - v);
+                    uint16_t voxel = voxel_indices[pick];
+                    voxel_indices[pick] = voxel_indices[v];
+
+                    m->modifications[v].index = (uint16_t)(voxel * 17);
+                    m->modifications[v].initial_value = (uint8_t)(rand() % 255);
+                    m->modifications[v].final_value = (uint8_t)(rand() % 255);
+                    m->colors[v] = (voxel_color_t)(rand() % 256);
+
+                    reference_voxel_t *ref = &reference[c * MERGE_VOXEL_RANGE + voxel];
+                    if (!ref->modified) {
+                        ref->modified = 1;
+                        ref->initial_value = m->modifications[v].initial_value;
+                    }
+
+                    ref->final_value = m->modifications[v].final_value;
+                    ref->color = m->colors[v];
+                }
+            }
+
+            timer->start();
+            merge_chunk_modifications(dst, &dst_count, src, src_count);
+            timer->stop();
+
+            LN_CLEAR();
+        }
+
+        // Every modified voxel exactly once, sorted, with the first initial value and the last final value / color
+        for (uint32_t i = 0; i < dst_count; ++i) {
+            chunk_modifications_t *m = &dst[i];
+            uint32_t c = (uint32_t)m->x;
+            uint32_t expected_count = 0;
+
+            for (uint32_t v = 0; v < MERGE_VOXEL_RANGE; ++v) {
+                expected_count += reference[c * MERGE_VOXEL_RANGE + v].modified;
+            }
+
+            bool mismatch = m->modified_voxels_count != expected_count;
+
+            for (uint32_t v = 0; v < m->modified_voxels_count && !mismatch; ++v) {
+                voxel_modification_t *vm = &m->modifications[v];
+                reference_voxel_t *ref = &reference[c * MERGE_VOXEL_RANGE + vm->index / 17];
+
+                mismatch |= (v && vm->index <= m->modifications[v - 1].index);
+                mismatch |= !ref->modified || vm->initial_value != ref->initial_value || vm->final_value != ref->final_value || m->colors[v] != ref->color;
+                mismatch |= find_voxel_modification(m, vm->index) != (int32_t)v;
+            }
+
+            mismatch_count += mismatch;
+        }
+    }
+
+    FL_FREE(reference);
+    FL_FREE(src);
+    FL_FREE(dst);
+
+    return mismatch_count;
+}
+
+void bench_terraform_queue() {
+    bench_load_map("ice.map");
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    // Players stand on chunks which have a surface, some of them close to each other
+    uint32_t surface_chunk_count = 0;
+    ivector3_t *surface_chunks = FL_MALLOC(ivector3_t, active_count);
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        voxel_t uniform_voxel;
+        if (active[i] && !is_chunk_uniform(active[i], &uniform_voxel)) {
+            surface_chunks[surface_chunk_count++] = active[i]->chunk_coord;
+        }
+    }
+
+    ivector3_t spots[PLAYER_COUNT];
+    srand(7);
+    for (uint32_t p = 0; p < PLAYER_COUNT; ++p) {
+        if (p & 1) {
+            spots[p] = spots[p - 1] + ivector3_t(3, 0, -2);
+        }
+        else {
+            spots[p] = surface_chunks[rand() % surface_chunk_count] * CHUNK_EDGE_LENGTH +
+                ivector3_t(rand() % CHUNK_EDGE_LENGTH, rand() % CHUNK_EDGE_LENGTH, rand() % CHUNK_EDGE_LENGTH);
+        }
+    }
+
+    bench_timer_t immediate_timer, queued_timer;
+    uint32_t immediate_hash = s_run_players(spots, STROKES_PER_PLAYER, 0, &immediate_timer);
+    uint32_t queued_hash = s_run_players(spots, STROKES_PER_PLAYER, 1, &queued_timer);
+
+    LOG_INFOV("%d players x %d strokes per tick: %.2f us per tick applying every brush, %.2f us per tick applying the queue once\n",
+        PLAYER_COUNT, STROKES_PER_PLAYER, immediate_timer.us_per(TICK_COUNT), queued_timer.us_per(TICK_COUNT));
+
+    if (immediate_hash != queued_hash) {
+        BENCH_FAILV("Applying the queue once per tick doesn't give the same terrain (%u vs %u)\n", queued_hash, immediate_hash);
+    }
+
+    // The queue gets applied when it is full
+    uint32_t overflow_immediate_hash = s_run_players(spots, OVERFLOW_STROKES_PER_PLAYER, 0, &immediate_timer);
+    uint32_t overflow_queued_hash = s_run_players(spots, OVERFLOW_STROKES_PER_PLAYER, 1, &queued_timer);
+
+    LOG_INFOV("%d players x %d strokes per tick (queue of %d): %.2f us per tick applying every brush, %.2f us per tick with the queue\n",
+        PLAYER_COUNT, OVERFLOW_STROKES_PER_PLAYER, TERRAFORM_MAX_QUEUED_COMMANDS, immediate_timer.us_per(TICK_COUNT), queued_timer.us_per(TICK_COUNT));
+
+    if (overflow_immediate_hash != overflow_queued_hash) {
+        BENCH_FAILV("Applying the queue when it is full doesn't give the same terrain (%u vs %u)\n", overflow_queued_hash, overflow_immediate_hash);
+    }
+
+    uint32_t pending_mismatch_count = s_check_pending_raycasts(spots);
+
+    if (pending_mismatch_count) {
+        BENCH_FAILV("%d / %d rays through the queued brushes didn't hit where they hit once the brushes are applied\n", pending_mismatch_count, PENDING_RAY_COUNT);
+    }
+
+    bench_timer_t merge_timer;
+    uint32_t mismatch_count = s_check_merge(&merge_timer);
+
+    LOG_INFOV("merge_chunk_modifications: %.2f us per packet\n", merge_timer.us_per(MERGE_ROUND_COUNT * MERGE_PACKET_COUNT));
+
+    if (mismatch_count) {
+        BENCH_FAILV("%d merged chunks don't have the right modifications\n", mismatch_count);
+    }
+
+    bench_reload_map("ice.map");
+
+    FL_FREE(surface_chunks);
+}
@@ -0,0 +1,204 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/allocators.hpp>
+
+static const uint32_t QUERY_COUNT = 200000;
+
+// Slow version of terrain_may_have_surface (reads every voxel)
+static bool s_reference_may_have_surface(const ivector3_t &vs_min, const ivector3_t &vs_max) {
+    bool has_solid = 0, has_air = 0;
+
+    for (int32_t z = vs_min.z; z <= vs_max.z; ++z) {
+        for (int32_t y = vs_min.y; y <= vs_max.y; ++y) {
+            for (int32_t x = vs_min.x; x <= vs_max.x; ++x) {
+                ivector3_t voxel = ivector3_t(x, y, z);
+                chunk_t *chunk = g_game->access_chunk(space_voxel_to_chunk(voxel));
+                ivector3_t local = space_voxel_to_local_chunk(voxel);
+
+                if (chunk && get_chunk_voxel(chunk, get_voxel_index(local.x, local.y, local.z)).value > CHUNK_SURFACE_LEVEL) {
+                    has_solid = 1;
+                }
+                else {
+                    has_air = 1;
+                }
+            }
+        }
+    }
+
+    return has_solid && has_air;
+}
+
+// Makes sure that the incrementally updated brick masks match the ones computed from scratch
+static bool s_verify_occupancy(chunk_t **chunks, uint32_t chunk_count) {
+    voxel_t *scratch = FL_MALLOC(voxel_t, CHUNK_VOXEL_COUNT);
+    bool valid = 1;
+
+    for (uint32_t i = 0; i < chunk_count && valid; ++i) {
+        chunk_t copy = *chunks[i];
+        update_chunk_occupancy(&copy, get_chunk_voxels(chunks[i], scratch));
+
+        valid = copy.solid_bricks == chunks[i]->solid_bricks && copy.air_bricks == chunks[i]->air_bricks &&
+            !memcmp(copy.brick_solid_counts, chunks[i]->brick_solid_counts, sizeof(copy.brick_solid_counts));
+    }
+
+    FL_FREE(scratch);
+
+    return valid;
+}
+
+// Cached aprons which survived modifications have to match the voxels
+static bool s_verify_aprons(chunk_t **chunks, uint32_t chunk_count) {
+    voxel_t *apron = FL_MALLOC(voxel_t, CHUNK_APRON_VOXEL_COUNT);
+    bool valid = 1;
+
+    for (uint32_t i = 0; i < chunk_count && valid; ++i) {
+        if (chunks[i]->apron) {
+            fill_chunk_apron(chunks[i], apron);
+            valid = !memcmp(apron, chunks[i]->apron->voxels, sizeof(voxel_t) * CHUNK_APRON_VOXEL_COUNT);
+        }
+    }
+
+    FL_FREE(apron);
+
+    return valid;
+}
+
+void bench_terrain_occupancy() {
+    bench_load_map("ice.map");
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    uint32_t chunk_count = 0;
+    chunk_t **chunks = FL_MALLOC(chunk_t *, active_count);
+    ivector3_t min_coord = ivector3_t(INT32_MAX), max_coord = ivector3_t(INT32_MIN);
+    uint32_t surface_bricks = 0;
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        if (active[i]) {
+            chunks[chunk_count++] = active[i];
+            min_coord = glm::min(min_coord, active[i]->chunk_coord);
+            max_coord = glm::max(max_coord, active[i]->chunk_coord);
+            surface_bricks += __builtin_popcountll(active[i]->solid_bricks & active[i]->air_bricks);
+        }
+    }
+
+    LOG_INFOV("%d chunks, %d / %d bricks straddle the surface\n", chunk_count, surface_bricks, chunk_count * CHUNK_BRICK_COUNT);
+
+    vector3_t ws_min = space_chunk_to_world(min_coord);
+    vector3_t ws_max = space_chunk_to_world(max_coord + ivector3_t(1));
+
+    // Rocks flying around the map (most of them are in the air)
+    srand(0);
+    vector3_t *positions = FL_MALLOC(vector3_t, QUERY_COUNT);
+    for (uint32_t q = 0; q < QUERY_COUNT; ++q) {
+        positions[q] = vector3_t(
+            bench_random_float(ws_min.x, ws_max.x),
+            bench_random_float(ws_min.y, ws_max.y),
+            bench_random_float(ws_min.z, ws_max.z));
+    }
+
+    uint32_t detected_count = 0, mismatch_count = 0, skipped_count = 0;
+    // Changes to the collision code shouldn't change this
+    float contact_checksum = 0.0f;
+
+    bench_timer_t check_timer = {};
+    check_timer.start();
+    for (uint32_t q = 0; q < QUERY_COUNT; ++q) {
+        terrain_collision_t collision = {};
+        collision.ws_size = vector3_t(0.2f);
+        collision.ws_position = positions[q];
+        collision.ws_velocity = vector3_t(0.0f, -PROJECTILE_ROCK_SPEED, 0.0f);
+        collision.es_position = collision.ws_position / collision.ws_size;
+        collision.es_velocity = collision.ws_velocity / collision.ws_size;
+
+        check_ray_terrain_collision(&collision);
+        detected_count += collision.detected;
+
+        if (collision.detected) {
+            contact_checksum += glm::dot(collision.es_contact_point, vector3_t(1.0f, 3.0f, 7.0f)) + collision.es_nearest_distance;
+        }
+
+        LN_CLEAR();
+    }
+    check_timer.stop();
+
+    LOG_INFOV("Projectile terrain checks: %.2f ns per rock (%d / %d hit the terrain, contact checksum %f)\n",
+        check_timer.ns_per(QUERY_COUNT), detected_count, QUERY_COUNT, contact_checksum);
+
+    for (uint32_t q = 0; q < QUERY_COUNT / 10; ++q) {
+        ivector3_t vs_min = space_world_to_voxel(positions[q]);
+        ivector3_t vs_max = vs_min + ivector3_t(rand() % 6, rand() % 6, rand() % 6);
+
+        bool may_have_surface = terrain_may_have_surface(vs_min, vs_max);
+        skipped_count += !may_have_surface;
+        // Masks are allowed to be conservative, but never to skip a surface
+        mismatch_count += !may_have_surface && s_reference_may_have_surface(vs_min, vs_max);
+    }
+
+    LOG_INFOV("%d / %d random boxes skipped\n", skipped_count, QUERY_COUNT / 10);
+
+    if (mismatch_count) {
+        BENCH_FAILV("terrain_may_have_surface skipped %d boxes with a surface\n", mismatch_count);
+    }
+
+    // Writes which cross the surface level in both directions
+    voxel_t *original = FL_MALLOC(voxel_t, chunk_count * CHUNK_VOXEL_COUNT);
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        voxel_t *dst = &original[i * CHUNK_VOXEL_COUNT];
+        const voxel_t *voxels = get_chunk_voxels(chunks[i], dst);
+        if (voxels != dst) {
+            memcpy(dst, voxels, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+        }
+    }
+
+    for (uint32_t w = 0; w < QUERY_COUNT; ++w) {
+        chunk_t *c = chunks[rand() % chunk_count];
+        uint32_t index = rand() % CHUNK_VOXEL_COUNT;
+        set_chunk_voxel_value(c, index, (uint8_t)(rand() % CHUNK_MAX_VOXEL_VALUE_I));
+    }
+
+    if (!s_verify_occupancy(chunks, chunk_count)) {
+        BENCH_FAIL("Brick occupancy got out of sync with the voxels\n");
+    }
+
+    // Writes on chunk edges have to invalidate the aprons of the neighbours
+    bool aprons_valid = 1;
+    for (uint32_t round = 0; round < 100 && aprons_valid; ++round) {
+        for (uint32_t i = 0; i < CHUNK_APRON_CACHE_COUNT; ++i) {
+            get_chunk_apron(chunks[(round * 7 + i) % chunk_count]);
+        }
+
+        for (uint32_t w = 0; w < 16; ++w) {
+            uint32_t index;
+            do {
+                index = rand() % CHUNK_VOXEL_COUNT;
+            } while (!is_voxel_on_chunk_edge(index));
+
+            set_chunk_voxel_value(chunks[(round * 7 + rand() % 80) % chunk_count], index, (uint8_t)(rand() % CHUNK_MAX_VOXEL_VALUE_I));
+        }
+
+        aprons_valid = s_verify_aprons(chunks, chunk_count);
+    }
+
+    if (!aprons_valid) {
+        BENCH_FAIL("A cached apron didn't get invalidated\n");
+    }
+
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        memcpy(get_chunk_voxels_for_write(chunks[i]), &original[i * CHUNK_VOXEL_COUNT], sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+        compress_chunk_storage(chunks[i]);
+    }
+
+    if (!s_verify_occupancy(chunks, chunk_count)) {
+        BENCH_FAIL("Brick occupancy wasn't recomputed after bulk writes\n");
+    }
+
+    FL_FREE(original);
+    FL_FREE(positions);
+    FL_FREE(chunks);
+}
@@ -0,0 +1,314 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/weapon.hpp>
+#include <common/allocators.hpp>
+
+static const uint32_t RAY_COUNT = 20000;
+static const uint32_t CHECKED_RAY_COUNT = 2000;
+static const float MAX_REACH = 10.0f;
+static const uint32_t CHECKED_SPHERE_COUNT = 500;
+static const float SPHERE_REACH = 2.0f;
+
+// cast_terrain_ray before it walked the voxels: fixed steps along the ray, with a ray / triangle check at each of them
+static bool s_marching_cast(const vector3_t &ws_ray_start, const vector3_t &ws_ray_direction, float max_reach, vector3_t *contact) {
+    static const float PRECISION = 1.0f / 15.0f;
+
+    vector3_t vs_position = ws_ray_start;
+    vector3_t vs_step = ws_ray_direction * max_reach * PRECISION;
+    float max_reach_squared = max_reach * max_reach;
+
+    for (; glm::dot(vs_position - ws_ray_start, vs_position - ws_ray_start) < max_reach_squared; vs_position += vs_step) {
+        chunk_t *chunk = g_game->access_chunk(space_voxel_to_chunk(space_world_to_voxel(vs_position)));
+
+        if (chunk) {
+            terrain_collision_t collision = {};
+            collision.ws_size = vector3_t(0.1f);
+            collision.ws_position = vs_position;
+            collision.ws_velocity = ws_ray_direction;
+            collision.es_position = collision.ws_position / collision.ws_size;
+            collision.es_velocity = collision.ws_velocity / collision.ws_size;
+
+            check_ray_terrain_collision(&collision);
+
+            if (collision.detected) {
+                *contact = collision.es_contact_point * collision.ws_size;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static float s_voxel_value(const ivector3_t &voxel) {
+    chunk_t *chunk = g_game->access_chunk(space_voxel_to_chunk(voxel));
+    ivector3_t local = space_voxel_to_local_chunk(voxel);
+
+    return chunk ? (float)get_chunk_voxel(chunk, get_voxel_index(local.x, local.y, local.z)).value : 0.0f;
+}
+
+// Values interpolated inside the marching cubes cell of the point (the voxels are at the corners of the cells)
+static float s_value_at(const vector3_t &ws_position) {
+    ivector3_t cell = ivector3_t(glm::floor(ws_position));
+    vector3_t f = ws_position - vector3_t(cell);
+    float value = 0.0f;
+
+    for (uint32_t i = 0; i < 8; ++i) {
+        ivector3_t corner = ivector3_t(i & 1, (i >> 1) & 1, i >> 2);
+        vector3_t weights = glm::mix(vector3_t(1.0f) - f, f, vector3_t(corner));
+        value += weights.x * weights.y * weights.z * s_voxel_value(cell + corner);
+    }
+
+    return value;
+}
+
+// Closest point of the triangle (Ericson, Real-Time Collision Detection 5.1.5)
+static vector3_t s_closest_point_on_triangle(const vector3_t &p, const vector3_t &a, const vector3_t &b, const vector3_t &c) {
+    vector3_t ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    vector3_t bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+    vector3_t cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Distance to the closest triangle of the collision mesh (which has the same vertices as the rendered mesh) - at most 2
+static float s_distance_to_mesh(const vector3_t &ws_position) {
+    uint32_t triangle_count;
+    collision_triangle_t *triangles = gather_collision_triangles(&triangle_count, ws_position, vector3_t(2.0f));
+    float closest = 2.0f;
+
+    for (uint32_t t = 0; t < triangle_count; ++t) {
+        vector3_t point = s_closest_point_on_triangle(ws_position, triangles[t].v.a, triangles[t].v.b, triangles[t].v.c);
+        closest = glm::min(closest, glm::length(point - ws_position));
+    }
+
+    return closest;
+}
+
+static const float REFERENCE_STEP = 1.0f / 128.0f;
+
+// First point where the interpolated values go over the surface level, in small steps - INFINITY if there isn't any
+static float s_reference_crossing(const vector3_t &start, const vector3_t &direction, float max_distance) {
+    float surface_level = (float)CHUNK_SURFACE_LEVEL;
+    float previous_value = s_value_at(start);
+
+    if (previous_value > surface_level) {
+        return 0.0f;
+    }
+
+    for (float distance = REFERENCE_STEP; distance < max_distance + REFERENCE_STEP; distance += REFERENCE_STEP) {
+        float current_distance = glm::min(distance, max_distance);
+        float value = s_value_at(start + direction * current_distance);
+
+        if (value > surface_level) {
+            float previous_distance = distance - REFERENCE_STEP;
+            return previous_distance + (current_distance - previous_distance) * (surface_level - previous_value) / (value - previous_value);
+        }
+
+        previous_value = value;
+    }
+
+    return INFINITY;
+}
+
+// First point where the sphere touches the collision mesh (or where its center is in the terrain), in small steps - INFINITY if there isn't any
+// clearance is how close the sphere got to the mesh without touching it
+static float s_reference_sphere_contact(const vector3_t &start, const vector3_t &direction, float max_distance, float radius, float *clearance) {
+    *clearance = INFINITY;
+
+    for (float distance = 0.0f; distance < max_distance + REFERENCE_STEP; distance += REFERENCE_STEP) {
+        vector3_t center = start + direction * glm::min(distance, max_distance);
+        float mesh_distance = s_distance_to_mesh(center);
+        LN_CLEAR();
+
+        if (s_value_at(center) > (float)CHUNK_SURFACE_LEVEL || mesh_distance <= radius) {
+            return glm::min(distance, max_distance);
+        }
+
+        *clearance = glm::min(*clearance, mesh_distance - radius);
+    }
+
+    return INFINITY;
+}
+
+void bench_terrain_raycast() {
+    bench_load_map("ice.map");
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    // Rays start around the surface (where players aim at the terrain)
+    uint32_t surface_chunk_count = 0;
+    ivector3_t *surface_chunks = FL_MALLOC(ivector3_t, active_count);
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        if (active[i] && (active[i]->solid_bricks & active[i]->air_bricks)) {
+            surface_chunks[surface_chunk_count++] = active[i]->chunk_coord;
+        }
+    }
+
+    vector3_t *starts = FL_MALLOC(vector3_t, RAY_COUNT);
+    vector3_t *directions = FL_MALLOC(vector3_t, RAY_COUNT);
+    srand(10);
+
+    for (uint32_t r = 0; r < RAY_COUNT; ++r) {
+        vector3_t chunk_origin = space_chunk_to_world(surface_chunks[rand() % surface_chunk_count]);
+        starts[r] = chunk_origin + vector3_t(
+            bench_random_float(0.0f, CHUNK_EDGE_LENGTH),
+            bench_random_float(0.0f, CHUNK_EDGE_LENGTH),
+            bench_random_float(0.0f, CHUNK_EDGE_LENGTH));
+
+        // Some rays go along an axis
+        if (r % 16 == 0) {
+            directions[r] = vector3_t(0.0f);
+            directions[r][rand() % 3] = (rand() & 1) ? 1.0f : -1.0f;
+        }
+        else {
+            directions[r] = glm::normalize(vector3_t(bench_random_float(-1.0f, 1.0f), bench_random_float(-1.0f, 1.0f), bench_random_float(-1.0f, 1.0f)));
+        }
+    }
+
+    // The walk has to stop where the values first go over the surface level (up to the precision of the reference, which can miss
+    // a ray that only grazes the surface)
+    uint32_t mismatch_count = 0, checked_hit_count = 0;
+    float max_error = 0.0f;
+
+    for (uint32_t r = 0; r < CHECKED_RAY_COUNT; ++r) {
+        terrain_raycast_hit_t hit;
+        bool detected = raycast_terrain(starts[r], directions[r], MAX_REACH, &hit);
+        float reference = s_reference_crossing(starts[r], directions[r], MAX_REACH);
+
+        if (detected) {
+            ++checked_hit_count;
+
+            if (s_voxel_value(hit.vs_voxel) <= (float)CHUNK_SURFACE_LEVEL || glm::abs(hit.distance - reference) > 2.0f * REFERENCE_STEP) {
+                ++mismatch_count;
+            }
+            else {
+                max_error = glm::max(max_error, glm::abs(hit.distance - reference));
+            }
+        }
+        else if (reference != INFINITY) {
+            ++mismatch_count;
+        }
+    }
+
+    if (mismatch_count) {
+        BENCH_FAILV("%d / %d rays didn't stop where the surface level gets crossed\n", mismatch_count, CHECKED_RAY_COUNT);
+    }
+
+    LOG_INFOV("Contact points are up to %.4f away from the crossing found in steps of %.4f\n", max_error, REFERENCE_STEP);
+
+    // Rock sized spheres have to stop where they first touch the mesh (spheres which only come within a step of it can go either way)
+    uint32_t sphere_mismatch_count = 0, sphere_hit_count = 0;
+
+    for (uint32_t r = 0; r < CHECKED_SPHERE_COUNT; ++r) {
+        terrain_raycast_hit_t hit;
+        bool detected = raycast_terrain_sphere(starts[r], directions[r], SPHERE_REACH, rock_t::RADIUS, &hit);
+        LN_CLEAR();
+
+        float clearance;
+        float reference = s_reference_sphere_contact(starts[r], directions[r], SPHERE_REACH, rock_t::RADIUS, &clearance);
+
+        if (clearance < REFERENCE_STEP) {
+            continue;
+        }
+
+        sphere_hit_count += detected;
+
+        if (detected != (reference != INFINITY) || (detected && glm::abs(hit.distance - reference) > 2.0f * REFERENCE_STEP)) {
+            ++sphere_mismatch_count;
+        }
+    }
+
+    if (sphere_mismatch_count) {
+        BENCH_FAILV("%d / %d spheres didn't stop where they first touch the mesh\n", sphere_mismatch_count, CHECKED_SPHERE_COUNT);
+    }
+
+    LOG_INFOV("%d spheres of radius %.2f checked against the mesh (%d hits)\n", CHECKED_SPHERE_COUNT, rock_t::RADIUS, sphere_hit_count);
+
+    // Timings, and how far the contact points of both versions are from the mesh
+    uint32_t marching_hit_count = 0, walk_hit_count = 0;
+    vector3_t *marching_contacts = FL_MALLOC(vector3_t, RAY_COUNT);
+    bool *marching_hits = FL_MALLOC(bool, RAY_COUNT);
+
+    bench_timer_t marching_timer = {}, walk_timer = {}, rock_timer = {};
+
+    marching_timer.start();
+    for (uint32_t r = 0; r < RAY_COUNT; ++r) {
+        marching_hits[r] = s_marching_cast(starts[r], directions[r], MAX_REACH, &marching_contacts[r]);
+        marching_hit_count += marching_hits[r];
+        LN_CLEAR();
+    }
+    marching_timer.stop();
+
+    walk_timer.start();
+    for (uint32_t r = 0; r < RAY_COUNT; ++r) {
+        terrain_raycast_hit_t hit;
+        if (raycast_terrain(starts[r], directions[r], MAX_REACH, &hit)) {
+            ++walk_hit_count;
+        }
+    }
+    walk_timer.stop();
+
+    // Rays which start in the terrain don't cross the surface (their contact point is their start)
+    uint32_t surface_hit_count = 0;
+    float marching_mesh_distance = 0.0f, walk_mesh_distance = 0.0f;
+    for (uint32_t r = 0; r < CHECKED_RAY_COUNT; ++r) {
+        terrain_raycast_hit_t hit;
+        if (marching_hits[r] && raycast_terrain(starts[r], directions[r], MAX_REACH, &hit) && hit.distance > 0.0f) {
+            marching_mesh_distance += s_distance_to_mesh(marching_contacts[r]);
+            walk_mesh_distance += s_distance_to_mesh(hit.ws_position);
+            ++surface_hit_count;
+        }
+        LN_CLEAR();
+    }
+
+    LOG_INFOV("%d rays of %.1f: %.2f us per ray marching (%d hits), %.2f us per ray walking the voxels (%d hits, %d checked against the reference)\n",
+        RAY_COUNT, MAX_REACH, marching_timer.us_per(RAY_COUNT), marching_hit_count,
+        walk_timer.us_per(RAY_COUNT), walk_hit_count, checked_hit_count);
+    LOG_INFOV("Contact points of %d rays which both versions hit are %.3f from the mesh on average marching, %.3f walking the cells\n",
+        surface_hit_count, marching_mesh_distance / (float)glm::max(surface_hit_count, 1u), walk_mesh_distance / (float)glm::max(surface_hit_count, 1u));
+
+    // Rocks in the middle of a tick
+    g_game->dt = 1.0f / 60.0f;
+    uint32_t rock_hit_count = 0;
+
+    rock_timer.start();
+    for (uint32_t r = 0; r < RAY_COUNT; ++r) {
+        rock_t rock = rock_t(starts[r], directions[r] * PROJECTILE_ROCK_SPEED, vector3_t(0.0f, 1.0f, 0.0f), 0, 0, 0);
+        rock_hit_count += check_projectile_terrain_collision(&rock);
+    }
+    rock_timer.stop();
+
+    LOG_INFOV("Projectile terrain checks: %.2f ns per rock (%d / %d hit the terrain)\n",
+        rock_timer.ns_per(RAY_COUNT), rock_hit_count, RAY_COUNT);
+
+    FL_FREE(marching_hits);
+    FL_FREE(marching_contacts);
+    FL_FREE(directions);
+    FL_FREE(starts);
+    FL_FREE(surface_chunks);
+}
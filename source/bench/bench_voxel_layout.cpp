@@ -0,0 +1,278 @@
+#include "bench.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/allocators.hpp>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const uint32_t TERRAFORM_COUNT = 20000;
+static const uint32_t COLLISION_COUNT = 200000;
+static const int32_t BRUSH_RADIUS = 4;
+
+// Hardware cache miss counter (-1 if perf events aren't available, e.g. in containers)
+static int32_t s_open_cache_miss_counter() {
+#if defined(__linux__)
+    perf_event_attr attr = {};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int32_t)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void s_start_counter(int32_t fd) {
+#if defined(__linux__)
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+static int64_t s_stop_counter(int32_t fd) {
+#if defined(__linux__)
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+        int64_t count;
+        if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+            return count;
+        }
+    }
+#endif
+    return -1;
+}
+
+struct layout_timings_t {
+    bench_timer_t meshing;
+    bench_timer_t terraforming;
+    bench_timer_t collision;
+    int64_t meshing_misses;
+    int64_t terraforming_misses;
+    int64_t collision_misses;
+    // Has to be the same for both layouts
+    uint32_t checksum;
+};
+
+// Every index has to map to a different voxel and back
+template <typename Layout> static bool s_verify_layout() {
+    uint8_t *hit = FL_MALLOC(uint8_t, CHUNK_VOXEL_COUNT);
+    memset(hit, 0, CHUNK_VOXEL_COUNT);
+    bool valid = 1;
+
+    for (uint32_t z = 0; z < CHUNK_EDGE_LENGTH; ++z) {
+        for (uint32_t y = 0; y < CHUNK_EDGE_LENGTH; ++y) {
+            for (uint32_t x = 0; x < CHUNK_EDGE_LENGTH; ++x) {
+                uint32_t index = get_voxel_index<Layout>(x, y, z);
+                valid &= index < CHUNK_VOXEL_COUNT && !hit[index] && get_voxel_coord<Layout>(index) == ivector3_t(x, y, z);
+                hit[index & (CHUNK_VOXEL_COUNT - 1)] = 1;
+            }
+        }
+    }
+
+    FL_FREE(hit);
+
+    return valid;
+}
+
+// Same gathers as the mesher: 8 corners of every cell of every chunk
+template <typename Layout> static uint32_t s_mesh_chunks(const voxel_t *voxels, uint32_t chunk_count) {
+    uint32_t surface_cells = 0;
+
+    for (uint32_t c = 0; c < chunk_count; ++c) {
+        const voxel_t *chunk_voxels = &voxels[c * CHUNK_VOXEL_COUNT];
+
+        for (uint32_t z = 0; z < CHUNK_EDGE_LENGTH - 1; ++z) {
+            for (uint32_t y = 0; y < CHUNK_EDGE_LENGTH - 1; ++y) {
+                for (uint32_t x = 0; x < CHUNK_EDGE_LENGTH - 1; ++x) {
+                    uint32_t bits = 0;
+                    for (uint32_t i = 0; i < 8; ++i) {
+                        uint32_t index = get_voxel_index<Layout>(x + (i & 1), y + ((i >> 1) & 1), z + (i >> 2));
+                        bits |= (uint32_t)(chunk_voxels[index].value > CHUNK_SURFACE_LEVEL) << i;
+                    }
+
+                    surface_cells += bits != 0 && bits != 0xFF;
+                }
+            }
+        }
+    }
+
+    return surface_cells;
+}
+
+// Sphere brush like terraform() - read-modify-write of every voxel in the sphere
+template <typename Layout> static uint32_t s_terraform_chunks(voxel_t *voxels, uint32_t chunk_count) {
+    srand(1);
+
+    for (uint32_t t = 0; t < TERRAFORM_COUNT; ++t) {
+        voxel_t *chunk_voxels = &voxels[(rand() % chunk_count) * CHUNK_VOXEL_COUNT];
+        ivector3_t center = ivector3_t(
+            BRUSH_RADIUS + rand() % (CHUNK_EDGE_LENGTH - 2 * BRUSH_RADIUS),
+            BRUSH_RADIUS + rand() % (CHUNK_EDGE_LENGTH - 2 * BRUSH_RADIUS),
+            BRUSH_RADIUS + rand() % (CHUNK_EDGE_LENGTH - 2 * BRUSH_RADIUS));
+        int32_t direction = (t & 1) ? 1 : -1;
+
+        for (int32_t z = center.z - BRUSH_RADIUS; z < center.z + BRUSH_RADIUS; ++z) {
+            for (int32_t y = center.y - BRUSH_RADIUS; y < center.y + BRUSH_RADIUS; ++y) {
+                for (int32_t x = center.x - BRUSH_RADIUS; x < center.x + BRUSH_RADIUS; ++x) {
+                    ivector3_t diff = ivector3_t(x, y, z) - center;
+                    int32_t distance2 = diff.x * diff.x + diff.y * diff.y + diff.z * diff.z;
+
+                    if (distance2 < BRUSH_RADIUS * BRUSH_RADIUS) {
+                        voxel_t *voxel = &chunk_voxels[get_voxel_index<Layout>(x, y, z)];
+                        int32_t value = (int32_t)voxel->value + direction * (BRUSH_RADIUS * BRUSH_RADIUS - distance2);
+                        voxel->value = (uint8_t)glm::clamp(value, 0, (int32_t)CHUNK_MAX_VOXEL_VALUE_I);
+                    }
+                }
+            }
+        }
+    }
+
+    uint32_t checksum = 0;
+    for (uint32_t c = 0; c < chunk_count; ++c) {
+        for (uint32_t z = 0; z < CHUNK_EDGE_LENGTH; ++z) {
+            for (uint32_t y = 0; y < CHUNK_EDGE_LENGTH; ++y) {
+                for (uint32_t x = 0; x < CHUNK_EDGE_LENGTH; ++x) {
+                    checksum = checksum * 31 + voxels[c * CHUNK_VOXEL_COUNT + get_voxel_index<Layout>(x, y, z)].value;
+                }
+            }
+        }
+    }
+
+    return checksum;
+}
+
+// Like s_get_collision_triangles: the cells of a small box around a random point
+template <typename Layout> static uint32_t s_collide_chunks(const voxel_t *voxels, uint32_t chunk_count) {
+    srand(2);
+    uint32_t surface_cells = 0;
+
+    for (uint32_t q = 0; q < COLLISION_COUNT; ++q) {
+        const voxel_t *chunk_voxels = &voxels[(rand() % chunk_count) * CHUNK_VOXEL_COUNT];
+        ivector3_t min = ivector3_t(rand() % (CHUNK_EDGE_LENGTH - 3), rand() % (CHUNK_EDGE_LENGTH - 3), rand() % (CHUNK_EDGE_LENGTH - 3));
+
+        for (int32_t z = min.z; z < min.z + 2; ++z) {
+            for (int32_t y = min.y; y < min.y + 2; ++y) {
+                for (int32_t x = min.x; x < min.x + 2; ++x) {
+                    uint32_t bits = 0;
+                    for (uint32_t i = 0; i < 8; ++i) {
+                        uint32_t index = get_voxel_index<Layout>(x + (i & 1), y + ((i >> 1) & 1), z + (i >> 2));
+                        bits |= (uint32_t)(chunk_voxels[index].value > CHUNK_SURFACE_LEVEL) << i;
+                    }
+
+                    surface_cells += bits != 0 && bits != 0xFF;
+                }
+            }
+        }
+    }
+
+    return surface_cells;
+}
+
+template <typename Layout> static layout_timings_t s_run_layout(const voxel_t *linear, uint32_t chunk_count, int32_t counter) {
+    layout_timings_t timings = {};
+
+    voxel_t *voxels = FL_MALLOC(voxel_t, chunk_count * CHUNK_VOXEL_COUNT);
+    for (uint32_t c = 0; c < chunk_count; ++c) {
+        for (uint32_t i = 0; i < CHUNK_VOXEL_COUNT; ++i) {
+            ivector3_t coord = get_voxel_coord<linear_voxel_layout_t>(i);
+            voxels[c * CHUNK_VOXEL_COUNT + get_voxel_index<Layout>(coord.x, coord.y, coord.z)] = linear[c * CHUNK_VOXEL_COUNT + i];
+        }
+    }
+
+    timings.meshing.start();
+    s_start_counter(counter);
+    timings.checksum += s_mesh_chunks<Layout>(voxels, chunk_count);
+    timings.meshing_misses = s_stop_counter(counter);
+    timings.meshing.stop();
+
+    timings.terraforming.start();
+    s_start_counter(counter);
+    timings.checksum += s_terraform_chunks<Layout>(voxels, chunk_count);
+    timings.terraforming_misses = s_stop_counter(counter);
+    timings.terraforming.stop();
+
+    timings.collision.start();
+    s_start_counter(counter);
+    timings.checksum += s_collide_chunks<Layout>(voxels, chunk_count);
+    timings.collision_misses = s_stop_counter(counter);
+    timings.collision.stop();
+
+    FL_FREE(voxels);
+
+    return timings;
+}
+
+static void s_print_layout(const char *name, const layout_timings_t &timings, uint32_t chunk_count) {
+    LOG_INFOV("%s: meshing %.2f us per chunk (%lld misses), terraforming %.2f us per brush (%lld misses), collision %.2f ns per query (%lld misses)\n",
+        name,
+        timings.meshing.us_per(chunk_count), (long long)timings.meshing_misses,
+        timings.terraforming.us_per(TERRAFORM_COUNT), (long long)timings.terraforming_misses,
+        timings.collision.ns_per(COLLISION_COUNT), (long long)timings.collision_misses);
+}
+
+void bench_voxel_layout() {
+    bench_load_map("ice.map");
+
+    if (!s_verify_layout<linear_voxel_layout_t>() || !s_verify_layout<morton_voxel_layout_t>()) {
+        BENCH_FAIL("A voxel layout doesn't map every voxel to a different index\n");
+    }
+
+    uint32_t active_count;
+    chunk_t **active = g_game->get_active_chunks(&active_count);
+
+    // Dense copies of every chunk (in linear order) - the layouts get compared on the same data
+    voxel_t *linear = FL_MALLOC(voxel_t, active_count * CHUNK_VOXEL_COUNT);
+    uint32_t chunk_count = 0;
+
+    for (uint32_t i = 0; i < active_count; ++i) {
+        if (active[i]) {
+            voxel_t *dst = &linear[chunk_count * CHUNK_VOXEL_COUNT];
+            const voxel_t *voxels = get_chunk_voxels_linear(active[i], dst);
+            if (voxels != dst) {
+                memcpy(dst, voxels, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+            }
+
+            ++chunk_count;
+        }
+    }
+
+    int32_t counter = s_open_cache_miss_counter();
+    if (counter < 0) {
+        LOG_INFO("Cache miss counter isn't available (misses are reported as -1)\n");
+    }
+
+    LOG_INFOV("%d chunks (build layout is %s)\n", chunk_count, voxel_layout_t::IS_LINEAR ? "linear" : "morton");
+
+    layout_timings_t linear_timings = s_run_layout<linear_voxel_layout_t>(linear, chunk_count, counter);
+    layout_timings_t morton_timings = s_run_layout<morton_voxel_layout_t>(linear, chunk_count, counter);
+
+    s_print_layout("linear", linear_timings, chunk_count);
+    s_print_layout("morton", morton_timings, chunk_count);
+
+    if (linear_timings.checksum != morton_timings.checksum) {
+        BENCH_FAILV("Layouts gave different results (%u vs %u)\n", linear_timings.checksum, morton_timings.checksum);
+    }
+
+#if defined(__linux__)
+    if (counter >= 0) {
+        close(counter);
+    }
+#endif
+
+    FL_FREE(linear);
+}
@@ -0,0 +1,133 @@
+#include "bench.hpp"
+#include <math.h>
+#include <string.h>
+#include <common/log.hpp>
+#include <common/game.hpp>
+#include <common/chunk.hpp>
+#include <common/allocators.hpp>
+#include <common/thread_pool.hpp>
+
+// Per voxel generation through get_chunk / set_chunk_voxel, like the generators before they got split into chunks
+static void s_reference_sphere(const vector3_t &ws_center, float ws_radius, float max_value, generation_type_t type, voxel_color_t color, bool hollow) {
+    ivector3_t vs_center = space_world_to_voxel(ws_center);
+    vector3_t vs_float_center = (vector3_t)(vs_center);
+    int32_t diameter = (int32_t)ws_radius * 2 + 1;
+    ivector3_t start = vs_center - ivector3_t((int32_t)ws_radius);
+
+    float radius_squared = ws_radius * ws_radius;
+    float smaller_radius_squared = (ws_radius - 10) * (ws_radius - 10);
+
+    for (int32_t z = start.z; z < start.z + diameter; ++z) {
+        for (int32_t y = start.y; y < start.y + diameter; ++y) {
+            for (int32_t x = start.x; x < start.x + diameter; ++x) {
+                vector3_t vs_diff_float = vector3_t((float)x, (float)y, (float)z) - vs_float_center;
+                float distance_squared = glm::dot(vs_diff_float, vs_diff_float);
+
+                if (distance_squared <= radius_squared) {
+                    ivector3_t vs_position = ivector3_t(x, y, z);
+                    chunk_t *chunk = g_game->get_chunk(space_voxel_to_chunk(vs_position));
+                    ivector3_t local = space_voxel_to_local_chunk(vs_position);
+                    uint32_t index = get_voxel_index(local.x, local.y, local.z);
+
+                    float proportion = 0.0f;
+                    if (type == GT_ADDITIVE) {
+                        if (hollow) {
+                            float diff = fabsf(distance_squared - smaller_radius_squared);
+                            proportion = (diff < 120.0f) ? 1.0f - (diff / 120.0f) : 0.0f;
+                        }
+                        else {
+                            proportion = 1.0f - (distance_squared / radius_squared);
+                        }
+                    }
+
+                    voxel_t v = get_chunk_voxel(chunk, index);
+                    uint8_t new_value = (uint32_t)(proportion * max_value);
+
+                    if (!hollow || v.value < new_value) {
+                        v.value = new_value;
+                        v.color = color;
+                        set_chunk_voxel(chunk, index, v);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static float s_hills(float x, float y, float z) {
+    return (sinf(x / 9.0f) * cosf(z / 7.0f) * 6.0f - y) / 10.0f;
+}
+
+static void s_reference_equation(const vector3_t &ws_center, const vector3_t &extent, voxel_color_t color) {
+    for (int32_t z = ws_center.z - extent.z / 2; z < ws_center.z + extent.z / 2; ++z) {
+        for (int32_t y = ws_center.y - extent.y / 2; y < ws_center.y + extent.y / 2; ++y) {
+            for (int32_t x = ws_center.x - extent.x / 2; x < ws_center.x + extent.x / 2; ++x) {
+                float c = s_hills(x - ws_center.x, y - ws_center.y, z - ws_center.z);
+
+                if (c > 0.0f) {
+                    ivector3_t vs_position = ivector3_t(x, y, z);
+                    chunk_t *chunk = g_game->get_chunk(space_voxel_to_chunk(vs_position));
+                    ivector3_t local = space_voxel_to_local_chunk(vs_position);
+
+                    voxel_t v;
+                    v.value = (uint8_t)(150.0f * c);
+                    v.color = color;
+                    set_chunk_voxel(chunk, get_voxel_index(local.x, local.y, local.z), v);
+                }
+            }
+        }
+    }
+}
+
+// Sphere / hollow sphere / equation (additive and destructive) on top of the map
+static uint32_t s_generate_world(bool reference, bench_timer_t *timer) {
+    bench_reload_map("ice.map");
+
+    *timer = {};
+    timer->start();
+
+    if (reference) {
+        s_reference_sphere(vector3_t(20.0f, 10.0f, -15.0f), 37.5f, 140.0f, GT_ADDITIVE, 0x2F, 0);
+        s_reference_sphere(vector3_t(-40.0f, 30.0f, 40.0f), 45.0f, 250.0f, GT_ADDITIVE, 0xA1, 1);
+        s_reference_sphere(vector3_t(30.0f, 20.0f, 0.0f), 18.0f, 140.0f, GT_DESTRUCTIVE, 0x00, 0);
+        s_reference_equation(vector3_t(0.0f, 60.5f, 0.0f), vector3_t(151.0f, 40.0f, 129.5f), 0x55);
+    }
+    else {
+        generate_sphere(vector3_t(20.0f, 10.0f, -15.0f), 37.5f, 140.0f, GT_ADDITIVE, 0x2F);
+        generate_hollow_sphere(vector3_t(-40.0f, 30.0f, 40.0f), 45.0f, 250.0f, GT_ADDITIVE, 0xA1);
+        generate_sphere(vector3_t(30.0f, 20.0f, 0.0f), 18.0f, 140.0f, GT_DESTRUCTIVE, 0x00);
+        generate_math_equation(vector3_t(0.0f, 60.5f, 0.0f), vector3_t(151.0f, 40.0f, 129.5f), s_hills, GT_ADDITIVE, 0x55);
+    }
+
+    timer->stop();
+
+    return bench_hash_world(0);
+}
+
+void bench_world_generation() {
+    bench_load_map("ice.map");
+
+    bench_timer_t reference_timer;
+    uint32_t reference_hash = s_generate_world(1, &reference_timer);
+    LOG_INFOV("reference (per voxel): %.2f ms\n", reference_timer.ms());
+
+    uint32_t default_worker_count = get_worker_thread_count();
+    uint32_t worker_counts[] = { 0, 1, 3, default_worker_count };
+
+    for (uint32_t i = 0; i < sizeof(worker_counts) / sizeof(worker_counts[0]); ++i) {
+        set_worker_thread_count(worker_counts[i]);
+
+        bench_timer_t timer;
+        uint32_t hash = s_generate_world(0, &timer);
+        LOG_INFOV("%d worker threads: %.2f ms\n", get_worker_thread_count(), timer.ms());
+
+        if (hash != reference_hash) {
+            BENCH_FAILV("generation with %d worker threads doesn't give the same terrain as the reference (%u vs %u)\n",
+                get_worker_thread_count(), hash, reference_hash);
+        }
+    }
+
+    set_worker_thread_count(default_worker_count);
+
+    bench_reload_map("ice.map");
+}
@@ -21,6 +21,7 @@
 #include <ui.hpp>
 #include <app.hpp>
 #include <common/allocators.hpp>
+#include <common/thread_pool.hpp>
 
 static bool running;
 
@@ -141,6 +142,7 @@ int32_t main(
     dispatch_events(&events);
 
     nw_stop_request_thread();
+    end_thread_pool();
 
     return 0;
 }
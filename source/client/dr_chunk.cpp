@@ -50,48 +50,14 @@ void dr_destroy_chunk_render(chunk_render_t *render) {
         if (mesh_buffer) {
             vk::destroy_sensitive_buffer(&render->mesh.get_mesh_buffer(vk::BT_VERTEX)->gpu_buffer);
         }
+        if (render->vertices) {
+            FL_FREE(render->vertices);
+        }
         FL_FREE(render);
         render = NULL;
     }
 }
 
-static voxel_t s_chunk_edge_voxel_value(
-    int32_t x,
-    int32_t y,
-    int32_t z,
-    bool *doesnt_exist,
-    ivector3_t chunk_coord) {
-    int32_t chunk_coord_offset_x = 0, chunk_coord_offset_y = 0, chunk_coord_offset_z = 0;
-    int32_t final_x = x, final_y = y, final_z = z;
-
-    if (x == CHUNK_EDGE_LENGTH) {
-        final_x = 0;
-        chunk_coord_offset_x = 1;
-    }
-    if (y == CHUNK_EDGE_LENGTH) {
-        final_y = 0;
-        chunk_coord_offset_y = 1;
-    }
-    if (z == CHUNK_EDGE_LENGTH) {
-        final_z = 0;
-        chunk_coord_offset_z = 1;
-    }
-
-    ivector3_t coord = ivector3_t(
-        chunk_coord.x + chunk_coord_offset_x,
-        chunk_coord.y + chunk_coord_offset_y,
-        chunk_coord.z + chunk_coord_offset_z);
-
-    chunk_t *chunk_ptr = g_game->access_chunk(coord);
-    
-    *doesnt_exist = (bool)(chunk_ptr == nullptr);
-
-    if (*doesnt_exist)
-        return { 0, 0 };
-    
-    return chunk_ptr->voxels[get_voxel_index(final_x, final_y, final_z)];
-}
-
 static const vector3_t NORMALIZED_CUBE_VERTICES[8] = {
     vector3_t(-0.5f, -0.5f, -0.5f),
     vector3_t(+0.5f, -0.5f, -0.5f),
@@ -190,167 +156,197 @@ static void s_update_chunk_mesh_voxel_pair(
 
     const int8_t *triangle_entry = &TRIANGLE_TABLE[bit_combination][0];
 
-    uint32_t edge = 0;
+    if (triangle_entry[0] == -1) {
+        return;
+    }
 
-    int8_t edge_pair[3] = {};
+    uint32_t dominant_voxel = 0;
 
-    while(triangle_entry[edge] != -1) {
-        int8_t edge_index = triangle_entry[edge];
-        edge_pair[edge % 3] = edge_index;
+    uncompressed_chunk_mesh_vertex_t vertices[8] = {};
+    for (uint32_t i = 0; i < 8; ++i) {
+        vertices[i].position = NORMALIZED_CUBE_VERTICES[i] + vector3_t(0.5f) + vector3_t((float)x, (float)y, (float)z);
+        vertices[i].color = voxel_values[i].color;
 
-        if (edge % 3 == 2) {
-            voxel_color_t color;
-            uint32_t dominant_voxel = 0;
+        if (voxel_values[i].value > voxel_values[dominant_voxel].value) {
+            dominant_voxel = i;
+        }
+    }
 
-            uncompressed_chunk_mesh_vertex_t vertices[8] = {};
-            for (uint32_t i = 0; i < 8; ++i) {
-                vertices[i].position = NORMALIZED_CUBE_VERTICES[i] + vector3_t(0.5f) + vector3_t((float)x, (float)y, (float)z);
-                vertices[i].color = voxel_values[i].color;
+    voxel_color_t color = voxel_values[dominant_voxel].color;
 
-                if (voxel_values[i].value > voxel_values[dominant_voxel].value) {
-                    dominant_voxel = i;
-                }
-            }
+    // Entries of the triangle table come in groups of 3 edges (one triangle)
+    for (uint32_t edge = 0; triangle_entry[edge] != -1; edge += 3) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            const uint8_t *corners = CELL_EDGE_CORNERS[triangle_entry[edge + i]];
+            s_push_vertex_to_triangle_array(color, corners[0], corners[1], vertices, voxel_values, surface_level, mesh_vertices, vertex_count);
+        }
+    }
+}
 
-            color = voxel_values[dominant_voxel].color;
-
-            for (uint32_t i = 0; i < 3; ++i) {
-                switch(edge_pair[i]) {
-                case 0: { s_push_vertex_to_triangle_array(color, 0, 1, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 1: { s_push_vertex_to_triangle_array(color, 1, 2, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 2: { s_push_vertex_to_triangle_array(color, 2, 3, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 3: { s_push_vertex_to_triangle_array(color, 3, 0, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 4: { s_push_vertex_to_triangle_array(color, 4, 5, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 5: { s_push_vertex_to_triangle_array(color, 5, 6, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 6: { s_push_vertex_to_triangle_array(color, 6, 7, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 7: { s_push_vertex_to_triangle_array(color, 7, 4, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 8: { s_push_vertex_to_triangle_array(color, 0, 4, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 9: { s_push_vertex_to_triangle_array(color, 1, 5, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 10: { s_push_vertex_to_triangle_array(color, 2, 6, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
-                case 11: { s_push_vertex_to_triangle_array(color, 3, 7, vertices, voxel_values, surface_level, mesh_vertices, vertex_count); } break;
+// Returns true if the chunk and all the chunks that its cells touch (+x, +y, +z) are uniform and on the same side of the surface
+static bool s_chunk_has_no_surface(uint8_t surface_level, const chunk_t *c) {
+    voxel_t uniform_voxel;
+    if (!is_chunk_uniform(c, &uniform_voxel)) {
+        return false;
+    }
+
+    bool over_surface = uniform_voxel.value > surface_level;
+
+    for (int32_t z = 0; z <= 1; ++z) {
+        for (int32_t y = 0; y <= 1; ++y) {
+            for (int32_t x = 0; x <= 1; ++x) {
+                if (x || y || z) {
+                    chunk_t *neighbour = get_chunk_neighbour(c, x, y, z);
+
+                    // Cells which touch chunks that don't exist don't get meshed
+                    if (neighbour) {
+                        voxel_t neighbour_voxel;
+                        if (!is_chunk_uniform(neighbour, &neighbour_voxel) ||
+                            (neighbour_voxel.value > surface_level) != over_surface) {
+                            return false;
+                        }
+                    }
                 }
             }
         }
-
-        ++edge;
     }
+
+    return true;
 }
 
-uint32_t dr_generate_chunk_verts(uint8_t surface_level, const chunk_t *c, compressed_chunk_mesh_vertex_t *mesh_vertices) {
-    if (!mesh_vertices)
-        mesh_vertices = dr_get_tmp_mesh_verts();
+// Marching cubes on the cells of one brick (brick coordinates), apron is the chunk + halo
+static void s_mesh_chunk_brick(
+    const voxel_t *apron,
+    const ivector3_t &brick,
+    const bool *mesh_edge_cells,
+    uint8_t surface_level,
+    compressed_chunk_mesh_vertex_t *mesh_vertices,
+    uint32_t *vertex_count) {
+    ivector3_t start = brick * CHUNK_BRICK_EDGE_LENGTH;
+
+    for (int32_t z = start.z; z < start.z + CHUNK_BRICK_EDGE_LENGTH; ++z) {
+        for (int32_t y = start.y; y < start.y + CHUNK_BRICK_EDGE_LENGTH; ++y) {
+            for (int32_t x = start.x; x < start.x + CHUNK_BRICK_EDGE_LENGTH; ++x) {
+                uint32_t edge_cell =
+                    (x == CHUNK_EDGE_LENGTH - 1) |
+                    ((y == CHUNK_EDGE_LENGTH - 1) << 1) |
+                    ((z == CHUNK_EDGE_LENGTH - 1) << 2);
+
+                if (!mesh_edge_cells[edge_cell]) {
+                    continue;
+                }
 
-    uint32_t vertex_count = 0;
+                const voxel_t *cell = &apron[get_apron_index(x, y, z)];
+                voxel_t voxel_values[8];
+                for (uint32_t i = 0; i < 8; ++i) {
+                    voxel_values[i] = cell[APRON_CELL_CORNER_OFFSETS[i]];
+                }
 
-    chunk_t *x_superior = g_game->access_chunk(ivector3_t(c->chunk_coord.x + 1, c->chunk_coord.y, c->chunk_coord.z));
-    chunk_t *y_superior = g_game->access_chunk(ivector3_t(c->chunk_coord.x, c->chunk_coord.y + 1, c->chunk_coord.z));
-    chunk_t *z_superior = g_game->access_chunk(ivector3_t(c->chunk_coord.x, c->chunk_coord.y, c->chunk_coord.z + 1));
-    
-    bool doesnt_exist = 0;
-    if (x_superior) {
-        // x_superior
-        for (uint32_t z = 0; z < CHUNK_EDGE_LENGTH; ++z) {
-            for (uint32_t y = 0; y < CHUNK_EDGE_LENGTH - 1; ++y) {
-                doesnt_exist = 0;
-                
-                uint32_t x = CHUNK_EDGE_LENGTH - 1;
-
-                voxel_t voxel_values[8] = {
-                    c->voxels[get_voxel_index(x, y, z)],
-                    s_chunk_edge_voxel_value(x + 1, y, z, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y][z],
-                    s_chunk_edge_voxel_value(x + 1, y, z + 1, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y][z + 1],
-                    s_chunk_edge_voxel_value(x,     y, z + 1, &doesnt_exist, c->chunk_coord),//voxels[x]    [y][z + 1],
-                    
-                    c->voxels[get_voxel_index(x, y + 1, z)],
-                    s_chunk_edge_voxel_value(x + 1, y + 1, z,&doesnt_exist, c->chunk_coord),//voxels[x + 1][y + 1][z],
-                    s_chunk_edge_voxel_value(x + 1, y + 1, z + 1, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y + 1][z + 1],
-                    s_chunk_edge_voxel_value(x,     y + 1, z + 1, &doesnt_exist, c->chunk_coord) };//voxels[x]    [y + 1][z + 1] };
-
-                if (!doesnt_exist)
-                    s_update_chunk_mesh_voxel_pair(voxel_values, x, y, z, surface_level, mesh_vertices, &vertex_count);
+                s_update_chunk_mesh_voxel_pair(voxel_values, x, y, z, surface_level, mesh_vertices, vertex_count);
             }
         }
     }
+}
 
-    if (y_superior) {
-        // y_superior    
-        for (uint32_t z = 0; z < CHUNK_EDGE_LENGTH; ++z) {
-            for (uint32_t x = 0; x < CHUNK_EDGE_LENGTH; ++x) {
-                doesnt_exist = 0;
-                
-                uint32_t y = CHUNK_EDGE_LENGTH - 1;
-
-                voxel_t voxel_values[8] = {
-                    c->voxels[get_voxel_index(x, y, z)],
-                    s_chunk_edge_voxel_value(x + 1, y, z, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y][z],
-                    s_chunk_edge_voxel_value(x + 1, y, z + 1, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y][z + 1],
-                    s_chunk_edge_voxel_value(x,     y, z + 1, &doesnt_exist, c->chunk_coord),//voxels[x]    [y][z + 1],
-                    
-                    s_chunk_edge_voxel_value(x, y + 1, z, &doesnt_exist, c->chunk_coord),
-                    s_chunk_edge_voxel_value(x + 1, y + 1, z, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y + 1][z],
-                    s_chunk_edge_voxel_value(x + 1, y + 1, z + 1, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y + 1][z + 1],
-                    s_chunk_edge_voxel_value(x,     y + 1, z + 1, &doesnt_exist, c->chunk_coord) };//voxels[x]    [y + 1][z + 1] };
-
-                if (!doesnt_exist)
-                    s_update_chunk_mesh_voxel_pair(voxel_values, x, y, z, surface_level, mesh_vertices, &vertex_count);
-               
-            }
-        }
+// Re-meshes the dirty bricks, the vertices of the other bricks get copied from the previous mesh (previous_vertices can be NULL if all bricks are dirty)
+// Vertices are grouped by brick: brick_vertex_offsets gets the range of each brick in mesh_vertices
+static uint32_t s_generate_chunk_verts(
+    uint8_t surface_level,
+    const chunk_t *c,
+    uint64_t dirty_bricks,
+    const compressed_chunk_mesh_vertex_t *previous_vertices,
+    const uint32_t *previous_offsets,
+    compressed_chunk_mesh_vertex_t *mesh_vertices,
+    uint32_t *brick_vertex_offsets) {
+    uint32_t vertex_count = 0;
+
+    if (s_chunk_has_no_surface(surface_level, c)) {
+        memset(brick_vertex_offsets, 0, sizeof(uint32_t) * (CHUNK_BRICK_COUNT + 1));
+        return 0;
     }
 
-    if (z_superior) {
-        // z_superior
-        for (uint32_t y = 0; y < CHUNK_EDGE_LENGTH - 1; ++y) {
-            for (uint32_t x = 0; x < CHUNK_EDGE_LENGTH - 1; ++x) {
-                doesnt_exist = 0;
-                
-                uint32_t z = CHUNK_EDGE_LENGTH - 1;
-
-                voxel_t voxel_values[8] = {
-                    c->voxels[get_voxel_index(x, y, z)],
-                    s_chunk_edge_voxel_value(x + 1, y, z, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y][z],
-                    s_chunk_edge_voxel_value(x + 1, y, z + 1, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y][z + 1],
-                    s_chunk_edge_voxel_value(x,     y, z + 1, &doesnt_exist, c->chunk_coord),//voxels[x]    [y][z + 1],
-                    
-                    c->voxels[get_voxel_index(x, y + 1, z)],
-                    s_chunk_edge_voxel_value(x + 1, y + 1, z, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y + 1][z],
-                    s_chunk_edge_voxel_value(x + 1, y + 1, z + 1, &doesnt_exist, c->chunk_coord),//voxels[x + 1][y + 1][z + 1],
-                    s_chunk_edge_voxel_value(x,     y + 1, z + 1, &doesnt_exist, c->chunk_coord) };//voxels[x]    [y + 1][z + 1] };
-
-                if (!doesnt_exist)
-                    s_update_chunk_mesh_voxel_pair(voxel_values, x, y, z, surface_level, mesh_vertices, &vertex_count);
-            }
+    // Meshing only happens on the main thread
+    static voxel_t apron[CHUNK_APRON_VOXEL_COUNT];
+    fill_chunk_apron(c, apron);
+
+    // Cells on the +x / +y / +z edges only get meshed if the chunks they touch exist
+    // (index: x edge | y edge << 1 | z edge << 2 - same rules as the per-edge loops this replaced)
+    bool x_superior = get_chunk_neighbour(c, 1, 0, 0);
+    bool y_superior = get_chunk_neighbour(c, 0, 1, 0);
+    bool z_superior = get_chunk_neighbour(c, 0, 0, 1);
+    bool yz_superior = get_chunk_neighbour(c, 0, 1, 1);
+
+    bool mesh_edge_cells[8] = {
+        true,
+        x_superior,
+        y_superior,
+        y_superior,
+        z_superior,
+        x_superior && z_superior,
+        y_superior && yz_superior,
+        y_superior && yz_superior };
+
+    // Brick occupancy is only tracked for CHUNK_SURFACE_LEVEL
+    bool skip_empty_bricks = surface_level == CHUNK_SURFACE_LEVEL;
+
+    for (uint32_t b = 0; b < CHUNK_BRICK_COUNT; ++b) {
+        brick_vertex_offsets[b] = vertex_count;
+
+        if (!(dirty_bricks & (1ull << b))) {
+            uint32_t count = previous_offsets[b + 1] - previous_offsets[b];
+            memcpy(&mesh_vertices[vertex_count], &previous_vertices[previous_offsets[b]], sizeof(compressed_chunk_mesh_vertex_t) * count);
+            vertex_count += count;
+
+            continue;
         }
-    }
-    
-    for (uint32_t z = 0; z < CHUNK_EDGE_LENGTH - 1; ++z) {
-        for (uint32_t y = 0; y < CHUNK_EDGE_LENGTH - 1; ++y) {
-            for (uint32_t x = 0; x < CHUNK_EDGE_LENGTH - 1; ++x) {
-                voxel_t voxel_values[8] = {
-                    c->voxels[get_voxel_index(x, y, z)],
-                    c->voxels[get_voxel_index(x + 1, y, z)],
-                    c->voxels[get_voxel_index(x + 1, y, z + 1)],
-                    c->voxels[get_voxel_index(x, y, z + 1)],
-                    
-                    c->voxels[get_voxel_index(x, y + 1, z)],
-                    c->voxels[get_voxel_index(x + 1, y + 1, z)],
-                    c->voxels[get_voxel_index(x + 1, y + 1, z + 1)],
-                    c->voxels[get_voxel_index(x, y + 1, z + 1)] };
-
-                s_update_chunk_mesh_voxel_pair(voxel_values, x, y, z, surface_level, mesh_vertices, &vertex_count);
-            }
+
+        ivector3_t brick = ivector3_t(b & 3, (b >> 2) & 3, b >> 4);
+        if (skip_empty_bricks && !chunk_brick_may_have_surface(c, brick)) {
+            continue;
         }
+
+        s_mesh_chunk_brick(apron, brick, mesh_edge_cells, surface_level, mesh_vertices, &vertex_count);
     }
 
+    brick_vertex_offsets[CHUNK_BRICK_COUNT] = vertex_count;
+
     return vertex_count;
 }
 
+uint32_t dr_generate_chunk_verts(uint8_t surface_level, const chunk_t *c, compressed_chunk_mesh_vertex_t *mesh_vertices) {
+    if (!mesh_vertices)
+        mesh_vertices = dr_get_tmp_mesh_verts();
+
+    uint32_t brick_vertex_offsets[CHUNK_BRICK_COUNT + 1];
+
+    return s_generate_chunk_verts(surface_level, c, ~0ull, NULL, NULL, mesh_vertices, brick_vertex_offsets);
+}
+
 void dr_update_chunk_draw_rsc(VkCommandBuffer command_buffer, uint8_t surface_level, chunk_t *c, compressed_chunk_mesh_vertex_t *mesh_vertices) {
     if (!mesh_vertices) {
         mesh_vertices = dr_get_tmp_mesh_verts();
     }
 
-    uint32_t vertex_count = dr_generate_chunk_verts(surface_level, c, mesh_vertices);
+    chunk_render_t *render = c->render;
+    uint64_t dirty_bricks = c->dirty_bricks;
+
+    // Chunks which got flagged without any dirty brick (or which don't have a mesh yet) get re-meshed entirely
+    if (!render || !dirty_bricks || render->surface_level != surface_level) {
+        dirty_bricks = ~0ull;
+    }
+
+    c->dirty_bricks = 0;
+
+    uint32_t brick_vertex_offsets[CHUNK_BRICK_COUNT + 1];
+    uint32_t vertex_count = s_generate_chunk_verts(
+        surface_level,
+        c,
+        dirty_bricks,
+        render ? render->vertices : NULL,
+        render ? render->brick_vertex_offsets : NULL,
+        mesh_vertices,
+        brick_vertex_offsets);
+
     if (vertex_count) {
         c->flags.active_vertices = 1;
 
@@ -358,15 +354,44 @@ void dr_update_chunk_draw_rsc(VkCommandBuffer command_buffer, uint8_t surface_le
             c->render = dr_chunk_render_init(c, space_chunk_to_world(c->chunk_coord));
         }
 
+        render = c->render;
+
+        // Vertices of the bricks before the first dirty brick didn't move - they are already on the GPU
+        uint32_t first_dirty_brick = 0;
+        while (!(dirty_bricks & (1ull << first_dirty_brick))) {
+            ++first_dirty_brick;
+        }
+
+        uint32_t first_changed_vertex = brick_vertex_offsets[first_dirty_brick];
+
+        if (render->vertex_capacity < vertex_count) {
+            if (render->vertices) {
+                FL_FREE(render->vertices);
+            }
+
+            render->vertex_capacity = vertex_count + vertex_count / 2;
+            render->vertices = FL_MALLOC(compressed_chunk_mesh_vertex_t, render->vertex_capacity);
+            memcpy(render->vertices, mesh_vertices, sizeof(compressed_chunk_mesh_vertex_t) * vertex_count);
+        }
+        else {
+            memcpy(
+                &render->vertices[first_changed_vertex],
+                &mesh_vertices[first_changed_vertex],
+                sizeof(compressed_chunk_mesh_vertex_t) * (vertex_count - first_changed_vertex));
+        }
+
+        memcpy(render->brick_vertex_offsets, brick_vertex_offsets, sizeof(brick_vertex_offsets));
+        render->surface_level = surface_level;
+
         static const uint32_t MAX_UPDATE_BUFFER_SIZE = 65536;
-        uint32_t update_size = vertex_count * sizeof(compressed_chunk_mesh_vertex_t);
+        uint32_t update_size = (vertex_count - first_changed_vertex) * sizeof(compressed_chunk_mesh_vertex_t);
 
         uint32_t loop_count = update_size / MAX_UPDATE_BUFFER_SIZE;
 
         typedef char copy_byte_t;
-        copy_byte_t *pointer = (copy_byte_t *)mesh_vertices;
+        copy_byte_t *pointer = (copy_byte_t *)&mesh_vertices[first_changed_vertex];
         uint32_t to_copy_left = update_size;
-        uint32_t copied = 0;
+        uint32_t copied = first_changed_vertex * sizeof(compressed_chunk_mesh_vertex_t);
         for (uint32_t i = 0; i < loop_count; ++i) {
             c->render->mesh.get_mesh_buffer(vk::BT_VERTEX)->gpu_buffer.update(
                 command_buffer,
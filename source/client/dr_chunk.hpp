@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vk.hpp>
+#include <common/constant.hpp>
 
 typedef vk::mesh_render_data_t chunk_render_data_t;
 
@@ -23,14 +24,21 @@ struct chunk_render_t {
 
     chunk_render_data_t render_data;
 
+    // CPU copy of the mesh (the vertices of brick b are in [brick_vertex_offsets[b], brick_vertex_offsets[b + 1]))
+    // When only some bricks are dirty, the vertices of the other bricks get copied from here instead of getting re-meshed
+    compressed_chunk_mesh_vertex_t *vertices;
+    uint32_t vertex_capacity;
+    uint32_t brick_vertex_offsets[CHUNK_BRICK_COUNT + 1];
+    uint8_t surface_level;
+
     uint32_t id;
 };
 
 // Temporary, just for refactoring
 chunk_render_t *dr_chunk_render_init(const struct chunk_t *c, const vector3_t &ws_position);
 void dr_destroy_chunk_render(chunk_render_t *render);
-uint32_t dr_generate_chunk_verts(uint8_t surface_level, const chunk_t *c, vector3_t *mesh_vertices);
-// Updates gpu buffers, etc...
+uint32_t dr_generate_chunk_verts(uint8_t surface_level, const struct chunk_t *c, compressed_chunk_mesh_vertex_t *mesh_vertices);
+// Updates gpu buffers, etc... (only the dirty bricks of the chunk get re-meshed, see chunk_t::dirty_bricks)
 void dr_update_chunk_draw_rsc(
     VkCommandBuffer command_buffer,
     uint8_t surface_level,
@@ -45,7 +45,6 @@ static void s_start_client(
     still_receiving_chunk_packets = 0;
     chunks_to_receive = 0;
 
-    memset(g_net_data.dummy_voxels, CHUNK_SPECIAL_VALUE, sizeof(g_net_data.dummy_voxels));
     main_udp_socket_init(GAME_OUTPUT_PORT_CLIENT);
     g_net_data.clients.init(NET_MAX_CLIENT_COUNT);
     started_client = 1;
@@ -124,6 +123,8 @@ static void s_receive_packet_connection_handshake(
     data->infos = FL_MALLOC(player_init_info_t, data->info_count);
 
     s_fill_enter_server_data(&handshake, data);
+    data->procedural_terrain = handshake.procedural_terrain;
+    data->terrain_seed = handshake.terrain_seed;
 
     submit_event(ET_ENTER_SERVER, data, events);
 
@@ -365,8 +366,10 @@ static void s_revert_history_instance(
 #if 0
             LOG_INFOV("(%i %i %i) Set voxel at index %i to %i\n", cm_ptr->x, cm_ptr->y, cm_ptr->z, vm_ptr->index, (int32_t)vm_ptr->initial_value);
 #endif
-            c_ptr->voxels[vm_ptr->index].value = vm_ptr->initial_value;
-            c_ptr->voxels[vm_ptr->index].color = cm_ptr->colors[vm_ptr->index];
+            voxel_t voxel;
+            voxel.value = vm_ptr->initial_value;
+            voxel.color = cm_ptr->colors[vm_ptr->index];
+            set_chunk_voxel(c_ptr, vm_ptr->index, voxel);
         }
 
         c_ptr->flags.has_to_update_vertices = 1;
@@ -427,7 +430,7 @@ static void s_correct_chunks(
 #if 0
             printf("(%i %i %i) Setting (%i) to %i\n", c_ptr->chunk_coord.x, c_ptr->chunk_coord.y, c_ptr->chunk_coord.z, vm_ptr->index, (int32_t)vm_ptr->final_value);
 #endif
-            c_ptr->voxels[vm_ptr->index].value = vm_ptr->final_value;
+            set_chunk_voxel_value(c_ptr, vm_ptr->index, vm_ptr->final_value);
         }
     }
 }
@@ -441,7 +444,7 @@ static void s_set_voxels_to_final_interpolated_values() {
 
         for (uint32_t vm_index = 0; vm_index < cm_ptr->modified_voxels_count; ++vm_index) {
             voxel_modification_t *vm_ptr = &cm_ptr->modifications[vm_index];
-            c_ptr->voxels[vm_ptr->index].value = vm_ptr->final_value;
+            set_chunk_voxel_value(c_ptr, vm_ptr->index, vm_ptr->final_value);
         }
 
         cm_ptr->modified_voxels_count = 0;
@@ -486,17 +489,16 @@ static void s_create_voxels_that_need_to_be_interpolated(
             uint32_t local_cm_index = c_ptr->flags.index_of_modification_struct;
             chunk_modifications_t *local_cm_ptr = &g_net_data.merged_recent_modifications.acc_predicted_modifications[local_cm_index];
             // Chunk was flagged as modified, need to check voxel per voxel if we need to push this to chunks to interpolate
-            fill_dummy_voxels(local_cm_ptr);
 
             uint32_t count = 0;
             for (uint32_t recv_vm_index = 0; recv_vm_index < recv_cm_ptr->modified_voxels_count; ++recv_vm_index) {
                 voxel_modification_t *recv_vm_ptr = &recv_cm_ptr->modifications[recv_vm_index];
-                if (g_net_data.dummy_voxels[recv_vm_ptr->index] == CHUNK_SPECIAL_VALUE) {
-                    if (recv_vm_ptr->final_value != c_ptr->voxels[recv_vm_ptr->index].value) {
+                if (find_voxel_modification(local_cm_ptr, recv_vm_ptr->index) == -1) {
+                    if (recv_vm_ptr->final_value != get_chunk_voxel(c_ptr, recv_vm_ptr->index).value) {
                         // Was not modified, can push this
                         dst_cm_ptr->modifications[dst_cm_ptr->modified_voxels_count].index = recv_vm_ptr->index;
                         // Initial value is current value of voxel
-                        dst_cm_ptr->modifications[dst_cm_ptr->modified_voxels_count].initial_value = c_ptr->voxels[recv_vm_ptr->index].value;
+                        dst_cm_ptr->modifications[dst_cm_ptr->modified_voxels_count].initial_value = get_chunk_voxel(c_ptr, recv_vm_ptr->index).value;
                         dst_cm_ptr->modifications[dst_cm_ptr->modified_voxels_count++].final_value = recv_vm_ptr->final_value;
                         ++count;
                     }
@@ -511,8 +513,6 @@ static void s_create_voxels_that_need_to_be_interpolated(
             if (count) {
                 ++cti_ptr->modification_count;
             }
-
-            unfill_dummy_voxels(local_cm_ptr);
         }
         else {
             // Simple push this to chunks to interpolate
@@ -532,7 +532,7 @@ static void s_create_voxels_that_need_to_be_interpolated(
                     voxel_modification_t *dst_vm_ptr = &dst_cm_ptr->modifications[vm_index];
                     voxel_modification_t *recv_vm_ptr = &recv_cm_ptr->modifications[vm_index];
                     dst_vm_ptr->index = recv_vm_ptr->index;
-                    dst_vm_ptr->initial_value = c_ptr->voxels[recv_vm_ptr->index].value;
+                    dst_vm_ptr->initial_value = get_chunk_voxel(c_ptr, recv_vm_ptr->index).value;
                     dst_vm_ptr->final_value = recv_vm_ptr->final_value;
                 }
             }
@@ -645,9 +645,11 @@ static void s_handle_incorrect_state(
                 chunk_t *c_ptr = g_game->get_chunk(ivector3_t(cm_ptr->x, cm_ptr->y, cm_ptr->z));
                 for (uint32_t vm_index = 0; vm_index < cm_ptr->modified_voxels_count; ++vm_index) {
                     voxel_modification_t *vm_ptr = &cm_ptr->modifications[vm_index];
-                    c_ptr->voxels[vm_ptr->index].value = vm_ptr->final_value;
+                    voxel_t voxel;
+                    voxel.value = vm_ptr->final_value;
                     // Color will not be stored in the separate color array
-                    c_ptr->voxels[vm_ptr->index].color = vm_ptr->color;
+                    voxel.color = vm_ptr->color;
+                    set_chunk_voxel(c_ptr, vm_ptr->index, voxel);
                 }
             }
         }
@@ -664,8 +666,10 @@ static void s_handle_incorrect_state(
 
             for (uint32_t v_index = 0; v_index < cm_ptr->modified_voxels_count; ++v_index) {
                 voxel_modification_t *vm_ptr = &cm_ptr->modifications[v_index];
-                c_ptr->voxels[vm_ptr->index].value = vm_ptr->final_value;
-                c_ptr->voxels[vm_ptr->index].color = vm_ptr->color;
+                voxel_t voxel;
+                voxel.value = vm_ptr->final_value;
+                voxel.color = vm_ptr->color;
+                set_chunk_voxel(c_ptr, vm_ptr->index, voxel);
             }
         }
     }
@@ -816,10 +820,13 @@ static void s_receive_packet_chunk_voxels(
     event_submissions_t *events) {
     uint32_t loaded_chunk_count = serialiser->deserialise_uint32();
 
+    chunk_coord_packer_t packer = {};
+
     for (uint32_t c = 0; c < loaded_chunk_count; ++c) {
-        int16_t x = serialiser->deserialise_int16();
-        int16_t y = serialiser->deserialise_int16();
-        int16_t z = serialiser->deserialise_int16();
+        ivector3_t chunk_coord = deserialise_chunk_coord(&packer, serialiser);
+        int32_t x = chunk_coord.x;
+        int32_t y = chunk_coord.y;
+        int32_t z = chunk_coord.z;
 
         chunk_t *chunk = g_game->get_chunk(ivector3_t(x, y, z));
         chunk->flags.has_to_update_vertices = 1;
@@ -844,36 +851,12 @@ static void s_receive_packet_chunk_voxels(
         g_game->get_chunk(ivector3_t(x - 1, y - 1, z - 1))->flags.has_to_update_vertices = 1;
 #endif
         
-        for (uint32_t v = 0; v < CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH;) {
-            uint8_t current_value = serialiser->deserialise_uint8();
-            uint8_t current_color = serialiser->deserialise_uint8();
-
-            if (current_value == CHUNK_SPECIAL_VALUE) {
-                chunk->voxels[v].value = 0;
-                chunk->voxels[v].color = 0;
-                ++v;
-
-                // Repeating zeros
-                uint32_t zero_count = serialiser->deserialise_uint32();
-                chunk->voxels[v + 1].value = 0;
-                chunk->voxels[v + 1].color = 0;
-                chunk->voxels[v + 2].value = 0;
-                chunk->voxels[v + 2].color = 0;
-
-                v += 2;
-
-                uint32_t previous_v = v;
-                for (; v < previous_v + zero_count - 3; ++v) {
-                    chunk->voxels[v].value = 0;
-                    chunk->voxels[v].color = 0;
-                }
-            }
-            else {
-                chunk->voxels[v].value = current_value;
-                chunk->voxels[v].color = current_color;
-                ++v;
-            }
-        }
+        // Overwrites every voxel (with procedural terrain, the chunk may already have been generated)
+        voxel_t *voxels = get_chunk_voxels_for_write(chunk);
+        deserialise_map_chunk_voxels(serialiser, voxels);
+
+        reorder_linear_chunk_voxels(voxels);
+        compress_chunk_storage(chunk);
     }
 
     uint32_t loaded;
@@ -61,43 +61,54 @@ void wd_tick(event_submissions_t *events) {
     { // Local and remote projectiles (basically predicting the state)
         player_t *local_player = g_game->get_player(wd_get_local_player());
 
-        for (uint32_t i = 0; i < g_game->rocks.list.data_count; ++i) {
-            rock_t *rock = &g_game->rocks.list[i];
+        rock_store_t *rocks = &g_game->rocks;
+        update_player_broadphase();
 
-            if (rock->flags.active) {
-                int32_t player_local_id;
-                bool collided_with_player = check_projectile_players_collision(rock, &player_local_id);
-                bool collided_with_terrain = check_projectile_terrain_collision(rock);
+        bool *rock_terrain_hits = LN_MALLOC(bool, rocks->count);
+        check_projectiles_terrain_collision(rocks, rock_terrain_hits);
 
-                if (collided_with_player) {
-                    // Player need to get dealt some DAMAGE MOUAHAHAH
-                    player_t *dst_player = g_game->get_player(player_local_id);
-                    dst_player->health -= rock_t::DIRECT_DAMAGE;
+        // Removed after the checks (removing a rock moves the last one into its place)
+        uint32_t *hit_rocks = LN_MALLOC(uint32_t, rocks->count);
+        uint32_t hit_rock_count = 0;
 
-                    if (rock->client_id == local_player->client_id) {
-                        // Add this player to the list of players that have been hit
-                        // So that the server can check whether or not the client actually got hit
-                        wd_add_predicted_projectile_hit(dst_player);
+        for (uint32_t i = 0; i < rocks->count; ++i) {
+            rock_t rock = rocks->get(i);
 
-                        uint32_t weapon_idx = rock->flags.ref_idx_weapon;
-                        uint32_t ref_idx = rock->flags.ref_idx_obj;
+            int32_t player_local_id;
+            bool collided_with_player = check_projectile_players_collision(&rock, &player_local_id);
+            bool collided_with_terrain = rock_terrain_hits[i];
 
-                        local_player->weapons[weapon_idx].active_projs[ref_idx].initialised = 0;
-                        local_player->weapons[weapon_idx].active_projs.remove(ref_idx);
-                    }
+            if (collided_with_player) {
+                // Player need to get dealt some DAMAGE MOUAHAHAH
+                player_t *dst_player = g_game->get_player(player_local_id);
+                dst_player->health -= rock_t::DIRECT_DAMAGE;
 
-                    rock->flags.active = 0;
-                    g_game->rocks.list.remove(i);
-                }
-                else if (collided_with_terrain) {
-                    // Make sure that players within radius get damage
-                    rock->flags.active = 0;
-                    g_game->rocks.list.remove(i);
+                if (rock.client_id == local_player->client_id) {
+                    // Add this player to the list of players that have been hit
+                    // So that the server can check whether or not the client actually got hit
+                    wd_add_predicted_projectile_hit(dst_player);
+
+                    uint32_t weapon_idx = rock.flags.ref_idx_weapon;
+                    uint32_t ref_idx = rock.flags.ref_idx_obj;
+
+                    local_player->weapons[weapon_idx].active_projs[ref_idx].initialised = 0;
+                    local_player->weapons[weapon_idx].active_projs.remove(ref_idx);
                 }
 
-                tick_rock(rock, g_game->dt);
+                hit_rocks[hit_rock_count++] = i;
+            }
+            else if (collided_with_terrain) {
+                // Make sure that players within radius get damage
+                hit_rocks[hit_rock_count++] = i;
             }
         }
+
+        // Backwards, so that the rocks which still need to be removed don't move
+        for (uint32_t i = hit_rock_count; i > 0; --i) {
+            rocks->remove(hit_rocks[i - 1]);
+        }
+
+        rocks->integrate(g_game->dt);
     }
 }
 
@@ -128,4 +139,10 @@ void wd_clear_world() {
     }
 
     g_game->clear_chunks();
+
+    // Only set if the server uses procedural terrain (the chunks of map files come from the server)
+    if (g_game->current_map_data) {
+        unload_map(g_game->current_map_data);
+        g_game->current_map_data = NULL;
+    }
 }
@@ -32,6 +32,13 @@ static void s_handle_event_enter_server(
 
     event_enter_server_t *data = (event_enter_server_t *)event->data;
 
+    if (data->procedural_terrain) {
+        // Server only sends the chunks which differ from the generated ones
+        g_game->configure_procedural_terrain(data->terrain_seed);
+        g_game->current_map_data = begin_procedural_terrain("client");
+        load_all_terrain_chunks();
+    }
+
     for (uint32_t i = 0; i < data->info_count; ++i) {
         player_t *player = g_game->add_player();
         fill_player_info(player, &data->infos[i]);
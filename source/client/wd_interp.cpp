@@ -23,8 +23,7 @@ void wd_finish_interp_step() {
         c_ptr->flags.has_to_update_vertices = 1;
         for (uint32_t vm_index = 0; vm_index < cm_ptr->modified_voxels_count; ++vm_index) {
             voxel_modification_t *vm_ptr = &cm_ptr->modifications[vm_index];
-            voxel_t *current_value = &c_ptr->voxels[vm_ptr->index];
-            current_value->value = vm_ptr->final_value;
+            set_chunk_voxel_value(c_ptr, vm_ptr->index, vm_ptr->final_value);
         }
 
         cm_ptr->modified_voxels_count = 0;
@@ -48,8 +47,7 @@ void wd_chunks_interp_step(float dt) {
         c_ptr->flags.has_to_update_vertices = 1;
         for (uint32_t vm_index = 0; vm_index < cm_ptr->modified_voxels_count; ++vm_index) {
             voxel_modification_t *vm_ptr = &cm_ptr->modifications[vm_index];
-            voxel_t *current_value = &c_ptr->voxels[vm_ptr->index];
-            float fcurrent_value = (float)(current_value->value);
+            float fcurrent_value = (float)(get_chunk_voxel(c_ptr, vm_ptr->index).value);
             float initial_value = (float)(vm_ptr->initial_value);
             float final_value = (float)(vm_ptr->final_value);
 
@@ -60,7 +58,7 @@ void wd_chunks_interp_step(float dt) {
             else if (fcurrent_value > 254.0f) {
                 fcurrent_value = 254.0f;
             }
-            current_value->value = (uint8_t)fcurrent_value;
+            set_chunk_voxel_value(c_ptr, vm_ptr->index, (uint8_t)fcurrent_value);
         }
     }
 }
@@ -95,6 +95,8 @@ void wd_handle_local_player_input(float dt) {
 }
 
 void wd_execute_player_actions(player_t *player, event_submissions_t *events) {
+    begin_player_terraform_commands();
+
     for (uint32_t i = 0; i < player->player_action_count; ++i) {
         player_action_t *action = &player->player_actions[i];
 
@@ -137,6 +139,8 @@ void wd_execute_player_actions(player_t *player, event_submissions_t *events) {
     }
 
     player->player_action_count = 0;
+
+    apply_terraform_commands();
 }
 
 void wd_predict_state(event_submissions_t *events) {
@@ -1,4 +1,10 @@
 #include "allocators.hpp"
+#include "log.hpp"
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 void arena_allocator_t::pool_init(
     uint32_t asize,
@@ -63,6 +69,160 @@ void arena_allocator_t::free_pool() {
     free(pool);
 }
 
+static const uint32_t PAGE_SIZE = 4096;
+static const uint32_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static uint32_t s_align_up(
+    uint32_t value,
+    uint32_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static uint8_t *s_allocate_slab(
+    uint32_t size,
+    bool huge_pages) {
+#if defined(__linux__)
+    void *p = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+    if (huge_pages) {
+        // Only works if the system has huge pages reserved
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+#if defined(MADV_HUGEPAGE)
+        if (p != MAP_FAILED && huge_pages) {
+            // Fall back to transparent huge pages
+            madvise(p, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    return (p == MAP_FAILED) ? NULL : (uint8_t *)p;
+#else
+    (void)huge_pages;
+    // Extra space to be able to align the first object
+    return (uint8_t *)malloc(size + slab_allocator_t::OBJECT_ALIGNMENT);
+#endif
+}
+
+static void s_free_slab(
+    uint8_t *slab,
+    uint32_t size) {
+#if defined(__linux__)
+    munmap(slab, size);
+#else
+    (void)size;
+    free(slab);
+#endif
+}
+
+void slab_allocator_t::init(
+    uint32_t osize,
+    uint32_t count_per_slab,
+    bool huge_pages) {
+    object_size = s_align_up(osize, OBJECT_ALIGNMENT);
+    use_huge_pages = huge_pages;
+    slab_size = s_align_up(object_size * count_per_slab, use_huge_pages ? HUGE_PAGE_SIZE : PAGE_SIZE);
+    objects_per_slab = slab_size / object_size;
+
+    slab_count = 0;
+    max_slab_count = 8;
+    slabs = FL_MALLOC(uint8_t *, max_slab_count);
+
+    bump = bump_end = NULL;
+    head = NULL;
+
+    allocated_count = 0;
+    peak_allocated_count = 0;
+}
+
+void *slab_allocator_t::allocate() {
+    void *p;
+
+    if (head) {
+        // Reuse the most recently freed object
+        p = head;
+        head = head->next;
+    }
+    else {
+        if (bump == bump_end) {
+            uint8_t *slab = s_allocate_slab(slab_size, use_huge_pages);
+
+            if (!slab) {
+                LOG_ERROR("Failed to allocate slab\n");
+                return NULL;
+            }
+
+            if (slab_count == max_slab_count) {
+                uint8_t **new_slabs = FL_MALLOC(uint8_t *, max_slab_count * 2);
+                memcpy(new_slabs, slabs, sizeof(uint8_t *) * max_slab_count);
+                FL_FREE(slabs);
+                slabs = new_slabs;
+                max_slab_count *= 2;
+            }
+
+            slabs[slab_count++] = slab;
+
+            bump = (uint8_t *)(((uintptr_t)slab + OBJECT_ALIGNMENT - 1) & ~(uintptr_t)(OBJECT_ALIGNMENT - 1));
+            bump_end = bump + objects_per_slab * object_size;
+        }
+
+        p = bump;
+        bump += object_size;
+    }
+
+    ++allocated_count;
+    if (allocated_count > peak_allocated_count) {
+        peak_allocated_count = allocated_count;
+    }
+
+    return p;
+}
+
+void slab_allocator_t::free(
+    void *pointer) {
+    if (pointer) {
+        free_arena_header_t *header = (free_arena_header_t *)pointer;
+        header->next = head;
+        head = header;
+
+        --allocated_count;
+    }
+}
+
+void slab_allocator_t::destroy() {
+    for (uint32_t i = 0; i < slab_count; ++i) {
+        s_free_slab(slabs[i], slab_size);
+    }
+
+    FL_FREE(slabs);
+    slabs = NULL;
+
+    slab_count = 0;
+    max_slab_count = 0;
+    bump = bump_end = NULL;
+    head = NULL;
+    allocated_count = 0;
+}
+
+slab_allocator_stats_t slab_allocator_t::stats() const {
+    slab_allocator_stats_t s = {};
+    s.slab_count = slab_count;
+    s.slab_size = slab_size;
+    s.object_size = object_size;
+    s.capacity = slab_count * objects_per_slab;
+    s.allocated_count = allocated_count;
+    s.peak_allocated_count = peak_allocated_count;
+    s.huge_pages = use_huge_pages;
+
+    return s;
+}
+
 void linear_allocator_t::init(
     uint32_t msize) {
     max_size = msize;
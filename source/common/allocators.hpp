@@ -38,6 +38,56 @@ struct arena_allocator_t {
     void free_pool();
 };
 
+struct slab_allocator_stats_t {
+    uint32_t slab_count;
+    uint32_t slab_size;
+    uint32_t object_size;
+    uint32_t capacity;
+    uint32_t allocated_count;
+    uint32_t peak_allocated_count;
+    bool huge_pages;
+};
+
+// Fixed size object pool - objects get carved out of big, contiguous slabs (64 byte aligned)
+// Freed objects go onto an intrusive free list so that allocate / free are O(1)
+struct slab_allocator_t {
+    enum { OBJECT_ALIGNMENT = 64 };
+
+    uint32_t object_size;
+    uint32_t slab_size;
+    uint32_t objects_per_slab;
+    bool use_huge_pages;
+
+    uint32_t slab_count;
+    uint32_t max_slab_count;
+    uint8_t **slabs;
+
+    // Next object in the latest slab which was never handed out
+    uint8_t *bump;
+    uint8_t *bump_end;
+
+    free_arena_header_t *head;
+
+    uint32_t allocated_count;
+    uint32_t peak_allocated_count;
+
+    // If huge_pages is set, slabs are 2MB aligned and huge page backed (if the OS allows it)
+    void init(
+        uint32_t object_size,
+        uint32_t objects_per_slab,
+        bool huge_pages);
+
+    void *allocate();
+
+    void free(
+        void *pointer);
+
+    // Frees all the slabs at once (all objects become invalid)
+    void destroy();
+
+    slab_allocator_stats_t stats() const;
+};
+
 struct linear_allocator_t {
     void *start;
     void *current;
@@ -3,6 +3,13 @@
 #include "chunk.hpp"
 #include "constant.hpp"
 #include "containers.hpp"
+#include "thread_pool.hpp"
+#include "terraform_kernel.hpp"
+#include "collision_kernel.hpp"
+#include <math.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
 
 ivector3_t space_world_to_voxel(const vector3_t &ws_position) {
     return (ivector3_t)(glm::floor(ws_position));
@@ -25,10 +32,6 @@ ivector3_t space_voxel_to_local_chunk(const ivector3_t &vs_position) {
     return (ivector3_t)(from_origin - xs_sized * (float)CHUNK_EDGE_LENGTH);
 }
 
-uint32_t get_voxel_index(uint32_t x, uint32_t y, uint32_t z) {
-    return z * (CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH) + y * CHUNK_EDGE_LENGTH + x;
-}
-
 enum { B8_R_MAX = 0b111, B8_G_MAX = 0b111, B8_B_MAX = 0b11 };
 
 vector3_t b8_color_to_v3(voxel_color_t color) {
@@ -65,394 +68,1915 @@ void chunk_init(chunk_t *chunk, uint32_t chunk_stack_index, const ivector3_t &ch
     chunk->flags.active_vertices = 0;
     chunk->flags.modified_marker = 0;
     chunk->flags.index_of_modification_struct = 0;
+    chunk->flags.needs_flush = 0;
+    chunk->last_used_tick = 0;
+
+    // Chunks start off empty
+    chunk->storage = CS_UNIFORM;
+    chunk->uniform_voxel.value = 0;
+    chunk->uniform_voxel.color = 0;
+    chunk->voxels = NULL;
+    chunk->palette = NULL;
+
+    memset(chunk->brick_solid_counts, 0, sizeof(chunk->brick_solid_counts));
+    chunk->solid_bricks = 0;
+    chunk->air_bricks = ~0ull;
+    chunk->dirty_bricks = ~0ull;
+    chunk->collision_dirty_bricks = ~0ull;
+
+    for (uint32_t i = 0; i < 27; ++i) {
+        chunk->neighbours[i] = NULL;
+    }
 
-    memset(chunk->voxels, 0, sizeof(voxel_t) * CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH);
+    chunk->neighbours[get_chunk_neighbour_index(0, 0, 0)] = chunk;
+    chunk->apron = NULL;
+    chunk->collision_mesh = NULL;
 
-    chunk->history.modification_count = 0;
-    memset(chunk->history.modification_pool, CHUNK_SPECIAL_VALUE, CHUNK_VOXEL_COUNT);
+    chunk->history = NULL;
 
     chunk->render = NULL;
 
     chunk->players_in_chunk.init();
 }
 
-void destroy_chunk(chunk_t *chunk) {
-    chunk->players_in_chunk.destroy();
-
-    FL_FREE(chunk);
+uint32_t chunk_palette_size(uint32_t bits) {
+    return offsetof(chunk_palette_t, entries) + sizeof(voxel_t) * (1 << bits) + CHUNK_VOXEL_COUNT * bits / 8;
 }
 
-uint32_t hash_chunk_coord(
-    const ivector3_t &coord) {
-    // static std::hash<glm::ivec3> hasher;
-
-    // TODO: Investigate if this is portable to different systems (endianness??)
-    struct {
-        union {
-            struct {
-                uint32_t padding: 2;
-                uint32_t x: 10;
-                uint32_t y: 10;
-                uint32_t z: 10;
-            };
-            uint32_t value;
-        };
-    } hasher;
-
-    hasher.value = 0;
+// 1, 2, 4, 8 -> 0, 1, 2, 3
+static uint32_t s_palette_allocator_index(uint32_t bits) {
+    return (bits >> 1) - (bits >> 3);
+}
 
-    hasher.x = *(uint32_t *)(&coord.x);
-    hasher.y = *(uint32_t *)(&coord.y);
-    hasher.z = *(uint32_t *)(&coord.z);
+static chunk_palette_t *s_allocate_palette(uint32_t bits) {
+    chunk_palette_t *palette = (chunk_palette_t *)g_game->palette_allocators[s_palette_allocator_index(bits)].allocate();
+    palette->count = 0;
+    palette->bits = bits;
 
-    return (uint32_t)hasher.value;
+    return palette;
 }
 
-template <typename T>
-static void s_iterate_3d(
-    const ivector3_t &center,
-    uint32_t radius,
-    T to_apply) {
-    int32_t start_z = center.z - (int32_t)radius;
-    int32_t start_y = center.y - (int32_t)radius;
-    int32_t start_x = center.x - (int32_t)radius;
+static void s_free_palette(chunk_palette_t *palette) {
+    g_game->palette_allocators[s_palette_allocator_index(palette->bits)].free(palette);
+}
 
-    int32_t diameter = (int32_t)radius * 2 + 1;
+// Fast path for decoding a whole chunk (mesher, serialiser) - the bit width is known at compile time
+template <uint32_t BITS> static void s_decode_palette(const chunk_palette_t *palette, voxel_t *dst) {
+    const uint8_t *indices = get_palette_indices(palette);
+    const uint32_t per_byte = 8 / BITS;
+    const uint32_t mask = (1 << BITS) - 1;
 
-    for (int32_t z = start_z; z < start_z + diameter; ++z) {
-        for (int32_t y = start_y; y < start_y + diameter; ++y) {
-            for (int32_t x = start_x; x < start_x + diameter; ++x) {
-                to_apply(x, y, z);
-            }
+    for (uint32_t b = 0; b < CHUNK_VOXEL_COUNT / per_byte; ++b) {
+        uint32_t byte = indices[b];
+        for (uint32_t i = 0; i < per_byte; ++i) {
+            *(dst++) = palette->entries[(byte >> (i * BITS)) & mask];
         }
     }
 }
 
-void generate_hollow_sphere(
-    const vector3_t &ws_center,
-    float ws_radius,
-    float max_value,
-    generation_type_t type,
-    voxel_color_t color) {
-    float (* generation_proc)(float distance_squared, float radius_squared);
-    switch(type) {
-    case GT_ADDITIVE: {
-        generation_proc =
-            [] (float distance_squared, float radius_squared) {
-                float diff = abs(distance_squared - radius_squared);
-                if (diff < 120.0f) {
-                    return 1.0f - (diff / 120.0f);
-                }
-                else {
-                    return 0.0f;
-                }
-            };
-    } break;
+static void s_decode_palette(const chunk_palette_t *palette, voxel_t *dst) {
+    switch (palette->bits) {
+    case 1: s_decode_palette<1>(palette, dst); break;
+    case 2: s_decode_palette<2>(palette, dst); break;
+    case 4: s_decode_palette<4>(palette, dst); break;
+    case 8: s_decode_palette<8>(palette, dst); break;
+    }
+}
 
-    case GT_DESTRUCTIVE: {
-        generation_proc =
-            [] (float distance_squared, float radius_squared) {
-                return 0.0f;
-            };
+static void s_set_palette_index(chunk_palette_t *palette, uint32_t voxel_index, uint32_t palette_index) {
+    uint8_t *indices = get_palette_indices(palette);
+    uint32_t bit = voxel_index * palette->bits;
+    uint32_t mask = ((1 << palette->bits) - 1) << (bit & 7);
+    indices[bit >> 3] = (indices[bit >> 3] & ~mask) | (palette_index << (bit & 7));
+}
 
-    } break;
+// Returns -1 if the voxel isn't in the palette
+static int32_t s_find_palette_entry(const chunk_palette_t *palette, voxel_t voxel) {
+    for (uint32_t i = 0; i < palette->count; ++i) {
+        if (palette->entries[i] == voxel) {
+            return i;
+        }
     }
 
-    ivector3_t vs_center = space_world_to_voxel(ws_center);
-    vector3_t vs_float_center = (vector3_t)(vs_center);
+    return -1;
+}
 
-    ivector3_t current_chunk_coord = space_voxel_to_chunk(vs_center);
+// Builds a palette from an array of voxels whose distinct values are already known
+static chunk_palette_t *s_encode_palette(const voxel_t *voxels, const voxel_t *distinct, uint32_t distinct_count) {
+    uint32_t bits = 1;
+    while ((1u << bits) < distinct_count) {
+        bits <<= 1;
+    }
 
-    chunk_t *current_chunk = g_game->get_chunk(
-        current_chunk_coord);
+    chunk_palette_t *palette = s_allocate_palette(bits);
+    palette->count = distinct_count;
+    memcpy(palette->entries, distinct, sizeof(voxel_t) * distinct_count);
 
-    current_chunk->flags.has_to_update_vertices = 1;
+    uint8_t *indices = get_palette_indices(palette);
+    memset(indices, 0, CHUNK_VOXEL_COUNT * bits / 8);
 
-    int32_t diameter = (int32_t)ws_radius * 2 + 1;
+    // Runs of identical voxels are very common - avoid searching the palette for each voxel
+    voxel_t previous = palette->entries[0];
+    uint32_t previous_index = 0;
+    for (uint32_t i = 0; i < CHUNK_VOXEL_COUNT; ++i) {
+        if (voxels[i] != previous) {
+            previous = voxels[i];
+            previous_index = s_find_palette_entry(palette, previous);
+        }
 
-    int32_t start_z = vs_center.z - (int32_t)ws_radius;
-    int32_t start_y = vs_center.y - (int32_t)ws_radius;
-    int32_t start_x = vs_center.x - (int32_t)ws_radius;
+        uint32_t bit = i * bits;
+        indices[bit >> 3] |= previous_index << (bit & 7);
+    }
 
-    float radius_squared = ws_radius * ws_radius;
-    float smaller_radius_squared = (ws_radius - 10) * (ws_radius - 10);
+    return palette;
+}
 
-    for (int32_t z = start_z; z < start_z + diameter; ++z) {
-        for (int32_t y = start_y; y < start_y + diameter; ++y) {
-            for (int32_t x = start_x; x < start_x + diameter; ++x) {
-                ivector3_t vs_position = ivector3_t(x, y, z);
-                vector3_t vs_float = vector3_t((float)x, (float)y, (float)z);
-                vector3_t vs_diff_float = vs_float - vs_float_center;
+// Palette ran out of entries: re-encode with twice as many bits per voxel
+static chunk_palette_t *s_widen_palette(chunk_palette_t *palette) {
+    chunk_palette_t *wider = s_allocate_palette(palette->bits * 2);
+    wider->count = palette->count;
+    memcpy(wider->entries, palette->entries, sizeof(voxel_t) * palette->count);
+    memset(get_palette_indices(wider), 0, CHUNK_VOXEL_COUNT * wider->bits / 8);
 
-                float distance_squared = glm::dot(vs_diff_float, vs_diff_float);
+    for (uint32_t i = 0; i < CHUNK_VOXEL_COUNT; ++i) {
+        s_set_palette_index(wider, i, get_palette_index(palette, i));
+    }
 
-                if (distance_squared <= radius_squared) {
-                    ivector3_t c = space_voxel_to_chunk(vs_position);
+    s_free_palette(palette);
 
-                    ivector3_t chunk_origin_diff = vs_position - current_chunk_coord * (int32_t)CHUNK_EDGE_LENGTH;
-                    if (chunk_origin_diff.x >= 0 && chunk_origin_diff.x < 16 &&
-                        chunk_origin_diff.y >= 0 && chunk_origin_diff.y < 16 &&
-                        chunk_origin_diff.z >= 0 && chunk_origin_diff.z < 16) {
-                        // Is within current chunk boundaries
-                        float proportion = generation_proc(distance_squared, smaller_radius_squared);
+    return wider;
+}
 
-                        ivector3_t voxel_coord = chunk_origin_diff;
+// Mask of the bricks in [lo, hi] (brick coordinates, inclusive)
+static uint64_t s_brick_box_mask(const ivector3_t &lo, const ivector3_t &hi) {
+    uint64_t row = ((1ull << (hi.x - lo.x + 1)) - 1) << lo.x;
+    uint64_t mask = 0;
 
-                        voxel_t *v = &current_chunk->voxels[get_voxel_index(voxel_coord.x, voxel_coord.y, voxel_coord.z)];
-                        uint8_t new_value = (uint32_t)((proportion) * max_value);
-                        if (v->value < new_value) {
-                            v->value = new_value;
-                            v->color = color;
-                        }
+    for (int32_t z = lo.z; z <= hi.z; ++z) {
+        for (int32_t y = lo.y; y <= hi.y; ++y) {
+            mask |= row << (y * 4 + z * 16);
+        }
+    }
+
+    return mask;
+}
+
+// Bricks on the +x / +y / +z faces of the chunks at -1 (their last cells read the voxels of this chunk)
+static void s_mark_lower_neighbours_dirty(chunk_t *chunk) {
+    for (int32_t z = -1; z <= 0; ++z) {
+        for (int32_t y = -1; y <= 0; ++y) {
+            for (int32_t x = -1; x <= 0; ++x) {
+                chunk_t *neighbour = get_chunk_neighbour(chunk, x, y, z);
+
+                if ((x || y || z) && neighbour) {
+                    ivector3_t lo = ivector3_t(x, y, z) * -(CHUNK_EDGE_LENGTH / CHUNK_BRICK_EDGE_LENGTH - 1);
+                    mark_chunk_bricks_dirty(neighbour, s_brick_box_mask(lo, ivector3_t(CHUNK_EDGE_LENGTH / CHUNK_BRICK_EDGE_LENGTH - 1)));
+                    neighbour->flags.has_to_update_vertices = 1;
+                }
+            }
+        }
+    }
+}
+
+void link_chunk_neighbours(chunk_t *chunk) {
+    for (int32_t z = -1; z <= 1; ++z) {
+        for (int32_t y = -1; y <= 1; ++y) {
+            for (int32_t x = -1; x <= 1; ++x) {
+                if (x || y || z) {
+                    // Non-resident neighbours don't get paged in, they link themselves when they are
+                    chunk_t *neighbour = g_game->access_resident_chunk(chunk->chunk_coord + ivector3_t(x, y, z));
+                    chunk->neighbours[get_chunk_neighbour_index(x, y, z)] = neighbour;
+
+                    if (neighbour) {
+                        neighbour->neighbours[get_chunk_neighbour_index(-x, -y, -z)] = chunk;
                     }
-                    else {
-                        ivector3_t c = space_voxel_to_chunk(vs_position);
+                }
+            }
+        }
+    }
 
-                        // In another chunk, need to switch current_chunk pointer
-                        current_chunk = g_game->get_chunk(c);
-                        current_chunk_coord = c;
+    // Halos which used to be outside of the world are now inside this chunk
+    invalidate_all_chunk_aprons(chunk);
+    // Cells of the chunks at -1 which touch this chunk can now be meshed
+    s_mark_lower_neighbours_dirty(chunk);
+}
 
-                        current_chunk->flags.has_to_update_vertices = 1;
+void destroy_chunk(chunk_t *chunk) {
+    chunk->players_in_chunk.destroy();
 
-                        float proportion = generation_proc(distance_squared, smaller_radius_squared);
+    invalidate_all_chunk_aprons(chunk);
+    s_mark_lower_neighbours_dirty(chunk);
 
-                        ivector3_t voxel_coord = vs_position - current_chunk_coord * CHUNK_EDGE_LENGTH;
+    if (chunk->collision_mesh) {
+        chunk->collision_mesh->owner = NULL;
+        chunk->collision_mesh = NULL;
+    }
 
-                        voxel_t *v = &current_chunk->voxels[get_voxel_index(voxel_coord.x, voxel_coord.y, voxel_coord.z)];
-                        uint8_t new_value = (uint32_t)((proportion) * max_value);
-                        if (v->value < new_value) {
-                            v->value = new_value;
-                            v->color = color;
-                        }
-                    }
+    // Make sure the surrounding chunks don't point to freed memory
+    for (int32_t z = -1; z <= 1; ++z) {
+        for (int32_t y = -1; y <= 1; ++y) {
+            for (int32_t x = -1; x <= 1; ++x) {
+                chunk_t *neighbour = get_chunk_neighbour(chunk, x, y, z);
+
+                if (neighbour && neighbour != chunk) {
+                    neighbour->neighbours[get_chunk_neighbour_index(-x, -y, -z)] = NULL;
                 }
             }
         }
     }
+
+    if (chunk->history) {
+        deactivate_chunk_history(chunk);
+    }
+
+    if (chunk->voxels) {
+        g_game->voxel_allocator.free(chunk->voxels);
+        chunk->voxels = NULL;
+    }
+
+    if (chunk->palette) {
+        s_free_palette(chunk->palette);
+        chunk->palette = NULL;
+    }
+
+    g_game->chunk_allocator.free(chunk);
 }
 
-void generate_sphere(
-    const vector3_t &ws_center,
-    float ws_radius,
-    float max_value,
-    generation_type_t type,
-    voxel_color_t color) {
-    float (* generation_proc)(float distance_squared, float radius_squared);
-    switch(type) {
-    case GT_ADDITIVE: {
-        generation_proc =
-            [] (float distance_squared, float radius_squared) {
-                return 1.0f - (distance_squared / radius_squared);
-            };
-    } break;
+void make_chunk_dense(chunk_t *chunk) {
+    if (chunk->storage == CS_UNIFORM) {
+        chunk->voxels = (voxel_t *)g_game->voxel_allocator.allocate();
 
-    case GT_DESTRUCTIVE: {
-        generation_proc =
-            [] (float distance_squared, float radius_squared) {
-                return 0.0f;
-            };
+        for (uint32_t i = 0; i < CHUNK_VOXEL_COUNT; ++i) {
+            chunk->voxels[i] = chunk->uniform_voxel;
+        }
 
-    } break;
+        chunk->storage = CS_DENSE;
     }
+    else if (chunk->storage == CS_PALETTE) {
+        chunk->voxels = (voxel_t *)g_game->voxel_allocator.allocate();
+        s_decode_palette(chunk->palette, chunk->voxels);
 
-    ivector3_t vs_center = space_world_to_voxel(ws_center);
-    vector3_t vs_float_center = (vector3_t)(vs_center);
+        s_free_palette(chunk->palette);
+        chunk->palette = NULL;
 
-    ivector3_t current_chunk_coord = space_voxel_to_chunk(vs_center);
+        chunk->storage = CS_DENSE;
+    }
+}
 
-    chunk_t *current_chunk = g_game->get_chunk(
-        current_chunk_coord);
+void set_compressed_chunk_voxel(chunk_t *chunk, uint32_t index, voxel_t voxel) {
+    if (chunk->storage == CS_UNIFORM) {
+        if (!g_game->flags.palette_chunks) {
+            make_chunk_dense(chunk);
+            chunk->voxels[index] = voxel;
+            return;
+        }
 
-    current_chunk->flags.has_to_update_vertices = 1;
+        // Every voxel points to entry 0 (the old uniform value)
+        chunk_palette_t *palette = s_allocate_palette(1);
+        palette->count = 1;
+        palette->entries[0] = chunk->uniform_voxel;
+        memset(get_palette_indices(palette), 0, CHUNK_VOXEL_COUNT / 8);
 
-    int32_t diameter = (int32_t)ws_radius * 2 + 1;
+        chunk->palette = palette;
+        chunk->storage = CS_PALETTE;
+    }
 
-    int32_t start_z = vs_center.z - (int32_t)ws_radius;
-    int32_t start_y = vs_center.y - (int32_t)ws_radius;
-    int32_t start_x = vs_center.x - (int32_t)ws_radius;
+    chunk_palette_t *palette = chunk->palette;
+    int32_t entry = s_find_palette_entry(palette, voxel);
 
-    float radius_squared = ws_radius * ws_radius;
+    if (entry < 0) {
+        if (palette->count == (1u << palette->bits)) {
+            if (palette->bits == CHUNK_PALETTE_MAX_BITS) {
+                // More than 256 distinct voxels
+                make_chunk_dense(chunk);
+                chunk->voxels[index] = voxel;
+                return;
+            }
 
-    for (int32_t z = start_z; z < start_z + diameter; ++z) {
-        for (int32_t y = start_y; y < start_y + diameter; ++y) {
-            for (int32_t x = start_x; x < start_x + diameter; ++x) {
-                ivector3_t vs_position = ivector3_t(x, y, z);
-                vector3_t vs_float = vector3_t((float)x, (float)y, (float)z);
-                vector3_t vs_diff_float = vs_float - vs_float_center;
+            palette = chunk->palette = s_widen_palette(palette);
+        }
 
-                float distance_squared = glm::dot(vs_diff_float, vs_diff_float);
+        entry = palette->count++;
+        palette->entries[entry] = voxel;
+    }
 
-                if (distance_squared <= radius_squared) {
-                    ivector3_t c = space_voxel_to_chunk(vs_position);
+    s_set_palette_index(palette, index, entry);
+}
 
-                    ivector3_t chunk_origin_diff = vs_position - current_chunk_coord * (int32_t)CHUNK_EDGE_LENGTH;
-                    //if (c.x == current_chunk_coord.x && c.y == current_chunk_coord.y && c.z == current_chunk_coord.z) {
-                    if (chunk_origin_diff.x >= 0 && chunk_origin_diff.x < 16 &&
-                        chunk_origin_diff.y >= 0 && chunk_origin_diff.y < 16 &&
-                        chunk_origin_diff.z >= 0 && chunk_origin_diff.z < 16) {
-                        // Is within current chunk boundaries
-                        float proportion = generation_proc(distance_squared, radius_squared);
+void update_chunk_occupancy(chunk_t *chunk, const voxel_t *voxels) {
+    memset(chunk->brick_solid_counts, 0, sizeof(chunk->brick_solid_counts));
 
-                        ivector3_t voxel_coord = chunk_origin_diff;
+    for (uint32_t i = 0; i < CHUNK_VOXEL_COUNT; ++i) {
+        chunk->brick_solid_counts[get_voxel_brick_index(i)] += voxels[i].value > CHUNK_SURFACE_LEVEL;
+    }
 
-                        //current_chunk->voxels[get_voxel_index(voxel_coord.x, voxel_coord.y, voxel_coord.z)] = (uint32_t)((proportion) * (float)MAX_VOXEL_VALUE_I);
+    chunk->solid_bricks = 0;
+    chunk->air_bricks = 0;
 
-                        voxel_t *v = &current_chunk->voxels[get_voxel_index(voxel_coord.x, voxel_coord.y, voxel_coord.z)];
-                        uint8_t new_value = (uint32_t)((proportion) * max_value);
-                        // if (*v < new_value) {
-                            v->value = new_value;
-                            v->color = color;
-                            // }
-                    }
-                    else {
-                        ivector3_t c = space_voxel_to_chunk(vs_position);
+    for (uint32_t b = 0; b < CHUNK_BRICK_COUNT; ++b) {
+        uint8_t count = chunk->brick_solid_counts[b];
+        chunk->solid_bricks |= (uint64_t)(count != 0) << b;
+        chunk->air_bricks |= (uint64_t)(count != CHUNK_BRICK_EDGE_LENGTH * CHUNK_BRICK_EDGE_LENGTH * CHUNK_BRICK_EDGE_LENGTH) << b;
+    }
+}
 
-                        // In another chunk, need to switch current_chunk pointer
-                        current_chunk = g_game->get_chunk(c);
-                        current_chunk_coord = c;
+bool terrain_may_have_surface(const ivector3_t &vs_min, const ivector3_t &vs_max) {
+    ivector3_t min_chunk = space_voxel_to_chunk(vs_min);
+    ivector3_t max_chunk = space_voxel_to_chunk(vs_max);
 
-                        current_chunk->flags.has_to_update_vertices = 1;
+    bool has_solid = 0, has_air = 0;
 
-                        float proportion = generation_proc(distance_squared, radius_squared);
+    for (int32_t z = min_chunk.z; z <= max_chunk.z; ++z) {
+        for (int32_t y = min_chunk.y; y <= max_chunk.y; ++y) {
+            for (int32_t x = min_chunk.x; x <= max_chunk.x; ++x) {
+                chunk_t *chunk = g_game->access_chunk(ivector3_t(x, y, z));
 
-                        ivector3_t voxel_coord = vs_position - current_chunk_coord * CHUNK_EDGE_LENGTH;
+                if (chunk) {
+                    ivector3_t lo = glm::clamp(vs_min - chunk->xs_bottom_corner, ivector3_t(0), ivector3_t(CHUNK_EDGE_LENGTH - 1));
+                    ivector3_t hi = glm::clamp(vs_max - chunk->xs_bottom_corner, ivector3_t(0), ivector3_t(CHUNK_EDGE_LENGTH - 1));
+                    uint64_t mask = s_brick_box_mask(lo / CHUNK_BRICK_EDGE_LENGTH, hi / CHUNK_BRICK_EDGE_LENGTH);
 
-                        voxel_t *v = &current_chunk->voxels[get_voxel_index(voxel_coord.x, voxel_coord.y, voxel_coord.z)];
-                        uint8_t new_value = (uint32_t)((proportion) * max_value);
-                        // if (*v < new_value) {
-                            v->value = new_value;
-                            v->color = color;
+                    has_solid |= (chunk->solid_bricks & mask) != 0;
+                    has_air |= (chunk->air_bricks & mask) != 0;
+                }
+                else {
+                    has_air = 1;
+                }
 
-                            // }
-                    }
+                if (has_solid && has_air) {
+                    return 1;
                 }
             }
         }
     }
+
+    return 0;
 }
 
-void generate_platform(const vector3_t &position, float width, float depth, generation_type_t type, voxel_color_t color) {
-    uint8_t (* generation_proc)();
-    switch (type) {
-    case GT_ADDITIVE: {
-        generation_proc =
-            [] () -> uint8_t {
-                return 80;
-            };
-    } break;
+void fill_chunk_apron(const chunk_t *chunk, voxel_t *dst) {
+    voxel_t scratch[CHUNK_VOXEL_COUNT];
+    const voxel_t *voxels = get_chunk_voxels(chunk, scratch);
 
-    case GT_DESTRUCTIVE: {
-        generation_proc =
-            [] () -> uint8_t {
-                return 0;
-            };
+    for (int32_t z = -1; z <= CHUNK_EDGE_LENGTH; ++z) {
+        for (int32_t y = -1; y <= CHUNK_EDGE_LENGTH; ++y) {
+            bool halo_row = z < 0 || y < 0 || z == CHUNK_EDGE_LENGTH || y == CHUNK_EDGE_LENGTH;
 
-    } break;
+            if (halo_row) {
+                for (int32_t x = -1; x <= CHUNK_EDGE_LENGTH; ++x) {
+                    get_voxel_with_neighbours(chunk, x, y, z, &dst[get_apron_index(x, y, z)]);
+                }
+            }
+            else {
+                get_voxel_with_neighbours(chunk, -1, y, z, &dst[get_apron_index(-1, y, z)]);
+
+                if (voxel_layout_t::IS_LINEAR) {
+                    memcpy(&dst[get_apron_index(0, y, z)], &voxels[get_voxel_index(0, y, z)], sizeof(voxel_t) * CHUNK_EDGE_LENGTH);
+                }
+                else {
+                    for (int32_t x = 0; x < CHUNK_EDGE_LENGTH; ++x) {
+                        dst[get_apron_index(x, y, z)] = voxels[get_voxel_index(x, y, z)];
+                    }
+                }
+
+                get_voxel_with_neighbours(chunk, CHUNK_EDGE_LENGTH, y, z, &dst[get_apron_index(CHUNK_EDGE_LENGTH, y, z)]);
+            }
+        }
     }
+}
 
-    for (int32_t z = position.z - depth / 2; z < position.z + depth / 2; ++z) {
-        for (int32_t x = position.x - width / 2; x < position.x + width / 2; ++x) {
-            ivector3_t voxel_coord = ivector3_t((float)x, -2.0f, (float)z);
-            ivector3_t chunk_coord = space_voxel_to_chunk(voxel_coord);
-            chunk_t *chunk = g_game->get_chunk(chunk_coord);
-            chunk->flags.has_to_update_vertices = 1;
-            ivector3_t local_coord = space_voxel_to_local_chunk(voxel_coord);
-            uint32_t index = get_voxel_index(local_coord.x, local_coord.y, local_coord.z);
-            chunk->voxels[index].value = generation_proc();
-            chunk->voxels[index].color = color;
+const chunk_apron_t *get_chunk_apron(chunk_t *chunk) {
+    if (!chunk->apron) {
+        // Entries get recycled in a round robin fashion
+        chunk_apron_t *apron = &g_game->chunk_aprons[g_game->next_chunk_apron];
+        g_game->next_chunk_apron = (g_game->next_chunk_apron + 1) % CHUNK_APRON_CACHE_COUNT;
+
+        if (apron->owner) {
+            apron->owner->apron = NULL;
         }
+
+        fill_chunk_apron(chunk, apron->voxels);
+        apron->owner = chunk;
+        chunk->apron = apron;
     }
+
+    return chunk->apron;
 }
 
-void generate_math_equation(
-    const vector3_t &ws_center,
-    const vector3_t &extent,
-    float (* equation)(float x, float y, float z),
-    generation_type_t type,
-    voxel_color_t color) {
-    uint8_t (* generation_proc)(float equation_result);
-    switch (type) {
-    case GT_ADDITIVE: {
-        generation_proc =
-            [] (float equation_result) -> uint8_t {
-                return (uint8_t)(150.0f * equation_result);
-            };
-    } break;
+static void s_release_chunk_apron(chunk_t *chunk) {
+    if (chunk && chunk->apron) {
+        chunk->apron->owner = NULL;
+        chunk->apron = NULL;
+    }
+}
 
-    case GT_DESTRUCTIVE: {
-        generation_proc =
-            [] (float equation_result) -> uint8_t {
-                return 0;
-            };
-    } break;
+void invalidate_chunk_aprons(chunk_t *chunk, uint32_t voxel_index) {
+    s_release_chunk_apron(chunk);
+
+    ivector3_t coord = get_voxel_coord(voxel_index);
+
+    // Neighbours in the direction of the edges the voxel is on
+    int32_t dx = (coord.x == CHUNK_EDGE_LENGTH - 1) - (coord.x == 0);
+    int32_t dy = (coord.y == CHUNK_EDGE_LENGTH - 1) - (coord.y == 0);
+    int32_t dz = (coord.z == CHUNK_EDGE_LENGTH - 1) - (coord.z == 0);
+
+    for (int32_t oz = MIN(dz, 0); oz <= MAX(dz, 0); ++oz) {
+        for (int32_t oy = MIN(dy, 0); oy <= MAX(dy, 0); ++oy) {
+            for (int32_t ox = MIN(dx, 0); ox <= MAX(dx, 0); ++ox) {
+                s_release_chunk_apron(get_chunk_neighbour(chunk, ox, oy, oz));
+            }
+        }
+    }
+}
+
+void invalidate_all_chunk_aprons(chunk_t *chunk) {
+    for (uint32_t i = 0; i < 27; ++i) {
+        s_release_chunk_apron(chunk->neighbours[i]);
     }
+}
 
-    for (int32_t z = ws_center.z - extent.z / 2; z < ws_center.z + extent.z / 2; ++z) {
-        for (int32_t y = ws_center.y - extent.y / 2; y < ws_center.y + extent.y / 2; ++y) {
-            for (int32_t x = ws_center.x - extent.x / 2; x < ws_center.x + extent.x / 2; ++x) {
-                float c = equation(x - ws_center.x, y - ws_center.y, z - ws_center.z);
+void mark_neighbour_bricks_dirty(chunk_t *chunk, uint32_t voxel_index) {
+    ivector3_t coord = get_voxel_coord(voxel_index);
 
-                if (c > 0.0f) {
-                    ivector3_t voxel_coord = ivector3_t((float)x, (float)y, (float)z);
-                    ivector3_t chunk_coord = space_voxel_to_chunk(voxel_coord);
-                    chunk_t *chunk = g_game->get_chunk(chunk_coord);
-                    chunk->flags.has_to_update_vertices = 1;
-                    ivector3_t local_coord = space_voxel_to_local_chunk(voxel_coord);
-                    uint32_t index = get_voxel_index(local_coord.x, local_coord.y, local_coord.z);
-                    chunk->voxels[index].value = generation_proc(c);
-                    chunk->voxels[index].color = color;
+    for (int32_t z = coord.z ? 0 : -1; z <= 0; ++z) {
+        for (int32_t y = coord.y ? 0 : -1; y <= 0; ++y) {
+            for (int32_t x = coord.x ? 0 : -1; x <= 0; ++x) {
+                chunk_t *neighbour = get_chunk_neighbour(chunk, x, y, z);
+
+                if ((x || y || z) && neighbour) {
+                    // Coordinate of the voxel in the space of the neighbour
+                    mark_chunk_bricks_dirty(neighbour, get_voxel_dirty_bricks(coord - ivector3_t(x, y, z) * CHUNK_EDGE_LENGTH));
+                    neighbour->flags.has_to_update_vertices = 1;
                 }
             }
         }
     }
-}
+}
+
+void mark_chunk_dirty(chunk_t *chunk) {
+    mark_chunk_bricks_dirty(chunk, ~0ull);
+    chunk->flags.has_to_update_vertices = 1;
+
+    s_mark_lower_neighbours_dirty(chunk);
+}
+
+voxel_t *get_chunk_voxels_for_write(chunk_t *chunk) {
+    make_chunk_dense(chunk);
+    invalidate_all_chunk_aprons(chunk);
+    mark_chunk_dirty(chunk);
+    chunk->flags.needs_flush = 1;
+
+    return chunk->voxels;
+}
+
+const voxel_t *get_chunk_voxels(const chunk_t *chunk, voxel_t *scratch) {
+    switch (chunk->storage) {
+    case CS_DENSE: {
+        return chunk->voxels;
+    }
+
+    case CS_PALETTE: {
+        s_decode_palette(chunk->palette, scratch);
+        return scratch;
+    }
+
+    default: {
+        for (uint32_t i = 0; i < CHUNK_VOXEL_COUNT; ++i) {
+            scratch[i] = chunk->uniform_voxel;
+        }
+
+        return scratch;
+    }
+    }
+}
+
+const voxel_t *get_chunk_voxels_linear(const chunk_t *chunk, voxel_t *scratch) {
+    if (voxel_layout_t::IS_LINEAR) {
+        return get_chunk_voxels(chunk, scratch);
+    }
+
+    voxel_t decoded[CHUNK_VOXEL_COUNT];
+    const voxel_t *voxels = get_chunk_voxels(chunk, decoded);
+
+    for (uint32_t i = 0; i < CHUNK_VOXEL_COUNT; ++i) {
+        scratch[voxel_index_to_linear(i)] = voxels[i];
+    }
+
+    return scratch;
+}
+
+void reorder_linear_chunk_voxels(voxel_t *voxels) {
+    if (voxel_layout_t::IS_LINEAR) {
+        return;
+    }
+
+    voxel_t linear_voxels[CHUNK_VOXEL_COUNT];
+    memcpy(linear_voxels, voxels, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+
+    for (uint32_t i = 0; i < CHUNK_VOXEL_COUNT; ++i) {
+        voxels[linear_to_voxel_index(i)] = linear_voxels[i];
+    }
+}
+
+bool compress_chunk_storage(chunk_t *chunk) {
+    if (chunk->storage == CS_UNIFORM) {
+        return true;
+    }
+
+    voxel_t scratch[CHUNK_VOXEL_COUNT];
+    const voxel_t *voxels = get_chunk_voxels(chunk, scratch);
+
+    update_chunk_occupancy(chunk, voxels);
+
+    // Gather the distinct voxels (stop as soon as it's clear the chunk can't be compressed)
+    uint32_t max_distinct = g_game->flags.palette_chunks ? (1 << CHUNK_PALETTE_MAX_BITS) : 1;
+    voxel_t distinct[1 << CHUNK_PALETTE_MAX_BITS];
+    uint32_t distinct_count = 1;
+    distinct[0] = voxels[0];
+
+    voxel_t previous = voxels[0];
+    for (uint32_t i = 1; i < CHUNK_VOXEL_COUNT; ++i) {
+        if (voxels[i] == previous) {
+            continue;
+        }
+
+        previous = voxels[i];
+
+        bool found = false;
+        for (uint32_t d = 0; d < distinct_count; ++d) {
+            if (distinct[d] == previous) {
+                found = true;
+                break;
+            }
+        }
+
+        if (!found) {
+            if (distinct_count == max_distinct) {
+                // Chunk already is a palette with as few bits as possible, or has to stay dense
+                if (chunk->storage == CS_PALETTE) {
+                    make_chunk_dense(chunk);
+                }
+
+                return false;
+            }
+
+            distinct[distinct_count++] = previous;
+        }
+    }
+
+    if (distinct_count == 1) {
+        if (chunk->storage == CS_DENSE) {
+            g_game->voxel_allocator.free(chunk->voxels);
+            chunk->voxels = NULL;
+        }
+        else {
+            s_free_palette(chunk->palette);
+            chunk->palette = NULL;
+        }
+
+        chunk->uniform_voxel = distinct[0];
+        chunk->storage = CS_UNIFORM;
+
+        return true;
+    }
+
+    chunk_palette_t *palette = s_encode_palette(voxels, distinct, distinct_count);
+
+    if (chunk->storage == CS_DENSE) {
+        g_game->voxel_allocator.free(chunk->voxels);
+        chunk->voxels = NULL;
+    }
+    else {
+        // Shrinks palettes which grew because of voxels that have since been overwritten
+        s_free_palette(chunk->palette);
+    }
+
+    chunk->palette = palette;
+    chunk->storage = CS_PALETTE;
+
+    return false;
+}
+
+void activate_chunk_history(chunk_t *chunk) {
+    chunk->history = (chunk_history_t *)g_game->history_allocator.allocate();
+    chunk->history->modification_count = 0;
+    memset(chunk->history->modification_pool, CHUNK_SPECIAL_VALUE, CHUNK_VOXEL_COUNT);
+}
+
+void deactivate_chunk_history(chunk_t *chunk) {
+    g_game->history_allocator.free(chunk->history);
+    chunk->history = NULL;
+}
+
+uint64_t region_coord_key(
+    const ivector3_t &region_coord) {
+    // 17 bits per axis (two's complement) - every region coordinate in range [-2^16, 2^16) gets its own key
+    uint64_t x = (uint64_t)(uint32_t)region_coord.x & 0x1FFFF;
+    uint64_t y = (uint64_t)(uint32_t)region_coord.y & 0x1FFFF;
+    uint64_t z = (uint64_t)(uint32_t)region_coord.z & 0x1FFFF;
+
+    return x | (y << 17) | (z << 34);
+}
+
+uint64_t chunk_coord_key(
+    const ivector3_t &coord) {
+    // Every chunk coordinate in range [-2^20, 2^20) gets its own key (that's 2^24 voxels in each direction)
+    // The top bit is never set so the key can never be open_hash_table_t::EMPTY_KEY
+    return (region_coord_key(space_chunk_to_region(coord)) << 12) | get_region_chunk_index(coord);
+}
+
+template <typename T>
+static void s_iterate_3d(
+    const ivector3_t &center,
+    uint32_t radius,
+    T to_apply) {
+    int32_t start_z = center.z - (int32_t)radius;
+    int32_t start_y = center.y - (int32_t)radius;
+    int32_t start_x = center.x - (int32_t)radius;
+
+    int32_t diameter = (int32_t)radius * 2 + 1;
+
+    for (int32_t z = start_z; z < start_z + diameter; ++z) {
+        for (int32_t y = start_y; y < start_y + diameter; ++y) {
+            for (int32_t x = start_x; x < start_x + diameter; ++x) {
+                to_apply(x, y, z);
+            }
+        }
+    }
+}
+
+// World generation runs in three steps:
+// - every chunk in the bounding box of the volume gets probed in parallel (does the volume cover one of its voxels?)
+// - the covered chunks get created and made dense on this thread (chunk creation / allocators aren't thread safe)
+// - the voxels of the covered chunks get filled in parallel, one chunk per work item
+// A voxel's new value only depends on its position and old value, so the terrain doesn't depend on the scheduling
+
+// Fills the voxels (dense, voxel layout order) of the chunk at xs_bottom_corner which are in the volume
+// If voxels is NULL, just returns whether the volume covers a voxel of the chunk
+typedef bool (* generation_fill_proc_t)(const void *generator, const ivector3_t &xs_bottom_corner, voxel_t *voxels);
+
+struct generation_job_t {
+    const void *generator;
+    generation_fill_proc_t fill_proc;
+
+    ivector3_t min_chunk_coord;
+    ivector3_t chunk_box_size;
+    bool *covered;
+
+    ivector3_t *coords;
+    voxel_t **voxels;
+};
+
+static void s_probe_generation_chunk(uint32_t item_index, void *data) {
+    generation_job_t *job = (generation_job_t *)data;
+
+    ivector3_t offset = ivector3_t(
+        item_index % job->chunk_box_size.x,
+        (item_index / job->chunk_box_size.x) % job->chunk_box_size.y,
+        item_index / (job->chunk_box_size.x * job->chunk_box_size.y));
+
+    ivector3_t xs_bottom_corner = (job->min_chunk_coord + offset) * (int32_t)CHUNK_EDGE_LENGTH;
+    job->covered[item_index] = job->fill_proc(job->generator, xs_bottom_corner, NULL);
+}
+
+static void s_fill_generation_chunk(uint32_t item_index, void *data) {
+    generation_job_t *job = (generation_job_t *)data;
+
+    ivector3_t xs_bottom_corner = job->coords[item_index] * (int32_t)CHUNK_EDGE_LENGTH;
+    job->fill_proc(job->generator, xs_bottom_corner, job->voxels[item_index]);
+}
+
+// vs_min / vs_max: inclusive voxel bounding box of the volume
+static void s_run_generation(
+    const ivector3_t &vs_min,
+    const ivector3_t &vs_max,
+    generation_fill_proc_t fill_proc,
+    const void *generator) {
+    if (vs_min.x > vs_max.x || vs_min.y > vs_max.y || vs_min.z > vs_max.z) {
+        return;
+    }
+
+    generation_job_t job = {};
+    job.generator = generator;
+    job.fill_proc = fill_proc;
+    job.min_chunk_coord = space_voxel_to_chunk(vs_min);
+    job.chunk_box_size = space_voxel_to_chunk(vs_max) - job.min_chunk_coord + ivector3_t(1);
+
+    uint32_t box_chunk_count = job.chunk_box_size.x * job.chunk_box_size.y * job.chunk_box_size.z;
+    job.covered = FL_MALLOC(bool, box_chunk_count);
+
+    run_parallel(box_chunk_count, s_probe_generation_chunk, &job);
+
+    uint32_t covered_count = 0;
+    for (uint32_t i = 0; i < box_chunk_count; ++i) {
+        covered_count += job.covered[i];
+    }
+
+    job.coords = FL_MALLOC(ivector3_t, covered_count);
+    job.voxels = FL_MALLOC(voxel_t *, covered_count);
+
+    // Same order as the chunks were created in before (z, y, x), doesn't change the result though
+    uint32_t item_count = 0;
+    for (uint32_t i = 0; i < box_chunk_count; ++i) {
+        if (job.covered[i]) {
+            ivector3_t coord = job.min_chunk_coord + ivector3_t(
+                i % job.chunk_box_size.x,
+                (i / job.chunk_box_size.x) % job.chunk_box_size.y,
+                i / (job.chunk_box_size.x * job.chunk_box_size.y));
+
+            chunk_t *chunk = g_game->get_chunk(coord);
+
+            // Also takes care of the neighbours' dirty bricks / aprons (those can't be touched by the workers)
+            job.coords[item_count] = coord;
+            job.voxels[item_count] = get_chunk_voxels_for_write(chunk);
+            ++item_count;
+        }
+    }
+
+    run_parallel(item_count, s_fill_generation_chunk, &job);
+
+    // Generating might have left the chunks with just one value (only the ones of this job changed)
+    for (uint32_t i = 0; i < item_count; ++i) {
+        compress_chunk_storage(g_game->get_chunk(job.coords[i]));
+    }
+
+    FL_FREE(job.voxels);
+    FL_FREE(job.coords);
+    FL_FREE(job.covered);
+}
+
+// Range of voxels of the chunk (local coordinates) which are inside the bounding box
+static void s_clip_to_chunk(
+    const ivector3_t &vs_min,
+    const ivector3_t &vs_max,
+    const ivector3_t &xs_bottom_corner,
+    ivector3_t *local_min,
+    ivector3_t *local_max) {
+    *local_min = glm::max(vs_min - xs_bottom_corner, ivector3_t(0));
+    *local_max = glm::min(vs_max - xs_bottom_corner, ivector3_t(CHUNK_EDGE_LENGTH - 1));
+}
+
+struct sphere_generator_t {
+    ivector3_t vs_center;
+    ivector3_t vs_min;
+    ivector3_t vs_max;
+    float radius_squared;
+    // Radius passed to generation_proc
+    float proc_radius_squared;
+    float max_value;
+    voxel_color_t color;
+    // Hollow spheres only ever increase the values
+    bool hollow;
+    float (* generation_proc)(float distance_squared, float radius_squared);
+};
+
+static bool s_fill_sphere_chunk(
+    const void *generator,
+    const ivector3_t &xs_bottom_corner,
+    voxel_t *voxels) {
+    const sphere_generator_t *sphere = (const sphere_generator_t *)generator;
+
+    ivector3_t local_min, local_max;
+    s_clip_to_chunk(sphere->vs_min, sphere->vs_max, xs_bottom_corner, &local_min, &local_max);
+
+    // Voxel of the chunk which is closest to the center (distances between voxels are exact in floats)
+    vector3_t vs_float_center = (vector3_t)(sphere->vs_center);
+    ivector3_t closest = glm::clamp(sphere->vs_center - xs_bottom_corner, local_min, local_max) + xs_bottom_corner;
+    vector3_t closest_diff = (vector3_t)closest - vs_float_center;
+
+    if (glm::dot(closest_diff, closest_diff) > sphere->radius_squared) {
+        return 0;
+    }
+
+    if (!voxels) {
+        return 1;
+    }
+
+    for (int32_t z = local_min.z; z <= local_max.z; ++z) {
+        for (int32_t y = local_min.y; y <= local_max.y; ++y) {
+            for (int32_t x = local_min.x; x <= local_max.x; ++x) {
+                ivector3_t vs_position = xs_bottom_corner + ivector3_t(x, y, z);
+                vector3_t vs_diff_float = (vector3_t)vs_position - vs_float_center;
+
+                float distance_squared = glm::dot(vs_diff_float, vs_diff_float);
+
+                if (distance_squared <= sphere->radius_squared) {
+                    float proportion = sphere->generation_proc(distance_squared, sphere->proc_radius_squared);
+                    voxel_t *v = &voxels[get_voxel_index(x, y, z)];
+
+                    uint8_t new_value = (uint32_t)((proportion) * sphere->max_value);
+                    if (!sphere->hollow || v->value < new_value) {
+                        v->value = new_value;
+                        v->color = sphere->color;
+                    }
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+static void s_generate_sphere(
+    const vector3_t &ws_center,
+    float ws_radius,
+    float proc_radius_squared,
+    float max_value,
+    voxel_color_t color,
+    bool hollow,
+    float (* generation_proc)(float distance_squared, float radius_squared)) {
+    sphere_generator_t sphere = {};
+    sphere.vs_center = space_world_to_voxel(ws_center);
+    sphere.vs_min = sphere.vs_center - ivector3_t((int32_t)ws_radius);
+    sphere.vs_max = sphere.vs_center + ivector3_t((int32_t)ws_radius);
+    sphere.radius_squared = ws_radius * ws_radius;
+    sphere.proc_radius_squared = proc_radius_squared;
+    sphere.max_value = max_value;
+    sphere.color = color;
+    sphere.hollow = hollow;
+    sphere.generation_proc = generation_proc;
+
+    s_run_generation(sphere.vs_min, sphere.vs_max, s_fill_sphere_chunk, &sphere);
+}
+
+void generate_hollow_sphere(
+    const vector3_t &ws_center,
+    float ws_radius,
+    float max_value,
+    generation_type_t type,
+    voxel_color_t color) {
+    float (* generation_proc)(float distance_squared, float radius_squared);
+    switch(type) {
+    case GT_ADDITIVE: {
+        generation_proc =
+            [] (float distance_squared, float radius_squared) {
+                float diff = abs(distance_squared - radius_squared);
+                if (diff < 120.0f) {
+                    return 1.0f - (diff / 120.0f);
+                }
+                else {
+                    return 0.0f;
+                }
+            };
+    } break;
+
+    case GT_DESTRUCTIVE: {
+        generation_proc =
+            [] (float distance_squared, float radius_squared) {
+                return 0.0f;
+            };
+
+    } break;
+    }
+
+    float smaller_radius_squared = (ws_radius - 10) * (ws_radius - 10);
+
+    s_generate_sphere(ws_center, ws_radius, smaller_radius_squared, max_value, color, 1, generation_proc);
+}
+
+void generate_sphere(
+    const vector3_t &ws_center,
+    float ws_radius,
+    float max_value,
+    generation_type_t type,
+    voxel_color_t color) {
+    float (* generation_proc)(float distance_squared, float radius_squared);
+    switch(type) {
+    case GT_ADDITIVE: {
+        generation_proc =
+            [] (float distance_squared, float radius_squared) {
+                return 1.0f - (distance_squared / radius_squared);
+            };
+    } break;
+
+    case GT_DESTRUCTIVE: {
+        generation_proc =
+            [] (float distance_squared, float radius_squared) {
+                return 0.0f;
+            };
+
+    } break;
+    }
+
+    s_generate_sphere(ws_center, ws_radius, ws_radius * ws_radius, max_value, color, 0, generation_proc);
+}
+
+void generate_platform(const vector3_t &position, float width, float depth, generation_type_t type, voxel_color_t color) {
+    uint8_t (* generation_proc)();
+    switch (type) {
+    case GT_ADDITIVE: {
+        generation_proc =
+            [] () -> uint8_t {
+                return 80;
+            };
+    } break;
+
+    case GT_DESTRUCTIVE: {
+        generation_proc =
+            [] () -> uint8_t {
+                return 0;
+            };
+
+    } break;
+    }
+
+    ivector3_t min_chunk_coord = ivector3_t(INT32_MAX);
+    ivector3_t max_chunk_coord = ivector3_t(INT32_MIN);
+
+    for (int32_t z = position.z - depth / 2; z < position.z + depth / 2; ++z) {
+        for (int32_t x = position.x - width / 2; x < position.x + width / 2; ++x) {
+            ivector3_t voxel_coord = ivector3_t((float)x, -2.0f, (float)z);
+            ivector3_t chunk_coord = space_voxel_to_chunk(voxel_coord);
+            min_chunk_coord = glm::min(min_chunk_coord, chunk_coord);
+            max_chunk_coord = glm::max(max_chunk_coord, chunk_coord);
+            chunk_t *chunk = g_game->get_chunk(chunk_coord);
+            chunk->flags.has_to_update_vertices = 1;
+            ivector3_t local_coord = space_voxel_to_local_chunk(voxel_coord);
+            uint32_t index = get_voxel_index(local_coord.x, local_coord.y, local_coord.z);
+            voxel_t v;
+            v.value = generation_proc();
+            v.color = color;
+            set_chunk_voxel(chunk, index, v);
+        }
+    }
+
+    // Only the chunks of the platform can have been left with just one value
+    for (int32_t z = min_chunk_coord.z; z <= max_chunk_coord.z; ++z) {
+        for (int32_t x = min_chunk_coord.x; x <= max_chunk_coord.x; ++x) {
+            compress_chunk_storage(g_game->get_chunk(ivector3_t(x, min_chunk_coord.y, z)));
+        }
+    }
+}
+
+struct equation_generator_t {
+    vector3_t ws_center;
+    ivector3_t vs_min;
+    ivector3_t vs_max;
+    voxel_color_t color;
+    float (* equation)(float x, float y, float z);
+    uint8_t (* generation_proc)(float equation_result);
+};
+
+static bool s_fill_equation_chunk(
+    const void *generator,
+    const ivector3_t &xs_bottom_corner,
+    voxel_t *voxels) {
+    const equation_generator_t *eq = (const equation_generator_t *)generator;
+
+    ivector3_t local_min, local_max;
+    s_clip_to_chunk(eq->vs_min, eq->vs_max, xs_bottom_corner, &local_min, &local_max);
+
+    bool covered = 0;
+
+    for (int32_t z = local_min.z; z <= local_max.z; ++z) {
+        for (int32_t y = local_min.y; y <= local_max.y; ++y) {
+            for (int32_t x = local_min.x; x <= local_max.x; ++x) {
+                ivector3_t vs_position = xs_bottom_corner + ivector3_t(x, y, z);
+                float c = eq->equation(
+                    vs_position.x - eq->ws_center.x,
+                    vs_position.y - eq->ws_center.y,
+                    vs_position.z - eq->ws_center.z);
+
+                if (c > 0.0f) {
+                    if (!voxels) {
+                        return 1;
+                    }
+
+                    voxel_t *v = &voxels[get_voxel_index(x, y, z)];
+                    v->value = eq->generation_proc(c);
+                    v->color = eq->color;
+
+                    covered = 1;
+                }
+            }
+        }
+    }
+
+    return covered;
+}
+
+void generate_math_equation(
+    const vector3_t &ws_center,
+    const vector3_t &extent,
+    float (* equation)(float x, float y, float z),
+    generation_type_t type,
+    voxel_color_t color) {
+    uint8_t (* generation_proc)(float equation_result);
+    switch (type) {
+    case GT_ADDITIVE: {
+        generation_proc =
+            [] (float equation_result) -> uint8_t {
+                return (uint8_t)(150.0f * equation_result);
+            };
+    } break;
+
+    case GT_DESTRUCTIVE: {
+        generation_proc =
+            [] (float equation_result) -> uint8_t {
+                return 0;
+            };
+    } break;
+    }
+
+    equation_generator_t generator = {};
+    generator.ws_center = ws_center;
+    generator.color = color;
+    generator.equation = equation;
+    generator.generation_proc = generation_proc;
+
+    // Voxels [ws_center - extent / 2, ws_center + extent / 2) (start gets truncated)
+    vector3_t end = ws_center + extent / 2.0f;
+    generator.vs_min = ivector3_t(ws_center - extent / 2.0f);
+    generator.vs_max = ivector3_t(glm::ceil(end)) - ivector3_t(1);
+
+    s_run_generation(generator.vs_min, generator.vs_max, s_fill_equation_chunk, &generator);
+}
+
+// Marching cubes cells (see s_push_collision_triangles_vertices): cell c has the voxels c + [0, 1]^3 as corners
+// Corner i is at c + (i & 1, (i >> 1) & 1, i >> 2), corners in chunks which don't exist are 0
+// Returns false without reading the values if the bricks show that none of the corners is over the surface level (unless read_empty is set)
+static bool s_get_cell_corner_values(
+    const ivector3_t &cell,
+    const chunk_t **chunk,
+    ivector3_t *chunk_origin,
+    float *values,
+    bool read_empty) {
+    ivector3_t local = cell - *chunk_origin;
+
+    if ((uint32_t)local.x >= CHUNK_EDGE_LENGTH || (uint32_t)local.y >= CHUNK_EDGE_LENGTH || (uint32_t)local.z >= CHUNK_EDGE_LENGTH) {
+        ivector3_t chunk_coord = space_voxel_to_chunk(cell);
+        *chunk_origin = chunk_coord * CHUNK_EDGE_LENGTH;
+        *chunk = g_game->access_chunk(chunk_coord);
+        local = cell - *chunk_origin;
+    }
+
+    // The last cells of the chunk have corners in the neighbours
+    if (local.x < CHUNK_EDGE_LENGTH - 1 && local.y < CHUNK_EDGE_LENGTH - 1 && local.z < CHUNK_EDGE_LENGTH - 1) {
+        if (!*chunk || !((*chunk)->solid_bricks & s_brick_box_mask(local / CHUNK_BRICK_EDGE_LENGTH, (local + 1) / CHUNK_BRICK_EDGE_LENGTH))) {
+            if (!read_empty) {
+                return 0;
+            }
+        }
+
+        for (uint32_t i = 0; i < 8; ++i) {
+            ivector3_t corner = local + ivector3_t(i & 1, (i >> 1) & 1, i >> 2);
+            values[i] = *chunk ? (float)get_chunk_voxel(*chunk, get_voxel_index(corner.x, corner.y, corner.z)).value : 0.0f;
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < 8; ++i) {
+            ivector3_t corner = local + ivector3_t(i & 1, (i >> 1) & 1, i >> 2);
+            ivector3_t offset = corner / (int32_t)CHUNK_EDGE_LENGTH;
+            const chunk_t *owner = *chunk ?
+                get_chunk_neighbour(*chunk, offset.x, offset.y, offset.z) :
+                g_game->access_chunk(space_voxel_to_chunk(*chunk_origin + corner));
+
+            corner -= offset * (int32_t)CHUNK_EDGE_LENGTH;
+            values[i] = owner ? (float)get_chunk_voxel(owner, get_voxel_index(corner.x, corner.y, corner.z)).value : 0.0f;
+        }
+    }
+
+    return 1;
+}
+
+// Coefficients (constant first) of the cubic in t that the trilinear interpolation of the corner values gives along p + d * t (cell space)
+static void s_get_cell_ray_cubic(const float *values, const vector3_t &p, const vector3_t &d, float *coeffs) {
+    // values[0] + x * vx + y * vy + z * vz + x * y * vxy + x * z * vxz + y * z * vyz + x * y * z * vxyz
+    float vx = values[1] - values[0];
+    float vy = values[2] - values[0];
+    float vz = values[4] - values[0];
+    float vxy = values[3] - values[2] - values[1] + values[0];
+    float vxz = values[5] - values[4] - values[1] + values[0];
+    float vyz = values[6] - values[4] - values[2] + values[0];
+    float vxyz = values[7] - values[6] - values[5] - values[3] + values[4] + values[2] + values[1] - values[0];
+
+    coeffs[0] = values[0] + p.x * vx + p.y * vy + p.z * vz + p.x * p.y * vxy + p.x * p.z * vxz + p.y * p.z * vyz + p.x * p.y * p.z * vxyz;
+    coeffs[1] = d.x * vx + d.y * vy + d.z * vz +
+        (p.x * d.y + p.y * d.x) * vxy +
+        (p.x * d.z + p.z * d.x) * vxz +
+        (p.y * d.z + p.z * d.y) * vyz +
+        (d.x * p.y * p.z + p.x * d.y * p.z + p.x * p.y * d.z) * vxyz;
+    coeffs[2] = d.x * d.y * vxy + d.x * d.z * vxz + d.y * d.z * vyz + (d.x * d.y * p.z + d.x * p.y * d.z + p.x * d.y * d.z) * vxyz;
+    coeffs[3] = d.x * d.y * d.z * vxyz;
+}
+
+static float s_evaluate_cubic(const float *coeffs, float t) {
+    return coeffs[0] + t * (coeffs[1] + t * (coeffs[2] + t * coeffs[3]));
+}
+
+// Bisection steps between two points of a part of the cubic where it only goes up (the last bracket gets interpolated linearly)
+static const uint32_t CELL_RAY_BISECTION_COUNT = 16;
+
+// First t in [0, length] at which the cubic goes over level, false if it doesn't
+// The cubic is monotonic between the roots of its derivative, so the first of these parts which ends over level has the crossing
+static bool s_find_cubic_crossing(const float *coeffs, float level, float length, float *t) {
+    float ends[4];
+    uint32_t end_count = 0;
+
+    // Roots of 3 * c3 * t^2 + 2 * c2 * t + c1
+    float a = 3.0f * coeffs[3], b = 2.0f * coeffs[2], c = coeffs[1];
+
+    if (a != 0.0f) {
+        float determinant = b * b - 4.0f * a * c;
+
+        if (determinant > 0.0f) {
+            float sqrt_d = sqrtf(determinant);
+            float r0 = (-b - sqrt_d) / (2.0f * a);
+            float r1 = (-b + sqrt_d) / (2.0f * a);
+
+            ends[end_count++] = glm::min(r0, r1);
+            ends[end_count++] = glm::max(r0, r1);
+        }
+    }
+    else if (b != 0.0f) {
+        ends[end_count++] = -c / b;
+    }
+
+    float previous_t = 0.0f;
+    float previous_value = s_evaluate_cubic(coeffs, 0.0f) - level;
+
+    if (previous_value > 0.0f) {
+        *t = 0.0f;
+        return 1;
+    }
+
+    ends[end_count++] = length;
+
+    for (uint32_t i = 0; i < end_count; ++i) {
+        if (ends[i] <= previous_t) {
+            continue;
+        }
+
+        float current_t = glm::min(ends[i], length);
+        float current_value = s_evaluate_cubic(coeffs, current_t) - level;
+
+        if (current_value > 0.0f) {
+            float lo = previous_t, hi = current_t;
+            float lo_value = previous_value, hi_value = current_value;
+
+            for (uint32_t step = 0; step < CELL_RAY_BISECTION_COUNT; ++step) {
+                float middle = (lo + hi) * 0.5f;
+                float middle_value = s_evaluate_cubic(coeffs, middle) - level;
+
+                if (middle_value > 0.0f) {
+                    hi = middle;
+                    hi_value = middle_value;
+                }
+                else {
+                    lo = middle;
+                    lo_value = middle_value;
+                }
+            }
+
+            *t = interpolate(lo, hi, lerp(lo_value, hi_value, 0.0f));
+            return 1;
+        }
+
+        if (current_t >= length) {
+            break;
+        }
+
+        previous_t = current_t;
+        previous_value = current_value;
+    }
+
+    return 0;
+}
+
+// Corner over the surface level which is closest to the point (cs_point is relative to the cell)
+static ivector3_t s_closest_solid_corner(const ivector3_t &cell, const float *values, const vector3_t &cs_point) {
+    ivector3_t closest_corner = cell;
+    float closest = INFINITY;
+
+    for (uint32_t i = 0; i < 8; ++i) {
+        vector3_t diff = vector3_t(i & 1, (i >> 1) & 1, i >> 2) - cs_point;
+
+        if (values[i] > (float)CHUNK_SURFACE_LEVEL && glm::dot(diff, diff) < closest) {
+            closest = glm::dot(diff, diff);
+            closest_corner = cell + ivector3_t(i & 1, (i >> 1) & 1, i >> 2);
+        }
+    }
+
+    return closest_corner;
+}
+
+// Value of the voxel once the queued brushes are applied to it (same math as the row kernels, in the order the brushes were queued)
+static float s_apply_queued_brushes(
+    const ivector3_t &vs_voxel,
+    float value,
+    const terraform_command_t *commands,
+    uint32_t command_count) {
+    int32_t current = (int32_t)value;
+
+    for (uint32_t i = 0; i < command_count; ++i) {
+        const terraform_command_t *command = &commands[i];
+        ivector3_t diff = vs_voxel - command->vs_center;
+        float distance_squared = (float)(diff.x * diff.x + diff.y * diff.y + diff.z * diff.z);
+        float radius_squared = command->radius * command->radius;
+
+        if (distance_squared <= radius_squared) {
+            float proportion = 1.0f - (distance_squared / radius_squared);
+            float coeff = (command->type == TT_DESTROY) ? -1.0f : +1.0f;
+            current = glm::clamp((int32_t)(proportion * coeff * command->dt * command->speed) + current, 0, (int32_t)CHUNK_MAX_VOXEL_VALUE_I);
+        }
+    }
+
+    return (float)current;
+}
+
+// Whether one of the brushes reaches a corner of the cell
+static bool s_cell_touches_brushes(
+    const ivector3_t &cell,
+    const terraform_command_t *commands,
+    uint32_t command_count) {
+    for (uint32_t i = 0; i < command_count; ++i) {
+        ivector3_t closest = glm::clamp(commands[i].vs_center, cell, cell + ivector3_t(1)) - commands[i].vs_center;
+
+        if ((float)(closest.x * closest.x + closest.y * closest.y + closest.z * closest.z) <= commands[i].radius * commands[i].radius) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// raycast_terrain through the terrain with the brushes applied to it (they only change the values that the walk reads)
+static bool s_raycast_terrain(
+    const vector3_t &ws_ray_start,
+    const vector3_t &ws_ray_direction,
+    float max_distance,
+    const terraform_command_t *brushes,
+    uint32_t brush_count,
+    terrain_raycast_hit_t *hit) {
+    float length = glm::length(ws_ray_direction);
+    // A ray without direction only checks the point it starts at
+    vector3_t direction = (length > 0.0f) ? ws_ray_direction / length : vector3_t(0.0f);
+    ivector3_t cell = ivector3_t(glm::floor(ws_ray_start));
+
+    // Distance along the ray at which the next cell boundary of each axis gets crossed, and between two of them
+    ivector3_t step;
+    vector3_t next_boundary;
+    vector3_t boundary_distance;
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        if (direction[i] > 0.0f) {
+            step[i] = 1;
+            next_boundary[i] = ((float)(cell[i] + 1) - ws_ray_start[i]) / direction[i];
+            boundary_distance[i] = 1.0f / direction[i];
+        }
+        else if (direction[i] < 0.0f) {
+            step[i] = -1;
+            next_boundary[i] = ((float)cell[i] - ws_ray_start[i]) / direction[i];
+            boundary_distance[i] = -1.0f / direction[i];
+        }
+        else {
+            step[i] = 0;
+            next_boundary[i] = INFINITY;
+            boundary_distance[i] = INFINITY;
+        }
+    }
+
+    // The chunk only gets looked up again when the walk leaves it
+    ivector3_t chunk_coord = space_voxel_to_chunk(cell);
+    ivector3_t chunk_origin = chunk_coord * CHUNK_EDGE_LENGTH;
+    const chunk_t *chunk = g_game->access_chunk(chunk_coord);
+
+    float surface_level = (float)CHUNK_SURFACE_LEVEL;
+    float cell_enter = 0.0f;
+
+    while (cell_enter <= max_distance) {
+        uint32_t axis = (next_boundary.x < next_boundary.y) ?
+            (next_boundary.x < next_boundary.z ? 0 : 2) :
+            (next_boundary.y < next_boundary.z ? 1 : 2);
+        float cell_exit = glm::min(next_boundary[axis], max_distance);
+
+        float values[8];
+        float max_value = 0.0f;
+        bool brushed = brush_count && s_cell_touches_brushes(cell, brushes, brush_count);
+
+        if (s_get_cell_corner_values(cell, &chunk, &chunk_origin, values, brushed)) {
+            for (uint32_t i = 0; i < 8; ++i) {
+                if (brushed) {
+                    values[i] = s_apply_queued_brushes(cell + ivector3_t(i & 1, (i >> 1) & 1, i >> 2), values[i], brushes, brush_count);
+                }
+
+                max_value = glm::max(max_value, values[i]);
+            }
+        }
+
+        // The values inside a cell never go over the values of its corners
+        if (max_value > surface_level) {
+            // Part of the ray which is in the cell, from where it enters it
+            vector3_t cs_enter = glm::clamp(ws_ray_start + direction * cell_enter - vector3_t(cell), vector3_t(0.0f), vector3_t(1.0f));
+            float coeffs[4];
+            s_get_cell_ray_cubic(values, cs_enter, direction, coeffs);
+
+            // If the ray starts in the terrain, the hit is at its start
+            float t;
+            if (s_find_cubic_crossing(coeffs, surface_level, cell_exit - cell_enter, &t)) {
+                float distance = cell_enter + t;
+
+                hit->ws_position = ws_ray_start + direction * distance;
+                hit->distance = distance;
+                hit->vs_voxel = s_closest_solid_corner(cell, values, hit->ws_position - vector3_t(cell));
+
+                return 1;
+            }
+        }
+
+        cell[axis] += step[axis];
+        cell_enter = next_boundary[axis];
+        next_boundary[axis] += boundary_distance[axis];
+    }
+
+    return 0;
+}
+
+bool raycast_terrain(
+    const vector3_t &ws_ray_start,
+    const vector3_t &ws_ray_direction,
+    float max_distance,
+    terrain_raycast_hit_t *hit) {
+    return s_raycast_terrain(ws_ray_start, ws_ray_direction, max_distance, NULL, 0, hit);
+}
+
+// Closest point of the triangle (Ericson, Real-Time Collision Detection 5.1.5)
+static vector3_t s_closest_point_on_triangle(const vector3_t &p, const collision_triangle_t *triangle) {
+    const vector3_t &a = triangle->v.a, &b = triangle->v.b, &c = triangle->v.c;
+
+    vector3_t ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    vector3_t bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+    vector3_t cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Contact of the sphere with the mesh: the voxel is the closest one over the surface level in the cell of the contact point
+static void s_set_mesh_hit(terrain_raycast_hit_t *hit, const vector3_t &ws_contact, float distance) {
+    hit->ws_position = ws_contact;
+    hit->distance = distance;
+
+    ivector3_t cell = ivector3_t(glm::floor(ws_contact));
+    ivector3_t chunk_coord = space_voxel_to_chunk(cell);
+    ivector3_t chunk_origin = chunk_coord * CHUNK_EDGE_LENGTH;
+    const chunk_t *chunk = g_game->access_chunk(chunk_coord);
+
+    float values[8];
+    if (s_get_cell_corner_values(cell, &chunk, &chunk_origin, values, 0)) {
+        hit->vs_voxel = s_closest_solid_corner(cell, values, ws_contact - vector3_t(cell));
+    }
+    else {
+        hit->vs_voxel = ivector3_t(glm::round(ws_contact));
+    }
+}
+
+bool raycast_terrain_sphere(
+    const vector3_t &ws_ray_start,
+    const vector3_t &ws_ray_direction,
+    float max_distance,
+    float ws_radius,
+    terrain_raycast_hit_t *hit) {
+    bool detected = raycast_terrain(ws_ray_start, ws_ray_direction, max_distance, hit);
+
+    float length = glm::length(ws_ray_direction);
+
+    if (ws_radius <= 0.0f || length == 0.0f) {
+        return detected;
+    }
+
+    // The sphere can only touch the mesh before the center gets to the surface
+    float sweep_distance = detected ? hit->distance : max_distance;
+
+    if (sweep_distance <= 0.0f) {
+        return detected;
+    }
+
+    vector3_t ws_size = vector3_t(ws_radius);
+    vector3_t ws_velocity = ws_ray_direction * (sweep_distance / length);
+
+    uint32_t triangle_count = 0;
+    collision_triangle_t *triangles = sweep_collision_triangles(&triangle_count, ws_ray_start, ws_size, ws_velocity);
+
+    // The kernel only sees the triangles which face the velocity: a sphere which already overlaps the mesh hits it where it starts
+    for (uint32_t i = 0; i < triangle_count; ++i) {
+        vector3_t ws_closest = s_closest_point_on_triangle(ws_ray_start, &triangles[i]);
+        vector3_t diff = ws_closest - ws_ray_start;
+
+        if (glm::dot(diff, diff) <= ws_radius * ws_radius) {
+            s_set_mesh_hit(hit, ws_closest, 0.0f);
+            return 1;
+        }
+    }
+
+    if (!triangle_count) {
+        return detected;
+    }
+
+    terrain_collision_t collision = {};
+    collision.ws_size = ws_size;
+    collision.ws_position = ws_ray_start;
+    collision.ws_velocity = ws_velocity;
+    collision.es_position = ws_ray_start / ws_size;
+    collision.es_velocity = ws_velocity / ws_size;
+    collision.es_normalised_velocity = glm::normalize(collision.es_velocity);
+
+    collision_triangle_batch_t batch;
+    make_collision_triangle_batch(&batch, triangles, triangle_count, ws_size);
+    get_collision_batch_kernel()(&collision, &batch);
+
+    if (collision.detected && !collision.under_terrain) {
+        float distance = collision.es_nearest_distance * ws_radius;
+
+        if (!detected || distance < hit->distance) {
+            s_set_mesh_hit(hit, collision.es_contact_point * ws_size, distance);
+            detected = 1;
+        }
+    }
+
+    return detected;
+}
+
+// Whether one of the voxels in [cs_min, cs_max] (relative to the chunk) may be over the surface level
+// Voxels outside of the chunk are found with its neighbours
+static bool s_voxels_may_be_solid(
+    const chunk_t *chunk,
+    const ivector3_t &cs_min,
+    const ivector3_t &cs_max) {
+    ivector3_t edge = ivector3_t(CHUNK_EDGE_LENGTH);
+    ivector3_t min_offset = ivector3_t(glm::greaterThanEqual(cs_min, edge)) - ivector3_t(glm::lessThan(cs_min, ivector3_t(0)));
+    ivector3_t max_offset = ivector3_t(glm::greaterThanEqual(cs_max, edge)) - ivector3_t(glm::lessThan(cs_max, ivector3_t(0)));
+
+    if (!chunk) {
+        // Nothing to check outside of a chunk which doesn't exist
+        return min_offset != ivector3_t(0) || max_offset != ivector3_t(0);
+    }
+
+    if (glm::any(glm::lessThan(cs_min, -edge)) || glm::any(glm::greaterThanEqual(cs_max, edge * 2))) {
+        return 1;
+    }
+
+    for (int32_t z = min_offset.z; z <= max_offset.z; ++z) {
+        for (int32_t y = min_offset.y; y <= max_offset.y; ++y) {
+            for (int32_t x = min_offset.x; x <= max_offset.x; ++x) {
+                const chunk_t *neighbour = get_chunk_neighbour(chunk, x, y, z);
+
+                if (neighbour) {
+                    ivector3_t offset = ivector3_t(x, y, z) * CHUNK_EDGE_LENGTH;
+                    ivector3_t lo = glm::clamp(cs_min - offset, ivector3_t(0), edge - 1);
+                    ivector3_t hi = glm::clamp(cs_max - offset, ivector3_t(0), edge - 1);
+
+                    if (neighbour->solid_bricks & s_brick_box_mask(lo / CHUNK_BRICK_EDGE_LENGTH, hi / CHUNK_BRICK_EDGE_LENGTH)) {
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Rays which start in the same chunk
+struct terrain_ray_group_t {
+    ivector3_t chunk_coord;
+    uint32_t first;
+    uint32_t count;
+};
+
+// Corners of the cells that the walk could go through between the two points (one more on each side, the walk doesn't compute the points the same way)
+static void s_get_ray_voxel_box(const vector3_t &ws_min, const vector3_t &ws_max, ivector3_t *vs_min, ivector3_t *vs_max) {
+    *vs_min = ivector3_t(glm::floor(ws_min)) - ivector3_t(1);
+    *vs_max = ivector3_t(glm::floor(ws_max)) + ivector3_t(2);
+}
+
+void raycast_terrain_batch(
+    const terrain_ray_t *rays,
+    uint32_t ray_count,
+    bool *detected,
+    terrain_raycast_hit_t *hits) {
+    uint32_t *ray_groups = LN_MALLOC(uint32_t, ray_count);
+    terrain_ray_group_t *groups = LN_MALLOC(terrain_ray_group_t, ray_count);
+    uint32_t group_count = 0;
+
+    open_hash_table_t<uint32_t> group_indices;
+    group_indices.init(ray_count * 2);
+
+    for (uint32_t r = 0; r < ray_count; ++r) {
+        // Chunk of the cell which raycast_terrain starts in
+        ivector3_t chunk_coord = ivector3_t(glm::floor(rays[r].ws_start / (float)CHUNK_EDGE_LENGTH));
+        uint64_t key = chunk_coord_key(chunk_coord);
+        uint32_t *group_index = group_indices.get(key);
+
+        if (group_index) {
+            ray_groups[r] = *group_index;
+        }
+        else {
+            groups[group_count].chunk_coord = chunk_coord;
+            groups[group_count].count = 0;
+            group_indices.insert(key, group_count);
+            ray_groups[r] = group_count++;
+        }
+
+        ++groups[ray_groups[r]].count;
+    }
+
+    group_indices.destroy();
+
+    // Rays of each group next to each other (in the order they were passed in)
+    uint32_t *ordered_rays = LN_MALLOC(uint32_t, ray_count);
+
+    for (uint32_t g = 0, first = 0; g < group_count; ++g) {
+        groups[g].first = first;
+        first += groups[g].count;
+        groups[g].count = 0;
+    }
+
+    for (uint32_t r = 0; r < ray_count; ++r) {
+        terrain_ray_group_t *group = &groups[ray_groups[r]];
+        ordered_rays[group->first + group->count++] = r;
+    }
+
+    vector3_t *ws_ends = LN_MALLOC(vector3_t, ray_count);
+
+    for (uint32_t g = 0; g < group_count; ++g) {
+        const uint32_t *group_rays = &ordered_rays[groups[g].first];
+        const chunk_t *chunk = g_game->access_chunk(groups[g].chunk_coord);
+        ivector3_t chunk_origin = groups[g].chunk_coord * CHUNK_EDGE_LENGTH;
+
+        // First, all the rays of the group at once (most of the rays of a tick are in the air)
+        vector3_t ws_min = vector3_t(INFINITY), ws_max = vector3_t(-INFINITY);
+
+        for (uint32_t i = 0; i < groups[g].count; ++i) {
+            const terrain_ray_t *ray = &rays[group_rays[i]];
+
+            float length = glm::length(ray->ws_direction);
+            vector3_t ws_end = ray->ws_start + ray->ws_direction * (length > 0.0f ? ray->max_distance / length : 0.0f);
+
+            ws_min = glm::min(ws_min, glm::min(ray->ws_start, ws_end) - vector3_t(ray->radius));
+            ws_max = glm::max(ws_max, glm::max(ray->ws_start, ws_end) + vector3_t(ray->radius));
+            ws_ends[group_rays[i]] = ws_end;
+
+            detected[group_rays[i]] = 0;
+        }
+
+        ivector3_t vs_min, vs_max;
+        s_get_ray_voxel_box(ws_min, ws_max, &vs_min, &vs_max);
+
+        if (!s_voxels_may_be_solid(chunk, vs_min - chunk_origin, vs_max - chunk_origin)) {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < groups[g].count; ++i) {
+            uint32_t r = group_rays[i];
+            const terrain_ray_t *ray = &rays[r];
+
+            s_get_ray_voxel_box(
+                glm::min(ray->ws_start, ws_ends[r]) - vector3_t(ray->radius),
+                glm::max(ray->ws_start, ws_ends[r]) + vector3_t(ray->radius),
+                &vs_min, &vs_max);
+
+            if (groups[g].count > 1 && !s_voxels_may_be_solid(chunk, vs_min - chunk_origin, vs_max - chunk_origin)) {
+                continue;
+            }
+
+            terrain_raycast_hit_t hit;
+            detected[r] = raycast_terrain_sphere(ray->ws_start, ray->ws_direction, ray->max_distance, ray->radius, &hit);
+
+            if (detected[r] && hits) {
+                hits[r] = hit;
+            }
+        }
+    }
+}
+
+// Brushes that the player whose actions are running queued since begin_player_terraform_commands
+static const terraform_command_t *s_get_player_terraform_commands(
+    uint32_t *count) {
+    terraform_queue_t *queue = &g_game->terraform_queue;
+    *count = queue->command_count - queue->player_first_command;
+
+    return &queue->commands[queue->player_first_command];
+}
+
+terraform_package_t cast_terrain_ray(
+    const vector3_t &ws_ray_start,
+    const vector3_t &ws_ray_direction,
+    float max_reach,
+    voxel_color_t color) {
+    terraform_package_t package = {};
+    package.ray_hit_terrain = 0;
+    package.color = color;
+
+    uint32_t pending_count;
+    const terraform_command_t *pending = s_get_player_terraform_commands(&pending_count);
+
+    terrain_raycast_hit_t hit;
+    if (s_raycast_terrain(ws_ray_start, ws_ray_direction, max_reach, pending, pending_count, &hit)) {
+        package.ray_hit_terrain = 1;
+        package.ws_contact_point = hit.ws_position;
+        package.ws_position = glm::round(package.ws_contact_point);
+    }
+
+    return package;
+}
+
+// set_chunk_voxel bookkeeping for a box of voxels which got written directly (lo / hi are inclusive, local to the chunk)
+static void s_mark_voxel_box_modified(chunk_t *chunk, const ivector3_t &lo, const ivector3_t &hi) {
+    chunk->flags.needs_flush = 1;
+    chunk->flags.has_to_update_vertices = 1;
+
+    ivector3_t brick_lo = glm::max(lo - 1, ivector3_t(0)) / CHUNK_BRICK_EDGE_LENGTH;
+    ivector3_t brick_hi = hi / CHUNK_BRICK_EDGE_LENGTH;
+    mark_chunk_bricks_dirty(chunk, s_brick_box_mask(brick_lo, brick_hi));
+
+    // Last cells of the chunks at -1 read the voxels on the low faces
+    for (int32_t z = lo.z ? 0 : -1; z <= 0; ++z) {
+        for (int32_t y = lo.y ? 0 : -1; y <= 0; ++y) {
+            for (int32_t x = lo.x ? 0 : -1; x <= 0; ++x) {
+                chunk_t *neighbour = get_chunk_neighbour(chunk, x, y, z);
+
+                if ((x || y || z) && neighbour) {
+                    ivector3_t last_brick = ivector3_t(CHUNK_EDGE_LENGTH / CHUNK_BRICK_EDGE_LENGTH - 1);
+                    ivector3_t neighbour_lo = ivector3_t(x ? last_brick.x : brick_lo.x, y ? last_brick.y : brick_lo.y, z ? last_brick.z : brick_lo.z);
+                    ivector3_t neighbour_hi = ivector3_t(x ? last_brick.x : brick_hi.x, y ? last_brick.y : brick_hi.y, z ? last_brick.z : brick_hi.z);
+
+                    mark_chunk_bricks_dirty(neighbour, s_brick_box_mask(neighbour_lo, neighbour_hi));
+                    neighbour->flags.has_to_update_vertices = 1;
+                }
+            }
+        }
+    }
+
+    bool on_edge =
+        !lo.x || !lo.y || !lo.z ||
+        hi.x == CHUNK_EDGE_LENGTH - 1 || hi.y == CHUNK_EDGE_LENGTH - 1 || hi.z == CHUNK_EDGE_LENGTH - 1;
+
+    if (on_edge) {
+        invalidate_all_chunk_aprons(chunk);
+    }
+    else {
+        s_release_chunk_apron(chunk);
+    }
+}
+
+// Brush over the voxels [lo, hi] of the chunk (center is relative to the chunk), one row at a time
+// The chunk has to be dense, the caller marks the box as modified
+static void s_terraform_chunk(
+    chunk_t *chunk,
+    const ivector3_t &lo,
+    const ivector3_t &hi,
+    const ivector3_t &center,
+    terraform_brush_t *brush,
+    terraform_row_kernel_t kernel,
+    bool with_history) {
+    brush->center_x = center.x;
+
+    for (int32_t z = lo.z; z <= hi.z; ++z) {
+        for (int32_t y = lo.y; y <= hi.y; ++y) {
+            int32_t dy = y - center.y;
+            int32_t dz = z - center.z;
+            int32_t yz_distance_squared = dy * dy + dz * dz;
+
+            if ((float)yz_distance_squared > brush->radius_squared) {
+                continue;
+            }
+
+            // Rows are contiguous in the linear layout, other layouts go through a copy of the row
+            voxel_t gathered[CHUNK_EDGE_LENGTH] = {};
+            voxel_t previous[CHUNK_EDGE_LENGTH];
+            voxel_t *row = gathered;
+
+            if (voxel_layout_t::IS_LINEAR) {
+                row = &chunk->voxels[get_voxel_index(0, y, z)];
+            }
+            else {
+                for (int32_t x = lo.x; x <= hi.x; ++x) {
+                    gathered[x] = chunk->voxels[get_voxel_index(x, y, z)];
+                }
+            }
+
+            memcpy(previous, row, sizeof(previous));
+
+            uint32_t changed = kernel(row, lo.x, hi.x, yz_distance_squared, brush);
+
+            if (!voxel_layout_t::IS_LINEAR) {
+                for (int32_t x = lo.x; x <= hi.x; ++x) {
+                    chunk->voxels[get_voxel_index(x, y, z)] = gathered[x];
+                }
+            }
+
+            // Brick occupancy and history only change for voxels whose value changed
+            for (int32_t x = lo.x; changed >> x; ++x) {
+                if (changed & (1u << x)) {
+                    uint32_t index = get_voxel_index(x, y, z);
+
+                    bool solid = row[x].value > CHUNK_SURFACE_LEVEL;
+                    if ((previous[x].value > CHUNK_SURFACE_LEVEL) != solid) {
+                        update_chunk_brick(chunk, index, solid);
+                    }
+
+                    if (with_history) {
+                        uint8_t *vh = &chunk->history->modification_pool[index];
+
+                        // Didn't add to the history yet
+                        if (*vh == CHUNK_SPECIAL_VALUE) {
+                            *vh = previous[x].value;
+                            chunk->history->modification_stack[chunk->history->modification_count++] = index;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static terraform_brush_t s_make_terraform_brush(const terraform_command_t *command) {
+    terraform_brush_t brush = {};
+    brush.radius_squared = command->radius * command->radius;
+    brush.coeff = (command->type == TT_DESTROY) ? -1.0f : +1.0f;
+    brush.dt = command->dt;
+    brush.speed = command->speed;
+    brush.color = command->color;
+
+    return brush;
+}
+
+// Part of a queued brush which falls in one chunk (lo / hi / center are relative to the chunk)
+struct terraform_chunk_job_t {
+    uint64_t chunk_key;
+    uint32_t command_index;
+    chunk_t *chunk;
+    ivector3_t lo;
+    ivector3_t hi;
+    ivector3_t center;
+};
+
+// Chunk by chunk, brushes of a chunk stay in the order they were queued in
+static int32_t s_compare_terraform_jobs(const void *a, const void *b) {
+    const terraform_chunk_job_t *job_a = (const terraform_chunk_job_t *)a;
+    const terraform_chunk_job_t *job_b = (const terraform_chunk_job_t *)b;
+
+    if (job_a->chunk_key != job_b->chunk_key) {
+        return job_a->chunk_key < job_b->chunk_key ? -1 : 1;
+    }
+
+    return (int32_t)job_a->command_index - (int32_t)job_b->command_index;
+}
+
+// Clips the brush against every chunk it intersects (chunks which don't exist yet get created)
+static uint32_t s_clip_terraform_command(
+    const terraform_command_t *command,
+    uint32_t command_index,
+    terraform_chunk_job_t *jobs) {
+    float radius_squared = command->radius * command->radius;
+    uint32_t job_count = 0;
+
+    ivector3_t vs_min = command->vs_center - ivector3_t((int32_t)command->radius);
+    ivector3_t vs_max = command->vs_center + ivector3_t((int32_t)command->radius);
+    ivector3_t chunk_min = space_voxel_to_chunk(vs_min);
+    ivector3_t chunk_max = space_voxel_to_chunk(vs_max);
+
+    for (int32_t cz = chunk_min.z; cz <= chunk_max.z; ++cz) {
+        for (int32_t cy = chunk_min.y; cy <= chunk_max.y; ++cy) {
+            for (int32_t cx = chunk_min.x; cx <= chunk_max.x; ++cx) {
+                ivector3_t chunk_coord = ivector3_t(cx, cy, cz);
+                ivector3_t xs_bottom_corner = chunk_coord * CHUNK_EDGE_LENGTH;
+                ivector3_t center = command->vs_center - xs_bottom_corner;
+                ivector3_t lo = glm::max(vs_min - xs_bottom_corner, ivector3_t(0));
+                ivector3_t hi = glm::min(vs_max - xs_bottom_corner, ivector3_t(CHUNK_EDGE_LENGTH - 1));
+
+                // Chunks which only the corners of the box reach don't have any voxel in the brush
+                ivector3_t closest = glm::clamp(center, lo, hi) - center;
+                if ((float)(closest.x * closest.x + closest.y * closest.y + closest.z * closest.z) > radius_squared) {
+                    continue;
+                }
+
+                chunk_t *chunk = g_game->get_chunk(chunk_coord);
+
+                if (command->with_history) {
+                    if (!chunk->flags.made_modification) {
+                        // Push this chunk onto list of modified chunks
+                        g_game->modified_chunks[g_game->modified_chunk_count++] = chunk;
+                    }
+
+                    if (chunk->history == NULL) {
+                        activate_chunk_history(chunk);
+                    }
+                }
+
+                chunk->flags.made_modification = 1;
+                chunk->flags.has_to_update_vertices = 1;
+
+                terraform_chunk_job_t *job = &jobs[job_count++];
+                job->chunk_key = chunk_coord_key(chunk_coord);
+                job->command_index = command_index;
+                job->chunk = chunk;
+                job->lo = lo;
+                job->hi = hi;
+                job->center = center;
+            }
+        }
+    }
+
+    return job_count;
+}
+
+void apply_terraform_commands() {
+    terraform_queue_t *queue = &g_game->terraform_queue;
+
+    if (!queue->command_count) {
+        return;
+    }
+
+    uint32_t max_job_count = 0;
+    for (uint32_t i = 0; i < queue->command_count; ++i) {
+        ivector3_t extent = ivector3_t((int32_t)queue->commands[i].radius);
+        ivector3_t chunk_range = space_voxel_to_chunk(queue->commands[i].vs_center + extent) - space_voxel_to_chunk(queue->commands[i].vs_center - extent) + 1;
+        max_job_count += chunk_range.x * chunk_range.y * chunk_range.z;
+    }
 
-terraform_package_t cast_terrain_ray(
-    const vector3_t &ws_ray_start,
-    const vector3_t &ws_ray_direction,
-    float max_reach,
-    voxel_color_t color) {
-    vector3_t vs_position = ws_ray_start;
-    vector3_t vs_dir = ws_ray_direction;
+    terraform_chunk_job_t *jobs = LN_MALLOC(terraform_chunk_job_t, max_job_count);
+    uint32_t job_count = 0;
 
-    static const float PRECISION = 1.0f / 15.0f;
-    
-    vector3_t vs_step = vs_dir * max_reach * PRECISION;
+    for (uint32_t i = 0; i < queue->command_count; ++i) {
+        job_count += s_clip_terraform_command(&queue->commands[i], i, &jobs[job_count]);
+    }
 
-    float max_reach_squared = max_reach * max_reach;
+    qsort(jobs, job_count, sizeof(terraform_chunk_job_t), s_compare_terraform_jobs);
 
-    terraform_package_t package = {};
-    package.ray_hit_terrain = 0;
-    package.color = color;
+    terraform_row_kernel_t kernel = get_terraform_row_kernel();
 
-    for (; glm::dot(vs_position - ws_ray_start, vs_position - ws_ray_start) < max_reach_squared; vs_position += vs_step) {
-        ivector3_t voxel = space_world_to_voxel(vs_position);
-        ivector3_t chunk_coord = space_voxel_to_chunk(voxel);
-        chunk_t *chunk = g_game->access_chunk(chunk_coord);
+    for (uint32_t first = 0, last = 0; first < job_count; first = last) {
+        chunk_t *chunk = jobs[first].chunk;
+        ivector3_t lo = jobs[first].lo;
+        ivector3_t hi = jobs[first].hi;
 
-        if (chunk) {
-            ivector3_t local_voxel_coord = space_voxel_to_local_chunk(voxel);
-            voxel_t *voxel_ptr = &chunk->voxels[get_voxel_index(local_voxel_coord.x, local_voxel_coord.y, local_voxel_coord.z)];
+        make_chunk_dense(chunk);
 
-            terrain_collision_t collision = {};
-            collision.ws_size = vector3_t(0.1f);
-            collision.ws_position = vs_position;
-            collision.ws_velocity = vs_dir;
-            collision.es_position = collision.ws_position / collision.ws_size;
-            collision.es_velocity = collision.ws_velocity / collision.ws_size;
+        // Overlapping brushes of the chunk: the bookkeeping happens once, for the union of their boxes
+        for (last = first; last < job_count && jobs[last].chunk == chunk; ++last) {
+            const terraform_command_t *command = &queue->commands[jobs[last].command_index];
+            terraform_brush_t brush = s_make_terraform_brush(command);
 
-            check_ray_terrain_collision(&collision);
+            s_terraform_chunk(chunk, jobs[last].lo, jobs[last].hi, jobs[last].center, &brush, kernel, command->with_history);
 
-            if (collision.detected) {
-                package.ray_hit_terrain = 1;
-                package.ws_contact_point = collision.es_contact_point * collision.ws_size;
-                package.ws_position = glm::round(package.ws_contact_point);
-                break;
-            }
+            lo = glm::min(lo, jobs[last].lo);
+            hi = glm::max(hi, jobs[last].hi);
         }
+
+        s_mark_voxel_box_modified(chunk, lo, hi);
     }
 
-    return package;
+    queue->command_count = 0;
+    queue->player_first_command = 0;
+}
+
+void begin_player_terraform_commands() {
+    terraform_queue_t *queue = &g_game->terraform_queue;
+    queue->player_first_command = queue->command_count;
+}
+
+static void s_queue_terraform_command(
+    terraform_type_t type,
+    const ivector3_t &vs_center,
+    voxel_color_t color,
+    float radius,
+    float speed,
+    float dt,
+    bool with_history) {
+    terraform_queue_t *queue = &g_game->terraform_queue;
+
+    // A lot of players terraformed this tick: what is already queued gets applied now (the brushes keep their order)
+    if (queue->command_count == TERRAFORM_MAX_QUEUED_COMMANDS) {
+        LOG_WARNING("Terraform queue is full, applying it before the end of the tick\n");
+        apply_terraform_commands();
+    }
+
+    terraform_command_t *command = &queue->commands[queue->command_count++];
+    command->type = type;
+    command->vs_center = vs_center;
+    command->color = color;
+    command->with_history = with_history;
+    command->radius = radius;
+    command->speed = speed;
+    command->dt = dt;
 }
 
 static bool s_terraform_with_history(
@@ -463,110 +1987,15 @@ static bool s_terraform_with_history(
     float dt) {
     if (package.ray_hit_terrain) {
         ivector3_t voxel = space_world_to_voxel(package.ws_position);
-        ivector3_t chunk_coord = space_voxel_to_chunk(voxel);
-        chunk_t *chunk = g_game->access_chunk(chunk_coord);
+        chunk_t *chunk = g_game->get_chunk(space_voxel_to_chunk(voxel));
 
+        // The chunk which got hit comes first in the list of modified chunks
         if (!chunk->flags.made_modification) {
-            // Push this chunk onto list of modified chunks
             g_game->modified_chunks[g_game->modified_chunk_count++] = chunk;
+            chunk->flags.made_modification = 1;
         }
-                    
-        chunk->flags.made_modification = 1;
-        chunk->flags.has_to_update_vertices = 1;
-
-        float coeff = 0.0f;
-        switch(type) {
-                        
-        case TT_DESTROY: {
-            coeff = -1.0f;
-        } break;
-                        
-        case TT_BUILD: {
-            coeff = +1.0f;
-        } break;
-                        
-        }
-
-        float radius_squared = radius * radius;
-        ivector3_t bottom_corner = voxel - ivector3_t((int32_t)radius);
-        int32_t diameter = (int32_t)radius * 2 + 1;
-
-#if 0
-        // Make sure to activate chunk history
-        if (chunk->history == NULL) {
-            activate_chunk_history(chunk);
-        }
-#endif
-
-        for (int32_t z = bottom_corner.z; z < bottom_corner.z + diameter; ++z) {
-            for (int32_t y = bottom_corner.y; y < bottom_corner.y + diameter; ++y) {
-                for (int32_t x = bottom_corner.x; x < bottom_corner.x + diameter; ++x) {
-                    vector3_t current_voxel = vector3_t((float)x, (float)y, (float)z);
-                    vector3_t diff = current_voxel - (vector3_t)voxel;
-                    float distance_squared = glm::dot(diff, diff);
-
-                    if (distance_squared <= radius_squared) {
-                        ivector3_t current_local_coord = (ivector3_t)current_voxel - chunk->xs_bottom_corner;
-                                
-                        if (current_local_coord.x < 0 || current_local_coord.x >= 16 ||
-                            current_local_coord.y < 0 || current_local_coord.y >= 16 ||
-                            current_local_coord.z < 0 || current_local_coord.z >= 16) {
-                            // If the current voxel coord is out of bounds, switch chunks
-                            ivector3_t chunk_coord = space_voxel_to_chunk(current_voxel);
-                            chunk_t *new_chunk = g_game->get_chunk(chunk_coord);
-
-                            chunk = new_chunk;
-
-                            if (!chunk->flags.made_modification) {
-                                // Push this chunk onto list of modified chunks
-                                g_game->modified_chunks[g_game->modified_chunk_count++] = chunk;
-                            }
-                                        
-                            chunk->flags.made_modification = 1;
-                            chunk->flags.has_to_update_vertices = 1;
-
-#if 0
-                            if (chunk->history == NULL) {
-                                activate_chunk_history(chunk);
-                            }
-#endif
-
-                            current_local_coord = (ivector3_t)current_voxel - chunk->xs_bottom_corner;
-                        }
 
-                        uint32_t voxel_index = get_voxel_index(current_local_coord.x, current_local_coord.y, current_local_coord.z);
-                        voxel_t *voxel = &chunk->voxels[voxel_index];
-                        uint8_t voxel_value = voxel->value;
-                        float proportion = 1.0f - (distance_squared / radius_squared);
-
-                        int32_t current_voxel_value = (int32_t)voxel->value;
-
-                        int32_t new_value = (int32_t)(proportion * coeff * dt * speed) + current_voxel_value;
-
-                        uint8_t *vh = &chunk->history.modification_pool[voxel_index];
-                                    
-                        if (new_value > (int32_t)CHUNK_MAX_VOXEL_VALUE_I) {
-                            voxel_value = (int32_t)CHUNK_MAX_VOXEL_VALUE_I;
-                        }
-                        else if (new_value < 0) {
-                            voxel_value = 0;
-                        }
-                        else {
-                            voxel_value = (uint8_t)new_value;
-                        }
-
-                        // Didn't add to the history yet
-                        if (*vh == CHUNK_SPECIAL_VALUE && voxel_value != voxel->value) {
-                            *vh = voxel->value;
-                            chunk->history.modification_stack[chunk->history.modification_count++] = voxel_index;
-                        }
-                                    
-                        voxel->value = voxel_value;
-                        voxel->color = package.color;
-                    }
-                }
-            }
-        }
+        s_queue_terraform_command(type, voxel, package.color, radius, speed, dt, 1);
 
         return 1;
     }
@@ -587,81 +2016,14 @@ static bool s_terraform_without_history(
 
         if (chunk) {
             ivector3_t local_voxel_coord = space_voxel_to_local_chunk(voxel);
-            voxel_t *voxel_ptr = &chunk->voxels[get_voxel_index(local_voxel_coord.x, local_voxel_coord.y, local_voxel_coord.z)];
-            if (voxel_ptr->value > CHUNK_SURFACE_LEVEL) {
-                package.ray_hit_terrain = 1;
-
-                chunk->flags.made_modification = 1;
-                chunk->flags.has_to_update_vertices = 1;
+            voxel_t hit_voxel = get_chunk_voxel(chunk, get_voxel_index(local_voxel_coord.x, local_voxel_coord.y, local_voxel_coord.z));
 
-                float coeff = 0.0f;
-                switch(type) {
-                        
-                case TT_DESTROY: {
-                    coeff = -1.0f;
-                } break;
-                        
-                case TT_BUILD: {
-                    coeff = +1.0f;
-                } break;
-                        
-                }
+            // Same terrain as the one cast_terrain_ray saw
+            uint32_t pending_count;
+            const terraform_command_t *pending = s_get_player_terraform_commands(&pending_count);
 
-                float radius_squared = radius * radius;
-                ivector3_t bottom_corner = voxel - ivector3_t((int32_t)radius);
-                int32_t diameter = (int32_t)radius * 2 + 1;
-
-                for (int32_t z = bottom_corner.z; z < bottom_corner.z + diameter; ++z) {
-                    for (int32_t y = bottom_corner.y; y < bottom_corner.y + diameter; ++y) {
-                        for (int32_t x = bottom_corner.x; x < bottom_corner.x + diameter; ++x) {
-                            vector3_t current_voxel = vector3_t((float)x, (float)y, (float)z);
-                            vector3_t diff = current_voxel - (vector3_t)voxel;
-                            float distance_squared = glm::dot(diff, diff);
-
-                            if (distance_squared <= radius_squared) {
-                                ivector3_t current_local_coord = (ivector3_t)current_voxel - chunk->xs_bottom_corner;
-                                
-                                if (current_local_coord.x < 0 || current_local_coord.x >= 16 ||
-                                    current_local_coord.y < 0 || current_local_coord.y >= 16 ||
-                                    current_local_coord.z < 0 || current_local_coord.z >= 16) {
-                                    // If the current voxel coord is out of bounds, switch chunks
-                                    ivector3_t chunk_coord = space_voxel_to_chunk(current_voxel);
-                                    chunk_t *new_chunk = g_game->get_chunk(chunk_coord);
-
-                                    chunk = new_chunk;
-                                    chunk->flags.made_modification = 1;
-                                    chunk->flags.has_to_update_vertices = 1;
-
-                                    current_local_coord = (ivector3_t)current_voxel - chunk->xs_bottom_corner;
-                                }
-
-                                uint32_t voxel_index = get_voxel_index(current_local_coord.x, current_local_coord.y, current_local_coord.z);
-
-                                voxel_t *voxel = &chunk->voxels[voxel_index];
-                                float proportion = 1.0f - (distance_squared / radius_squared);
-
-                                int32_t current_voxel_value = (int32_t)voxel->value;
-
-                                int32_t new_value = (int32_t)(proportion * coeff * dt * speed) + current_voxel_value;
-
-                                uint8_t voxel_value = 0;
-                                    
-                                if (new_value > (int32_t)CHUNK_MAX_VOXEL_VALUE_I) {
-                                    voxel_value = (int32_t)CHUNK_MAX_VOXEL_VALUE_I;
-                                }
-                                else if (new_value < 0) {
-                                    voxel_value = 0;
-                                }
-                                else {
-                                    voxel_value = (uint8_t)new_value;
-                                }
-
-                                voxel->value = voxel_value;
-                                voxel->color = package.color;
-                            }
-                        }
-                    }
-                }
+            if (s_apply_queued_brushes(voxel, (float)hit_voxel.value, pending, pending_count) > (float)CHUNK_SURFACE_LEVEL) {
+                s_queue_terraform_command(type, voxel, package.color, radius, speed, dt, 0);
             }
         }
 
@@ -690,41 +2052,6 @@ bool terraform(terraform_type_t type, terraform_package_t package, float radius,
     }
 }
 
-static uint8_t s_chunk_edge_voxel_value(
-    int32_t x,
-    int32_t y,
-    int32_t z,
-    bool *doesnt_exist,
-    ivector3_t chunk_coord) {
-    int32_t chunk_coord_offset_x = 0, chunk_coord_offset_y = 0, chunk_coord_offset_z = 0;
-    int32_t final_x = x, final_y = y, final_z = z;
-
-    if (x == CHUNK_EDGE_LENGTH) {
-        final_x = 0;
-        chunk_coord_offset_x = 1;
-    }
-    if (y == CHUNK_EDGE_LENGTH) {
-        final_y = 0;
-        chunk_coord_offset_y = 1;
-    }
-    if (z == CHUNK_EDGE_LENGTH) {
-        final_z = 0;
-        chunk_coord_offset_z = 1;
-    }
-
-    chunk_t *chunk_ptr = g_game->access_chunk(
-        ivector3_t(chunk_coord.x + chunk_coord_offset_x,
-                   chunk_coord.y + chunk_coord_offset_y,
-                   chunk_coord.z + chunk_coord_offset_z));
-    
-    *doesnt_exist = (bool)(chunk_ptr == nullptr);
-    if (*doesnt_exist) {
-        return 0;
-    }
-    
-    return chunk_ptr->voxels[get_voxel_index(final_x, final_y, final_z)].value;
-}
-
 #include "triangle_table.inc"
 
 static const vector3_t NORMALIZED_CUBE_VERTICES[8] = {
@@ -783,417 +2110,537 @@ static void s_push_collision_triangles_vertices(
 
     const int8_t *triangle_entry = &TRIANGLE_TABLE[bit_combination][0];
 
-    uint32_t edge = 0;
+    if (triangle_entry[0] == -1) {
+        return;
+    }
 
-    int8_t edge_pair[3] = {};
+    vector3_t vertices[8];
+    for (uint32_t i = 0; i < 8; ++i) {
+        vertices[i] = NORMALIZED_CUBE_VERTICES[i] + vector3_t(0.5f) + vector3_t((float)x, (float)y, (float)z);
+    }
 
-    while (triangle_entry[edge] != -1) {
+    // Entries of the triangle table come in groups of 3 edges (one triangle)
+    for (uint32_t edge = 0; triangle_entry[edge] != -1; edge += 3) {
         if (*count + 3 >= max) {
             break;
         }
 
-        int8_t edge_index = triangle_entry[edge];
-        edge_pair[edge % 3] = edge_index;
+        for (uint32_t i = 0; i < 3; ++i) {
+            const uint8_t *corners = CELL_EDGE_CORNERS[triangle_entry[edge + i]];
+            s_push_collision_vertex(corners[0], corners[1], vertices, voxel_values, surface_level, &dst_array[*count], i);
+        }
 
-        if (edge % 3 == 2) {
-            vector3_t vertices[8] = {};
-            for (uint32_t i = 0; i < 8; ++i) {
-                vertices[i] = NORMALIZED_CUBE_VERTICES[i] + vector3_t(0.5f) + vector3_t((float)x, (float)y, (float)z);
-            }
+        (*count)++;
+    }
+}
+
+bool chunk_brick_may_have_surface(const chunk_t *chunk, const ivector3_t &brick) {
+    bool has_solid = 0, has_air = 0;
 
-            for (uint32_t i = 0; i < 3; ++i) {
-                switch (edge_pair[i]) {
-                case 0: { s_push_collision_vertex(0, 1, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 1: { s_push_collision_vertex(1, 2, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 2: { s_push_collision_vertex(2, 3, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 3: { s_push_collision_vertex(3, 0, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 4: { s_push_collision_vertex(4, 5, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 5: { s_push_collision_vertex(5, 6, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 6: { s_push_collision_vertex(6, 7, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 7: { s_push_collision_vertex(7, 4, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 8: { s_push_collision_vertex(0, 4, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 9: { s_push_collision_vertex(1, 5, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 10: { s_push_collision_vertex(2, 6, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
-                case 11: { s_push_collision_vertex(3, 7, vertices, voxel_values, surface_level, &dst_array[*count], i); } break;
+    for (int32_t z = 0; z <= 1; ++z) {
+        for (int32_t y = 0; y <= 1; ++y) {
+            for (int32_t x = 0; x <= 1; ++x) {
+                ivector3_t current = brick + ivector3_t(x, y, z);
+                ivector3_t offset = ivector3_t(
+                    current.x == CHUNK_BRICK_EDGE_LENGTH,
+                    current.y == CHUNK_BRICK_EDGE_LENGTH,
+                    current.z == CHUNK_BRICK_EDGE_LENGTH);
+
+                const chunk_t *owner = get_chunk_neighbour(chunk, offset.x, offset.y, offset.z);
+
+                if (owner) {
+                    current -= offset * CHUNK_BRICK_EDGE_LENGTH;
+                    uint64_t bit = 1ull << (current.x + current.y * 4 + current.z * 16);
+
+                    has_solid |= (owner->solid_bricks & bit) != 0;
+                    has_air |= (owner->air_bricks & bit) != 0;
+                }
+                else {
+                    has_air = 1;
                 }
             }
-
-            (*count)++;
         }
+    }
+
+    return has_solid && has_air;
+}
 
-        ++edge;
+static void s_empty_collision_bvh_node(collision_bvh_node_t *node) {
+    for (uint32_t i = 0; i < 3; ++i) {
+        node->min[i] = 0xFFFF;
+        node->max[i] = 0;
     }
 }
 
-static collision_triangle_t *s_get_collision_triangles(
-    uint32_t *triangle_count,
-    const vector3_t &ws_center,
-    const vector3_t &ws_size) {
-    // Get range of triangles (v3 min - v3 max)
-    ivector3_t bounding_cube_max = ivector3_t(glm::ceil(ws_center + ws_size));
-    ivector3_t bounding_cube_min = ivector3_t(glm::floor(ws_center - ws_size));
-    ivector3_t bounding_cube_range = bounding_cube_max - bounding_cube_min;
+static void s_grow_collision_bvh_node(collision_bvh_node_t *node, const collision_bvh_node_t *child) {
+    for (uint32_t i = 0; i < 3; ++i) {
+        node->min[i] = MIN(node->min[i], child->min[i]);
+        node->max[i] = MAX(node->max[i], child->max[i]);
+    }
+}
 
-    bool is_between_chunks = 0;
-    ivector3_t min_local_coord = space_voxel_to_local_chunk(bounding_cube_min);
-    ivector3_t max_local_coord = space_voxel_to_local_chunk(bounding_cube_max);
+// Bounds of the leaves of the brick, then of the brick (brick is the Morton index of the brick)
+static void s_refit_collision_brick(chunk_t *chunk, chunk_collision_mesh_t *mesh, uint32_t brick) {
+    collision_bvh_node_t *brick_node = &mesh->nodes[COLLISION_BVH_LEVEL_OFFSETS[COLLISION_BVH_LEAF_LEVEL - 1] + brick];
+    s_empty_collision_bvh_node(brick_node);
 
-    if (max_local_coord.x < min_local_coord.x ||
-        max_local_coord.y < min_local_coord.y ||
-        max_local_coord.z < min_local_coord.z) {
-        is_between_chunks = 1;
-    }
+    vector3_t ws_corner = vector3_t(chunk->xs_bottom_corner);
 
-    uint32_t collision_vertex_count = 0;
-    // Estimation
-    uint32_t max_vertices = 5 * (uint32_t)glm::dot(vector3_t(bounding_cube_range), vector3_t(bounding_cube_range)) / 2;
-    collision_triangle_t *triangles = LN_MALLOC(collision_triangle_t, max_vertices);
+    for (uint32_t l = brick * 8; l < brick * 8 + 8; ++l) {
+        collision_bvh_node_t *leaf = &mesh->nodes[COLLISION_BVH_LEVEL_OFFSETS[COLLISION_BVH_LEAF_LEVEL] + l];
+        uint32_t begin = mesh->cell_first_triangles[l * COLLISION_BVH_LEAF_CELL_COUNT];
+        uint32_t end = mesh->cell_first_triangles[(l + 1) * COLLISION_BVH_LEAF_CELL_COUNT];
 
-    for (int32_t z = bounding_cube_min.z; z < bounding_cube_max.z; ++z) {
-        for (int32_t y = bounding_cube_min.y; y < bounding_cube_max.y; ++y) {
-            for (int32_t x = bounding_cube_min.x; x < bounding_cube_max.x; ++x) {
-                ivector3_t voxel_coord = ivector3_t(x, y, z);
-                ivector3_t chunk_coord = space_voxel_to_chunk(voxel_coord);
-                chunk_t *chunk = g_game->access_chunk(chunk_coord);
+        s_empty_collision_bvh_node(leaf);
 
-                if (chunk) {
-                    bool doesnt_exist = 0;
-                
-                    uint8_t voxel_values[8] = {};
-                    
-                    ivector3_t cs_coord = space_voxel_to_local_chunk(voxel_coord);
-                    
-                    if (is_between_chunks) {
-                        voxel_values[0] = chunk->voxels[get_voxel_index(cs_coord.x, cs_coord.y, cs_coord.z)].value;
-                        voxel_values[1] = s_chunk_edge_voxel_value(cs_coord.x + 1, cs_coord.y, cs_coord.z, &doesnt_exist, chunk_coord);
-                        voxel_values[2] = s_chunk_edge_voxel_value(cs_coord.x + 1, cs_coord.y, cs_coord.z + 1, &doesnt_exist, chunk_coord);
-                        voxel_values[3] = s_chunk_edge_voxel_value(cs_coord.x,     cs_coord.y, cs_coord.z + 1, &doesnt_exist, chunk_coord);
-                        
-                        voxel_values[4] = s_chunk_edge_voxel_value(cs_coord.x,     cs_coord.y + 1, cs_coord.z, &doesnt_exist, chunk_coord);
-                        voxel_values[5] = s_chunk_edge_voxel_value(cs_coord.x + 1, cs_coord.y + 1, cs_coord.z, &doesnt_exist, chunk_coord);
-                        voxel_values[6] = s_chunk_edge_voxel_value(cs_coord.x + 1, cs_coord.y + 1, cs_coord.z + 1, &doesnt_exist, chunk_coord);
-                        voxel_values[7] = s_chunk_edge_voxel_value(cs_coord.x,     cs_coord.y + 1, cs_coord.z + 1, &doesnt_exist, chunk_coord);
-                    }
-                    else {
-                        voxel_values[0] = chunk->voxels[get_voxel_index(cs_coord.x, cs_coord.y, cs_coord.z)].value;
-                        voxel_values[1] = chunk->voxels[get_voxel_index(cs_coord.x + 1, cs_coord.y, cs_coord.z)].value;
-                        voxel_values[2] = chunk->voxels[get_voxel_index(cs_coord.x + 1, cs_coord.y, cs_coord.z + 1)].value;
-                        voxel_values[3] = chunk->voxels[get_voxel_index(cs_coord.x, cs_coord.y, cs_coord.z + 1)].value;
-                    
-                        voxel_values[4] = chunk->voxels[get_voxel_index(cs_coord.x, cs_coord.y + 1, cs_coord.z)].value;
-                        voxel_values[5] = chunk->voxels[get_voxel_index(cs_coord.x + 1, cs_coord.y + 1, cs_coord.z)].value;
-                        voxel_values[6] = chunk->voxels[get_voxel_index(cs_coord.x + 1, cs_coord.y + 1, cs_coord.z + 1)].value;
-                        voxel_values[7] = chunk->voxels[get_voxel_index(cs_coord.x, cs_coord.y + 1, cs_coord.z + 1)].value;
-                    }
+        if (begin == end) {
+            continue;
+        }
 
-                    s_push_collision_triangles_vertices(
-                        voxel_values,
-                        x,
-                        y,
-                        z,
-                        CHUNK_SURFACE_LEVEL,
-                        triangles,
-                        &collision_vertex_count,
-                        max_vertices);
-                }
+        vector3_t ls_min = vector3_t(CHUNK_EDGE_LENGTH), ls_max = vector3_t(0.0f);
+        for (uint32_t t = begin; t < end; ++t) {
+            for (uint32_t v = 0; v < 3; ++v) {
+                vector3_t ls_vertex = mesh->triangles[t].vertices[v] - ws_corner;
+                ls_min = glm::min(ls_min, ls_vertex);
+                ls_max = glm::max(ls_max, ls_vertex);
             }
         }
-    }
 
-    *triangle_count = collision_vertex_count;
+        // Rounded outwards so that the quantised bounds always contain the triangles
+        vector3_t qs_min = glm::clamp(glm::floor(ls_min * COLLISION_BVH_QUANTISATION), vector3_t(0.0f), vector3_t(65535.0f));
+        vector3_t qs_max = glm::clamp(glm::ceil(ls_max * COLLISION_BVH_QUANTISATION), vector3_t(0.0f), vector3_t(65535.0f));
 
-    return triangles;
+        for (uint32_t i = 0; i < 3; ++i) {
+            leaf->min[i] = (uint16_t)qs_min[i];
+            leaf->max[i] = (uint16_t)qs_max[i];
+        }
+
+        s_grow_collision_bvh_node(brick_node, leaf);
+    }
 }
 
-// This function solves the quadratic eqation "At^2 + Bt + C = 0" and is found in Kasper Fauerby's paper on collision detection and response
-static bool s_get_smallest_root(
-    float a,
-    float b,
-    float c,
-    float max_r,
-    float *root) {
-    // Check if a solution exists
-    float determinant = b * b - 4.0f * a * c;
-    // If determinant is negative it means no solutions.
-    if (determinant < 0.0f) return false;
-    // calculate the two roots: (if determinant == 0 then
-    // x1==x2 but lets disregard that slight optimization)
-    float sqrt_d = sqrt(determinant);
-    float r1 = (-b - sqrt_d) / (2 * a);
-    float r2 = (-b + sqrt_d) / (2 * a);
-    // Sort so x1 <= x2
-    if (r1 > r2) {
-        float temp = r2;
-        r2 = r1;
-        r1 = temp;
-    }
-    // Get lowest root:
-    if (r1 > 0 && r1 < max_r) {
-        *root = r1;
-        return true;
+// Cells of the dirty bricks get re-meshed from the apron, the other bricks keep their triangles
+// Only the bounds of the dirty bricks (and of the nodes above them) get recomputed
+static void s_update_collision_mesh(chunk_t *chunk, chunk_collision_mesh_t *mesh, uint64_t dirty_bricks) {
+    // Dirty bricks which don't have a surface don't have any triangles
+    uint64_t meshed_bricks = 0;
+    for (uint32_t b = 0; b < CHUNK_BRICK_COUNT; ++b) {
+        ivector3_t brick = ivector3_t(b & 3, (b >> 2) & 3, b >> 4);
+
+        if ((dirty_bricks & (1ull << b)) && chunk_brick_may_have_surface(chunk, brick)) {
+            meshed_bricks |= 1ull << b;
+        }
     }
-    // It is possible that we want x2 - this can happen
-    // if x1 < 0
-    if (r2 > 0 && r2 < max_r) {
-        *root = r2;
-        return true;
+
+    uint16_t *first = mesh->cell_first_triangles;
+    uint32_t old_count = first[CHUNK_VOXEL_COUNT];
+    // A cell has at most 5 triangles (s_push_collision_triangles_vertices needs some room past the end)
+    uint32_t max_count = old_count + 5 * CHUNK_BRICK_EDGE_LENGTH * CHUNK_BRICK_EDGE_LENGTH * CHUNK_BRICK_EDGE_LENGTH *
+        (pop_count((uint32_t)meshed_bricks) + pop_count((uint32_t)(meshed_bricks >> 32))) + 4;
+    collision_triangle_t *triangles = g_game->collision_mesh_scratch.reserve(max_count);
+
+    const chunk_apron_t *apron = meshed_bricks ? get_chunk_apron(chunk) : NULL;
+    uint32_t count = 0;
+
+    static const uint32_t BRICK_CELL_COUNT = CHUNK_BRICK_EDGE_LENGTH * CHUNK_BRICK_EDGE_LENGTH * CHUNK_BRICK_EDGE_LENGTH;
+
+    // Bricks are in Morton order too: the cells of a brick are contiguous
+    for (uint32_t morton_brick = 0; morton_brick < CHUNK_BRICK_COUNT; ++morton_brick) {
+        uint32_t first_cell = morton_brick * BRICK_CELL_COUNT;
+        ivector3_t brick_coord = morton_voxel_layout_t::coord(morton_brick);
+        uint64_t brick_bit = 1ull << (brick_coord.x | (brick_coord.y << 2) | (brick_coord.z << 4));
+
+        if (meshed_bricks & brick_bit) {
+            for (uint32_t cell_index = first_cell; cell_index < first_cell + BRICK_CELL_COUNT; ++cell_index) {
+                ivector3_t cs_coord = morton_voxel_layout_t::coord(cell_index);
+                first[cell_index] = (uint16_t)count;
+
+                // Corners which are in chunks that don't exist are 0
+                const voxel_t *cell = &apron->voxels[get_apron_index(cs_coord.x, cs_coord.y, cs_coord.z)];
+                uint8_t voxel_values[8];
+                for (uint32_t i = 0; i < 8; ++i) {
+                    voxel_values[i] = cell[APRON_CELL_CORNER_OFFSETS[i]].value;
+                }
+
+                ivector3_t vs_coord = chunk->xs_bottom_corner + cs_coord;
+
+                s_push_collision_triangles_vertices(
+                    voxel_values,
+                    vs_coord.x,
+                    vs_coord.y,
+                    vs_coord.z,
+                    CHUNK_SURFACE_LEVEL,
+                    triangles,
+                    &count,
+                    max_count);
+            }
+        }
+        else if (dirty_bricks & brick_bit) {
+            for (uint32_t cell_index = first_cell; cell_index < first_cell + BRICK_CELL_COUNT; ++cell_index) {
+                first[cell_index] = (uint16_t)count;
+            }
+        }
+        else {
+            // The first cell of the next brick hasn't been overwritten yet
+            uint32_t old_begin = first[first_cell];
+            uint32_t old_end = first[first_cell + BRICK_CELL_COUNT];
+
+            memcpy(&triangles[count], &mesh->triangles[old_begin], sizeof(collision_triangle_t) * (old_end - old_begin));
+
+            for (uint32_t cell_index = first_cell; cell_index < first_cell + BRICK_CELL_COUNT; ++cell_index) {
+                first[cell_index] = (uint16_t)(first[cell_index] - old_begin + count);
+            }
+
+            count += old_end - old_begin;
+        }
     }
 
-    // No (valid) solutions
-    return false;
-}
+    first[CHUNK_VOXEL_COUNT] = (uint16_t)count;
 
+    if (count > mesh->triangle_capacity) {
+        if (mesh->triangles) {
+            FL_FREE(mesh->triangles);
+        }
 
-static float s_get_plane_constant(
-    const vector3_t &plane_point,
-    const vector3_t &plane_normal) {
-    return -glm::dot(plane_point, plane_normal);
-}
+        // Leave some room for the terrain to grow
+        mesh->triangle_capacity = count + count / 4;
+        mesh->triangles = FL_MALLOC(collision_triangle_t, mesh->triangle_capacity);
+    }
 
-static bool s_facing_triangle(
-    const vector3_t &es_normalised_velocity,
-    const vector3_t &es_normal) {
-    return (glm::dot(es_normalised_velocity, es_normal) <= 0.0f);
-}
+    memcpy(mesh->triangles, triangles, sizeof(collision_triangle_t) * count);
 
-static bool s_inside_triangle(
-    const vector3_t &plane_contact_point,
-    collision_triangle_t *triangle) {
-    vector3_t cross0 = glm::cross(triangle->v.c - triangle->v.b, plane_contact_point - triangle->v.b);
-    vector3_t cross1 = glm::cross(triangle->v.c - triangle->v.b, triangle->v.a - triangle->v.b);
+    // Refit: leaves and bricks which changed, then the two levels above from their children
+    for (uint32_t morton_brick = 0; morton_brick < CHUNK_BRICK_COUNT; ++morton_brick) {
+        ivector3_t brick_coord = morton_voxel_layout_t::coord(morton_brick);
 
-    if (glm::dot(cross0, cross1) >= 0.0f) {
-        cross0 = glm::cross(triangle->v.c - triangle->v.a, plane_contact_point - triangle->v.a);
-        cross1 = glm::cross(triangle->v.c - triangle->v.a, triangle->v.b - triangle->v.a);
+        if (dirty_bricks & (1ull << (brick_coord.x | (brick_coord.y << 2) | (brick_coord.z << 4)))) {
+            s_refit_collision_brick(chunk, mesh, morton_brick);
+        }
+    }
 
-        if (glm::dot(cross0, cross1) >= 0.0f) {
-            cross0 = glm::cross(triangle->v.b - triangle->v.a, plane_contact_point - triangle->v.a);
-            cross1 = glm::cross(triangle->v.b - triangle->v.a, triangle->v.c - triangle->v.a);
+    for (int32_t level = COLLISION_BVH_LEAF_LEVEL - 2; level >= 0; --level) {
+        uint32_t level_node_count = 1 << (3 * level);
 
-            if (glm::dot(cross0, cross1) >= 0.0f) {
-                return true;
+        for (uint32_t n = 0; n < level_node_count; ++n) {
+            collision_bvh_node_t *node = &mesh->nodes[COLLISION_BVH_LEVEL_OFFSETS[level] + n];
+            s_empty_collision_bvh_node(node);
+
+            for (uint32_t c = n * 8; c < n * 8 + 8; ++c) {
+                s_grow_collision_bvh_node(node, &mesh->nodes[COLLISION_BVH_LEVEL_OFFSETS[level + 1] + c]);
             }
         }
     }
-
-    return false;
 }
 
-static bool s_touched_vertex(
-    float a,
-    float *cinstance0,
-    const vector3_t &vertex,
-    terrain_collision_t *collision) {
-    float b = 2.0f * glm::dot(collision->es_velocity, collision->es_position - vertex);
-    float c = glm::dot(vertex - collision->es_position, vertex - collision->es_position) - 1.0f;
+const chunk_collision_mesh_t *get_chunk_collision_mesh(chunk_t *chunk) {
+    if (!chunk->collision_mesh) {
+        // Entries get recycled in a round robin fashion
+        chunk_collision_mesh_t *mesh = &g_game->collision_meshes[g_game->next_collision_mesh];
+        g_game->next_collision_mesh = (g_game->next_collision_mesh + 1) % CHUNK_COLLISION_MESH_CACHE_COUNT;
 
-    float new_cinstance;
-    
-    if (s_get_smallest_root(a, b, c, *cinstance0, &new_cinstance)) {
-        *cinstance0 = new_cinstance;
-        return true;
+        if (mesh->owner) {
+            mesh->owner->collision_mesh = NULL;
+        }
+
+        mesh->owner = chunk;
+        chunk->collision_mesh = mesh;
+        chunk->collision_dirty_bricks = ~0ull;
     }
 
-    return false;
+    if (chunk->collision_dirty_bricks) {
+        s_update_collision_mesh(chunk, chunk->collision_mesh, chunk->collision_dirty_bricks);
+        chunk->collision_dirty_bricks = 0;
+    }
+
+    return chunk->collision_mesh;
 }
 
-static bool s_touched_edge(
-    float *cinstance0,
-    vector3_t *new_position,
-    const vector3_t &vertex0,
-    const vector3_t &vertex1,
-    terrain_collision_t *collision) {
-    vector3_t edge_vector = vertex1 - vertex0;
-    vector3_t position_to_vertex0 = vertex0 - collision->es_position;
-    float velocity_length2 = glm::dot(collision->es_velocity, collision->es_velocity);
-    float edge_length2 = glm::dot(edge_vector, edge_vector);
-    float edge_dot_velocity = glm::dot(edge_vector, collision->es_velocity);
-    float edge_dot_position_to_vertex0 = glm::dot(edge_vector, position_to_vertex0);
-    float position_to_vertex0_length2 = glm::dot(position_to_vertex0, position_to_vertex0);
-
-    float a = edge_length2 * (-velocity_length2) + (edge_dot_velocity * edge_dot_velocity);
-    float b = edge_length2 * (2.0f * glm::dot(collision->es_velocity, position_to_vertex0)) - (2.0f * edge_dot_velocity * edge_dot_position_to_vertex0);
-    float c = edge_length2 * (1.0f - position_to_vertex0_length2) + (edge_dot_position_to_vertex0 * edge_dot_position_to_vertex0);
-
-    float new_cinstance;
-    
-    if (s_get_smallest_root(a, b, c, *cinstance0, &new_cinstance)) {
-        // Where on the line did the collision happen (did it even happen on the edge, or just on the infinite line of the edge)
-        float proportion = (edge_dot_velocity * new_cinstance - edge_dot_position_to_vertex0) / edge_length2;
-        if (proportion >= 0.0f && proportion <= 1.0f) {
-            *cinstance0 = new_cinstance;
-            *new_position = vertex0 + proportion * edge_vector;
-            return true;
+// Cells read the voxels of the chunks at +1: the chunk and those have to be all air, or all solid for it not to have triangles
+static bool s_chunk_may_have_triangles(const chunk_t *chunk) {
+    bool has_solid = 0, has_air = 0;
+
+    for (int32_t z = 0; z <= 1; ++z) {
+        for (int32_t y = 0; y <= 1; ++y) {
+            for (int32_t x = 0; x <= 1; ++x) {
+                const chunk_t *neighbour = get_chunk_neighbour(chunk, x, y, z);
+
+                if (neighbour) {
+                    has_solid |= neighbour->solid_bricks != 0;
+                    has_air |= neighbour->air_bricks != 0;
+                }
+                else {
+                    has_air = 1;
+                }
+            }
         }
     }
 
-    return false;
+    return has_solid && has_air;
 }
 
-static bool s_collided_with_triangle(
-    terrain_collision_t *collision,
-    collision_triangle_t *es_triangle) {
-    vector3_t es_a = es_triangle->v.a;
-    vector3_t es_b = es_triangle->v.b;
-    vector3_t es_c = es_triangle->v.c;
+// Chunks from min_chunk to min_chunk + chunk_range, z-y-x order (NULL if they don't exist or can't have triangles)
+// Chunks without triangles don't take up an entry of the collision mesh cache
+static chunk_t **s_get_chunk_range(const ivector3_t &min_chunk, const ivector3_t &chunk_range) {
+    chunk_t **chunks = LN_MALLOC(chunk_t *, chunk_range.x * chunk_range.y * chunk_range.z);
 
-    vector3_t es_plane_normal = glm::normalize(glm::cross(es_b - es_a, es_c - es_a));
+    // The chunks get fetched through the neighbours of the first one (only one lookup in chunk_indices)
+    chunk_t *anchor = g_game->access_chunk(min_chunk);
 
-    float es_distance_to_plane = 0.0f;
-
-    bool inside_terrain = 0;
-    
-    if (s_facing_triangle(collision->es_normalised_velocity, es_plane_normal)) {
-        // get plane constant
-        float plane_constant = s_get_plane_constant(es_a, es_plane_normal);
-        es_distance_to_plane = glm::dot(collision->es_position, es_plane_normal) + plane_constant;
-        float plane_normal_dot_velocity = glm::dot(es_plane_normal, collision->es_velocity);
-
-        bool sphere_inside_plane = 0;
-
-        float cinstance0 = 0.0f, cinstance1 = 0.0f;
-        
-        if (plane_normal_dot_velocity == 0.0f) {
-            // sphere velocity is parallel to plane surface (& facing plane, as we calculated before)
-            if (glm::abs(es_distance_to_plane) >= 1.0f) {
-                // sphere is not in plane and distance is more than sphere radius, cannot possibly collide
-                return false;
-            }
-            else {
-                sphere_inside_plane = 1;
-            }
-        }
-        else {
-            // sphere velocity is not parallel to plane surface (& facing towards plane)
-            // need to check collision with triangle surface, edges and vertices
-            // collision instance 0 (first time sphere touches plane)
-            cinstance0 = (1.0f - es_distance_to_plane) / plane_normal_dot_velocity;
-            cinstance1 = (-1.0f - es_distance_to_plane) / plane_normal_dot_velocity;
-
-            // The sphere is inside the fricking plane
-            if (cinstance0 < 0.0f) {
-                inside_terrain = 1;
-                //LOG_ERROR("There is problem: sphere is inside the terrain\n");
-            }
+    for (int32_t z = 0; z < chunk_range.z; ++z) {
+        for (int32_t y = 0; y < chunk_range.y; ++y) {
+            for (int32_t x = 0; x < chunk_range.x; ++x) {
+                chunk_t **chunk = &chunks[(z * chunk_range.y + y) * chunk_range.x + x];
 
-            // always make sure that 0 corresponds to closer collision and 1 responds to further
-            if (cinstance0 > cinstance1) {
-                float t = cinstance0;
-                cinstance0 = cinstance1;
-                cinstance1 = t;
-            }
+                if (anchor && x <= 1 && y <= 1 && z <= 1) {
+                    *chunk = get_chunk_neighbour(anchor, x, y, z);
+                }
+                else {
+                    // Only happens for huge ellipsoids, or if the first chunk doesn't exist
+                    *chunk = g_game->access_chunk(min_chunk + ivector3_t(x, y, z));
+                }
 
-            if (cinstance0 > 1.0f || cinstance1 < 0.0f) {
-                // either triangle plane is behind, or too far (0.0f to 1.0f represents 0.0f to dt, if we cinstance0 > 1.0f, we are trying to go further than we can in this timeframe)
-                return false;
+                if (*chunk && !s_chunk_may_have_triangles(*chunk)) {
+                    *chunk = NULL;
+                }
             }
-
-            if (cinstance0 < 0.0f) cinstance0 = 0.0f;
-            if (cinstance1 > 1.0f) cinstance1 = 1.0f;
         }
+    }
+
+    return chunks;
+}
 
-        // point where sphere intersects with plane, not triangle
-        vector3_t plane_contact_point = (collision->es_position + cinstance0 * collision->es_velocity - es_plane_normal);
+// Triangles of the cells [vs_min, vs_max[ (chunks are the ones which contain the cells, NULL if they don't exist)
+// Only counts them if dst is NULL
+static uint32_t s_copy_collision_triangles(
+    chunk_t **chunks,
+    const ivector3_t &min_chunk,
+    const ivector3_t &chunk_range,
+    const ivector3_t &vs_min,
+    const ivector3_t &vs_max,
+    collision_triangle_t *dst) {
+    uint32_t count = 0;
+
+    for (int32_t z = vs_min.z; z < vs_max.z; ++z) {
+        for (int32_t y = vs_min.y; y < vs_max.y; ++y) {
+            // Arithmetic shift rounds negative coordinates down
+            uint32_t chunk_row = ((z >> 4) - min_chunk.z) * chunk_range.y * chunk_range.x + ((y >> 4) - min_chunk.y) * chunk_range.x;
+
+            for (int32_t c = 0; c < chunk_range.x; ++c) {
+                chunk_t *chunk = chunks[chunk_row + c];
+
+                if (!chunk) {
+                    continue;
+                }
 
-        bool detected_collision = 0;
-        float cinstance = 1.0f;
-        vector3_t triangle_contact_point;
+                const chunk_collision_mesh_t *mesh = get_chunk_collision_mesh(chunk);
+                ivector3_t lo = ivector3_t(vs_min.x, y, z) - chunk->xs_bottom_corner;
+                int32_t hi_x = vs_max.x - chunk->xs_bottom_corner.x;
+                lo.x = MAX(lo.x, 0);
+                hi_x = MIN(hi_x, CHUNK_EDGE_LENGTH);
 
-        if (!sphere_inside_plane) {
-            if (s_inside_triangle(plane_contact_point, es_triangle)) {
-                // sphere collided with triangle
-                detected_collision = 1;
-                cinstance = cinstance0;
+                for (int32_t x = lo.x; x < hi_x; ++x) {
+                    uint32_t cell_index = get_collision_cell_index(x, lo.y, lo.z);
+                    uint32_t begin = mesh->cell_first_triangles[cell_index];
+                    uint32_t end = mesh->cell_first_triangles[cell_index + 1];
 
-                if (inside_terrain) {
-                    
-                    //LOG_ERRORV("We got a problem, cinstance < 0: %f\n", cinstance);
-                }
+                    if (dst && end > begin) {
+                        memcpy(&dst[count], &mesh->triangles[begin], sizeof(collision_triangle_t) * (end - begin));
+                    }
 
-                if (cinstance < 0.0f) {
+                    count += end - begin;
                 }
-                
-                triangle_contact_point = plane_contact_point;
-            }
-            else {
-                inside_terrain = 0;
             }
         }
+    }
 
-        // check triangle edges / vertices
-        if (!detected_collision) {
-            float a; /*, b, c*/
+    return count;
+}
 
-            a = glm::dot(collision->es_velocity, collision->es_velocity);
+collision_triangle_t *gather_collision_triangles(
+    uint32_t *triangle_count,
+    const vector3_t &ws_center,
+    const vector3_t &ws_size) {
+    // Get range of triangles (v3 min - v3 max)
+    ivector3_t bounding_cube_max = ivector3_t(glm::ceil(ws_center + ws_size));
+    ivector3_t bounding_cube_min = ivector3_t(glm::floor(ws_center - ws_size));
 
-            if (s_touched_vertex(a, &cinstance, es_triangle->v.a, collision)) {
-                detected_collision = true;
-                triangle_contact_point = es_triangle->v.a;
-            }
+    // Cells in [min, max[ read the voxels in [min, max]
+    if (!terrain_may_have_surface(bounding_cube_min, bounding_cube_max)) {
+        *triangle_count = 0;
+        return NULL;
+    }
 
-            if (s_touched_vertex(a, &cinstance, es_triangle->v.b, collision)) {
-                detected_collision = true;
-                triangle_contact_point = es_triangle->v.b;
-            }
+    ivector3_t min_chunk = space_voxel_to_chunk(bounding_cube_min);
+    ivector3_t chunk_range = space_voxel_to_chunk(bounding_cube_max - ivector3_t(1)) - min_chunk + ivector3_t(1);
+    chunk_t **chunks = s_get_chunk_range(min_chunk, chunk_range);
 
-            if (s_touched_vertex(a, &cinstance, es_triangle->v.c, collision)) {
-                detected_collision = true;
-                triangle_contact_point = es_triangle->v.c;
-            }
+    // Count first to allocate exactly what's needed (the meshes get built during this pass)
+    uint32_t count = s_copy_collision_triangles(chunks, min_chunk, chunk_range, bounding_cube_min, bounding_cube_max, NULL);
+    collision_triangle_t *triangles = LN_MALLOC(collision_triangle_t, count);
+    s_copy_collision_triangles(chunks, min_chunk, chunk_range, bounding_cube_min, bounding_cube_max, triangles);
 
-            vector3_t new_position_on_edge;
+    *triangle_count = count;
 
-            if (s_touched_edge(&cinstance, &new_position_on_edge, es_a, es_b, collision)) {
-                detected_collision = true;
-                triangle_contact_point = new_position_on_edge;
-            }
+    return triangles;
+}
+
+// Box moving along a segment, in the quantised space of a chunk (see COLLISION_BVH_QUANTISATION)
+struct collision_sweep_t {
+    vector3_t qs_start;
+    vector3_t qs_displacement;
+    vector3_t qs_extent;
+};
+
+// Whether the box touches the node at some point of the segment (slab test against the node grown by the box)
+static bool s_sweep_overlaps_node(const collision_bvh_node_t *node, const collision_sweep_t *sweep) {
+    if (node->min[0] > node->max[0]) {
+        return 0;
+    }
+
+    float enter = 0.0f, exit = 1.0f;
 
-            if (s_touched_edge(&cinstance, &new_position_on_edge, es_b, es_c, collision)) {
-                detected_collision = true;
-                triangle_contact_point = new_position_on_edge;
+    for (uint32_t i = 0; i < 3; ++i) {
+        float lo = (float)node->min[i] - sweep->qs_extent[i];
+        float hi = (float)node->max[i] + sweep->qs_extent[i];
+
+        if (sweep->qs_displacement[i] == 0.0f) {
+            if (sweep->qs_start[i] < lo || sweep->qs_start[i] > hi) {
+                return 0;
             }
+        }
+        else {
+            float t0 = (lo - sweep->qs_start[i]) / sweep->qs_displacement[i];
+            float t1 = (hi - sweep->qs_start[i]) / sweep->qs_displacement[i];
+            enter = glm::max(enter, glm::min(t0, t1));
+            exit = glm::min(exit, glm::max(t0, t1));
 
-            if (s_touched_edge(&cinstance, &new_position_on_edge, es_c, es_a, collision)) {
-                detected_collision = true;
-                triangle_contact_point = new_position_on_edge;
+            if (enter > exit) {
+                return 0;
             }
         }
+    }
 
-        if (detected_collision) {
-            float distance_to_collision = glm::abs(cinstance) * glm::length(collision->es_velocity);
+    return 1;
+}
 
-            if (!collision->detected || distance_to_collision < collision->es_nearest_distance) {
-                if (inside_terrain) {
-                    collision->es_nearest_distance = es_distance_to_plane;
-                }
-                else {
-                    collision->es_nearest_distance = distance_to_collision;
-                }
-                
-                collision->es_contact_point = triangle_contact_point;
-                collision->es_surface_normal = es_plane_normal;
-                collision->detected = 1;
-                collision->under_terrain = inside_terrain;
+static void s_sweep_collision_bvh(
+    chunk_t *chunk,
+    const chunk_collision_mesh_t *mesh,
+    const collision_sweep_t *sweep,
+    uint32_t level,
+    uint32_t node_index,
+    scratch_array_t<collision_triangle_range_t> *ranges,
+    uint32_t *range_count) {
+    if (!s_sweep_overlaps_node(&mesh->nodes[COLLISION_BVH_LEVEL_OFFSETS[level] + node_index], sweep)) {
+        return;
+    }
+
+    if (level < COLLISION_BVH_LEAF_LEVEL) {
+        for (uint32_t c = node_index * 8; c < node_index * 8 + 8; ++c) {
+            s_sweep_collision_bvh(chunk, mesh, sweep, level + 1, c, ranges, range_count);
+        }
+
+        return;
+    }
+
+    uint16_t begin = mesh->cell_first_triangles[node_index * COLLISION_BVH_LEAF_CELL_COUNT];
+    uint16_t end = mesh->cell_first_triangles[(node_index + 1) * COLLISION_BVH_LEAF_CELL_COUNT];
+
+    // Leaves come in Morton order: neighbouring leaves often follow each other in the triangle array
+    collision_triangle_range_t *previous = *range_count ? &ranges->data[*range_count - 1] : NULL;
+    if (previous && previous->chunk == chunk && previous->end == begin) {
+        previous->end = end;
+    }
+    else {
+        ranges->reserve(*range_count + 1);
+        ranges->data[(*range_count)++] = { chunk, begin, end };
+    }
+}
+
+collision_triangle_t *sweep_collision_triangles(
+    uint32_t *triangle_count,
+    const vector3_t &ws_center,
+    const vector3_t &ws_size,
+    const vector3_t &ws_velocity) {
+    // A little bigger than the ellipsoid: collide_and_slide keeps some distance from the terrain
+    vector3_t ws_extent = ws_size + vector3_t(0.01f);
+    vector3_t ws_end = ws_center + ws_velocity;
+    ivector3_t vs_min = ivector3_t(glm::floor(glm::min(ws_center, ws_end) - ws_extent));
+    ivector3_t vs_max = ivector3_t(glm::ceil(glm::max(ws_center, ws_end) + ws_extent));
+
+    if (!terrain_may_have_surface(vs_min, vs_max)) {
+        *triangle_count = 0;
+        return NULL;
+    }
+
+    // The cells at vs_min - 1 may have triangles on their +x / +y / +z faces
+    ivector3_t min_chunk = space_voxel_to_chunk(vs_min - ivector3_t(1));
+    ivector3_t chunk_range = space_voxel_to_chunk(vs_max) - min_chunk + ivector3_t(1);
+    uint32_t chunk_count = chunk_range.x * chunk_range.y * chunk_range.z;
+    chunk_t **chunks = s_get_chunk_range(min_chunk, chunk_range);
 
-                collision->has_detected_previously = 1;
+    // Only the leaves which the sweep reaches take room (collide_and_slide sweeps several times per move)
+    scratch_array_t<collision_triangle_range_t> *ranges = &g_game->collision_range_scratch;
+    uint32_t range_count = 0;
+    uint32_t count = 0;
 
-                return true;
+    for (uint32_t c = 0; c < chunk_count; ++c) {
+        chunk_t *chunk = chunks[c];
+
+        if (chunk) {
+            vector3_t ws_corner = vector3_t(chunk->xs_bottom_corner);
+
+            collision_sweep_t sweep;
+            sweep.qs_start = (ws_center - ws_corner) * COLLISION_BVH_QUANTISATION;
+            sweep.qs_displacement = ws_velocity * COLLISION_BVH_QUANTISATION;
+            sweep.qs_extent = ws_extent * COLLISION_BVH_QUANTISATION;
+
+            uint32_t first_range = range_count;
+            s_sweep_collision_bvh(chunk, get_chunk_collision_mesh(chunk), &sweep, 0, 0, ranges, &range_count);
+
+            for (uint32_t r = first_range; r < range_count; ++r) {
+                count += ranges->data[r].end - ranges->data[r].begin;
             }
         }
     }
 
-    return false;
+    collision_triangle_t *triangles = LN_MALLOC(collision_triangle_t, count);
+    count = 0;
+
+    for (uint32_t r = 0; r < range_count; ++r) {
+        // Building the mesh of another chunk could have evicted this one (it would get rebuilt the same)
+        const collision_triangle_range_t *range = &ranges->data[r];
+        const chunk_collision_mesh_t *mesh = get_chunk_collision_mesh(range->chunk);
+        uint32_t range_size = range->end - range->begin;
+
+        memcpy(&triangles[count], &mesh->triangles[range->begin], sizeof(collision_triangle_t) * range_size);
+        count += range_size;
+    }
+
+    *triangle_count = count;
+
+    return triangles;
+}
+
+static float s_get_plane_constant(
+    const vector3_t &plane_point,
+    const vector3_t &plane_normal) {
+    return -glm::dot(plane_point, plane_normal);
 }
 
 vector3_t collide_and_slide(
     terrain_collision_t *collision) {
-    // Get intersecting triangles
-    uint32_t triangle_count = 0;
-    collision_triangle_t *triangles = s_get_collision_triangles(&triangle_count, collision->ws_position, collision->ws_size);
-
     if (collision->recurse > 5) {
         return collision->es_position;
     }
+
+    // Triangles that the ellipsoid may touch on the way (position and velocity change with each recursion)
+    uint32_t triangle_count = 0;
+    collision_triangle_t *triangles = sweep_collision_triangles(
+        &triangle_count,
+        collision->es_position * collision->ws_size,
+        collision->ws_size,
+        collision->es_velocity * collision->ws_size);
     
     // Avoid division by zero
     if (glm::abs(glm::dot(collision->es_velocity, collision->es_velocity)) == 0.0f) {
@@ -1205,16 +2652,10 @@ vector3_t collide_and_slide(
 
     collision->has_detected_previously = 0;
 
-    for (uint32_t triangle_index = 0; triangle_index < triangle_count; ++triangle_index) {
-        collision_triangle_t *triangle = &triangles[triangle_index];
-
-        for (uint32_t i = 0; i < 3; ++i) {
-            triangle->vertices[i] /= collision->ws_size;
-        }
-
-        // Check collision with this triangle (now is ellipsoid space)
-        s_collided_with_triangle(collision, triangle);
-    }
+    // Check collision with the triangles (in ellipsoid space)
+    collision_triangle_batch_t batch;
+    make_collision_triangle_batch(&batch, triangles, triangle_count, collision->ws_size);
+    get_collision_batch_kernel()(collision, &batch);
 
     if (!collision->has_detected_previously) {
         // No more collisions, just return position + velocity
@@ -1281,16 +2722,9 @@ vector3_t collide_and_slide(
 
 void check_ray_terrain_collision(terrain_collision_t *collision) {
     uint32_t triangle_count = 0;
-    collision_triangle_t *triangles = s_get_collision_triangles(&triangle_count, collision->ws_position, collision->ws_size);
-
-    for (uint32_t triangle_index = 0; triangle_index < triangle_count; ++triangle_index) {
-        collision_triangle_t *triangle = &triangles[triangle_index];
+    collision_triangle_t *triangles = gather_collision_triangles(&triangle_count, collision->ws_position, collision->ws_size);
 
-        for (uint32_t i = 0; i < 3; ++i) {
-            triangle->vertices[i] /= collision->ws_size;
-        }
-
-        // Check collision with this triangle (now is ellipsoid space)
-        s_collided_with_triangle(collision, triangle);
-    }
+    collision_triangle_batch_t batch;
+    make_collision_triangle_batch(&batch, triangles, triangle_count, collision->ws_size);
+    get_collision_batch_kernel()(collision, &batch);
 }
@@ -9,8 +9,76 @@ ivector3_t space_world_to_voxel(const vector3_t &ws_position);
 ivector3_t space_voxel_to_chunk(const ivector3_t &vs_position);
 vector3_t space_chunk_to_world(const ivector3_t &chunk_coord);
 ivector3_t space_voxel_to_local_chunk(const ivector3_t &vs_position);
-uint32_t get_voxel_index(uint32_t x, uint32_t y, uint32_t z);
 
+// Order of the voxels in memory (chosen at build time with VKPHYSICS_VOXEL_LAYOUT, see voxel_layout_t)
+// Map files and packets always use the linear order (see get_chunk_voxels_linear / reorder_linear_chunk_voxels)
+struct linear_voxel_layout_t {
+    static const bool IS_LINEAR = true;
+
+    // z-y-x: rows of x are contiguous
+    static uint32_t index(uint32_t x, uint32_t y, uint32_t z) {
+        return z * (CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH) + y * CHUNK_EDGE_LENGTH + x;
+    }
+
+    static ivector3_t coord(uint32_t index) {
+        return ivector3_t(index & (CHUNK_EDGE_LENGTH - 1), (index >> 4) & (CHUNK_EDGE_LENGTH - 1), index >> 8);
+    }
+};
+
+struct morton_voxel_layout_t {
+    static const bool IS_LINEAR = false;
+
+    // Bits of x, y and z are interleaved (x0 y0 z0 x1 y1 z1 ...): the 8 corners of a cell are usually in the same cache line
+    static uint32_t spread(uint32_t v) {
+        static const uint16_t SPREAD[CHUNK_EDGE_LENGTH] = {
+            0x000, 0x001, 0x008, 0x009, 0x040, 0x041, 0x048, 0x049,
+            0x200, 0x201, 0x208, 0x209, 0x240, 0x241, 0x248, 0x249
+        };
+
+        return SPREAD[v & (CHUNK_EDGE_LENGTH - 1)];
+    }
+
+    static uint32_t compact(uint32_t v) {
+        return (v & 1) | ((v >> 2) & 2) | ((v >> 4) & 4) | ((v >> 6) & 8);
+    }
+
+    static uint32_t index(uint32_t x, uint32_t y, uint32_t z) {
+        return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+    }
+
+    static ivector3_t coord(uint32_t index) {
+        return ivector3_t(compact(index), compact(index >> 1), compact(index >> 2));
+    }
+};
+
+#if defined(VOXEL_LAYOUT_MORTON)
+typedef morton_voxel_layout_t voxel_layout_t;
+#else
+typedef linear_voxel_layout_t voxel_layout_t;
+#endif
+
+template <typename Layout = voxel_layout_t>
+inline uint32_t get_voxel_index(uint32_t x, uint32_t y, uint32_t z) {
+    return Layout::index(x, y, z);
+}
+
+template <typename Layout = voxel_layout_t>
+inline ivector3_t get_voxel_coord(uint32_t index) {
+    return Layout::coord(index);
+}
+
+// Converts between the index of the build's layout and the index in linear order (used by packets)
+inline uint32_t voxel_index_to_linear(uint32_t index) {
+    ivector3_t coord = get_voxel_coord(index);
+    return get_voxel_index<linear_voxel_layout_t>(coord.x, coord.y, coord.z);
+}
+
+inline uint32_t linear_to_voxel_index(uint32_t linear_index) {
+    ivector3_t coord = get_voxel_coord<linear_voxel_layout_t>(linear_index);
+    return get_voxel_index(coord.x, coord.y, coord.z);
+}
+
+// Only chunks which got terraformed since the last snapshot have one of these (see activate_chunk_history)
 struct chunk_history_t {
     // These are all going to be set to 255 by default. If a voxel gets modified, modification_pool[voxel_index]
     // will be set to the initial value of that voxel before modifications
@@ -33,6 +101,119 @@ vector3_t b8_color_to_v3(voxel_color_t color);
 voxel_color_t v3_color_to_b8(const vector3_t &color);
 voxel_color_t b8v_color_to_b8(uint8_t r, uint8_t g, uint8_t b);
 
+// How the voxels of a chunk are stored in memory
+enum chunk_storage_t {
+    // All voxels have the same value (chunk_t::uniform_voxel) - there is no voxel array
+    CS_UNIFORM,
+    // chunk_t::voxels points to CHUNK_VOXEL_COUNT voxels (allocated from game_t::voxel_allocator)
+    CS_DENSE,
+    // chunk_t::palette holds the distinct voxels of the chunk + a 1/2/4/8-bit index per voxel (game_t::flags.palette_chunks)
+    CS_PALETTE
+};
+
+#define CHUNK_PALETTE_MAX_BITS 8
+
+struct chunk_palette_t {
+    uint16_t count;
+    // 1, 2, 4 or 8 (indices never straddle two bytes)
+    uint8_t bits;
+    // There are (1 << bits) entries, followed by the CHUNK_VOXEL_COUNT packed indices (see get_palette_indices)
+    voxel_t entries[1];
+};
+
+// Size of a palette block with (1 << bits) entries
+uint32_t chunk_palette_size(uint32_t bits);
+
+inline uint8_t *get_palette_indices(chunk_palette_t *palette) {
+    return (uint8_t *)&palette->entries[1 << palette->bits];
+}
+
+inline const uint8_t *get_palette_indices(const chunk_palette_t *palette) {
+    return (const uint8_t *)&palette->entries[1 << palette->bits];
+}
+
+inline uint32_t get_palette_index(const chunk_palette_t *palette, uint32_t voxel_index) {
+    uint32_t bit = voxel_index * palette->bits;
+    return (get_palette_indices(palette)[bit >> 3] >> (bit & 7)) & ((1 << palette->bits) - 1);
+}
+
+// Copy of a chunk padded with one voxel from each neighbour: the 8 corners of every cell are in the same array
+// Voxels of chunks which don't exist are empty
+struct chunk_apron_t {
+    voxel_t voxels[CHUNK_APRON_VOXEL_COUNT];
+    // NULL if this entry of game_t::chunk_aprons isn't used
+    struct chunk_t *owner;
+};
+
+// Coordinates are local to the chunk (from -1 to CHUNK_EDGE_LENGTH)
+inline uint32_t get_apron_index(int32_t x, int32_t y, int32_t z) {
+    return (z + 1) * (CHUNK_APRON_EDGE_LENGTH * CHUNK_APRON_EDGE_LENGTH) + (y + 1) * CHUNK_APRON_EDGE_LENGTH + (x + 1);
+}
+
+// Offsets (in the apron) of the 8 corners of a cell - same order as NORMALIZED_CUBE_VERTICES
+enum : uint32_t {
+    APRON_X = 1,
+    APRON_Y = CHUNK_APRON_EDGE_LENGTH,
+    APRON_Z = CHUNK_APRON_EDGE_LENGTH * CHUNK_APRON_EDGE_LENGTH
+};
+
+static const uint32_t APRON_CELL_CORNER_OFFSETS[8] = {
+    0, APRON_X, APRON_X + APRON_Z, APRON_Z,
+    APRON_Y, APRON_X + APRON_Y, APRON_X + APRON_Y + APRON_Z, APRON_Y + APRON_Z
+};
+
+// The two corners of each of the 12 edges of a cell (edge indices are the ones used in triangle_table.inc)
+static const uint8_t CELL_EDGE_CORNERS[12][2] = {
+    { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+    { 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+    { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }
+};
+
+// Bounds of the triangles of a node of the collision BVH, local to the chunk and quantised (see COLLISION_BVH_QUANTISATION)
+// Empty if min is over max
+struct collision_bvh_node_t {
+    uint16_t min[3];
+    uint16_t max[3];
+};
+
+// The collision BVH is an implicit octree over the cells: nodes of a level are in Morton order, the children of node i are 8i to 8i + 7
+// Levels: chunk, 8x8x8 cells, bricks (4x4x4 cells), leaves (2x2x2 cells)
+enum : uint32_t {
+    COLLISION_BVH_LEVEL_COUNT = 4,
+    COLLISION_BVH_LEAF_LEVEL = COLLISION_BVH_LEVEL_COUNT - 1,
+    COLLISION_BVH_LEAF_CELL_COUNT = 8,
+    COLLISION_BVH_NODE_COUNT = 1 + 8 + 64 + 512
+};
+
+// Index of the first node of each level in chunk_collision_mesh_t::nodes
+static const uint32_t COLLISION_BVH_LEVEL_OFFSETS[COLLISION_BVH_LEVEL_COUNT] = { 0, 1, 9, 73 };
+// Local coordinates (0 to CHUNK_EDGE_LENGTH) get multiplied by this
+static const float COLLISION_BVH_QUANTISATION = 2048.0f;
+
+// Marching cubes triangles of a chunk, kept around for the collision code (see get_chunk_collision_mesh)
+// The triangles of each cell come one after the other, with the cells in Morton order: the cells of every BVH node are contiguous
+struct chunk_collision_mesh_t {
+    // First triangle of each cell (the last entry is the triangle count)
+    uint16_t cell_first_triangles[CHUNK_VOXEL_COUNT + 1];
+    // Refitted whenever bricks get re-meshed (the layout of the tree never changes)
+    collision_bvh_node_t nodes[COLLISION_BVH_NODE_COUNT];
+    uint32_t triangle_capacity;
+    struct collision_triangle_t *triangles;
+    // NULL if this entry of game_t::collision_meshes isn't used
+    struct chunk_t *owner;
+};
+
+// Triangles of a chunk's collision mesh (see sweep_collision_triangles)
+struct collision_triangle_range_t {
+    struct chunk_t *chunk;
+    uint16_t begin;
+    uint16_t end;
+};
+
+inline uint32_t get_collision_cell_index(int32_t x, int32_t y, int32_t z) {
+    return morton_voxel_layout_t::index(x, y, z);
+}
+
 struct chunk_t {
     struct flags_t {
         uint32_t made_modification: 1;
@@ -41,26 +222,277 @@ struct chunk_t {
         // Flag that is used temporarily
         uint32_t modified_marker: 1;
         uint32_t index_of_modification_struct: 10;
+        // Voxels changed since the chunk was loaded / written to the chunk spill file (see chunk_residency.hpp)
+        uint32_t needs_flush: 1;
     } flags;
     
     uint32_t chunk_stack_index;
+    // Last tick the chunk got accessed through game_t (chunks which weren't used for the longest get evicted first)
+    uint64_t last_used_tick;
     ivector3_t xs_bottom_corner;
     ivector3_t chunk_coord;
 
-    voxel_t voxels[CHUNK_VOXEL_COUNT];
+    // Don't access these directly, go through the accessors below (get_chunk_voxel, set_chunk_voxel, etc...)
+    uint8_t storage;
+    voxel_t uniform_voxel;
+    voxel_t *voxels;
+    chunk_palette_t *palette;
+
+    // Occupancy of the 4x4x4 bricks (kept in sync by set_chunk_voxel and compress_chunk_storage)
+    // Number of voxels above CHUNK_SURFACE_LEVEL in each brick
+    uint8_t brick_solid_counts[CHUNK_BRICK_COUNT];
+    // Bit is set if the brick has at least one voxel above / at or below CHUNK_SURFACE_LEVEL
+    uint64_t solid_bricks;
+    uint64_t air_bricks;
+    // Bricks whose cells have to be re-meshed (set by every voxel write, cleared by the mesher)
+    uint64_t dirty_bricks;
+    // Same bricks, but cleared when the collision mesh gets updated (see mark_chunk_bricks_dirty)
+    uint64_t collision_dirty_bricks;
+
+    // The 26 surrounding chunks (NULL if they don't exist) + the chunk itself in the middle (see get_chunk_neighbour_index)
+    // Filled in by game_t::get_chunk, cleared by destroy_chunk
+    chunk_t *neighbours[27];
+
+    // Cached copy of the chunk + halo (NULL if it isn't cached, see get_chunk_apron)
+    chunk_apron_t *apron;
+    // Cached collision triangles (NULL if they aren't cached, see get_chunk_collision_mesh)
+    chunk_collision_mesh_t *collision_mesh;
 
     // uint8_t because anyway, player index won't go beyond 50
     static_stack_container_t<uint8_t, PLAYER_MAX_COUNT> players_in_chunk;
 
-    chunk_history_t history;
+    // NULL unless the chunk was modified since the last call to game_t::reset_modification_tracker
+    chunk_history_t *history;
 
     struct chunk_render_t *render;
 };
 
 void chunk_init(chunk_t *chunk, uint32_t chunk_stack_index, const ivector3_t &chunk_coord);
-uint32_t hash_chunk_coord(const ivector3_t &coord);
+
+// Voxel accessors (these hide the way the chunk is stored)
+inline bool operator==(voxel_t a, voxel_t b) {
+    return a.value == b.value && a.color == b.color;
+}
+
+inline bool operator!=(voxel_t a, voxel_t b) {
+    return !(a == b);
+}
+
+inline voxel_t get_chunk_voxel(const chunk_t *chunk, uint32_t index) {
+    switch (chunk->storage) {
+    case CS_DENSE: return chunk->voxels[index];
+    case CS_PALETTE: return chunk->palette->entries[get_palette_index(chunk->palette, index)];
+    default: return chunk->uniform_voxel;
+    }
+}
+
+// Offsets go from -1 to +1 on each axis (13 is the chunk itself)
+inline uint32_t get_chunk_neighbour_index(int32_t x, int32_t y, int32_t z) {
+    return (x + 1) + (y + 1) * 3 + (z + 1) * 9;
+}
+
+inline chunk_t *get_chunk_neighbour(const chunk_t *chunk, int32_t x, int32_t y, int32_t z) {
+    return chunk->neighbours[get_chunk_neighbour_index(x, y, z)];
+}
+
+// Links a newly created chunk with the chunks around it
+void link_chunk_neighbours(chunk_t *chunk);
+
+// Index of the 4x4x4 brick which contains the voxel
+inline uint32_t get_voxel_brick_index(uint32_t voxel_index) {
+    ivector3_t brick = get_voxel_coord(voxel_index) / CHUNK_BRICK_EDGE_LENGTH;
+    return brick.x | (brick.y << 2) | (brick.z << 4);
+}
+
+// Called when a voxel crosses CHUNK_SURFACE_LEVEL
+inline void update_chunk_brick(chunk_t *chunk, uint32_t voxel_index, bool solid) {
+    uint32_t brick = get_voxel_brick_index(voxel_index);
+    uint64_t bit = 1ull << brick;
+    uint8_t count = chunk->brick_solid_counts[brick] += solid ? 1 : -1;
+
+    chunk->solid_bricks = count ? (chunk->solid_bricks | bit) : (chunk->solid_bricks & ~bit);
+    chunk->air_bricks = (count == CHUNK_BRICK_EDGE_LENGTH * CHUNK_BRICK_EDGE_LENGTH * CHUNK_BRICK_EDGE_LENGTH) ?
+        (chunk->air_bricks & ~bit) : (chunk->air_bricks | bit);
+}
+
+// Bricks whose cells read the voxel (a cell reads the voxels from its coordinate to its coordinate + 1)
+// The coordinate may be one voxel past the +x / +y / +z edges (voxel of the neighbouring chunk)
+inline uint64_t get_voxel_dirty_bricks(const ivector3_t &coord) {
+    ivector3_t lo = glm::max(coord - 1, ivector3_t(0)) / CHUNK_BRICK_EDGE_LENGTH;
+    ivector3_t hi = glm::min(coord, ivector3_t(CHUNK_EDGE_LENGTH - 1)) / CHUNK_BRICK_EDGE_LENGTH;
+
+    uint64_t row = ((1ull << (hi.x + 1)) - 1) & ~((1ull << lo.x) - 1);
+    uint64_t plane = (row << (lo.y * 4)) | (row << (hi.y * 4));
+
+    return (plane << (lo.z * 16)) | (plane << (hi.z * 16));
+}
+
+// Both the render mesh and the collision mesh have to be rebuilt for these bricks
+inline void mark_chunk_bricks_dirty(chunk_t *chunk, uint64_t bricks) {
+    chunk->dirty_bricks |= bricks;
+    chunk->collision_dirty_bricks |= bricks;
+}
+
+// Coordinates are local to the chunk but may go one voxel past its edges (from -1 to CHUNK_EDGE_LENGTH)
+// Returns false (and an empty voxel) if the voxel is in a chunk which doesn't exist
+inline bool get_voxel_with_neighbours(const chunk_t *chunk, int32_t x, int32_t y, int32_t z, voxel_t *voxel) {
+    int32_t offset_x = (x >= CHUNK_EDGE_LENGTH) - (x < 0);
+    int32_t offset_y = (y >= CHUNK_EDGE_LENGTH) - (y < 0);
+    int32_t offset_z = (z >= CHUNK_EDGE_LENGTH) - (z < 0);
+
+    const chunk_t *owner = get_chunk_neighbour(chunk, offset_x, offset_y, offset_z);
+
+    if (!owner) {
+        voxel->color = 0;
+        voxel->value = 0;
+        return false;
+    }
+
+    *voxel = get_chunk_voxel(owner, get_voxel_index(
+        x - offset_x * CHUNK_EDGE_LENGTH,
+        y - offset_y * CHUNK_EDGE_LENGTH,
+        z - offset_z * CHUNK_EDGE_LENGTH));
+
+    return true;
+}
+
+// Fills dst (CHUNK_APRON_VOXEL_COUNT voxels) with the chunk and a one voxel halo from its neighbours
+void fill_chunk_apron(const chunk_t *chunk, voxel_t *dst);
+// Returns the cached apron of the chunk (or builds it, possibly evicting the apron of another chunk)
+const chunk_apron_t *get_chunk_apron(chunk_t *chunk);
+// Drops the cached aprons which contain this voxel (the chunk's and the ones of neighbours if the voxel is on an edge)
+void invalidate_chunk_aprons(chunk_t *chunk, uint32_t voxel_index);
+// Drops the cached aprons of the chunk and of all its neighbours
+void invalidate_all_chunk_aprons(chunk_t *chunk);
+// The chunks at -1 have cells which read the voxels on the low faces of the chunk - marks their bricks which read this voxel
+void mark_neighbour_bricks_dirty(chunk_t *chunk, uint32_t voxel_index);
+// Every brick of the chunk (and the bricks of the chunks at -1 which read its voxels) has to be re-meshed
+void mark_chunk_dirty(chunk_t *chunk);
+
+inline bool is_voxel_on_chunk_edge(uint32_t voxel_index) {
+    ivector3_t coord = get_voxel_coord(voxel_index);
+    // 0 and CHUNK_EDGE_LENGTH - 1 both wrap to something smaller than 2
+    return
+        ((coord.x + 1) & (CHUNK_EDGE_LENGTH - 1)) < 2 ||
+        ((coord.y + 1) & (CHUNK_EDGE_LENGTH - 1)) < 2 ||
+        ((coord.z + 1) & (CHUNK_EDGE_LENGTH - 1)) < 2;
+}
+
+// Recomputes the brick occupancy of the entire chunk
+void update_chunk_occupancy(chunk_t *chunk, const voxel_t *voxels);
+
+// Upgrades a uniform / palette chunk to a full voxel array
+void make_chunk_dense(chunk_t *chunk);
+// Writes to uniform / palette chunks (may transcode the chunk to a bigger palette or to a voxel array)
+void set_compressed_chunk_voxel(chunk_t *chunk, uint32_t index, voxel_t voxel);
+
+// Uniform chunks only get upgraded if the new voxel is different
+inline void set_chunk_voxel(chunk_t *chunk, uint32_t index, voxel_t voxel) {
+    voxel_t previous;
+
+    if (chunk->storage == CS_DENSE) {
+        previous = chunk->voxels[index];
+        chunk->voxels[index] = voxel;
+    }
+    else if (chunk->storage == CS_UNIFORM && voxel == chunk->uniform_voxel) {
+        return;
+    }
+    else {
+        previous = get_chunk_voxel(chunk, index);
+        set_compressed_chunk_voxel(chunk, index, voxel);
+    }
+
+    chunk->flags.needs_flush = 1;
+
+    bool solid = voxel.value > CHUNK_SURFACE_LEVEL;
+    if ((previous.value > CHUNK_SURFACE_LEVEL) != solid) {
+        update_chunk_brick(chunk, index, solid);
+    }
+
+    ivector3_t coord = get_voxel_coord(index);
+    mark_chunk_bricks_dirty(chunk, get_voxel_dirty_bricks(coord));
+    chunk->flags.has_to_update_vertices = 1;
+
+    if (chunk->apron || is_voxel_on_chunk_edge(index)) {
+        invalidate_chunk_aprons(chunk, index);
+    }
+
+    if (!coord.x || !coord.y || !coord.z) {
+        mark_neighbour_bricks_dirty(chunk, index);
+    }
+}
+
+// Only changes the value of the voxel (color stays the same)
+inline void set_chunk_voxel_value(chunk_t *chunk, uint32_t index, uint8_t value) {
+    voxel_t voxel = get_chunk_voxel(chunk, index);
+    voxel.value = value;
+    set_chunk_voxel(chunk, index, voxel);
+}
+
+// For code which writes a lot of voxels at once (upgrades the chunk to dense storage)
+// Call compress_chunk_storage once done writing (brick occupancy doesn't get updated before that)
+voxel_t *get_chunk_voxels_for_write(chunk_t *chunk);
+// For code which reads the entire chunk - if the chunk isn't stored densely, it gets decoded into scratch
+const voxel_t *get_chunk_voxels(const chunk_t *chunk, voxel_t *scratch);
+// Same but the voxels are in linear order whatever the layout is (for map files / packets)
+const voxel_t *get_chunk_voxels_linear(const chunk_t *chunk, voxel_t *scratch);
+// Voxels were written in linear order (map file / packet) - puts them in the order of the build's layout
+void reorder_linear_chunk_voxels(voxel_t *voxels);
+// Returns true if all the voxels of the chunk are the same (and writes the voxel to *voxel)
+inline bool is_chunk_uniform(const chunk_t *chunk, voxel_t *voxel) {
+    if (chunk->storage == CS_UNIFORM) {
+        *voxel = chunk->uniform_voxel;
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+// If the chunk is dense, get_chunk_voxels doesn't need a scratch buffer
+inline bool is_chunk_dense(const chunk_t *chunk) {
+    return chunk->storage == CS_DENSE;
+}
+// Goes back to uniform storage if all the voxels of the chunk are the same - returns true if the chunk is uniform
+// If game_t::flags.palette_chunks is set, chunks with at most 256 distinct voxels get palette encoded
+// Also recomputes the brick occupancy of the chunk
+bool compress_chunk_storage(chunk_t *chunk);
+// Whether the cells of a brick (brick coordinates) may generate triangles - looks at the brick and the bricks at +1 on each axis
+bool chunk_brick_may_have_surface(const chunk_t *chunk, const ivector3_t &brick);
+// Returns false if the voxels in [vs_min, vs_max] (inclusive) are all on the same side of CHUNK_SURFACE_LEVEL
+// (marching cubes can't generate any triangle there). Voxels of chunks which don't exist count as air
+bool terrain_may_have_surface(const ivector3_t &vs_min, const ivector3_t &vs_max);
+
+// Region which contains the chunk (regions are CHUNK_REGION_EDGE_LENGTH chunks wide)
+inline ivector3_t space_chunk_to_region(const ivector3_t &chunk_coord) {
+    // Arithmetic shifts round towards negative infinity like the other space_ conversions
+    return ivector3_t(chunk_coord.x >> 4, chunk_coord.y >> 4, chunk_coord.z >> 4);
+}
+
+// Index of the chunk inside its region (12 bits)
+inline uint32_t get_region_chunk_index(const ivector3_t &chunk_coord) {
+    return
+        (chunk_coord.x & (CHUNK_REGION_EDGE_LENGTH - 1)) |
+        ((chunk_coord.y & (CHUNK_REGION_EDGE_LENGTH - 1)) << 4) |
+        ((chunk_coord.z & (CHUNK_REGION_EDGE_LENGTH - 1)) << 8);
+}
+
+inline ivector3_t space_region_to_chunk(const ivector3_t &region_coord, uint32_t region_chunk_index) {
+    return region_coord * CHUNK_REGION_EDGE_LENGTH + ivector3_t(
+        region_chunk_index & (CHUNK_REGION_EDGE_LENGTH - 1),
+        (region_chunk_index >> 4) & (CHUNK_REGION_EDGE_LENGTH - 1),
+        region_chunk_index >> 8);
+}
+
+// 51-bit key of the region (17 bits per axis)
+uint64_t region_coord_key(const ivector3_t &region_coord);
+// Packs the chunk coordinate into a unique 64-bit key (used to index game_t::chunk_indices): region key + index in the region
+uint64_t chunk_coord_key(const ivector3_t &coord);
 // If on client side, client will have to handle destroying the rendering resources of the chunk
 void destroy_chunk(chunk_t *chunk);
+// Attaches a history record from game_t::history_allocator (all modification_pool entries set to CHUNK_SPECIAL_VALUE)
+void activate_chunk_history(chunk_t *chunk);
+// Gives the history record back to the pool
+void deactivate_chunk_history(chunk_t *chunk);
 // Adds a sphere through modifying voxels
 enum generation_type_t { GT_ADDITIVE, GT_DESTRUCTIVE, GT_INVALID } ;
 void generate_sphere(const vector3_t &ws_center, float ws_radius, float max_value, generation_type_t type, voxel_color_t color);
@@ -79,10 +511,65 @@ struct terraform_package_t {
     voxel_color_t color;
 };
 
+// Brushes of every player during a tick (when it gets full, the queue is applied before the end of the tick)
+#define TERRAFORM_MAX_QUEUED_COMMANDS 256
+
+// Brush which terraform() queued for the next apply_terraform_commands
+struct terraform_command_t {
+    terraform_type_t type;
+    ivector3_t vs_center;
+    voxel_color_t color;
+    bool with_history;
+    float radius;
+    float speed;
+    float dt;
+};
+
+struct terraform_queue_t {
+    uint32_t command_count;
+    // Commands from this one on were queued by the player whose actions are running (see begin_player_terraform_commands)
+    uint32_t player_first_command;
+    terraform_command_t commands[TERRAFORM_MAX_QUEUED_COMMANDS];
+};
+
+struct terrain_raycast_hit_t {
+    // Where the ray crosses the surface level (trilinear interpolation of the values inside the marching cubes cells)
+    vector3_t ws_position;
+    // From the start of the ray
+    float distance;
+    // Voxel over the surface level which is closest to the contact point
+    ivector3_t vs_voxel;
+};
+
+// Walks the marching cubes cells along the ray one by one (cell c is [c, c + 1[, the voxels are at its corners), across chunk boundaries
+// In a cell, the values along the ray are a cubic: the hit is its first crossing of the surface level
+// Returns false if the ray doesn't cross the surface level within max_distance (if the ray starts in the terrain, the hit is at its start)
+bool raycast_terrain(const vector3_t &ws_ray_start, const vector3_t &ws_ray_direction, float max_distance, terrain_raycast_hit_t *hit);
+// Same for a sphere moving along the ray: the sphere also gets swept against the collision mesh, and the closest hit wins
+bool raycast_terrain_sphere(const vector3_t &ws_ray_start, const vector3_t &ws_ray_direction, float max_distance, float ws_radius, terrain_raycast_hit_t *hit);
+struct terrain_ray_t {
+    vector3_t ws_start;
+    vector3_t ws_direction;
+    float max_distance;
+    // 0 for a ray, otherwise see raycast_terrain_sphere
+    float radius;
+};
+
+// raycast_terrain_sphere for a lot of rays at once (e.g. all the projectiles of a tick): the rays get grouped by the chunk they start in,
+// and the ones which only go through bricks without any voxel over the surface level (or chunks which don't exist) don't walk the cells
+// detected[i] / hits[i] are what raycast_terrain_sphere returns for rays[i] (hits may be NULL, hits[i] only gets written if detected[i])
+void raycast_terrain_batch(const terrain_ray_t *rays, uint32_t ray_count, bool *detected, terrain_raycast_hit_t *hits);
 // This will return a terraforming package to use in the terraform function
+// The ray goes through the terrain as it was before the tick, with the brushes that the player queued since then
 terraform_package_t cast_terrain_ray(const vector3_t &ws_ray_start, const vector3_t &ws_ray_direction, float max_reach, voxel_color_t color);
-// Terraforms at a position that was specified in the terraform package
+// Queues a brush at the position that was specified in the terraform package (gets applied by apply_terraform_commands)
 bool terraform(terraform_type_t type, terraform_package_t package, float radius, float speed, float dt);
+// Applies the queued brushes, chunk by chunk: every chunk gets written once, with its brushes in the order they were queued
+// (same voxels / history as applying the brushes one after the other) - called once per tick, after the actions of every player
+void apply_terraform_commands();
+// Called before the actions of a player get executed: the player's actions only see the brushes the player queued this tick
+// (the client applies its brushes after every frame, cast_terrain_ray sees the same voxels on both sides)
+void begin_player_terraform_commands();
 
 enum collision_primitive_type_t { CPT_FACE, CPT_EDGE, CPT_VERTEX };
 
@@ -126,6 +613,13 @@ struct terrain_collision_t {
     vector3_t es_contact_point;
 };
 
+// Returns the cached collision triangles of the chunk (re-meshes the dirty bricks first, possibly evicting the mesh of another chunk)
+const chunk_collision_mesh_t *get_chunk_collision_mesh(chunk_t *chunk);
+// Copies of the triangles of the cells around the ellipsoid (allocated with LN_MALLOC)
+collision_triangle_t *gather_collision_triangles(uint32_t *triangle_count, const vector3_t &ws_center, const vector3_t &ws_size);
+// Copies of the triangles which the ellipsoid may touch while it moves by ws_velocity (walks the BVH of the chunks on the way)
+collision_triangle_t *sweep_collision_triangles(uint32_t *triangle_count, const vector3_t &ws_center, const vector3_t &ws_size, const vector3_t &ws_velocity);
+
 // This will perform a collide and slide physics thingy
 vector3_t collide_and_slide(terrain_collision_t *collision);
 void check_ray_terrain_collision(terrain_collision_t *collision);
@@ -0,0 +1,285 @@
+#include "log.hpp"
+#include "map.hpp"
+#include "game.hpp"
+#include "player.hpp"
+#include "serialiser.hpp"
+#include "allocators.hpp"
+#include "chunk_residency.hpp"
+#include <string.h>
+#include <algorithm>
+
+void begin_chunk_residency(
+    const char *map_file_path,
+    const char *spill_file_path) {
+    chunk_residency_t *residency = &g_game->residency;
+
+    residency->records.init(CHUNK_MAX_LOADED_COUNT);
+    // Procedural terrain doesn't have a map file
+    residency->map_file = map_file_path ? create_file(map_file_path, FLF_BINARY) : INVALID_FILE_HANDLE;
+    residency->spill_file = create_file(spill_file_path, FLF_BINARY | FLF_WRITEABLE | FLF_OVERWRITE);
+    residency->spill_file_size = 0;
+    strncpy(residency->spill_file_path, spill_file_path, sizeof(residency->spill_file_path) - 1);
+    residency->spill_file_path[sizeof(residency->spill_file_path) - 1] = 0;
+
+    residency->paged_in_count = 0;
+    residency->evicted_count = 0;
+    residency->flushed_count = 0;
+
+    memset(residency->tracks_player, 0, sizeof(residency->tracks_player));
+
+    if (!does_file_exist(residency->spill_file)) {
+        LOG_ERRORV("Failed to create chunk spill file %s\n", spill_file_path);
+    }
+}
+
+void add_chunk_record(
+    const ivector3_t &chunk_coord,
+    uint32_t offset,
+    uint32_t size) {
+    chunk_record_t record = {};
+    record.chunk_coord = chunk_coord;
+    record.offset = offset;
+    record.size = size;
+    record.in_spill_file = 0;
+
+    g_game->residency.records.insert(chunk_coord_key(chunk_coord), record);
+}
+
+void end_chunk_residency() {
+    chunk_residency_t *residency = &g_game->residency;
+
+    if (residency->map_file != INVALID_FILE_HANDLE) {
+        free_file(residency->map_file);
+    }
+
+    free_file(residency->spill_file);
+    delete_file(residency->spill_file_path);
+    residency->records.destroy();
+}
+
+void read_chunk_record(
+    const chunk_record_t *record,
+    uint8_t *dst) {
+    chunk_residency_t *residency = &g_game->residency;
+    read_file_range(record->in_spill_file ? residency->spill_file : residency->map_file, record->offset, dst, record->size);
+}
+
+void load_chunk_record(
+    const chunk_record_t *record,
+    voxel_t *linear_voxels) {
+    if (!record->size) {
+        // Modified procedural terrain chunk which got emptied
+        memset(linear_voxels, 0, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+        return;
+    }
+
+    // Run-length encoding never takes more space than the raw voxels
+    uint8_t data[CHUNK_BYTE_SIZE];
+    read_chunk_record(record, data);
+
+    serialiser_t serialiser = {};
+    serialiser.data_buffer = data;
+    serialiser.data_buffer_head = 0;
+    serialiser.data_buffer_size = record->size;
+
+    deserialise_map_chunk_voxels(&serialiser, linear_voxels);
+}
+
+chunk_t *page_in_chunk(
+    const ivector3_t &chunk_coord) {
+    chunk_residency_t *residency = &g_game->residency;
+    chunk_record_t *record = residency->records.get(chunk_coord_key(chunk_coord));
+
+    if (!record) {
+        // Chunks which weren't modified get generated again
+        return g_game->flags.procedural_terrain ? load_terrain_chunk(chunk_coord) : NULL;
+    }
+
+    if (!record->size) {
+        // Empty chunk (game_t::get_chunk creates them empty)
+        return NULL;
+    }
+
+    if (!g_game->chunks.removed_count && g_game->chunks.data_count == g_game->chunks.max_size) {
+        LOG_WARNING("Can't page chunk in - all the chunk slots are taken\n");
+        return NULL;
+    }
+
+    chunk_t *chunk = g_game->add_chunk(chunk_coord);
+    voxel_t *voxels = get_chunk_voxels_for_write(chunk);
+    load_chunk_record(record, voxels);
+    reorder_linear_chunk_voxels(voxels);
+    compress_chunk_storage(chunk);
+
+    // Same as what is in the backing store
+    chunk->flags.needs_flush = 0;
+
+    ++residency->paged_in_count;
+
+    return chunk;
+}
+
+// Writes the voxels of the chunk to the spill file (the chunk can then get evicted)
+static void s_flush_chunk(
+    chunk_t *chunk) {
+    chunk_residency_t *residency = &g_game->residency;
+
+    uint8_t data[CHUNK_BYTE_SIZE];
+    serialiser_t serialiser = {};
+    serialiser.data_buffer = data;
+    serialiser.data_buffer_head = 0;
+    serialiser.data_buffer_size = CHUNK_BYTE_SIZE;
+
+    voxel_t scratch[CHUNK_VOXEL_COUNT];
+    const voxel_t *voxels = get_chunk_voxels_linear(chunk, scratch);
+
+    uint64_t key = chunk_coord_key(chunk->chunk_coord);
+    chunk_record_t *record = residency->records.get(key);
+
+    if (!serialise_map_chunk_voxels(&serialiser, voxels)) {
+        if (g_game->flags.procedural_terrain) {
+            // Without a record, the chunk would get generated again
+            if (!record) {
+                chunk_record_t new_record = {};
+                new_record.chunk_coord = chunk->chunk_coord;
+                new_record.in_spill_file = 1;
+
+                residency->records.insert(key, new_record);
+                record = residency->records.get(key);
+            }
+
+            record->size = 0;
+        }
+        else if (record) {
+            // Empty chunks don't need a record (game_t::get_chunk creates them empty)
+            residency->records.remove(key);
+        }
+    }
+    else {
+        uint32_t size = serialiser.data_buffer_head;
+
+        // Records which are already in the spill file get overwritten if the new data fits
+        if (record && record->in_spill_file && record->size >= size) {
+            record->size = size;
+        }
+        else {
+            chunk_record_t new_record = {};
+            new_record.chunk_coord = chunk->chunk_coord;
+            new_record.offset = residency->spill_file_size;
+            new_record.size = size;
+            new_record.in_spill_file = 1;
+
+            residency->spill_file_size += size;
+            residency->records.insert(key, new_record);
+            record = residency->records.get(key);
+        }
+
+        write_file_range(residency->spill_file, record->offset, data, size);
+    }
+
+    chunk->flags.needs_flush = 0;
+    ++residency->flushed_count;
+}
+
+static bool s_used_before(
+    const chunk_t *a,
+    const chunk_t *b) {
+    return a->last_used_tick < b->last_used_tick;
+}
+
+// Whether the chunk is in the box of chunks which stays resident around one of the players
+static bool s_is_near_player(
+    const chunk_t *chunk) {
+    chunk_residency_t *residency = &g_game->residency;
+
+    for (uint32_t p = 0; p < g_game->players.data_count; ++p) {
+        if (residency->tracks_player[p]) {
+            ivector3_t distance = glm::abs(chunk->chunk_coord - residency->player_chunk_coords[p]);
+
+            if (distance.x <= residency->radius && distance.y <= residency->radius && distance.z <= residency->radius) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void update_chunk_residency() {
+    chunk_residency_t *residency = &g_game->residency;
+    int32_t radius = residency->radius;
+
+    // Chunks around the players get paged in when a player gets into another chunk
+    for (uint32_t p = 0; p < g_game->players.data_count; ++p) {
+        player_t *player = g_game->players[p];
+
+        if (!player) {
+            residency->tracks_player[p] = 0;
+            continue;
+        }
+
+        if (residency->tracks_player[p] && residency->player_chunk_coords[p] == player->chunk_coord) {
+            continue;
+        }
+
+        residency->tracks_player[p] = 1;
+        residency->player_chunk_coords[p] = player->chunk_coord;
+
+        for (int32_t z = -radius; z <= radius; ++z) {
+            for (int32_t y = -radius; y <= radius; ++y) {
+                for (int32_t x = -radius; x <= radius; ++x) {
+                    g_game->access_chunk(player->chunk_coord + ivector3_t(x, y, z));
+                }
+            }
+        }
+    }
+
+    uint32_t resident_count = g_game->chunks.data_count - g_game->chunks.removed_count;
+
+    if (resident_count <= residency->max_resident_count) {
+        return;
+    }
+
+    // Chunks which weren't used this tick, and which nothing else holds on to
+    chunk_t **candidates = LN_MALLOC(chunk_t *, resident_count);
+    uint32_t candidate_count = 0;
+
+    for (uint32_t i = 0; i < g_game->chunks.data_count; ++i) {
+        chunk_t *chunk = g_game->chunks[i];
+
+        if (chunk &&
+            chunk->last_used_tick < g_game->current_tick &&
+            !chunk->players_in_chunk.data_count &&
+            !chunk->history &&
+            !chunk->flags.made_modification &&
+            !s_is_near_player(chunk)) {
+            candidates[candidate_count++] = chunk;
+        }
+    }
+
+    // Only the chunks which get evicted have to be the least recently used ones (the others stay in any order)
+    // Chunks which can't get flushed this tick are skipped, so a few more than that get selected
+    uint32_t selected_count = MIN(candidate_count, resident_count - residency->max_resident_count + residency->max_flushes_per_tick);
+    std::nth_element(candidates, candidates + selected_count, candidates + candidate_count, s_used_before);
+    std::sort(candidates, candidates + selected_count, s_used_before);
+
+    uint32_t flush_count = 0;
+
+    for (uint32_t i = 0; i < candidate_count && resident_count > residency->max_resident_count; ++i) {
+        chunk_t *chunk = candidates[i];
+
+        if (chunk->flags.needs_flush) {
+            if (flush_count == residency->max_flushes_per_tick) {
+                // Stays pinned until it gets written
+                continue;
+            }
+
+            s_flush_chunk(chunk);
+            ++flush_count;
+        }
+
+        g_game->remove_chunk(chunk);
+        ++residency->evicted_count;
+        --resident_count;
+    }
+}
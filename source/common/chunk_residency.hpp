@@ -0,0 +1,62 @@
+#pragma once
+
+#include "files.hpp"
+#include "chunk.hpp"
+#include "containers.hpp"
+
+// Chunk paging (game_t::flags.page_chunks, used by the server): only the chunks around the players have to stay in game_t::chunks
+// The other chunks live in a backing store - the map file if they weren't modified, the spill file otherwise
+// game_t::get_chunk / game_t::access_chunk page chunks back in, so the rest of the code doesn't see the difference
+
+// Where the voxels of a chunk are stored (see serialise_map_chunk_voxels for the format)
+// With procedural terrain, only the modified chunks have a record (size is 0 if the chunk got emptied)
+struct chunk_record_t {
+    ivector3_t chunk_coord;
+    uint32_t offset;
+    uint32_t size;
+    // Otherwise the record points into the map file
+    uint8_t in_spill_file;
+};
+
+struct chunk_residency_t {
+    // Every chunk which has voxels in the backing store (whether it is resident or not)
+    open_hash_table_t<chunk_record_t> records;
+    file_handle_t map_file;
+    file_handle_t spill_file;
+    uint32_t spill_file_size;
+    // Spill file gets deleted at the end of the session
+    char spill_file_path[64];
+
+    // Chunks this close to a player (in chunks, on every axis) get paged in and don't get evicted
+    int32_t radius;
+    // Least recently used chunks get evicted when more chunks than this are resident
+    uint32_t max_resident_count;
+    // Modified chunks are pinned until they get written to the spill file - this is how many get written per tick
+    uint32_t max_flushes_per_tick;
+
+    // Chunk coordinate of each player slot when its chunks were last paged in (only done again when it changes)
+    ivector3_t player_chunk_coords[PLAYER_MAX_COUNT];
+    bool tracks_player[PLAYER_MAX_COUNT];
+
+    // Statistics
+    uint32_t paged_in_count;
+    uint32_t evicted_count;
+    uint32_t flushed_count;
+};
+
+// Called by load_map - the chunks of the map become records (add_chunk_record) instead of getting loaded
+// map_file_path is NULL with procedural terrain (chunks without a record get generated)
+void begin_chunk_residency(const char *map_file_path, const char *spill_file_path);
+void add_chunk_record(const ivector3_t &chunk_coord, uint32_t offset, uint32_t size);
+void end_chunk_residency();
+
+// Reads the serialised voxels of the record (record->size bytes)
+void read_chunk_record(const chunk_record_t *record, uint8_t *dst);
+// Voxels (in linear order) of a chunk from the backing store
+void load_chunk_record(const chunk_record_t *record, voxel_t *linear_voxels);
+
+// Makes the chunk resident if it has a record (NULL if it doesn't, or if game_t::chunks is full)
+chunk_t *page_in_chunk(const ivector3_t &chunk_coord);
+
+// Once per tick: pages in the chunks around the players, writes modified chunks to the spill file and evicts the least recently used ones
+void update_chunk_residency();
@@ -0,0 +1,944 @@
+#include "allocators.hpp"
+#include "collision_kernel.hpp"
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLLISION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Compiled for every x86 GCC build, s_collide_batch_avx2 only runs on CPUs with AVX2
+#if defined(COLLISION_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLLISION_AVX2 1
+#include <immintrin.h>
+#endif
+
+void make_collision_triangle_batch(
+    collision_triangle_batch_t *batch,
+    const collision_triangle_t *ws_triangles,
+    uint32_t triangle_count,
+    const vector3_t &ws_size) {
+    uint32_t padded_count = (triangle_count + COLLISION_BATCH_WIDTH - 1) / COLLISION_BATCH_WIDTH * COLLISION_BATCH_WIDTH;
+    float *coords = LN_MALLOC(float, 9 * padded_count);
+
+    batch->count = triangle_count;
+
+    for (uint32_t v = 0; v < 3; ++v) {
+        for (uint32_t axis = 0; axis < 3; ++axis) {
+            float *dst = &coords[(v * 3 + axis) * padded_count];
+            batch->coords[v][axis] = dst;
+
+            for (uint32_t t = 0; t < triangle_count; ++t) {
+                dst[t] = ws_triangles[t].vertices[v][axis] / ws_size[axis];
+            }
+
+            // Empty triangles have no normal: they never face the sphere
+            for (uint32_t t = triangle_count; t < padded_count; ++t) {
+                dst[t] = 0.0f;
+            }
+        }
+    }
+}
+
+// Keeps the contact if it is nearer than the ones of the previous triangles
+static bool s_add_contact(
+    terrain_collision_t *collision,
+    float cinstance,
+    bool inside_terrain,
+    float es_distance_to_plane,
+    const vector3_t &es_contact_point,
+    const vector3_t &es_plane_normal) {
+    float distance_to_collision = glm::abs(cinstance) * glm::length(collision->es_velocity);
+
+    if (!collision->detected || distance_to_collision < collision->es_nearest_distance) {
+        if (inside_terrain) {
+            collision->es_nearest_distance = es_distance_to_plane;
+        }
+        else {
+            collision->es_nearest_distance = distance_to_collision;
+        }
+
+        collision->es_contact_point = es_contact_point;
+        collision->es_surface_normal = es_plane_normal;
+        collision->detected = 1;
+        collision->under_terrain = inside_terrain;
+
+        collision->has_detected_previously = 1;
+
+        return true;
+    }
+
+    return false;
+}
+
+// This function solves the quadratic eqation "At^2 + Bt + C = 0" and is found in Kasper Fauerby's paper on collision detection and response
+static bool s_get_smallest_root(
+    float a,
+    float b,
+    float c,
+    float max_r,
+    float *root) {
+    // Check if a solution exists
+    float determinant = b * b - 4.0f * a * c;
+    // If determinant is negative it means no solutions.
+    if (determinant < 0.0f) return false;
+    // calculate the two roots: (if determinant == 0 then
+    // x1==x2 but lets disregard that slight optimization)
+    float sqrt_d = sqrt(determinant);
+    float r1 = (-b - sqrt_d) / (2 * a);
+    float r2 = (-b + sqrt_d) / (2 * a);
+    // Sort so x1 <= x2
+    if (r1 > r2) {
+        float temp = r2;
+        r2 = r1;
+        r1 = temp;
+    }
+    // Get lowest root:
+    if (r1 > 0 && r1 < max_r) {
+        *root = r1;
+        return true;
+    }
+    // It is possible that we want x2 - this can happen
+    // if x1 < 0
+    if (r2 > 0 && r2 < max_r) {
+        *root = r2;
+        return true;
+    }
+
+    // No (valid) solutions
+    return false;
+}
+
+
+static float s_get_plane_constant(
+    const vector3_t &plane_point,
+    const vector3_t &plane_normal) {
+    return -glm::dot(plane_point, plane_normal);
+}
+
+static bool s_facing_triangle(
+    const vector3_t &es_normalised_velocity,
+    const vector3_t &es_normal) {
+    return (glm::dot(es_normalised_velocity, es_normal) <= 0.0f);
+}
+
+static bool s_inside_triangle(
+    const vector3_t &plane_contact_point,
+    collision_triangle_t *triangle) {
+    vector3_t cross0 = glm::cross(triangle->v.c - triangle->v.b, plane_contact_point - triangle->v.b);
+    vector3_t cross1 = glm::cross(triangle->v.c - triangle->v.b, triangle->v.a - triangle->v.b);
+
+    if (glm::dot(cross0, cross1) >= 0.0f) {
+        cross0 = glm::cross(triangle->v.c - triangle->v.a, plane_contact_point - triangle->v.a);
+        cross1 = glm::cross(triangle->v.c - triangle->v.a, triangle->v.b - triangle->v.a);
+
+        if (glm::dot(cross0, cross1) >= 0.0f) {
+            cross0 = glm::cross(triangle->v.b - triangle->v.a, plane_contact_point - triangle->v.a);
+            cross1 = glm::cross(triangle->v.b - triangle->v.a, triangle->v.c - triangle->v.a);
+
+            if (glm::dot(cross0, cross1) >= 0.0f) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool s_touched_vertex(
+    float a,
+    float *cinstance0,
+    const vector3_t &vertex,
+    terrain_collision_t *collision) {
+    float b = 2.0f * glm::dot(collision->es_velocity, collision->es_position - vertex);
+    float c = glm::dot(vertex - collision->es_position, vertex - collision->es_position) - 1.0f;
+
+    float new_cinstance;
+
+    if (s_get_smallest_root(a, b, c, *cinstance0, &new_cinstance)) {
+        *cinstance0 = new_cinstance;
+        return true;
+    }
+
+    return false;
+}
+
+static bool s_touched_edge(
+    float *cinstance0,
+    vector3_t *new_position,
+    const vector3_t &vertex0,
+    const vector3_t &vertex1,
+    terrain_collision_t *collision) {
+    vector3_t edge_vector = vertex1 - vertex0;
+    vector3_t position_to_vertex0 = vertex0 - collision->es_position;
+    float velocity_length2 = glm::dot(collision->es_velocity, collision->es_velocity);
+    float edge_length2 = glm::dot(edge_vector, edge_vector);
+    float edge_dot_velocity = glm::dot(edge_vector, collision->es_velocity);
+    float edge_dot_position_to_vertex0 = glm::dot(edge_vector, position_to_vertex0);
+    float position_to_vertex0_length2 = glm::dot(position_to_vertex0, position_to_vertex0);
+
+    float a = edge_length2 * (-velocity_length2) + (edge_dot_velocity * edge_dot_velocity);
+    float b = edge_length2 * (2.0f * glm::dot(collision->es_velocity, position_to_vertex0)) - (2.0f * edge_dot_velocity * edge_dot_position_to_vertex0);
+    float c = edge_length2 * (1.0f - position_to_vertex0_length2) + (edge_dot_position_to_vertex0 * edge_dot_position_to_vertex0);
+
+    float new_cinstance;
+
+    if (s_get_smallest_root(a, b, c, *cinstance0, &new_cinstance)) {
+        // Where on the line did the collision happen (did it even happen on the edge, or just on the infinite line of the edge)
+        float proportion = (edge_dot_velocity * new_cinstance - edge_dot_position_to_vertex0) / edge_length2;
+        if (proportion >= 0.0f && proportion <= 1.0f) {
+            *cinstance0 = new_cinstance;
+            *new_position = vertex0 + proportion * edge_vector;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool s_collided_with_triangle(
+    terrain_collision_t *collision,
+    collision_triangle_t *es_triangle) {
+    vector3_t es_a = es_triangle->v.a;
+    vector3_t es_b = es_triangle->v.b;
+    vector3_t es_c = es_triangle->v.c;
+
+    vector3_t es_plane_normal = glm::normalize(glm::cross(es_b - es_a, es_c - es_a));
+
+    float es_distance_to_plane = 0.0f;
+
+    bool inside_terrain = 0;
+
+    if (s_facing_triangle(collision->es_normalised_velocity, es_plane_normal)) {
+        // get plane constant
+        float plane_constant = s_get_plane_constant(es_a, es_plane_normal);
+        es_distance_to_plane = glm::dot(collision->es_position, es_plane_normal) + plane_constant;
+        float plane_normal_dot_velocity = glm::dot(es_plane_normal, collision->es_velocity);
+
+        bool sphere_inside_plane = 0;
+
+        float cinstance0 = 0.0f, cinstance1 = 0.0f;
+
+        if (plane_normal_dot_velocity == 0.0f) {
+            // sphere velocity is parallel to plane surface (& facing plane, as we calculated before)
+            if (glm::abs(es_distance_to_plane) >= 1.0f) {
+                // sphere is not in plane and distance is more than sphere radius, cannot possibly collide
+                return false;
+            }
+            else {
+                sphere_inside_plane = 1;
+            }
+        }
+        else {
+            // sphere velocity is not parallel to plane surface (& facing towards plane)
+            // need to check collision with triangle surface, edges and vertices
+            // collision instance 0 (first time sphere touches plane)
+            cinstance0 = (1.0f - es_distance_to_plane) / plane_normal_dot_velocity;
+            cinstance1 = (-1.0f - es_distance_to_plane) / plane_normal_dot_velocity;
+
+            // The sphere is inside the fricking plane
+            if (cinstance0 < 0.0f) {
+                inside_terrain = 1;
+                //LOG_ERROR("There is problem: sphere is inside the terrain\n");
+            }
+
+            // always make sure that 0 corresponds to closer collision and 1 responds to further
+            if (cinstance0 > cinstance1) {
+                float t = cinstance0;
+                cinstance0 = cinstance1;
+                cinstance1 = t;
+            }
+
+            if (cinstance0 > 1.0f || cinstance1 < 0.0f) {
+                // either triangle plane is behind, or too far (0.0f to 1.0f represents 0.0f to dt, if we cinstance0 > 1.0f, we are trying to go further than we can in this timeframe)
+                return false;
+            }
+
+            if (cinstance0 < 0.0f) cinstance0 = 0.0f;
+            if (cinstance1 > 1.0f) cinstance1 = 1.0f;
+        }
+
+        // point where sphere intersects with plane, not triangle
+        vector3_t plane_contact_point = (collision->es_position + cinstance0 * collision->es_velocity - es_plane_normal);
+
+        bool detected_collision = 0;
+        float cinstance = 1.0f;
+        vector3_t triangle_contact_point;
+
+        if (!sphere_inside_plane) {
+            if (s_inside_triangle(plane_contact_point, es_triangle)) {
+                // sphere collided with triangle
+                detected_collision = 1;
+                cinstance = cinstance0;
+
+                triangle_contact_point = plane_contact_point;
+            }
+            else {
+                inside_terrain = 0;
+            }
+        }
+
+        // check triangle edges / vertices
+        if (!detected_collision) {
+            float a; /*, b, c*/
+
+            a = glm::dot(collision->es_velocity, collision->es_velocity);
+
+            if (s_touched_vertex(a, &cinstance, es_triangle->v.a, collision)) {
+                detected_collision = true;
+                triangle_contact_point = es_triangle->v.a;
+            }
+
+            if (s_touched_vertex(a, &cinstance, es_triangle->v.b, collision)) {
+                detected_collision = true;
+                triangle_contact_point = es_triangle->v.b;
+            }
+
+            if (s_touched_vertex(a, &cinstance, es_triangle->v.c, collision)) {
+                detected_collision = true;
+                triangle_contact_point = es_triangle->v.c;
+            }
+
+            vector3_t new_position_on_edge;
+
+            if (s_touched_edge(&cinstance, &new_position_on_edge, es_a, es_b, collision)) {
+                detected_collision = true;
+                triangle_contact_point = new_position_on_edge;
+            }
+
+            if (s_touched_edge(&cinstance, &new_position_on_edge, es_b, es_c, collision)) {
+                detected_collision = true;
+                triangle_contact_point = new_position_on_edge;
+            }
+
+            if (s_touched_edge(&cinstance, &new_position_on_edge, es_c, es_a, collision)) {
+                detected_collision = true;
+                triangle_contact_point = new_position_on_edge;
+            }
+        }
+
+        if (detected_collision) {
+            return s_add_contact(collision, cinstance, inside_terrain, es_distance_to_plane, triangle_contact_point, es_plane_normal);
+        }
+    }
+
+    return false;
+}
+
+static void s_collide_batch_scalar(
+    terrain_collision_t *collision,
+    const collision_triangle_batch_t *batch) {
+    for (uint32_t t = 0; t < batch->count; ++t) {
+        collision_triangle_t es_triangle;
+
+        for (uint32_t v = 0; v < 3; ++v) {
+            for (uint32_t axis = 0; axis < 3; ++axis) {
+                es_triangle.vertices[v][axis] = batch->coords[v][axis][t];
+            }
+        }
+
+        // Check collision with this triangle (now is ellipsoid space)
+        s_collided_with_triangle(collision, &es_triangle);
+    }
+}
+
+// The SIMD kernels do the same operations as the scalar one, in the same order, for 4 / 8 triangles at a time:
+// the branches become masks, and the contacts get added in triangle order once all the lanes are done
+// (a negative determinant gives NaN roots, which fail all the comparisons like the early out of s_get_smallest_root)
+
+#if defined(COLLISION_SSE2)
+
+struct sse2_vector3_t {
+    __m128 x, y, z;
+};
+
+static inline sse2_vector3_t s_set_sse2(const vector3_t &v) {
+    sse2_vector3_t r = { _mm_set1_ps(v.x), _mm_set1_ps(v.y), _mm_set1_ps(v.z) };
+    return r;
+}
+
+static inline sse2_vector3_t s_load_sse2(const collision_triangle_batch_t *batch, uint32_t vertex, uint32_t first) {
+    sse2_vector3_t r = {
+        _mm_loadu_ps(&batch->coords[vertex][0][first]),
+        _mm_loadu_ps(&batch->coords[vertex][1][first]),
+        _mm_loadu_ps(&batch->coords[vertex][2][first]) };
+    return r;
+}
+
+static inline sse2_vector3_t s_add_sse2(const sse2_vector3_t &a, const sse2_vector3_t &b) {
+    sse2_vector3_t r = { _mm_add_ps(a.x, b.x), _mm_add_ps(a.y, b.y), _mm_add_ps(a.z, b.z) };
+    return r;
+}
+
+static inline sse2_vector3_t s_sub_sse2(const sse2_vector3_t &a, const sse2_vector3_t &b) {
+    sse2_vector3_t r = { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) };
+    return r;
+}
+
+static inline sse2_vector3_t s_scale_sse2(const sse2_vector3_t &v, __m128 s) {
+    sse2_vector3_t r = { _mm_mul_ps(v.x, s), _mm_mul_ps(v.y, s), _mm_mul_ps(v.z, s) };
+    return r;
+}
+
+// Same order as glm::dot: (x + y) + z
+static inline __m128 s_dot_sse2(const sse2_vector3_t &a, const sse2_vector3_t &b) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+}
+
+static inline sse2_vector3_t s_cross_sse2(const sse2_vector3_t &x, const sse2_vector3_t &y) {
+    sse2_vector3_t r = {
+        _mm_sub_ps(_mm_mul_ps(x.y, y.z), _mm_mul_ps(y.y, x.z)),
+        _mm_sub_ps(_mm_mul_ps(x.z, y.x), _mm_mul_ps(y.z, x.x)),
+        _mm_sub_ps(_mm_mul_ps(x.x, y.y), _mm_mul_ps(y.x, x.y)) };
+    return r;
+}
+
+// mask ? a : b
+static inline __m128 s_select_sse2(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline sse2_vector3_t s_select3_sse2(__m128 mask, const sse2_vector3_t &a, const sse2_vector3_t &b) {
+    sse2_vector3_t r = { s_select_sse2(mask, a.x, b.x), s_select_sse2(mask, a.y, b.y), s_select_sse2(mask, a.z, b.z) };
+    return r;
+}
+
+// Lanes of the returned mask have a root
+static inline __m128 s_get_smallest_root_sse2(__m128 a, __m128 b, __m128 c, __m128 max_r, __m128 *root) {
+    __m128 zero = _mm_setzero_ps();
+    __m128 determinant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(4.0f), a), c));
+    __m128 sqrt_d = _mm_sqrt_ps(determinant);
+    __m128 minus_b = _mm_xor_ps(b, _mm_set1_ps(-0.0f));
+    __m128 two_a = _mm_mul_ps(_mm_set1_ps(2.0f), a);
+    __m128 r1 = _mm_div_ps(_mm_sub_ps(minus_b, sqrt_d), two_a);
+    __m128 r2 = _mm_div_ps(_mm_add_ps(minus_b, sqrt_d), two_a);
+
+    __m128 swap = _mm_cmpgt_ps(r1, r2);
+    __m128 lower = s_select_sse2(swap, r2, r1);
+    __m128 upper = s_select_sse2(swap, r1, r2);
+
+    __m128 lower_valid = _mm_and_ps(_mm_cmpgt_ps(lower, zero), _mm_cmplt_ps(lower, max_r));
+    __m128 upper_valid = _mm_and_ps(_mm_cmpgt_ps(upper, zero), _mm_cmplt_ps(upper, max_r));
+
+    *root = s_select_sse2(lower_valid, lower, upper);
+
+    return _mm_or_ps(lower_valid, upper_valid);
+}
+
+static inline __m128 s_inside_triangle_sse2(
+    const sse2_vector3_t &point,
+    const sse2_vector3_t &a,
+    const sse2_vector3_t &b,
+    const sse2_vector3_t &c) {
+    __m128 zero = _mm_setzero_ps();
+
+    sse2_vector3_t cb = s_sub_sse2(c, b);
+    __m128 inside = _mm_cmpge_ps(s_dot_sse2(s_cross_sse2(cb, s_sub_sse2(point, b)), s_cross_sse2(cb, s_sub_sse2(a, b))), zero);
+
+    sse2_vector3_t ca = s_sub_sse2(c, a);
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(s_dot_sse2(s_cross_sse2(ca, s_sub_sse2(point, a)), s_cross_sse2(ca, s_sub_sse2(b, a))), zero));
+
+    sse2_vector3_t ba = s_sub_sse2(b, a);
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(s_dot_sse2(s_cross_sse2(ba, s_sub_sse2(point, a)), s_cross_sse2(ba, s_sub_sse2(c, a))), zero));
+
+    return inside;
+}
+
+static inline __m128 s_touched_vertex_sse2(
+    __m128 a,
+    __m128 *cinstance,
+    const sse2_vector3_t &vertex,
+    const sse2_vector3_t &position,
+    const sse2_vector3_t &velocity) {
+    sse2_vector3_t vertex_to_position = s_sub_sse2(vertex, position);
+    __m128 b = _mm_mul_ps(_mm_set1_ps(2.0f), s_dot_sse2(velocity, s_sub_sse2(position, vertex)));
+    __m128 c = _mm_sub_ps(s_dot_sse2(vertex_to_position, vertex_to_position), _mm_set1_ps(1.0f));
+
+    __m128 root;
+    __m128 touched = s_get_smallest_root_sse2(a, b, c, *cinstance, &root);
+    *cinstance = s_select_sse2(touched, root, *cinstance);
+
+    return touched;
+}
+
+static inline __m128 s_touched_edge_sse2(
+    __m128 velocity_length2,
+    __m128 *cinstance,
+    sse2_vector3_t *new_position,
+    const sse2_vector3_t &vertex0,
+    const sse2_vector3_t &vertex1,
+    const sse2_vector3_t &position,
+    const sse2_vector3_t &velocity) {
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+
+    sse2_vector3_t edge_vector = s_sub_sse2(vertex1, vertex0);
+    sse2_vector3_t position_to_vertex0 = s_sub_sse2(vertex0, position);
+    __m128 edge_length2 = s_dot_sse2(edge_vector, edge_vector);
+    __m128 edge_dot_velocity = s_dot_sse2(edge_vector, velocity);
+    __m128 edge_dot_position_to_vertex0 = s_dot_sse2(edge_vector, position_to_vertex0);
+    __m128 position_to_vertex0_length2 = s_dot_sse2(position_to_vertex0, position_to_vertex0);
+
+    __m128 a = _mm_add_ps(
+        _mm_mul_ps(edge_length2, _mm_xor_ps(velocity_length2, _mm_set1_ps(-0.0f))),
+        _mm_mul_ps(edge_dot_velocity, edge_dot_velocity));
+    __m128 b = _mm_sub_ps(
+        _mm_mul_ps(edge_length2, _mm_mul_ps(two, s_dot_sse2(velocity, position_to_vertex0))),
+        _mm_mul_ps(_mm_mul_ps(two, edge_dot_velocity), edge_dot_position_to_vertex0));
+    __m128 c = _mm_add_ps(
+        _mm_mul_ps(edge_length2, _mm_sub_ps(one, position_to_vertex0_length2)),
+        _mm_mul_ps(edge_dot_position_to_vertex0, edge_dot_position_to_vertex0));
+
+    __m128 root;
+    __m128 touched = s_get_smallest_root_sse2(a, b, c, *cinstance, &root);
+
+    __m128 proportion = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(edge_dot_velocity, root), edge_dot_position_to_vertex0), edge_length2);
+    touched = _mm_and_ps(touched, _mm_and_ps(_mm_cmpge_ps(proportion, zero), _mm_cmple_ps(proportion, one)));
+
+    *cinstance = s_select_sse2(touched, root, *cinstance);
+    *new_position = s_select3_sse2(touched, s_add_sse2(vertex0, s_scale_sse2(edge_vector, proportion)), *new_position);
+
+    return touched;
+}
+
+static void s_collide_batch_sse2(
+    terrain_collision_t *collision,
+    const collision_triangle_batch_t *batch) {
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 minus_one = _mm_set1_ps(-1.0f);
+    __m128 sign = _mm_set1_ps(-0.0f);
+
+    sse2_vector3_t position = s_set_sse2(collision->es_position);
+    sse2_vector3_t velocity = s_set_sse2(collision->es_velocity);
+    sse2_vector3_t normalised_velocity = s_set_sse2(collision->es_normalised_velocity);
+    __m128 velocity_length2 = s_dot_sse2(velocity, velocity);
+
+    __m128i lane = _mm_set_epi32(3, 2, 1, 0);
+    __m128i count = _mm_set1_epi32((int32_t)batch->count);
+
+    for (uint32_t first = 0; first < batch->count; first += 4) {
+        sse2_vector3_t a = s_load_sse2(batch, 0, first);
+        sse2_vector3_t b = s_load_sse2(batch, 1, first);
+        sse2_vector3_t c = s_load_sse2(batch, 2, first);
+
+        __m128 in_batch = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_add_epi32(lane, _mm_set1_epi32((int32_t)first)), count));
+
+        // glm::normalize multiplies by 1 / sqrt
+        sse2_vector3_t normal = s_cross_sse2(s_sub_sse2(b, a), s_sub_sse2(c, a));
+        normal = s_scale_sse2(normal, _mm_div_ps(one, _mm_sqrt_ps(s_dot_sse2(normal, normal))));
+
+        __m128 facing = _mm_and_ps(in_batch, _mm_cmple_ps(s_dot_sse2(normalised_velocity, normal), zero));
+
+        __m128 distance_to_plane = _mm_sub_ps(s_dot_sse2(position, normal), s_dot_sse2(a, normal));
+        __m128 normal_dot_velocity = s_dot_sse2(normal, velocity);
+        __m128 parallel = _mm_cmpeq_ps(normal_dot_velocity, zero);
+
+        __m128 cinstance0 = _mm_div_ps(_mm_sub_ps(one, distance_to_plane), normal_dot_velocity);
+        __m128 cinstance1 = _mm_div_ps(_mm_sub_ps(minus_one, distance_to_plane), normal_dot_velocity);
+        __m128 inside_terrain = _mm_andnot_ps(parallel, _mm_cmplt_ps(cinstance0, zero));
+
+        __m128 swap = _mm_cmpgt_ps(cinstance0, cinstance1);
+        __m128 first_cinstance = s_select_sse2(swap, cinstance1, cinstance0);
+        __m128 last_cinstance = s_select_sse2(swap, cinstance0, cinstance1);
+
+        __m128 out_of_reach = s_select_sse2(
+            parallel,
+            _mm_cmpge_ps(_mm_andnot_ps(sign, distance_to_plane), one),
+            _mm_or_ps(_mm_cmpgt_ps(first_cinstance, one), _mm_cmplt_ps(last_cinstance, zero)));
+        __m128 candidate = _mm_andnot_ps(out_of_reach, facing);
+
+        if (!_mm_movemask_ps(candidate)) {
+            continue;
+        }
+
+        first_cinstance = _mm_andnot_ps(parallel, s_select_sse2(_mm_cmplt_ps(first_cinstance, zero), zero, first_cinstance));
+
+        sse2_vector3_t plane_contact_point = s_sub_sse2(s_add_sse2(position, s_scale_sse2(velocity, first_cinstance)), normal);
+
+        // A sphere which moves parallel to the plane can only touch the edges / vertices
+        __m128 face = _mm_andnot_ps(parallel, s_inside_triangle_sse2(plane_contact_point, a, b, c));
+        inside_terrain = _mm_and_ps(inside_terrain, face);
+
+        __m128 cinstance = s_select_sse2(face, first_cinstance, one);
+        sse2_vector3_t contact_point = plane_contact_point;
+        __m128 touched = face;
+
+        if (_mm_movemask_ps(_mm_andnot_ps(face, candidate))) {
+            __m128 edge_cinstance = one;
+            sse2_vector3_t edge_contact_point = plane_contact_point;
+            __m128 touched_edge;
+
+            touched_edge = s_touched_vertex_sse2(velocity_length2, &edge_cinstance, a, position, velocity);
+            edge_contact_point = s_select3_sse2(touched_edge, a, edge_contact_point);
+            __m128 edge_touched = touched_edge;
+
+            touched_edge = s_touched_vertex_sse2(velocity_length2, &edge_cinstance, b, position, velocity);
+            edge_contact_point = s_select3_sse2(touched_edge, b, edge_contact_point);
+            edge_touched = _mm_or_ps(edge_touched, touched_edge);
+
+            touched_edge = s_touched_vertex_sse2(velocity_length2, &edge_cinstance, c, position, velocity);
+            edge_contact_point = s_select3_sse2(touched_edge, c, edge_contact_point);
+            edge_touched = _mm_or_ps(edge_touched, touched_edge);
+
+            edge_touched = _mm_or_ps(edge_touched, s_touched_edge_sse2(velocity_length2, &edge_cinstance, &edge_contact_point, a, b, position, velocity));
+            edge_touched = _mm_or_ps(edge_touched, s_touched_edge_sse2(velocity_length2, &edge_cinstance, &edge_contact_point, b, c, position, velocity));
+            edge_touched = _mm_or_ps(edge_touched, s_touched_edge_sse2(velocity_length2, &edge_cinstance, &edge_contact_point, c, a, position, velocity));
+
+            // Edges / vertices only get checked if the sphere didn't hit the face
+            cinstance = s_select_sse2(face, cinstance, edge_cinstance);
+            contact_point = s_select3_sse2(face, contact_point, edge_contact_point);
+            touched = _mm_or_ps(face, edge_touched);
+        }
+
+        uint32_t hits = (uint32_t)_mm_movemask_ps(_mm_and_ps(candidate, touched));
+
+        if (!hits) {
+            continue;
+        }
+
+        float cinstances[4], distances[4], contact_x[4], contact_y[4], contact_z[4], normal_x[4], normal_y[4], normal_z[4];
+        uint32_t inside = (uint32_t)_mm_movemask_ps(inside_terrain);
+
+        _mm_storeu_ps(cinstances, cinstance);
+        _mm_storeu_ps(distances, distance_to_plane);
+        _mm_storeu_ps(contact_x, contact_point.x);
+        _mm_storeu_ps(contact_y, contact_point.y);
+        _mm_storeu_ps(contact_z, contact_point.z);
+        _mm_storeu_ps(normal_x, normal.x);
+        _mm_storeu_ps(normal_y, normal.y);
+        _mm_storeu_ps(normal_z, normal.z);
+
+        for (uint32_t l = 0; l < 4; ++l) {
+            if (hits & (1 << l)) {
+                s_add_contact(
+                    collision,
+                    cinstances[l],
+                    (inside >> l) & 1,
+                    distances[l],
+                    vector3_t(contact_x[l], contact_y[l], contact_z[l]),
+                    vector3_t(normal_x[l], normal_y[l], normal_z[l]));
+            }
+        }
+    }
+}
+
+#endif
+
+#if defined(COLLISION_AVX2)
+
+struct avx2_vector3_t {
+    __m256 x, y, z;
+};
+
+__attribute__((target("avx2"))) static inline avx2_vector3_t s_set_avx2(const vector3_t &v) {
+    avx2_vector3_t r = { _mm256_set1_ps(v.x), _mm256_set1_ps(v.y), _mm256_set1_ps(v.z) };
+    return r;
+}
+
+__attribute__((target("avx2"))) static inline avx2_vector3_t s_load_avx2(const collision_triangle_batch_t *batch, uint32_t vertex, uint32_t first) {
+    avx2_vector3_t r = {
+        _mm256_loadu_ps(&batch->coords[vertex][0][first]),
+        _mm256_loadu_ps(&batch->coords[vertex][1][first]),
+        _mm256_loadu_ps(&batch->coords[vertex][2][first]) };
+    return r;
+}
+
+__attribute__((target("avx2"))) static inline avx2_vector3_t s_add_avx2(const avx2_vector3_t &a, const avx2_vector3_t &b) {
+    avx2_vector3_t r = { _mm256_add_ps(a.x, b.x), _mm256_add_ps(a.y, b.y), _mm256_add_ps(a.z, b.z) };
+    return r;
+}
+
+__attribute__((target("avx2"))) static inline avx2_vector3_t s_sub_avx2(const avx2_vector3_t &a, const avx2_vector3_t &b) {
+    avx2_vector3_t r = { _mm256_sub_ps(a.x, b.x), _mm256_sub_ps(a.y, b.y), _mm256_sub_ps(a.z, b.z) };
+    return r;
+}
+
+__attribute__((target("avx2"))) static inline avx2_vector3_t s_scale_avx2(const avx2_vector3_t &v, __m256 s) {
+    avx2_vector3_t r = { _mm256_mul_ps(v.x, s), _mm256_mul_ps(v.y, s), _mm256_mul_ps(v.z, s) };
+    return r;
+}
+
+__attribute__((target("avx2"))) static inline __m256 s_dot_avx2(const avx2_vector3_t &a, const avx2_vector3_t &b) {
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a.x, b.x), _mm256_mul_ps(a.y, b.y)), _mm256_mul_ps(a.z, b.z));
+}
+
+__attribute__((target("avx2"))) static inline avx2_vector3_t s_cross_avx2(const avx2_vector3_t &x, const avx2_vector3_t &y) {
+    avx2_vector3_t r = {
+        _mm256_sub_ps(_mm256_mul_ps(x.y, y.z), _mm256_mul_ps(y.y, x.z)),
+        _mm256_sub_ps(_mm256_mul_ps(x.z, y.x), _mm256_mul_ps(y.z, x.x)),
+        _mm256_sub_ps(_mm256_mul_ps(x.x, y.y), _mm256_mul_ps(y.x, x.y)) };
+    return r;
+}
+
+__attribute__((target("avx2"))) static inline __m256 s_select_avx2(__m256 mask, __m256 a, __m256 b) {
+    return _mm256_blendv_ps(b, a, mask);
+}
+
+__attribute__((target("avx2"))) static inline avx2_vector3_t s_select3_avx2(__m256 mask, const avx2_vector3_t &a, const avx2_vector3_t &b) {
+    avx2_vector3_t r = { s_select_avx2(mask, a.x, b.x), s_select_avx2(mask, a.y, b.y), s_select_avx2(mask, a.z, b.z) };
+    return r;
+}
+
+__attribute__((target("avx2"))) static inline __m256 s_get_smallest_root_avx2(__m256 a, __m256 b, __m256 c, __m256 max_r, __m256 *root) {
+    __m256 zero = _mm256_setzero_ps();
+    __m256 determinant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(4.0f), a), c));
+    __m256 sqrt_d = _mm256_sqrt_ps(determinant);
+    __m256 minus_b = _mm256_xor_ps(b, _mm256_set1_ps(-0.0f));
+    __m256 two_a = _mm256_mul_ps(_mm256_set1_ps(2.0f), a);
+    __m256 r1 = _mm256_div_ps(_mm256_sub_ps(minus_b, sqrt_d), two_a);
+    __m256 r2 = _mm256_div_ps(_mm256_add_ps(minus_b, sqrt_d), two_a);
+
+    __m256 swap = _mm256_cmp_ps(r1, r2, _CMP_GT_OQ);
+    __m256 lower = s_select_avx2(swap, r2, r1);
+    __m256 upper = s_select_avx2(swap, r1, r2);
+
+    __m256 lower_valid = _mm256_and_ps(_mm256_cmp_ps(lower, zero, _CMP_GT_OQ), _mm256_cmp_ps(lower, max_r, _CMP_LT_OQ));
+    __m256 upper_valid = _mm256_and_ps(_mm256_cmp_ps(upper, zero, _CMP_GT_OQ), _mm256_cmp_ps(upper, max_r, _CMP_LT_OQ));
+
+    *root = s_select_avx2(lower_valid, lower, upper);
+
+    return _mm256_or_ps(lower_valid, upper_valid);
+}
+
+__attribute__((target("avx2"))) static inline __m256 s_inside_triangle_avx2(
+    const avx2_vector3_t &point,
+    const avx2_vector3_t &a,
+    const avx2_vector3_t &b,
+    const avx2_vector3_t &c) {
+    __m256 zero = _mm256_setzero_ps();
+
+    avx2_vector3_t cb = s_sub_avx2(c, b);
+    __m256 inside = _mm256_cmp_ps(s_dot_avx2(s_cross_avx2(cb, s_sub_avx2(point, b)), s_cross_avx2(cb, s_sub_avx2(a, b))), zero, _CMP_GE_OQ);
+
+    avx2_vector3_t ca = s_sub_avx2(c, a);
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(s_dot_avx2(s_cross_avx2(ca, s_sub_avx2(point, a)), s_cross_avx2(ca, s_sub_avx2(b, a))), zero, _CMP_GE_OQ));
+
+    avx2_vector3_t ba = s_sub_avx2(b, a);
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(s_dot_avx2(s_cross_avx2(ba, s_sub_avx2(point, a)), s_cross_avx2(ba, s_sub_avx2(c, a))), zero, _CMP_GE_OQ));
+
+    return inside;
+}
+
+__attribute__((target("avx2"))) static inline __m256 s_touched_vertex_avx2(
+    __m256 a,
+    __m256 *cinstance,
+    const avx2_vector3_t &vertex,
+    const avx2_vector3_t &position,
+    const avx2_vector3_t &velocity) {
+    avx2_vector3_t vertex_to_position = s_sub_avx2(vertex, position);
+    __m256 b = _mm256_mul_ps(_mm256_set1_ps(2.0f), s_dot_avx2(velocity, s_sub_avx2(position, vertex)));
+    __m256 c = _mm256_sub_ps(s_dot_avx2(vertex_to_position, vertex_to_position), _mm256_set1_ps(1.0f));
+
+    __m256 root;
+    __m256 touched = s_get_smallest_root_avx2(a, b, c, *cinstance, &root);
+    *cinstance = s_select_avx2(touched, root, *cinstance);
+
+    return touched;
+}
+
+__attribute__((target("avx2"))) static inline __m256 s_touched_edge_avx2(
+    __m256 velocity_length2,
+    __m256 *cinstance,
+    avx2_vector3_t *new_position,
+    const avx2_vector3_t &vertex0,
+    const avx2_vector3_t &vertex1,
+    const avx2_vector3_t &position,
+    const avx2_vector3_t &velocity) {
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 two = _mm256_set1_ps(2.0f);
+
+    avx2_vector3_t edge_vector = s_sub_avx2(vertex1, vertex0);
+    avx2_vector3_t position_to_vertex0 = s_sub_avx2(vertex0, position);
+    __m256 edge_length2 = s_dot_avx2(edge_vector, edge_vector);
+    __m256 edge_dot_velocity = s_dot_avx2(edge_vector, velocity);
+    __m256 edge_dot_position_to_vertex0 = s_dot_avx2(edge_vector, position_to_vertex0);
+    __m256 position_to_vertex0_length2 = s_dot_avx2(position_to_vertex0, position_to_vertex0);
+
+    __m256 a = _mm256_add_ps(
+        _mm256_mul_ps(edge_length2, _mm256_xor_ps(velocity_length2, _mm256_set1_ps(-0.0f))),
+        _mm256_mul_ps(edge_dot_velocity, edge_dot_velocity));
+    __m256 b = _mm256_sub_ps(
+        _mm256_mul_ps(edge_length2, _mm256_mul_ps(two, s_dot_avx2(velocity, position_to_vertex0))),
+        _mm256_mul_ps(_mm256_mul_ps(two, edge_dot_velocity), edge_dot_position_to_vertex0));
+    __m256 c = _mm256_add_ps(
+        _mm256_mul_ps(edge_length2, _mm256_sub_ps(one, position_to_vertex0_length2)),
+        _mm256_mul_ps(edge_dot_position_to_vertex0, edge_dot_position_to_vertex0));
+
+    __m256 root;
+    __m256 touched = s_get_smallest_root_avx2(a, b, c, *cinstance, &root);
+
+    __m256 proportion = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(edge_dot_velocity, root), edge_dot_position_to_vertex0), edge_length2);
+    touched = _mm256_and_ps(touched, _mm256_and_ps(_mm256_cmp_ps(proportion, zero, _CMP_GE_OQ), _mm256_cmp_ps(proportion, one, _CMP_LE_OQ)));
+
+    *cinstance = s_select_avx2(touched, root, *cinstance);
+    *new_position = s_select3_avx2(touched, s_add_avx2(vertex0, s_scale_avx2(edge_vector, proportion)), *new_position);
+
+    return touched;
+}
+
+__attribute__((target("avx2"))) static void s_collide_batch_avx2(
+    terrain_collision_t *collision,
+    const collision_triangle_batch_t *batch) {
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 minus_one = _mm256_set1_ps(-1.0f);
+    __m256 sign = _mm256_set1_ps(-0.0f);
+
+    avx2_vector3_t position = s_set_avx2(collision->es_position);
+    avx2_vector3_t velocity = s_set_avx2(collision->es_velocity);
+    avx2_vector3_t normalised_velocity = s_set_avx2(collision->es_normalised_velocity);
+    __m256 velocity_length2 = s_dot_avx2(velocity, velocity);
+
+    __m256i lane = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256i count = _mm256_set1_epi32((int32_t)batch->count);
+
+    for (uint32_t first = 0; first < batch->count; first += 8) {
+        avx2_vector3_t a = s_load_avx2(batch, 0, first);
+        avx2_vector3_t b = s_load_avx2(batch, 1, first);
+        avx2_vector3_t c = s_load_avx2(batch, 2, first);
+
+        __m256 in_batch = _mm256_castsi256_ps(_mm256_cmpgt_epi32(count, _mm256_add_epi32(lane, _mm256_set1_epi32((int32_t)first))));
+
+        avx2_vector3_t normal = s_cross_avx2(s_sub_avx2(b, a), s_sub_avx2(c, a));
+        normal = s_scale_avx2(normal, _mm256_div_ps(one, _mm256_sqrt_ps(s_dot_avx2(normal, normal))));
+
+        __m256 facing = _mm256_and_ps(in_batch, _mm256_cmp_ps(s_dot_avx2(normalised_velocity, normal), zero, _CMP_LE_OQ));
+
+        __m256 distance_to_plane = _mm256_sub_ps(s_dot_avx2(position, normal), s_dot_avx2(a, normal));
+        __m256 normal_dot_velocity = s_dot_avx2(normal, velocity);
+        __m256 parallel = _mm256_cmp_ps(normal_dot_velocity, zero, _CMP_EQ_OQ);
+
+        __m256 cinstance0 = _mm256_div_ps(_mm256_sub_ps(one, distance_to_plane), normal_dot_velocity);
+        __m256 cinstance1 = _mm256_div_ps(_mm256_sub_ps(minus_one, distance_to_plane), normal_dot_velocity);
+        __m256 inside_terrain = _mm256_andnot_ps(parallel, _mm256_cmp_ps(cinstance0, zero, _CMP_LT_OQ));
+
+        __m256 swap = _mm256_cmp_ps(cinstance0, cinstance1, _CMP_GT_OQ);
+        __m256 first_cinstance = s_select_avx2(swap, cinstance1, cinstance0);
+        __m256 last_cinstance = s_select_avx2(swap, cinstance0, cinstance1);
+
+        __m256 out_of_reach = s_select_avx2(
+            parallel,
+            _mm256_cmp_ps(_mm256_andnot_ps(sign, distance_to_plane), one, _CMP_GE_OQ),
+            _mm256_or_ps(_mm256_cmp_ps(first_cinstance, one, _CMP_GT_OQ), _mm256_cmp_ps(last_cinstance, zero, _CMP_LT_OQ)));
+        __m256 candidate = _mm256_andnot_ps(out_of_reach, facing);
+
+        if (!_mm256_movemask_ps(candidate)) {
+            continue;
+        }
+
+        first_cinstance = _mm256_andnot_ps(parallel, s_select_avx2(_mm256_cmp_ps(first_cinstance, zero, _CMP_LT_OQ), zero, first_cinstance));
+
+        avx2_vector3_t plane_contact_point = s_sub_avx2(s_add_avx2(position, s_scale_avx2(velocity, first_cinstance)), normal);
+
+        __m256 face = _mm256_andnot_ps(parallel, s_inside_triangle_avx2(plane_contact_point, a, b, c));
+        inside_terrain = _mm256_and_ps(inside_terrain, face);
+
+        __m256 cinstance = s_select_avx2(face, first_cinstance, one);
+        avx2_vector3_t contact_point = plane_contact_point;
+        __m256 touched = face;
+
+        if (_mm256_movemask_ps(_mm256_andnot_ps(face, candidate))) {
+            __m256 edge_cinstance = one;
+            avx2_vector3_t edge_contact_point = plane_contact_point;
+            __m256 touched_edge;
+
+            touched_edge = s_touched_vertex_avx2(velocity_length2, &edge_cinstance, a, position, velocity);
+            edge_contact_point = s_select3_avx2(touched_edge, a, edge_contact_point);
+            __m256 edge_touched = touched_edge;
+
+            touched_edge = s_touched_vertex_avx2(velocity_length2, &edge_cinstance, b, position, velocity);
+            edge_contact_point = s_select3_avx2(touched_edge, b, edge_contact_point);
+            edge_touched = _mm256_or_ps(edge_touched, touched_edge);
+
+            touched_edge = s_touched_vertex_avx2(velocity_length2, &edge_cinstance, c, position, velocity);
+            edge_contact_point = s_select3_avx2(touched_edge, c, edge_contact_point);
+            edge_touched = _mm256_or_ps(edge_touched, touched_edge);
+
+            edge_touched = _mm256_or_ps(edge_touched, s_touched_edge_avx2(velocity_length2, &edge_cinstance, &edge_contact_point, a, b, position, velocity));
+            edge_touched = _mm256_or_ps(edge_touched, s_touched_edge_avx2(velocity_length2, &edge_cinstance, &edge_contact_point, b, c, position, velocity));
+            edge_touched = _mm256_or_ps(edge_touched, s_touched_edge_avx2(velocity_length2, &edge_cinstance, &edge_contact_point, c, a, position, velocity));
+
+            cinstance = s_select_avx2(face, cinstance, edge_cinstance);
+            contact_point = s_select3_avx2(face, contact_point, edge_contact_point);
+            touched = _mm256_or_ps(face, edge_touched);
+        }
+
+        uint32_t hits = (uint32_t)_mm256_movemask_ps(_mm256_and_ps(candidate, touched));
+
+        if (!hits) {
+            continue;
+        }
+
+        float cinstances[8], distances[8], contact_x[8], contact_y[8], contact_z[8], normal_x[8], normal_y[8], normal_z[8];
+        uint32_t inside = (uint32_t)_mm256_movemask_ps(inside_terrain);
+
+        _mm256_storeu_ps(cinstances, cinstance);
+        _mm256_storeu_ps(distances, distance_to_plane);
+        _mm256_storeu_ps(contact_x, contact_point.x);
+        _mm256_storeu_ps(contact_y, contact_point.y);
+        _mm256_storeu_ps(contact_z, contact_point.z);
+        _mm256_storeu_ps(normal_x, normal.x);
+        _mm256_storeu_ps(normal_y, normal.y);
+        _mm256_storeu_ps(normal_z, normal.z);
+
+        for (uint32_t l = 0; l < 8; ++l) {
+            if (hits & (1 << l)) {
+                s_add_contact(
+                    collision,
+                    cinstances[l],
+                    (inside >> l) & 1,
+                    distances[l],
+                    vector3_t(contact_x[l], contact_y[l], contact_z[l]),
+                    vector3_t(normal_x[l], normal_y[l], normal_z[l]));
+            }
+        }
+    }
+}
+
+#endif
+
+static collision_batch_kernel_t s_batch_kernel = NULL;
+
+collision_batch_kernel_t get_collision_batch_kernel() {
+    if (!s_batch_kernel) {
+        if (!set_collision_batch_kernel(CKT_AVX2) && !set_collision_batch_kernel(CKT_SSE2)) {
+            set_collision_batch_kernel(CKT_SCALAR);
+        }
+    }
+
+    return s_batch_kernel;
+}
+
+bool set_collision_batch_kernel(collision_kernel_type_t type) {
+    switch (type) {
+    case CKT_SCALAR: {
+        s_batch_kernel = s_collide_batch_scalar;
+        return 1;
+    }
+
+#if defined(COLLISION_SSE2)
+    case CKT_SSE2: {
+        s_batch_kernel = s_collide_batch_sse2;
+        return 1;
+    }
+#endif
+
+#if defined(COLLISION_AVX2)
+    case CKT_AVX2: {
+        if (__builtin_cpu_supports("avx2")) {
+            s_batch_kernel = s_collide_batch_avx2;
+            return 1;
+        }
+
+        return 0;
+    }
+#endif
+
+    default: {
+        return 0;
+    }
+    }
+}
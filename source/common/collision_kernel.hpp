@@ -0,0 +1,34 @@
+#pragma once
+
+#include "chunk.hpp"
+
+// Swept sphere / triangle kernels of the terrain collision (Kasper Fauerby's paper), in ellipsoid space
+
+enum { COLLISION_BATCH_WIDTH = 8 };
+
+// Triangles of a collision query, divided by the size of the ellipsoid
+// Coordinates are in arrays of count triangles (padded with empty triangles to a multiple of COLLISION_BATCH_WIDTH)
+struct collision_triangle_batch_t {
+    uint32_t count;
+    // [vertex][axis][triangle]
+    float *coords[3][3];
+};
+
+// Fills the batch with the triangles (coordinates are allocated with LN_MALLOC)
+void make_collision_triangle_batch(
+    collision_triangle_batch_t *batch,
+    const collision_triangle_t *ws_triangles,
+    uint32_t triangle_count,
+    const vector3_t &ws_size);
+
+// Checks the sphere (es_position / es_velocity / es_normalised_velocity) against every triangle of the batch
+// The nearest contact gets written to the collision, like if the triangles were checked one after the other
+typedef void (* collision_batch_kernel_t)(
+    terrain_collision_t *collision,
+    const collision_triangle_batch_t *batch);
+
+enum collision_kernel_type_t { CKT_SCALAR, CKT_SSE2, CKT_AVX2, CKT_INVALID };
+
+// The SIMD kernels test 4 / 8 triangles per iteration and keep the contact that the scalar loop over the triangles would keep
+collision_batch_kernel_t get_collision_batch_kernel();
+bool set_collision_batch_kernel(collision_kernel_type_t type);
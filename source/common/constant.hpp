@@ -9,6 +9,26 @@
 #define CHUNK_SPECIAL_VALUE 255
 #define CHUNK_SURFACE_LEVEL 70
 #define CHUNK_BYTE_SIZE (CHUNK_VOXEL_COUNT * sizeof(voxel_t))
+// Chunks are addressed through regions of 16x16x16 chunks (see chunk_coord_key)
+#define CHUNK_REGION_EDGE_LENGTH 16
+#define CHUNK_REGION_CHUNK_COUNT (CHUNK_REGION_EDGE_LENGTH * CHUNK_REGION_EDGE_LENGTH * CHUNK_REGION_EDGE_LENGTH)
+// Chunks are split into 4x4x4 bricks for empty space skipping (one bit per brick in a uint64_t)
+#define CHUNK_BRICK_EDGE_LENGTH 4
+#define CHUNK_BRICK_COUNT 64
+// Chunk + a one voxel halo taken from the neighbours (see chunk_apron_t)
+#define CHUNK_APRON_EDGE_LENGTH (CHUNK_EDGE_LENGTH + 2)
+#define CHUNK_APRON_VOXEL_COUNT (CHUNK_APRON_EDGE_LENGTH * CHUNK_APRON_EDGE_LENGTH * CHUNK_APRON_EDGE_LENGTH)
+// How many chunks can have a cached apron at the same time
+#define CHUNK_APRON_CACHE_COUNT 64
+// How many chunks can have cached collision triangles at the same time
+#define CHUNK_COLLISION_MESH_CACHE_COUNT 256
+// How many chunks get carved out of each slab of the chunk allocator
+#define CHUNK_SLAB_OBJECT_COUNT 128
+// Chunk paging defaults (see chunk_residency.hpp) - leaves room for the chunks which get paged in during a tick
+#define CHUNK_RESIDENCY_RADIUS 4
+#define CHUNK_MAX_RESIDENT_COUNT (CHUNK_MAX_LOADED_COUNT * 3 / 4)
+#define CHUNK_MAX_FLUSHES_PER_TICK 16
+#define CHUNK_HISTORY_SLAB_OBJECT_COUNT 32
 
 #define PLAYER_MAX_COUNT 50
 #define PLAYER_SHAPE_SWITCH_DURATION 0.3f
@@ -17,6 +37,8 @@
 #define PLAYER_TERRAFORMING_SPEED 200.0f
 #define PLAYER_TERRAFORMING_RADIUS 3.0f
 #define PLAYER_WALKING_SPEED 25.0f
+// Edge length of the cells of the player broadphase (see player_broadphase.hpp)
+#define PLAYER_BROADPHASE_CELL_SIZE 4.0f
 
 #define PROJECTILE_MAX_ROCK_COUNT 1000
 #define PROJECTILE_ROCK_SPEED 35.0f
@@ -30,6 +52,14 @@
 #define NET_MAX_AVAILABLE_SERVER_COUNT 1000
 #define NET_CLIENT_COMMAND_OUTPUT_INTERVAL (1.0f / 25.0f)
 #define NET_SERVER_SNAPSHOT_OUTPUT_INTERVAL (1.0f / 20.0f)
+// Ticks of player states the server keeps for lag compensation (see rewind_history.hpp)
+#define NET_SERVER_REWIND_FRAME_COUNT 128
+// The server simulates the world at a fixed rate (can be changed with -r)
+#define NET_SERVER_TICK_RATE 60.0f
+// Ticks the server runs at most in a row to catch up after a hitch (the others are dropped)
+#define NET_SERVER_MAX_CATCH_UP_TICKS 5
+// Relative difference between the predicted state of a client and the state of the server above which the client gets corrected
+#define NET_PREDICTION_TOLERANCE 0.00001f
 #define NET_SERVER_CHUNK_WORLD_OUTPUT_INTERVAL (1.0f / 40.0f)
 #define NET_PING_INTERVAL 2.0f
 #define NET_CLIENT_TIMEOUT 5.0f
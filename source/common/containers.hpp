@@ -117,6 +117,170 @@ private:
     bucket_t buckets[Bucket_Count] = {};
 };
 
+// Open addressing hash table which stores the full 64-bit key (no aliasing between different keys)
+// Uses linear probing - deletion shifts the following items back so there are no tombstones
+// Capacity is always a power of two and the table grows when it gets 3/4 full
+template <
+    typename T> struct open_hash_table_t {
+    enum : uint64_t { EMPTY_KEY = 0xFFFFFFFFFFFFFFFFull };
+
+    struct item_t {
+        uint64_t key;
+        T value;
+    };
+
+    uint32_t capacity = 0;
+    uint32_t count = 0;
+    item_t *items = NULL;
+
+    void init(
+        uint32_t initial_capacity) {
+        capacity = 16;
+        while (capacity < initial_capacity) {
+            capacity <<= 1;
+        }
+
+        count = 0;
+        items = FL_MALLOC(item_t, capacity);
+
+        clear();
+    }
+
+    void clear() {
+        for (uint32_t i = 0; i < capacity; ++i) {
+            items[i].key = EMPTY_KEY;
+        }
+
+        count = 0;
+    }
+
+    void destroy() {
+        FL_FREE(items);
+        items = NULL;
+        capacity = 0;
+        count = 0;
+    }
+
+    void insert(
+        uint64_t key,
+        T value) {
+        assert(key != EMPTY_KEY);
+
+        if ((count + 1) * 4 > capacity * 3) {
+            s_grow();
+        }
+
+        uint32_t mask = capacity - 1;
+        uint32_t slot = s_home(key);
+
+        while (items[slot].key != EMPTY_KEY) {
+            if (items[slot].key == key) {
+                items[slot].value = value;
+                return;
+            }
+
+            slot = (slot + 1) & mask;
+        }
+
+        items[slot].key = key;
+        items[slot].value = value;
+        ++count;
+    }
+
+    void remove(
+        uint64_t key) {
+        uint32_t mask = capacity - 1;
+        uint32_t slot = s_find(key);
+
+        if (slot == capacity) {
+            LOG_ERROR("Error in open hash table remove()\n");
+            return;
+        }
+
+        // Backward shift: pull back every item of the cluster which would become unreachable
+        uint32_t next = (slot + 1) & mask;
+        while (items[next].key != EMPTY_KEY) {
+            uint32_t home = s_home(items[next].key);
+
+            if (((next - home) & mask) >= ((next - slot) & mask)) {
+                items[slot] = items[next];
+                slot = next;
+            }
+
+            next = (next + 1) & mask;
+        }
+
+        items[slot].key = EMPTY_KEY;
+        items[slot].value = T();
+        --count;
+    }
+
+    T *get(
+        uint64_t key) {
+        uint32_t slot = s_find(key);
+
+        if (slot == capacity) {
+            return NULL;
+        }
+        else {
+            return &items[slot].value;
+        }
+    }
+
+private:
+    uint32_t s_home(
+        uint64_t key) const {
+        // Mix the bits (splitmix64 finaliser) so that neighbouring keys don't form clusters
+        key ^= key >> 30;
+        key *= 0xBF58476D1CE4E5B9ull;
+        key ^= key >> 27;
+        key *= 0x94D049BB133111EBull;
+        key ^= key >> 31;
+
+        return (uint32_t)key & (capacity - 1);
+    }
+
+    // Returns capacity if the key isn't in the table
+    uint32_t s_find(
+        uint64_t key) const {
+        if (!capacity) {
+            return capacity;
+        }
+
+        uint32_t mask = capacity - 1;
+        uint32_t slot = s_home(key);
+
+        while (items[slot].key != EMPTY_KEY) {
+            if (items[slot].key == key) {
+                return slot;
+            }
+
+            slot = (slot + 1) & mask;
+        }
+
+        return capacity;
+    }
+
+    void s_grow() {
+        item_t *old_items = items;
+        uint32_t old_capacity = capacity;
+
+        capacity = old_capacity ? old_capacity * 2 : 16;
+        items = FL_MALLOC(item_t, capacity);
+        clear();
+
+        for (uint32_t i = 0; i < old_capacity; ++i) {
+            if (old_items[i].key != EMPTY_KEY) {
+                insert(old_items[i].key, old_items[i].value);
+            }
+        }
+
+        if (old_items) {
+            FL_FREE(old_items);
+        }
+    }
+};
+
 // Makes it so that when items are deleted, the array indices of all other items don't change
 template <
     typename T> struct stack_container_t {
@@ -192,6 +356,47 @@ struct lnarray_t {
     }
 };
 
+// Array allocated on free list allocator which keeps its memory from one use to the next and only ever grows
+// (for scratch memory which would be too big, or needed too often, for the linear allocator)
+template <typename T>
+struct scratch_array_t {
+    uint32_t capacity;
+    T *data;
+
+    void init() {
+        capacity = 0;
+        data = NULL;
+    }
+
+    void destroy() {
+        if (data) {
+            FL_FREE(data);
+        }
+
+        capacity = 0;
+        data = NULL;
+    }
+
+    // Makes room for count items (the items which are already in the array are kept)
+    T *reserve(
+        uint32_t count) {
+        if (count > capacity) {
+            uint32_t new_capacity = MAX(count, capacity * 2);
+            T *new_data = FL_MALLOC(T, new_capacity);
+
+            if (data) {
+                memcpy(new_data, data, sizeof(T) * capacity);
+                FL_FREE(data);
+            }
+
+            capacity = new_capacity;
+            data = new_data;
+        }
+
+        return data;
+    }
+};
+
 template <
     typename T, uint32_t Count> struct static_stack_container_t {
     uint32_t max_size = 0;
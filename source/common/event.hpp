@@ -140,6 +140,10 @@ struct event_enter_server_t {
     uint32_t info_count;
     player_init_info_t *infos;
 
+    // The server's terrain gets generated from the seed (otherwise all the chunks get sent)
+    bool procedural_terrain;
+    uint32_t terrain_seed;
+
     // Will need to have other stuff
 };
 
@@ -53,12 +53,26 @@ file_handle_t create_file(
             flags[1] = '+';
         }
 
-        object->file = fopen(object->path, flags);
+        if ((type & FLF_WRITEABLE) && (type & FLF_UPDATE)) {
+            object->file = fopen(object->path, "r+b");
+
+            if (!object->file) {
+                object->file = fopen(object->path, "w+b");
+            }
+        }
+        else {
+            object->file = fopen(object->path, flags);
+        }
     }
 
     return handle;
 }
 
+void delete_file(
+    const char *file) {
+    remove(s_create_path(file));
+}
+
 bool does_file_exist(file_handle_t handle) {
     return files.get(handle)->file != NULL;
 }
@@ -102,6 +116,36 @@ void write_file(
     fwrite(bytes, 1, size, object->file);
 }
 
+void read_file_range(
+    file_handle_t handle,
+    uint32_t offset,
+    uint8_t *bytes,
+    uint32_t size) {
+    file_object_t *object = files.get(handle);
+
+    fseek(object->file, offset, SEEK_SET);
+    fread(bytes, 1, size, object->file);
+}
+
+void write_file_range(
+    file_handle_t handle,
+    uint32_t offset,
+    uint8_t *bytes,
+    uint32_t size) {
+    file_object_t *object = files.get(handle);
+
+    fseek(object->file, offset, SEEK_SET);
+    fwrite(bytes, 1, size, object->file);
+}
+
+uint32_t get_file_size(
+    file_handle_t handle) {
+    file_object_t *object = files.get(handle);
+
+    fseek(object->file, 0L, SEEK_END);
+    return (uint32_t)ftell(object->file);
+}
+
 void free_file(
     file_handle_t handle) {
     file_object_t *object = files.get(handle);
@@ -19,7 +19,9 @@ enum file_load_flags_t {
     FLF_IMAGE = 1 << 2,
     FLF_WRITEABLE = 1 << 3,
     FLF_OVERWRITE = 1 << 4,
-    FLF_NONE = 1 << 5
+    FLF_NONE = 1 << 5,
+    // With FLF_WRITEABLE: read / write without truncating the file (it gets created if it doesn't exist)
+    FLF_UPDATE = 1 << 6
 };
 
 void files_init();
@@ -54,5 +56,9 @@ struct file_contents_t {
 file_contents_t read_file(file_handle_t handle);
 void free_file_contents(file_handle_t file, file_contents_t content);
 void write_file(file_handle_t file, uint8_t *bytes, uint32_t size);
+// Random access (for files which don't get read in one go, e.g. the chunk spill file)
+void read_file_range(file_handle_t file, uint32_t offset, uint8_t *bytes, uint32_t size);
+void write_file_range(file_handle_t file, uint32_t offset, uint8_t *bytes, uint32_t size);
+uint32_t get_file_size(file_handle_t file);
 void free_file(file_handle_t handle);
 void free_image(file_contents_t contents);
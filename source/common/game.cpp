@@ -39,21 +39,56 @@ void game_t::init_memory() {
         for (uint32_t i = 0; i < PLAYER_MAX_COUNT; ++i) {
             client_to_local_id_map[i] = -1;
         }
+
+        player_broadphase.init(PLAYER_MAX_COUNT);
     }
 
     { // Chunks
-        chunk_indices.init();
+        chunk_indices.init(CHUNK_MAX_LOADED_COUNT * 2);
         chunks.init(CHUNK_MAX_LOADED_COUNT);
+        chunk_allocator.init(sizeof(chunk_t), CHUNK_SLAB_OBJECT_COUNT, 1);
+        voxel_allocator.init(sizeof(voxel_t) * CHUNK_VOXEL_COUNT, CHUNK_SLAB_OBJECT_COUNT, 1);
+        history_allocator.init(sizeof(chunk_history_t), CHUNK_HISTORY_SLAB_OBJECT_COUNT, 0);
+
+        for (uint32_t i = 0; i < 4; ++i) {
+            palette_allocators[i].init(chunk_palette_size(1 << i), CHUNK_SLAB_OBJECT_COUNT, 0);
+        }
+
+        chunk_aprons = FL_MALLOC(chunk_apron_t, CHUNK_APRON_CACHE_COUNT);
+        for (uint32_t i = 0; i < CHUNK_APRON_CACHE_COUNT; ++i) {
+            chunk_aprons[i].owner = NULL;
+        }
+        next_chunk_apron = 0;
+
+        collision_meshes = FL_MALLOC(chunk_collision_mesh_t, CHUNK_COLLISION_MESH_CACHE_COUNT);
+        for (uint32_t i = 0; i < CHUNK_COLLISION_MESH_CACHE_COUNT; ++i) {
+            memset(collision_meshes[i].cell_first_triangles, 0, sizeof(collision_meshes[i].cell_first_triangles));
+            collision_meshes[i].triangle_capacity = 0;
+            collision_meshes[i].triangles = NULL;
+            collision_meshes[i].owner = NULL;
+        }
+        next_collision_mesh = 0;
+        collision_mesh_scratch.init();
+        collision_range_scratch.init();
 
         max_modified_chunks = CHUNK_MAX_LOADED_COUNT / 2;
         modified_chunk_count = 0;
         modified_chunks = FL_MALLOC(chunk_t *, max_modified_chunks);
+        terraform_queue.command_count = 0;
+        terraform_queue.player_first_command = 0;
 
         flags.track_history = 1;
+        flags.palette_chunks = 0;
+
+        flags.page_chunks = 0;
+        flags.procedural_terrain = 0;
+        residency.radius = CHUNK_RESIDENCY_RADIUS;
+        residency.max_resident_count = CHUNK_MAX_RESIDENT_COUNT;
+        residency.max_flushes_per_tick = CHUNK_MAX_FLUSHES_PER_TICK;
     }
 
     { // Projectiles
-        rocks.init();
+        rocks.init(PROJECTILE_MAX_ROCK_COUNT);
         predicted_hits.init(60);
     }
 }
@@ -66,6 +101,11 @@ void game_t::configure_map(const char *map_path) {
     current_map_path = map_path;
 }
 
+void game_t::configure_procedural_terrain(uint32_t seed) {
+    flags.procedural_terrain = 1;
+    make_default_terrain_generator(seed, &terrain.generator);
+}
+
 void game_t::configure_team_count(uint32_t count) {
     team_count = count;
     teams = FL_MALLOC(team_t, team_count);
@@ -83,7 +123,9 @@ void game_t::configure_team(
 }
 
 void game_t::start_session() {
-    if (current_map_path)
+    if (flags.procedural_terrain)
+        current_map_data = begin_procedural_terrain("server");
+    else if (current_map_path)
         current_map_data = load_map(current_map_path);
 
     current_tick = 0;
@@ -231,32 +273,41 @@ void game_t::clear_chunks() {
 
 chunk_t *game_t::get_chunk(
     const ivector3_t &coord) {
-    uint32_t hash = hash_chunk_coord(coord);
-    uint32_t *index = chunk_indices.get(hash);
+    chunk_t *chunk = access_chunk(coord);
     
-    if (index) {
-        // Chunk was already added
-        return chunks[*index];
+    if (chunk) {
+        // Chunk was already added (or got paged in)
+        return chunk;
     }
     else {
-        uint32_t i = chunks.add();
-        chunk_t *&chunk = chunks[i];
-        chunk = FL_MALLOC(chunk_t, 1);
-        chunk_init(chunk, i, coord);
+        return add_chunk(coord);
+    }
+}
 
-        chunk_indices.insert(hash, i);
+chunk_t *game_t::access_chunk(
+    const ivector3_t &coord) {
+    chunk_t *chunk = access_resident_chunk(coord);
 
+    if (chunk) {
+        chunk->last_used_tick = current_tick;
         return chunk;
     }
+    else if (flags.page_chunks) {
+        return page_in_chunk(coord);
+    }
+    else if (flags.procedural_terrain) {
+        return load_terrain_chunk(coord);
+    }
+    else {
+        return NULL;
+    }
 }
 
-chunk_t *game_t::access_chunk(
+chunk_t *game_t::access_resident_chunk(
     const ivector3_t &coord) {
-    uint32_t hash = hash_chunk_coord(coord);
-    uint32_t *index = chunk_indices.get(hash);
+    uint32_t *index = chunk_indices.get(chunk_coord_key(coord));
 
     if (index) {
-        // Chunk was already added
         return chunks[*index];
     }
     else {
@@ -264,6 +315,27 @@ chunk_t *game_t::access_chunk(
     }
 }
 
+chunk_t *game_t::add_chunk(
+    const ivector3_t &coord) {
+    uint32_t i = chunks.add();
+    chunk_t *&chunk = chunks[i];
+    chunk = (chunk_t *)chunk_allocator.allocate();
+    chunk_init(chunk, i, coord);
+    chunk->last_used_tick = current_tick;
+
+    chunk_indices.insert(chunk_coord_key(coord), i);
+    link_chunk_neighbours(chunk);
+
+    return chunk;
+}
+
+void game_t::remove_chunk(
+    chunk_t *chunk) {
+    chunk_indices.remove(chunk_coord_key(chunk->chunk_coord));
+    chunks.remove(chunk->chunk_stack_index);
+    destroy_chunk(chunk);
+}
+
 chunk_t **game_t::get_active_chunks(
     uint32_t *count) {
     *count = chunks.data_count;
@@ -281,11 +353,12 @@ void game_t::reset_modification_tracker() {
         chunk_t *c = modified_chunks[i];
         c->flags.made_modification = 0;
 
-        for (int32_t v = 0; v < c->history.modification_count; ++v) {
-            c->history.modification_pool[c->history.modification_stack[v]] = CHUNK_SPECIAL_VALUE;
+        if (c->history) {
+            deactivate_chunk_history(c);
         }
 
-        c->history.modification_count = 0;
+        // Terraforming may have emptied / filled the whole chunk
+        compress_chunk_storage(c);
     }
 
     modified_chunk_count = 0;
@@ -4,10 +4,14 @@
 #include "team.hpp"
 #include "player.hpp"
 #include "weapon.hpp"
+#include "projectile.hpp"
+#include "player_broadphase.hpp"
 #include "constant.hpp"
 #include "containers.hpp"
 
 #include "map.hpp"
+#include "chunk_residency.hpp"
+#include "procedural_terrain.hpp"
 
 enum class game_mode_t { DEATHMATCH, CAPTURE_THE_FLAG, INVALID };
 
@@ -29,24 +33,56 @@ struct game_t {
     // Players ////////////////////////////////////////////////////////////////
     stack_container_t<player_t *> players;
     int16_t client_to_local_id_map[PLAYER_MAX_COUNT];
+    // Boxes of the players of the current tick (see update_player_broadphase)
+    player_broadphase_t player_broadphase;
 
     // Map ////////////////////////////////////////////////////////////////////
     const char *current_map_path;
     map_t *current_map_data;
+    // Used instead of the map if flags.procedural_terrain is set
+    procedural_terrain_t terrain;
 
     // Chunks /////////////////////////////////////////////////////////////////
     stack_container_t<chunk_t *> chunks;
-    hash_table_t<uint32_t, 1500, 30, 10> chunk_indices;
+    // All chunk_t memory comes from here (see destroy_chunk)
+    slab_allocator_t chunk_allocator;
+    // Voxel arrays of chunks which aren't uniform
+    slab_allocator_t voxel_allocator;
+    // Pool of chunk_history_t records (only modified chunks hold on to one)
+    slab_allocator_t history_allocator;
+    // Palette blocks of CS_PALETTE chunks - one allocator per index width (1, 2, 4, 8 bits)
+    slab_allocator_t palette_allocators[4];
+    open_hash_table_t<uint32_t> chunk_indices;
+    // Padded copies of chunks used by the collision code (see get_chunk_apron)
+    chunk_apron_t *chunk_aprons;
+    uint32_t next_chunk_apron;
+    // Collision triangles of the chunks which players / projectiles are in (see get_chunk_collision_mesh)
+    chunk_collision_mesh_t *collision_meshes;
+    uint32_t next_collision_mesh;
+    // Triangles of the collision mesh which is getting rebuilt
+    scratch_array_t<collision_triangle_t> collision_mesh_scratch;
+    // Parts of the collision meshes that a sweep goes through (see sweep_collision_triangles)
+    scratch_array_t<collision_triangle_range_t> collision_range_scratch;
+    // Chunk paging (see chunk_residency.hpp)
+    chunk_residency_t residency;
     uint32_t max_modified_chunks;
     uint32_t modified_chunk_count;
     chunk_t **modified_chunks;
+    // Terraforming of the current tick (see apply_terraform_commands)
+    terraform_queue_t terraform_queue;
 
     struct {
         uint8_t track_history: 1;
+        // Chunks with few distinct voxels get stored as a palette (saves memory on the server)
+        uint8_t palette_chunks: 1;
+        // Only chunks around the players stay loaded, the others get paged in and out (see chunk_residency.hpp)
+        uint8_t page_chunks: 1;
+        // Chunks get generated from a seed instead of getting loaded from a map (see procedural_terrain.hpp)
+        uint8_t procedural_terrain: 1;
     } flags;
 
     // Projectiles ////////////////////////////////////////////////////////////
-    projectile_tracker_t<rock_t, PROJECTILE_MAX_ROCK_COUNT> rocks;
+    rock_store_t rocks;
     stack_container_t<predicted_projectile_hit_t> predicted_hits;
 
 
@@ -57,6 +93,8 @@ struct game_t {
     // Configure a game that will start
     void configure_game_mode(game_mode_t mode);
     void configure_map(const char *path);
+    // Default terrain settings (see make_default_terrain_generator) with this seed
+    void configure_procedural_terrain(uint32_t seed);
     void configure_team_count(uint32_t count);
     void configure_team(
         uint32_t team_d,
@@ -94,8 +132,14 @@ struct game_t {
 
     // If chunk doesn't exist, create one
     chunk_t *get_chunk(const ivector3_t &coord);
-    // If chunk doesn't exist, return NULL
+    // If chunk doesn't exist, return NULL (pages it in / generates it if needed)
     chunk_t *access_chunk(const ivector3_t &coord);
+    // Same but never pages the chunk in (NULL if it isn't resident)
+    chunk_t *access_resident_chunk(const ivector3_t &coord);
+    // Creates an empty chunk (it mustn't be resident already)
+    chunk_t *add_chunk(const ivector3_t &coord);
+    // Destroys the chunk and frees its slot in chunks
+    void remove_chunk(chunk_t *chunk);
     chunk_t **get_active_chunks(uint32_t *count);
     chunk_t **get_modified_chunks(uint32_t *count);
     void reset_modification_tracker();
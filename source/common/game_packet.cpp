@@ -1,5 +1,6 @@
 #include "common/weapon.hpp"
 #include "net.hpp"
+#include "chunk.hpp"
 #include "allocators.hpp"
 #include "game_packet.hpp"
 
@@ -49,6 +50,8 @@ void deserialise_connection_request(
 uint32_t packed_connection_handshake_size(
     packet_connection_handshake_t *game_state) {
     uint32_t final_size = 0;
+    final_size += sizeof(game_state->loaded_chunk_count);
+    final_size += sizeof(game_state->procedural_terrain) + sizeof(game_state->terrain_seed);
     final_size += sizeof(game_state->player_count);
     final_size += game_state->player_count * sizeof(full_player_info_t);
 
@@ -60,6 +63,8 @@ void serialise_connection_handshake(
     packet_connection_handshake_t *full_game_state,
     serialiser_t *serialiser) {
     serialiser->serialise_uint32(full_game_state->loaded_chunk_count);
+    serialiser->serialise_uint8(full_game_state->procedural_terrain);
+    serialiser->serialise_uint32(full_game_state->terrain_seed);
     serialiser->serialise_uint32(full_game_state->player_count);
     for (uint32_t i = 0; i < full_game_state->player_count; ++i) {
         serialiser->serialise_string(full_game_state->player_infos[i].name);
@@ -84,6 +89,8 @@ void deserialise_connection_handshake(
     packet_connection_handshake_t *full_game_state,
     serialiser_t *serialiser) {
     full_game_state->loaded_chunk_count = serialiser->deserialise_uint32();
+    full_game_state->procedural_terrain = serialiser->deserialise_uint8();
+    full_game_state->terrain_seed = serialiser->deserialise_uint32();
     full_game_state->player_count = serialiser->deserialise_uint32();
     full_game_state->player_infos = LN_MALLOC(full_player_info_t, full_game_state->player_count);
 
@@ -145,12 +152,50 @@ void deserialise_player_joined(
     packet->player_info.flags.u32 = serialiser->deserialise_uint32();
 }
 
+// Bit of the region chunk index which says that the region coordinate follows
+static const uint16_t NEW_REGION_BIT = 1 << 15;
+
+void serialise_chunk_coord(
+    const ivector3_t &chunk_coord,
+    chunk_coord_packer_t *packer,
+    serialiser_t *serialiser) {
+    ivector3_t region_coord = space_chunk_to_region(chunk_coord);
+    uint16_t index = (uint16_t)get_region_chunk_index(chunk_coord);
+
+    if (packer->has_region && packer->region_coord == region_coord) {
+        serialiser->serialise_uint16(index);
+    }
+    else {
+        serialiser->serialise_uint16(index | NEW_REGION_BIT);
+        serialiser->serialise_uint32((uint32_t)region_coord.x);
+        serialiser->serialise_uint32((uint32_t)region_coord.y);
+        serialiser->serialise_uint32((uint32_t)region_coord.z);
+
+        packer->region_coord = region_coord;
+        packer->has_region = 1;
+    }
+}
+
+ivector3_t deserialise_chunk_coord(
+    chunk_coord_packer_t *packer,
+    serialiser_t *serialiser) {
+    uint16_t index = serialiser->deserialise_uint16();
+
+    if (index & NEW_REGION_BIT) {
+        packer->region_coord.x = (int32_t)serialiser->deserialise_uint32();
+        packer->region_coord.y = (int32_t)serialiser->deserialise_uint32();
+        packer->region_coord.z = (int32_t)serialiser->deserialise_uint32();
+        packer->has_region = 1;
+    }
+
+    return space_region_to_chunk(packer->region_coord, index & ~NEW_REGION_BIT);
+}
+
 static void s_serialise_chunk_modification_meta_info(
     serialiser_t *serialiser,
+    chunk_coord_packer_t *packer,
     chunk_modifications_t *c) {
-    serialiser->serialise_int16(c->x);
-    serialiser->serialise_int16(c->y);
-    serialiser->serialise_int16(c->z);
+    serialise_chunk_coord(ivector3_t(c->x, c->y, c->z), packer, serialiser);
     serialiser->serialise_uint32(c->modified_voxels_count);
 }
 
@@ -159,7 +204,7 @@ static void s_serialise_chunk_modification_values_without_colors(
     chunk_modifications_t *c) {
     for (uint32_t v = 0; v < c->modified_voxels_count; ++v) {
         voxel_modification_t *v_ptr =  &c->modifications[v];
-        serialiser->serialise_uint16(v_ptr->index);
+        serialiser->serialise_uint16(voxel_index_to_linear(v_ptr->index));
         serialiser->serialise_uint8(v_ptr->final_value);
     }
 }
@@ -169,7 +214,7 @@ static void s_serialise_chunk_modification_values_with_colors(
     chunk_modifications_t *c) {
     for (uint32_t v = 0; v < c->modified_voxels_count; ++v) {
         voxel_modification_t *v_ptr =  &c->modifications[v];
-        serialiser->serialise_uint16(v_ptr->index);
+        serialiser->serialise_uint16(voxel_index_to_linear(v_ptr->index));
         serialiser->serialise_uint8(v_ptr->color);
         serialiser->serialise_uint8(v_ptr->final_value);
     }
@@ -180,7 +225,7 @@ static void s_serialise_chunk_modification_values_with_initial_values(
     chunk_modifications_t *c) {
     for (uint32_t v = 0; v < c->modified_voxels_count; ++v) {
         voxel_modification_t *v_ptr =  &c->modifications[v];
-        serialiser->serialise_uint16(v_ptr->index);
+        serialiser->serialise_uint16(voxel_index_to_linear(v_ptr->index));
         serialiser->serialise_uint8(v_ptr->initial_value);
         serialiser->serialise_uint8(v_ptr->final_value);
     }
@@ -200,12 +245,14 @@ void serialise_chunk_modifications(
     serialiser_t *serialiser,
     color_serialisation_type_t cst) {
     serialiser->serialise_uint32(modification_count);
+
+    chunk_coord_packer_t packer = {};
     
     // Yes I know this is stupid because color is a bool
     if (cst == CST_SERIALISE_SEPARATE_COLOR) {
         for (uint32_t i = 0; i < modification_count; ++i) {
             chunk_modifications_t *c = &modifications[i];
-            s_serialise_chunk_modification_meta_info(serialiser, c);
+            s_serialise_chunk_modification_meta_info(serialiser, &packer, c);
             s_serialise_chunk_modification_values_without_colors(serialiser, c);
             s_serialise_chunk_modification_colors_from_array(serialiser, c);
         }
@@ -213,7 +260,7 @@ void serialise_chunk_modifications(
     else {
         for (uint32_t i = 0; i < modification_count; ++i) {
             chunk_modifications_t *c = &modifications[i];
-            s_serialise_chunk_modification_meta_info(serialiser, c);
+            s_serialise_chunk_modification_meta_info(serialiser, &packer, c);
             s_serialise_chunk_modification_values_with_colors(serialiser, c);
         }
     }
@@ -221,10 +268,12 @@ void serialise_chunk_modifications(
 
 static void s_deserialise_chunk_modification_meta_info(
     serialiser_t *serialiser,
+    chunk_coord_packer_t *packer,
     chunk_modifications_t *c) {
-    c->x = serialiser->deserialise_int16();
-    c->y = serialiser->deserialise_int16();
-    c->z = serialiser->deserialise_int16();
+    ivector3_t chunk_coord = deserialise_chunk_coord(packer, serialiser);
+    c->x = chunk_coord.x;
+    c->y = chunk_coord.y;
+    c->z = chunk_coord.z;
     c->modified_voxels_count = serialiser->deserialise_uint32();
 }
 
@@ -233,7 +282,7 @@ static void s_deserialise_chunk_modification_values_without_colors(
     chunk_modifications_t *c) {
     for (uint32_t v = 0; v < c->modified_voxels_count; ++v) {
         voxel_modification_t *v_ptr =  &c->modifications[v];
-        v_ptr->index = serialiser->deserialise_uint16();
+        v_ptr->index = linear_to_voxel_index(serialiser->deserialise_uint16());
         v_ptr->final_value = serialiser->deserialise_uint8();
     }
 }
@@ -243,7 +292,7 @@ static void s_deserialise_chunk_modification_values_with_colors(
     chunk_modifications_t *c) {
     for (uint32_t v = 0; v < c->modified_voxels_count; ++v) {
         voxel_modification_t *v_ptr =  &c->modifications[v];
-        v_ptr->index = serialiser->deserialise_uint16();
+        v_ptr->index = linear_to_voxel_index(serialiser->deserialise_uint16());
         v_ptr->color = serialiser->deserialise_uint8();
         v_ptr->final_value = serialiser->deserialise_uint8();
     }
@@ -254,7 +303,7 @@ static void s_deserialise_chunk_modification_values_with_initial_values(
     chunk_modifications_t *c) {
     for (uint32_t v = 0; v < c->modified_voxels_count; ++v) {
         voxel_modification_t *v_ptr =  &c->modifications[v];
-        v_ptr->index = serialiser->deserialise_uint16();
+        v_ptr->index = linear_to_voxel_index(serialiser->deserialise_uint16());
         v_ptr->initial_value = serialiser->deserialise_uint8();
         v_ptr->final_value = serialiser->deserialise_uint8();
     }
@@ -275,10 +324,12 @@ chunk_modifications_t *deserialise_chunk_modifications(
     *modification_count = serialiser->deserialise_uint32();
     chunk_modifications_t *chunk_modifications = LN_MALLOC(chunk_modifications_t, *modification_count);
 
+    chunk_coord_packer_t packer = {};
+
     if (color == CST_SERIALISE_SEPARATE_COLOR) {
         for (uint32_t i = 0; i < *modification_count; ++i) {
             chunk_modifications_t *c = &chunk_modifications[i];
-            s_deserialise_chunk_modification_meta_info(serialiser, c);
+            s_deserialise_chunk_modification_meta_info(serialiser, &packer, c);
             s_deserialise_chunk_modification_values_without_colors(serialiser, c);
             s_deserialise_chunk_modification_colors_from_array(serialiser, c);
         }
@@ -286,7 +337,7 @@ chunk_modifications_t *deserialise_chunk_modifications(
     else {
         for (uint32_t i = 0; i < *modification_count; ++i) {
             chunk_modifications_t *c = &chunk_modifications[i];
-            s_deserialise_chunk_modification_meta_info(serialiser, c);
+            s_deserialise_chunk_modification_meta_info(serialiser, &packer, c);
             s_deserialise_chunk_modification_values_with_colors(serialiser, c);
         }
     }
@@ -320,7 +371,7 @@ uint32_t packed_player_commands_size(
         // Number of modified voxels in this chunk
         final_size += sizeof(chunk_modifications_t::modified_voxels_count);
         // Size of the coordinates of this chunk
-        final_size += + sizeof(chunk_modifications_t::x) * 3;
+        final_size += PACKED_CHUNK_COORD_MAX_SIZE;
 
         // Incorporate the size of the actual voxel values
         uint32_t sizeof_voxel_modification = sizeof(voxel_modification_t::index) + sizeof(voxel_modification_t::initial_value) + sizeof(voxel_modification_t::final_value);
@@ -369,9 +420,11 @@ void serialise_player_commands(
 
     serialiser->serialise_uint32(packet->modified_chunk_count);
 
+    chunk_coord_packer_t packer = {};
+
     for (uint32_t i = 0; i < packet->modified_chunk_count; ++i) {
         chunk_modifications_t *c = &packet->chunk_modifications[i];
-        s_serialise_chunk_modification_meta_info(serialiser, c);
+        s_serialise_chunk_modification_meta_info(serialiser, &packer, c);
         s_serialise_chunk_modification_values_with_initial_values(serialiser, c);
         s_serialise_chunk_modification_colors_from_array(serialiser, c);
     }
@@ -414,9 +467,11 @@ void deserialise_player_commands(
     packet->modified_chunk_count = serialiser->deserialise_uint32();
     packet->chunk_modifications = LN_MALLOC(chunk_modifications_t, packet->modified_chunk_count);
 
+    chunk_coord_packer_t packer = {};
+
     for (uint32_t i = 0; i < packet->modified_chunk_count; ++i) {
         chunk_modifications_t *c = &packet->chunk_modifications[i];
-        s_deserialise_chunk_modification_meta_info(serialiser, c);
+        s_deserialise_chunk_modification_meta_info(serialiser, &packer, c);
         s_deserialise_chunk_modification_values_with_initial_values(serialiser, c);
         s_deserialise_chunk_modification_colors_from_array(serialiser, c);
     }
@@ -529,7 +584,7 @@ uint32_t packed_chunk_voxels_size(
     uint32_t final_size = 0;
     final_size += sizeof(packet_chunk_voxels_t::chunk_in_packet_count);
 
-    uint32_t voxel_chunk_values_size = 3 * sizeof(int16_t) + CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * sizeof(voxel_t);
+    uint32_t voxel_chunk_values_size = PACKED_CHUNK_COORD_MAX_SIZE + CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * sizeof(voxel_t);
 
     final_size += voxel_chunk_values_size * packet->chunk_in_packet_count;
 
@@ -541,10 +596,10 @@ void serialise_packet_chunk_voxels(
     serialiser_t *serialiser) {
     serialiser->serialise_uint32(packet->chunk_in_packet_count);
 
+    chunk_coord_packer_t packer = {};
+
     for (uint32_t i = 0; i < packet->chunk_in_packet_count; ++i) {
-        serialiser->serialise_int16(packet->values[i].x);
-        serialiser->serialise_int16(packet->values[i].y);
-        serialiser->serialise_int16(packet->values[i].z);
+        serialise_chunk_coord(ivector3_t(packet->values[i].x, packet->values[i].y, packet->values[i].z), &packer, serialiser);
         // TODO: In future, optimise this, use the fact that the maximum value for a voxel is 254.
         // Make 255 a marker for: no more values that are not 0 or something
         serialiser->serialise_bytes((uint8_t *)packet->values[i].voxel_values, CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * sizeof(voxel_t));
@@ -558,10 +613,13 @@ void deserialise_packet_chunk_voxels(
 
     packet->values = LN_MALLOC(voxel_chunk_values_t, packet->chunk_in_packet_count);
 
+    chunk_coord_packer_t packer = {};
+
     for (uint32_t i = 0; i < packet->chunk_in_packet_count; ++i) {
-        packet->values[i].x = serialiser->deserialise_int16();
-        packet->values[i].y = serialiser->deserialise_int16();
-        packet->values[i].z = serialiser->deserialise_int16();
+        ivector3_t chunk_coord = deserialise_chunk_coord(&packer, serialiser);
+        packet->values[i].x = chunk_coord.x;
+        packet->values[i].y = chunk_coord.y;
+        packet->values[i].z = chunk_coord.z;
 
         packet->values[i].voxel_values = (voxel_t *)serialiser->deserialise_bytes(NULL, CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * sizeof(voxel_t));
     }
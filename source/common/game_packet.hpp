@@ -87,6 +87,10 @@ struct packet_connection_handshake_t {
     uint32_t loaded_chunk_count;
     // TODO: In future, find a way to only have chunks nearby to be sent to the client possibly?
 
+    // Clients generate the terrain from the seed - the chunks which get sent are the ones which were modified
+    uint8_t procedural_terrain;
+    uint32_t terrain_seed;
+
     uint32_t player_count;
     full_player_info_t *player_infos;
 
@@ -165,6 +169,19 @@ uint32_t packed_game_state_snapshot_size(packet_game_state_snapshot_t *packet);
 void serialise_game_state_snapshot(packet_game_state_snapshot_t *packet, serialiser_t *serialiser);
 void deserialise_game_state_snapshot(packet_game_state_snapshot_t *packet, serialiser_t *serialiser);
 
+// Chunk coordinates are sent relative to the region of the previous chunk in the packet:
+// 16-bit index in the region, followed by the region coordinate only when the region changes
+struct chunk_coord_packer_t {
+    ivector3_t region_coord;
+    bool has_region;
+};
+
+#define PACKED_CHUNK_COORD_MAX_SIZE (sizeof(uint16_t) + 3 * sizeof(int32_t))
+
+// Packer has to be zero initialised at the start of every packet
+void serialise_chunk_coord(const ivector3_t &chunk_coord, chunk_coord_packer_t *packer, serialiser_t *serialiser);
+ivector3_t deserialise_chunk_coord(chunk_coord_packer_t *packer, serialiser_t *serialiser);
+
 enum color_serialisation_type_t { CST_SERIALISE_UNION_COLOR = 0, CST_SERIALISE_SEPARATE_COLOR = 1 };
 
 // color_serialisation_type_t parameter refers to whether to (de)serialise the color value from the colors array
@@ -174,7 +191,7 @@ chunk_modifications_t *deserialise_chunk_modifications(uint32_t *modification_co
 
 struct voxel_chunk_values_t {
     // Chunk coord
-    int16_t x, y, z;
+    int32_t x, y, z;
     voxel_t *voxel_values;
 };
 
@@ -70,6 +70,71 @@ map_names_t *get_map_names() {
     return &map_names;
 }
 
+bool serialise_map_chunk_voxels(
+    serialiser_t *serialiser,
+    const voxel_t *voxels) {
+    for (uint32_t v_index = 0; v_index < CHUNK_VOXEL_COUNT; ++v_index) {
+        voxel_t current_voxel = voxels[v_index];
+        if (current_voxel.value == 0) {
+            uint32_t before_head = serialiser->data_buffer_head;
+
+            static constexpr uint32_t MAX_ZERO_COUNT_BEFORE_COMPRESSION = 3;
+
+            uint32_t zero_count = 0;
+            for (; v_index < CHUNK_VOXEL_COUNT && voxels[v_index].value == 0 && zero_count < MAX_ZERO_COUNT_BEFORE_COMPRESSION; ++v_index, ++zero_count) {
+                serialiser->serialise_uint8(0);
+                serialiser->serialise_uint8(0);
+            }
+
+            if (zero_count == MAX_ZERO_COUNT_BEFORE_COMPRESSION) {
+                for (; v_index < CHUNK_VOXEL_COUNT && voxels[v_index].value == 0; ++v_index, ++zero_count) {}
+
+                if (zero_count == CHUNK_VOXEL_COUNT) {
+                    return 0;
+                }
+
+                serialiser->data_buffer_head = before_head;
+                serialiser->serialise_uint8(CHUNK_SPECIAL_VALUE);
+                serialiser->serialise_uint8(CHUNK_SPECIAL_VALUE);
+                serialiser->serialise_uint32(zero_count);
+            }
+
+            v_index -= 1;
+        }
+        else {
+            serialiser->serialise_uint8(current_voxel.value);
+            serialiser->serialise_uint8(current_voxel.color);
+        }
+    }
+
+    return 1;
+}
+
+void deserialise_map_chunk_voxels(
+    serialiser_t *serialiser,
+    voxel_t *voxels) {
+    for (uint32_t v = 0; v < CHUNK_VOXEL_COUNT;) {
+        uint8_t current_value = serialiser->deserialise_uint8();
+        uint8_t current_color = serialiser->deserialise_uint8();
+
+        if (current_value == CHUNK_SPECIAL_VALUE) {
+            // Repeating zeros
+            uint32_t zero_count = serialiser->deserialise_uint32();
+            uint32_t end = MIN(v + zero_count, (uint32_t)CHUNK_VOXEL_COUNT);
+
+            for (; v < end; ++v) {
+                voxels[v].value = 0;
+                voxels[v].color = 0;
+            }
+        }
+        else {
+            voxels[v].value = current_value;
+            voxels[v].color = current_color;
+            ++v;
+        }
+    }
+}
+
 map_t *load_map(const char *path) {
     map_t *current_loaded_map = FL_MALLOC(map_t, 1);
 
@@ -78,6 +143,12 @@ map_t *load_map(const char *path) {
     char full_path[50] = {};
     sprintf(full_path, "assets/maps/%s", path);
 
+    if (g_game->flags.page_chunks) {
+        char spill_path[60] = {};
+        sprintf(spill_path, "assets/maps/%s.spill", path);
+        begin_chunk_residency(full_path, spill_path);
+    }
+
     file_handle_t map_file = create_file(full_path, FLF_BINARY);
     if (does_file_exist(map_file)) {
         file_contents_t contents = read_file(map_file);
@@ -96,6 +167,16 @@ map_t *load_map(const char *path) {
             int16_t y = serialiser.deserialise_int16();
             int16_t z = serialiser.deserialise_int16();
 
+            if (g_game->flags.page_chunks) {
+                // The chunk stays in the map file until something needs it
+                uint32_t offset = serialiser.data_buffer_head;
+                voxel_t scratch[CHUNK_VOXEL_COUNT];
+                deserialise_map_chunk_voxels(&serialiser, scratch);
+                add_chunk_record(ivector3_t(x, y, z), offset, serialiser.data_buffer_head - offset);
+
+                continue;
+            }
+
             chunk_t *chunk = g_game->get_chunk(ivector3_t(x, y, z));
             chunk->flags.has_to_update_vertices = 1;
 
@@ -117,39 +198,26 @@ map_t *load_map(const char *path) {
             g_game->get_chunk(ivector3_t(x - 1, y - 1, z + 1))->flags.has_to_update_vertices = 1;
             g_game->get_chunk(ivector3_t(x - 1, y - 1, z - 1))->flags.has_to_update_vertices = 1;
 
-            for (uint32_t v = 0; v < CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH * CHUNK_EDGE_LENGTH;) {
-                uint8_t current_value = serialiser.deserialise_uint8();
-                uint8_t current_color = serialiser.deserialise_uint8();
-
-                if (current_value == CHUNK_SPECIAL_VALUE) {
-                    chunk->voxels[v].value = 0;
-                    chunk->voxels[v].color = 0;
-                    ++v;
-
-                    // Repeating zeros
-                    uint32_t zero_count = serialiser.deserialise_uint32();
-                    chunk->voxels[v + 1].value = 0;
-                    chunk->voxels[v + 1].color = 0;
-                    chunk->voxels[v + 2].value = 0;
-                    chunk->voxels[v + 2].color = 0;
-
-                    v += 2;
-
-                    uint32_t previous_v = v;
-                    for (; v < previous_v + zero_count - 3; ++v) {
-                        chunk->voxels[v].value = 0;
-                        chunk->voxels[v].color = 0;
-                    }
-                }
-                else {
-                    chunk->voxels[v].value = current_value;
-                    chunk->voxels[v].color = current_color;
-                    ++v;
-                }
-            }
+            voxel_t *voxels = get_chunk_voxels_for_write(chunk);
+            deserialise_map_chunk_voxels(&serialiser, voxels);
+
+            reorder_linear_chunk_voxels(voxels);
+
+            // Most chunks of the map are completely full or completely empty
+            compress_chunk_storage(chunk);
         }
 
         current_loaded_map->is_new = 0;
+
+        slab_allocator_stats_t stats = g_game->chunk_allocator.stats();
+        slab_allocator_stats_t voxel_stats = g_game->voxel_allocator.stats();
+        LOG_INFOV("Loaded map %s: %d chunks in %d slabs (%d/%d slots used), %d chunks aren't uniform\n",
+            current_loaded_map->name, stats.allocated_count, stats.slab_count, stats.allocated_count, stats.capacity,
+            voxel_stats.allocated_count);
+
+        if (g_game->flags.page_chunks) {
+            LOG_INFOV("%d chunks stay in the map file until they get paged in\n", g_game->residency.records.count);
+        }
     }
     else {
         current_loaded_map->is_new = 1;
@@ -180,6 +248,10 @@ void save_map(map_t *map) {
 
     uint32_t saved_chunk_count = 0;
     for (uint32_t i = 0; i < chunk_count; ++i) {
+        if (!chunks[i]) {
+            continue;
+        }
+
         ++saved_chunk_count;
 
         uint32_t before_chunk_ptr = serialiser.data_buffer_head;
@@ -188,39 +260,30 @@ void save_map(map_t *map) {
         serialiser.serialise_int16(chunks[i]->chunk_coord.y);
         serialiser.serialise_int16(chunks[i]->chunk_coord.z);
 
-        for (uint32_t v_index = 0; v_index < CHUNK_VOXEL_COUNT; ++v_index) {
-            voxel_t current_voxel = chunks[i]->voxels[v_index];
-            if (current_voxel.value == 0) {
-                uint32_t before_head = serialiser.data_buffer_head;
-
-                static constexpr uint32_t MAX_ZERO_COUNT_BEFORE_COMPRESSION = 3;
+        voxel_t scratch[CHUNK_VOXEL_COUNT];
+        const voxel_t *voxels = get_chunk_voxels_linear(chunks[i], scratch);
 
-                uint32_t zero_count = 0;
-                for (; chunks[i]->voxels[v_index].value == 0 && zero_count < MAX_ZERO_COUNT_BEFORE_COMPRESSION; ++v_index, ++zero_count) {
-                    serialiser.serialise_uint8(0);
-                    serialiser.serialise_uint8(0);
-                }
+        // Empty chunks don't get saved
+        if (!serialise_map_chunk_voxels(&serialiser, voxels)) {
+            serialiser.data_buffer_head = before_chunk_ptr;
+            --saved_chunk_count;
+        }
+    }
 
-                if (zero_count == MAX_ZERO_COUNT_BEFORE_COMPRESSION) {
-                    for (; chunks[i]->voxels[v_index].value == 0; ++v_index, ++zero_count) {}
+    if (g_game->flags.page_chunks) {
+        // Chunks which aren't resident are already serialised in the backing store
+        open_hash_table_t<chunk_record_t> *records = &g_game->residency.records;
 
-                    if (zero_count == CHUNK_VOXEL_COUNT) {
-                        serialiser.data_buffer_head = before_chunk_ptr;
-                        --saved_chunk_count;
-                        break;
-                    }
+        for (uint32_t i = 0; i < records->capacity; ++i) {
+            chunk_record_t *record = &records->items[i].value;
 
-                    serialiser.data_buffer_head = before_head;
-                    serialiser.serialise_uint8(CHUNK_SPECIAL_VALUE);
-                    serialiser.serialise_uint8(CHUNK_SPECIAL_VALUE);
-                    serialiser.serialise_uint32(zero_count);
-                }
+            if (records->items[i].key != records->EMPTY_KEY && record->size && !g_game->access_resident_chunk(record->chunk_coord)) {
+                serialiser.serialise_int16(record->chunk_coord.x);
+                serialiser.serialise_int16(record->chunk_coord.y);
+                serialiser.serialise_int16(record->chunk_coord.z);
+                read_chunk_record(record, serialiser.grow_data_buffer(record->size));
 
-                v_index -= 1;
-            }
-            else {
-                serialiser.serialise_uint8(current_voxel.value);
-                serialiser.serialise_uint8(current_voxel.color);
+                ++saved_chunk_count;
             }
         }
     }
@@ -234,7 +297,16 @@ void save_map(map_t *map) {
 }
 
 void unload_map(map_t *map) {
-    memset(map, 0, sizeof(map_t));
+    if (g_game->flags.page_chunks) {
+        end_chunk_residency();
+    }
+
+    if (g_game->flags.procedural_terrain) {
+        end_procedural_terrain();
+    }
+
+    // Allocated by load_map / begin_procedural_terrain
+    FL_FREE(map);
     // TODO: Make sure to reset all the voxels from the chunks
 }
 
@@ -30,3 +30,11 @@ map_t *load_map(const char *path);
 void add_map_name(const char *map_name, const char *path);
 void save_map(map_t *map);
 void unload_map(map_t *map);
+
+struct voxel_t;
+struct serialiser_t;
+
+// Run-length encoded voxels of a chunk (in linear order) - format of the chunks in map files and in the chunk spill file
+// Returns false (and the data shouldn't be kept) if the chunk is empty
+bool serialise_map_chunk_voxels(serialiser_t *serialiser, const voxel_t *voxels);
+void deserialise_map_chunk_voxels(serialiser_t *serialiser, voxel_t *voxels);
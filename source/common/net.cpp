@@ -215,23 +215,6 @@ void unflag_modified_chunks(
     }
 }
 
-void fill_dummy_voxels(
-    chunk_modifications_t *modifications) {
-    for (uint32_t i = 0; i < modifications->modified_voxels_count; ++i) {
-        voxel_modification_t *v = &modifications->modifications[i];
-        g_net_data.dummy_voxels[v->index] = i;
-    }
-}
-
-void unfill_dummy_voxels(
-    chunk_modifications_t *modifications) {
-    for (uint32_t i = 0; i < modifications->modified_voxels_count; ++i) {
-        voxel_modification_t *v = &modifications->modifications[i];
-        g_net_data.dummy_voxels[v->index] = CHUNK_SPECIAL_VALUE;
-    }
-}
-
-
 uint32_t fill_chunk_modification_array_with_initial_values(
     chunk_modifications_t *modifications) {
     uint32_t modified_chunk_count = 0;
@@ -242,9 +225,9 @@ uint32_t fill_chunk_modification_array_with_initial_values(
     for (uint32_t c_index = 0; c_index < modified_chunk_count; ++c_index) {
         chunk_modifications_t *cm_ptr = &modifications[current];
         chunk_t *c_ptr = chunks[c_index];
-        chunk_history_t *h_ptr = &chunks[c_index]->history;
+        chunk_history_t *h_ptr = chunks[c_index]->history;
 
-        if (h_ptr->modification_count == 0) {
+        if (h_ptr == NULL || h_ptr->modification_count == 0) {
             // Chunk doesn't actually have modifications, it was just flagged
         }
         else {
@@ -255,8 +238,8 @@ uint32_t fill_chunk_modification_array_with_initial_values(
             for (uint32_t v_index = 0; v_index < cm_ptr->modified_voxels_count; ++v_index) {
                 cm_ptr->modifications[v_index].index = (uint16_t)h_ptr->modification_stack[v_index];
                 cm_ptr->modifications[v_index].initial_value = h_ptr->modification_pool[cm_ptr->modifications[v_index].index];
-                cm_ptr->modifications[v_index].final_value = c_ptr->voxels[cm_ptr->modifications[v_index].index].value;
-                cm_ptr->colors[v_index] = c_ptr->voxels[cm_ptr->modifications[v_index].index].color;
+                cm_ptr->modifications[v_index].final_value = get_chunk_voxel(c_ptr, cm_ptr->modifications[v_index].index).value;
+                cm_ptr->colors[v_index] = get_chunk_voxel(c_ptr, cm_ptr->modifications[v_index].index).color;
             }
 
             ++current;
@@ -275,9 +258,9 @@ uint32_t fill_chunk_modification_array_with_colors(chunk_modifications_t *modifi
     for (uint32_t c_index = 0; c_index < modified_chunk_count; ++c_index) {
         chunk_modifications_t *cm_ptr = &modifications[current];
         chunk_t *c_ptr = chunks[c_index];
-        chunk_history_t *h_ptr = &chunks[c_index]->history;
+        chunk_history_t *h_ptr = chunks[c_index]->history;
 
-        if (h_ptr->modification_count == 0) {
+        if (h_ptr == NULL || h_ptr->modification_count == 0) {
             // Chunk doesn't actually have modifications, it was just flagged
         }
         else {
@@ -288,9 +271,9 @@ uint32_t fill_chunk_modification_array_with_colors(chunk_modifications_t *modifi
             for (uint32_t v_index = 0; v_index < cm_ptr->modified_voxels_count; ++v_index) {
                 cm_ptr->modifications[v_index].index = (uint16_t)h_ptr->modification_stack[v_index];
                 // Difference is here because the server will just send the voxel values array, not the colors array
-                cm_ptr->modifications[v_index].color = c_ptr->voxels[cm_ptr->modifications[v_index].index].color;
-                cm_ptr->modifications[v_index].final_value = c_ptr->voxels[cm_ptr->modifications[v_index].index].value;
-                cm_ptr->colors[v_index] = c_ptr->voxels[cm_ptr->modifications[v_index].index].color;
+                cm_ptr->modifications[v_index].color = get_chunk_voxel(c_ptr, cm_ptr->modifications[v_index].index).color;
+                cm_ptr->modifications[v_index].final_value = get_chunk_voxel(c_ptr, cm_ptr->modifications[v_index].index).value;
+                cm_ptr->colors[v_index] = get_chunk_voxel(c_ptr, cm_ptr->modifications[v_index].index).color;
             }
 
             ++current;
@@ -317,61 +300,119 @@ accumulated_predicted_modification_t *accumulate_history() {
     }
 }
 
+int32_t find_voxel_modification(
+    const chunk_modifications_t *modifications,
+    uint16_t index) {
+    int32_t first = 0;
+    int32_t last = (int32_t)modifications->modified_voxels_count - 1;
+
+    while (first <= last) {
+        int32_t middle = (first + last) / 2;
+        uint16_t middle_index = modifications->modifications[middle].index;
+
+        if (middle_index == index) {
+            return middle;
+        }
+        else if (middle_index < index) {
+            first = middle + 1;
+        }
+        else {
+            last = middle - 1;
+        }
+    }
+
+    return -1;
+}
+
+static int32_t s_compare_modification_keys(const void *a, const void *b) {
+    uint32_t key_a = *(const uint32_t *)a;
+    uint32_t key_b = *(const uint32_t *)b;
+
+    return key_a < key_b ? -1 : (key_a > key_b);
+}
+
+// Pushes the modification, or updates the previous one if it's for the same voxel (which keeps its initial value)
+static void s_push_merged_voxel_modification(
+    chunk_modifications_t *merged,
+    const voxel_modification_t *modification,
+    voxel_color_t color) {
+    uint32_t count = merged->modified_voxels_count;
+
+    if (count && merged->modifications[count - 1].index == modification->index) {
+        merged->modifications[count - 1].final_value = modification->final_value;
+        merged->colors[count - 1] = color;
+    }
+    else if (count < MAX_PREDICTED_VOXEL_MODIFICATIONS_PER_CHUNK) {
+        merged->modifications[count] = *modification;
+        merged->colors[count] = color;
+        ++merged->modified_voxels_count;
+    }
+}
+
+// Merges the modifications of src into dst (same chunk) - one pass over both, dst stays sorted by voxel index
+static void s_merge_voxel_modifications(
+    chunk_modifications_t *dst,
+    const chunk_modifications_t *src) {
+    // Sorted by voxel index, then by order in src (modified_voxels_count < 256), so that the last modification of a voxel wins
+    uint32_t src_count = src->modified_voxels_count;
+    uint32_t *keys = LN_MALLOC(uint32_t, src_count);
+    for (uint32_t i = 0; i < src_count; ++i) {
+        keys[i] = ((uint32_t)src->modifications[i].index << 8) | i;
+    }
+
+    qsort(keys, src_count, sizeof(uint32_t), s_compare_modification_keys);
+
+    chunk_modifications_t *merged = LN_MALLOC(chunk_modifications_t, 1);
+    merged->modified_voxels_count = 0;
+
+    uint32_t d = 0, s = 0;
+    while (d < dst->modified_voxels_count || s < src_count) {
+        uint32_t src_index = (s < src_count) ? keys[s] & 0xFF : 0;
+
+        // Voxels which were already in dst come first (their initial value is the one to keep)
+        if (s == src_count || (d < dst->modified_voxels_count && dst->modifications[d].index <= src->modifications[src_index].index)) {
+            s_push_merged_voxel_modification(merged, &dst->modifications[d], dst->colors[d]);
+            ++d;
+        }
+        else {
+            s_push_merged_voxel_modification(merged, &src->modifications[src_index], src->colors[src_index]);
+            ++s;
+        }
+    }
+
+    dst->modified_voxels_count = merged->modified_voxels_count;
+    memcpy(dst->modifications, merged->modifications, sizeof(voxel_modification_t) * merged->modified_voxels_count);
+    memcpy(dst->colors, merged->colors, sizeof(voxel_color_t) * merged->modified_voxels_count);
+}
+
 void merge_chunk_modifications(
     chunk_modifications_t *dst,
     uint32_t *dst_count,
     chunk_modifications_t *src,
     uint32_t src_count) {
-    flag_modified_chunks(dst, *dst_count);
-
     for (uint32_t i = 0; i < src_count; ++i) {
         chunk_modifications_t *src_modifications = &src[i];
+        chunk_modifications_t *dst_modifications = NULL;
 
-        chunk_t *chunk = g_game->get_chunk(ivector3_t(src_modifications->x, src_modifications->y, src_modifications->z));
-
-        // Chunk has been terraformed on before (between previous game state dispatch and next one)
-        if (chunk->flags.modified_marker) {
-            // Index of modification struct would have been filled by s_flag_modiifed_chunks(), called above;
-            chunk_modifications_t *dst_modifications = &dst[chunk->flags.index_of_modification_struct];
-
-            // Has been modified, must fill dummy voxels
-            fill_dummy_voxels(dst_modifications);
-
-            for (uint32_t voxel = 0; voxel < src_modifications->modified_voxels_count; ++voxel) {
-                voxel_modification_t *vm_ptr = &src_modifications->modifications[voxel];
-                voxel_color_t color = src_modifications->colors[voxel];
-
-                if (g_net_data.dummy_voxels[vm_ptr->index] == CHUNK_SPECIAL_VALUE) {
-                    // Voxel has not yet been modified, can just push it into array
-                    dst_modifications->colors[dst_modifications->modified_voxels_count] = color;
-                    dst_modifications->modifications[dst_modifications->modified_voxels_count] = *vm_ptr;
-                    ++(dst_modifications->modified_voxels_count);
-                }
-                else {
-                    // Voxel has been modified
-                    uint32_t previous_index = g_net_data.dummy_voxels[vm_ptr->index];
-                    // Just update final value
-                    dst_modifications->modifications[previous_index].final_value = vm_ptr->final_value;
-                    dst_modifications->colors[previous_index] = color;
-                }
+        // Chunk may have been terraformed before (between previous game state dispatch and next one)
+        for (uint32_t j = 0; j < *dst_count; ++j) {
+            if (dst[j].x == src_modifications->x && dst[j].y == src_modifications->y && dst[j].z == src_modifications->z) {
+                dst_modifications = &dst[j];
+                break;
             }
-
-            unfill_dummy_voxels(dst_modifications);
         }
-        else {
+
+        if (!dst_modifications) {
             // Chunk has not been terraformed before, need to push a new modification
-            chunk_modifications_t *m = &dst[*(dst_count)];
+            dst_modifications = &dst[*(dst_count)];
             ++(*dst_count);
 
-            m->x = src_modifications->x;
-            m->y = src_modifications->y;
-            m->z = src_modifications->z;
-
-            m->modified_voxels_count = src_modifications->modified_voxels_count;
-            memcpy(m->modifications, src_modifications->modifications, sizeof(voxel_modification_t) * m->modified_voxels_count);
-            memcpy(m->colors, src_modifications->colors, sizeof(voxel_color_t) * m->modified_voxels_count);
+            dst_modifications->x = src_modifications->x;
+            dst_modifications->y = src_modifications->y;
+            dst_modifications->z = src_modifications->z;
+            dst_modifications->modified_voxels_count = 0;
         }
+
+        s_merge_voxel_modifications(dst_modifications, src_modifications);
     }
-    
-    unflag_modified_chunks(dst, *dst_count);
 }
@@ -17,6 +17,7 @@
 //#define NET_DEBUG_TERRAFORMING 1
 
 struct voxel_modification_t {
+    // Index in the build's voxel layout (packets carry the linear index)
     uint16_t index;
     uint8_t final_value;
 
@@ -29,7 +30,7 @@ struct voxel_modification_t {
 };
 
 struct chunk_modifications_t {
-    int16_t x, y, z;
+    int32_t x, y, z;
     uint32_t modified_voxels_count;
     // Due to alignment and padding issues, it's best to store the data like so
     voxel_modification_t modifications[MAX_PREDICTED_VOXEL_MODIFICATIONS_PER_CHUNK];
@@ -89,9 +90,6 @@ struct client_t {
     uint32_t predicted_proj_hit_count;
     predicted_projectile_hit_t predicted_proj_hits[MAX_PREDICTED_PROJECTILE_HITS];
 
-    // Previous locations
-    circular_buffer_array_t<player_position_snapshot_t, 40> previous_locations;
-
     // Predicted chunk modifications
     uint32_t predicted_chunk_mod_count;
     chunk_modifications_t *predicted_modifications;
@@ -142,8 +140,6 @@ struct net_data_t {
     uint64_t current_packet;
     char *message_buffer;
     stack_container_t<client_t> clients;
-    // This stores the index of the modification in the chunk_modifications_t struct's array
-    uint8_t dummy_voxels[CHUNK_VOXEL_COUNT];
     arena_allocator_t chunk_modification_allocator;
     circular_buffer_array_t<
         accumulated_predicted_modification_t,
@@ -179,11 +175,13 @@ accumulated_predicted_modification_t *add_acc_predicted_modification();
 void check_incoming_meta_server_packets(event_submissions_t *events);
 void flag_modified_chunks(chunk_modifications_t *modifications, uint32_t count);
 void unflag_modified_chunks(chunk_modifications_t *modifications, uint32_t count);
-void fill_dummy_voxels(chunk_modifications_t *modifications);
-void unfill_dummy_voxels(chunk_modifications_t *modifications);
 uint32_t fill_chunk_modification_array_with_initial_values(chunk_modifications_t *modifications);
 uint32_t fill_chunk_modification_array_with_colors(chunk_modifications_t *modifications);
 accumulated_predicted_modification_t *accumulate_history();
+// Index of the voxel's modification in the array (-1 if the voxel wasn't modified) - the modifications have to be sorted by voxel index
+int32_t find_voxel_modification(const chunk_modifications_t *modifications, uint16_t index);
+// Adds the modifications of src to dst (the modifications of every chunk in dst end up sorted by voxel index)
+// Voxels which were already modified in dst keep their initial value and get the final value / color of src
 void merge_chunk_modifications(
     chunk_modifications_t *dst,
     uint32_t *dst_count,
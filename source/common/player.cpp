@@ -99,7 +99,7 @@ void handle_shape_switch(player_t *player, bool switch_shapes, float dt) {
     }
 
     if (player->switching_shapes)
-        player->shape_switching_time += g_game->dt;
+        player->shape_switching_time += dt;
 
     if (player->shape_switching_time > PLAYER_SHAPE_SWITCH_DURATION) {
         player->shape_switching_time = 0.0f;
@@ -140,7 +140,7 @@ static void s_execute_player_triggers(
             // TODO: Do check to see if the player can shoot...
             uint32_t ref_idx = weapon->active_projs.add();
 
-            uint32_t rock_idx = g_game->rocks.spawn(
+            rock_handle_t rock_handle = g_game->rocks.spawn(
                 compute_player_view_position(player),
                 player->ws_view_direction * PROJECTILE_ROCK_SPEED,
                 player->ws_up_vector,
@@ -148,8 +148,14 @@ static void s_execute_player_triggers(
                 ref_idx,
                 player->selected_weapon);
 
-            weapon->active_projs[ref_idx].initialised = 1;
-            weapon->active_projs[ref_idx].idx = rock_idx;
+            if (rock_handle == ROCK_INVALID_HANDLE) {
+                // Every rock slot is used
+                weapon->active_projs.remove(ref_idx);
+            }
+            else {
+                weapon->active_projs[ref_idx].initialised = 1;
+                weapon->active_projs[ref_idx].idx = rock_handle;
+            }
         }
 
         player->terraform_package.ray_hit_terrain = 0;
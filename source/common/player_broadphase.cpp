@@ -0,0 +1,184 @@
+#include "player_broadphase.hpp"
+#include "game.hpp"
+#include "constant.hpp"
+#include "allocators.hpp"
+#include <string.h>
+
+player_bounds_t make_player_bounds(const player_t *player) {
+    // The highest sphere of a standing player is centered 1.5 scale above the player's position, and has a radius of 1 scale
+    float extent = PLAYER_SCALE * 2.5f;
+
+    player_bounds_t bounds;
+    bounds.local_id = player->local_id;
+    bounds.ws_min = player->ws_position - vector3_t(extent);
+    bounds.ws_max = player->ws_position + vector3_t(extent);
+
+    return bounds;
+}
+
+static ivector3_t s_world_to_cell(const vector3_t &ws_position) {
+    return ivector3_t(glm::floor(ws_position / PLAYER_BROADPHASE_CELL_SIZE));
+}
+
+static uint32_t s_hash_cell(int32_t x, int32_t y, int32_t z, uint32_t bucket_count) {
+    uint32_t hash = ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^ ((uint32_t)z * 83492791u);
+    return hash & (bucket_count - 1);
+}
+
+void player_broadphase_t::init(uint32_t max_players) {
+    max_player_count = max_players;
+    player_count = 0;
+    players = FL_MALLOC(player_bounds_t, max_player_count);
+
+    // At least twice as many buckets as entries
+    bucket_count = 1;
+    while (bucket_count < max_player_count * MAX_CELLS_PER_PLAYER * 2) {
+        bucket_count <<= 1;
+    }
+
+    bucket_starts = FL_MALLOC(uint32_t, bucket_count + 1);
+    memset(bucket_starts, 0, sizeof(uint32_t) * (bucket_count + 1));
+    entries = FL_MALLOC(uint32_t, max_player_count * MAX_CELLS_PER_PLAYER);
+    oversized_count = 0;
+    oversized = FL_MALLOC(uint32_t, max_player_count);
+
+    query_stamp = 0;
+    player_stamps = FL_MALLOC(uint32_t, max_player_count);
+    memset(player_stamps, 0, sizeof(uint32_t) * max_player_count);
+}
+
+void player_broadphase_t::destroy() {
+    FL_FREE(players);
+    FL_FREE(bucket_starts);
+    FL_FREE(entries);
+    FL_FREE(oversized);
+    FL_FREE(player_stamps);
+
+    player_count = 0;
+    max_player_count = 0;
+}
+
+void player_broadphase_t::build(const player_bounds_t *bounds, uint32_t count) {
+    player_count = MIN(count, max_player_count);
+    memcpy(players, bounds, sizeof(player_bounds_t) * player_count);
+    memset(bucket_starts, 0, sizeof(uint32_t) * (bucket_count + 1));
+    oversized_count = 0;
+
+    // Bucket of each cell that each player touches
+    uint32_t *entry_buckets = LN_MALLOC(uint32_t, player_count * MAX_CELLS_PER_PLAYER);
+    uint32_t *entry_players = LN_MALLOC(uint32_t, player_count * MAX_CELLS_PER_PLAYER);
+    uint32_t entry_count = 0;
+
+    for (uint32_t p = 0; p < player_count; ++p) {
+        ivector3_t lo = s_world_to_cell(players[p].ws_min);
+        ivector3_t hi = s_world_to_cell(players[p].ws_max);
+        ivector3_t extent = hi - lo + ivector3_t(1);
+
+        // 64 bits: boxes can be huge when the server doesn't know yet where the player was
+        if ((int64_t)extent.x * (int64_t)extent.y * (int64_t)extent.z > (int64_t)MAX_CELLS_PER_PLAYER) {
+            oversized[oversized_count++] = p;
+            continue;
+        }
+
+        for (int32_t z = lo.z; z <= hi.z; ++z) {
+            for (int32_t y = lo.y; y <= hi.y; ++y) {
+                for (int32_t x = lo.x; x <= hi.x; ++x) {
+                    uint32_t bucket = s_hash_cell(x, y, z, bucket_count);
+                    ++bucket_starts[bucket + 1];
+
+                    entry_buckets[entry_count] = bucket;
+                    entry_players[entry_count++] = p;
+                }
+            }
+        }
+    }
+
+    // Counting sort of the entries by bucket
+    for (uint32_t b = 0; b < bucket_count; ++b) {
+        bucket_starts[b + 1] += bucket_starts[b];
+    }
+
+    uint32_t *offsets = LN_MALLOC(uint32_t, bucket_count);
+    memcpy(offsets, bucket_starts, sizeof(uint32_t) * bucket_count);
+
+    for (uint32_t e = 0; e < entry_count; ++e) {
+        entries[offsets[entry_buckets[e]]++] = entry_players[e];
+    }
+}
+
+static bool s_sphere_touches_box(const vector3_t &center, float radius, const player_bounds_t *bounds) {
+    vector3_t closest = glm::clamp(center, bounds->ws_min, bounds->ws_max);
+    vector3_t diff = closest - center;
+
+    return glm::dot(diff, diff) <= radius * radius;
+}
+
+uint32_t player_broadphase_t::query_sphere(const vector3_t &ws_center, float radius, uint32_t *dst_local_ids) {
+    if (++query_stamp == 0) {
+        memset(player_stamps, 0, sizeof(uint32_t) * max_player_count);
+        query_stamp = 1;
+    }
+
+    uint32_t found_count = 0;
+
+    ivector3_t lo = s_world_to_cell(ws_center - vector3_t(radius));
+    ivector3_t hi = s_world_to_cell(ws_center + vector3_t(radius));
+    ivector3_t extent = hi - lo + ivector3_t(1);
+
+    if ((int64_t)extent.x * (int64_t)extent.y * (int64_t)extent.z > (int64_t)player_count) {
+        // Checking every player is faster than going through the cells
+        for (uint32_t p = 0; p < player_count; ++p) {
+            if (s_sphere_touches_box(ws_center, radius, &players[p])) {
+                dst_local_ids[found_count++] = players[p].local_id;
+            }
+        }
+
+        return found_count;
+    }
+
+    for (uint32_t o = 0; o < oversized_count; ++o) {
+        uint32_t p = oversized[o];
+
+        if (s_sphere_touches_box(ws_center, radius, &players[p])) {
+            dst_local_ids[found_count++] = players[p].local_id;
+        }
+    }
+
+    for (int32_t z = lo.z; z <= hi.z; ++z) {
+        for (int32_t y = lo.y; y <= hi.y; ++y) {
+            for (int32_t x = lo.x; x <= hi.x; ++x) {
+                uint32_t bucket = s_hash_cell(x, y, z, bucket_count);
+
+                // Buckets may contain players of other cells (which the box check filters out)
+                for (uint32_t e = bucket_starts[bucket]; e < bucket_starts[bucket + 1]; ++e) {
+                    uint32_t p = entries[e];
+
+                    if (player_stamps[p] != query_stamp) {
+                        player_stamps[p] = query_stamp;
+
+                        if (s_sphere_touches_box(ws_center, radius, &players[p])) {
+                            dst_local_ids[found_count++] = players[p].local_id;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return found_count;
+}
+
+void update_player_broadphase() {
+    player_bounds_t *bounds = LN_MALLOC(player_bounds_t, g_game->players.data_count);
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < g_game->players.data_count; ++i) {
+        player_t *p = g_game->players[i];
+
+        if (p) {
+            bounds[count++] = make_player_bounds(p);
+        }
+    }
+
+    g_game->player_broadphase.build(bounds, count);
+}
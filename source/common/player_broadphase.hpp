@@ -0,0 +1,49 @@
+#pragma once
+
+#include "math.hpp"
+#include "player.hpp"
+
+// Box that a player may be in this tick (e.g. the server adds the positions that lag compensation can rewind the player to)
+struct player_bounds_t {
+    uint32_t local_id;
+    vector3_t ws_min;
+    vector3_t ws_max;
+};
+
+// Box around the collision shapes of the player (see collide_sphere_with_player)
+player_bounds_t make_player_bounds(const player_t *player);
+
+// Uniform grid of the player boxes (cells of PLAYER_BROADPHASE_CELL_SIZE, hashed into buckets)
+// Gets rebuilt once per tick - building and each query only depend on the number of players / cells they touch,
+// not on how the players are clustered
+struct player_broadphase_t {
+    uint32_t max_player_count;
+    uint32_t player_count;
+    player_bounds_t *players;
+
+    // A box goes in every cell it overlaps, the boxes which overlap more than MAX_CELLS_PER_PLAYER cells
+    // (e.g. players who can be rewound very far) get checked by every query instead
+    uint32_t bucket_count;
+    // Entries of bucket b are entries[bucket_starts[b], bucket_starts[b + 1]) - indices in players
+    uint32_t *bucket_starts;
+    uint32_t *entries;
+    uint32_t oversized_count;
+    uint32_t *oversized;
+
+    // Players which the current query already found
+    uint32_t query_stamp;
+    uint32_t *player_stamps;
+
+    static constexpr uint32_t MAX_CELLS_PER_PLAYER = 8;
+
+    void init(uint32_t max_players);
+    void destroy();
+
+    void build(const player_bounds_t *bounds, uint32_t count);
+
+    // Local ids of the players whose box touches the sphere (dst_local_ids needs room for every player)
+    uint32_t query_sphere(const vector3_t &ws_center, float radius, uint32_t *dst_local_ids);
+};
+
+// Rebuilds g_game->player_broadphase with the boxes of all the players (from player_t::ws_position)
+void update_player_broadphase();
@@ -0,0 +1,626 @@
+#include "log.hpp"
+#include "game.hpp"
+#include "serialiser.hpp"
+#include "allocators.hpp"
+#include "thread_pool.hpp"
+#include "procedural_terrain.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Has to change whenever the generation code changes (cached chunks would be stale)
+#define TERRAIN_GENERATOR_VERSION 1
+#define TERRAIN_CACHE_MAGIC 0x43525254
+// int16 x, y, z + uint32 size
+#define TERRAIN_CACHE_ENTRY_HEADER_SIZE 10
+// Chunks generated together by load_all_terrain_chunks
+#define TERRAIN_GENERATION_BATCH_SIZE 64
+
+void make_default_terrain_generator(
+    uint32_t seed,
+    terrain_generator_t *generator) {
+    memset(generator, 0, sizeof(terrain_generator_t));
+
+    generator->seed = seed;
+    // Heights stay roughly in [-32, 60]
+    generator->min_chunk = ivector3_t(-9, -2, -9);
+    generator->max_chunk = ivector3_t(8, 2, 8);
+    generator->base_height = -6.0f;
+    generator->density_gradient = 60.0f;
+    generator->warp_frequency = 1.0f / 90.0f;
+    generator->warp_amplitude = 20.0f;
+
+    // Rolling hills
+    terrain_noise_stage_t *hills = &generator->stages[generator->stage_count++];
+    hills->type = TNT_FBM;
+    hills->octaves = 5;
+    hills->frequency = 1.0f / 110.0f;
+    hills->lacunarity = 2.0f;
+    hills->gain = 0.5f;
+    hills->amplitude = 18.0f;
+
+    // Mountain ridges
+    terrain_noise_stage_t *ridges = &generator->stages[generator->stage_count++];
+    ridges->type = TNT_RIDGED;
+    ridges->octaves = 4;
+    ridges->frequency = 1.0f / 200.0f;
+    ridges->lacunarity = 2.1f;
+    ridges->gain = 0.5f;
+    ridges->amplitude = 22.0f;
+
+    terrain_color_rule_t rules[] = {
+        // Snow on the peaks
+        { 40.0f, 1000.0f, 3.0f, b8v_color_to_b8(7, 7, 3) },
+        // Grass
+        { -4.0f, 40.0f, 2.0f, b8v_color_to_b8(2, 5, 0) },
+        // Sand in the valleys
+        { -1000.0f, -4.0f, 2.0f, b8v_color_to_b8(6, 6, 1) },
+        // Dirt
+        { -1000.0f, 1000.0f, 6.0f, b8v_color_to_b8(3, 2, 0) },
+    };
+
+    generator->color_rule_count = sizeof(rules) / sizeof(rules[0]);
+    memcpy(generator->color_rules, rules, sizeof(rules));
+
+    // Rock
+    generator->default_color = b8v_color_to_b8(3, 3, 1);
+}
+
+static uint32_t s_hash_bytes(
+    uint32_t hash,
+    const void *data,
+    uint32_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    // FNV-1a
+    for (uint32_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+uint32_t hash_terrain_generator(
+    const terrain_generator_t *generator) {
+    // Field by field (the padding of the structs isn't initialised)
+    uint32_t hash = 2166136261u;
+    uint32_t version = TERRAIN_GENERATOR_VERSION;
+
+    hash = s_hash_bytes(hash, &version, sizeof(version));
+    hash = s_hash_bytes(hash, &generator->seed, sizeof(generator->seed));
+    hash = s_hash_bytes(hash, &generator->min_chunk, sizeof(generator->min_chunk));
+    hash = s_hash_bytes(hash, &generator->max_chunk, sizeof(generator->max_chunk));
+    hash = s_hash_bytes(hash, &generator->base_height, sizeof(generator->base_height));
+    hash = s_hash_bytes(hash, &generator->density_gradient, sizeof(generator->density_gradient));
+    hash = s_hash_bytes(hash, &generator->warp_frequency, sizeof(generator->warp_frequency));
+    hash = s_hash_bytes(hash, &generator->warp_amplitude, sizeof(generator->warp_amplitude));
+
+    for (uint32_t i = 0; i < generator->stage_count; ++i) {
+        const terrain_noise_stage_t *stage = &generator->stages[i];
+        uint32_t type = stage->type;
+
+        hash = s_hash_bytes(hash, &type, sizeof(type));
+        hash = s_hash_bytes(hash, &stage->octaves, sizeof(stage->octaves));
+        hash = s_hash_bytes(hash, &stage->frequency, sizeof(stage->frequency));
+        hash = s_hash_bytes(hash, &stage->lacunarity, sizeof(stage->lacunarity));
+        hash = s_hash_bytes(hash, &stage->gain, sizeof(stage->gain));
+        hash = s_hash_bytes(hash, &stage->amplitude, sizeof(stage->amplitude));
+    }
+
+    for (uint32_t i = 0; i < generator->color_rule_count; ++i) {
+        const terrain_color_rule_t *rule = &generator->color_rules[i];
+
+        hash = s_hash_bytes(hash, &rule->min_height, sizeof(rule->min_height));
+        hash = s_hash_bytes(hash, &rule->max_height, sizeof(rule->max_height));
+        hash = s_hash_bytes(hash, &rule->max_depth, sizeof(rule->max_depth));
+        hash = s_hash_bytes(hash, &rule->color, sizeof(rule->color));
+    }
+
+    hash = s_hash_bytes(hash, &generator->default_color, sizeof(generator->default_color));
+
+    return hash;
+}
+
+// Noise only uses integer hashing and basic float operations: same results on every machine running the same build
+static uint32_t s_hash_lattice_point(
+    int32_t x,
+    int32_t z,
+    uint32_t seed) {
+    uint32_t h = seed ^ ((uint32_t)x * 0x8da6b343u) ^ ((uint32_t)z * 0xd8163841u);
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    h *= 0x297a2d39u;
+    h ^= h >> 15;
+
+    return h;
+}
+
+// Dot product with one of 8 gradient directions
+static float s_gradient_dot(
+    uint32_t hash,
+    float dx,
+    float dz) {
+    switch (hash & 7) {
+    case 0: return dx + dz;
+    case 1: return dx - dz;
+    case 2: return -dx + dz;
+    case 3: return -dx - dz;
+    case 4: return dx;
+    case 5: return -dx;
+    case 6: return dz;
+    default: return -dz;
+    }
+}
+
+static float s_fade(
+    float t) {
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+// 2D gradient noise, roughly in [-1, 1]
+static float s_gradient_noise(
+    float x,
+    float z,
+    uint32_t seed) {
+    float floor_x = floorf(x);
+    float floor_z = floorf(z);
+    int32_t ix = (int32_t)floor_x;
+    int32_t iz = (int32_t)floor_z;
+    float dx = x - floor_x;
+    float dz = z - floor_z;
+
+    float n00 = s_gradient_dot(s_hash_lattice_point(ix, iz, seed), dx, dz);
+    float n10 = s_gradient_dot(s_hash_lattice_point(ix + 1, iz, seed), dx - 1.0f, dz);
+    float n01 = s_gradient_dot(s_hash_lattice_point(ix, iz + 1, seed), dx, dz - 1.0f);
+    float n11 = s_gradient_dot(s_hash_lattice_point(ix + 1, iz + 1, seed), dx - 1.0f, dz - 1.0f);
+
+    float u = s_fade(dx);
+    float v = s_fade(dz);
+
+    float nx0 = n00 + u * (n10 - n00);
+    float nx1 = n01 + u * (n11 - n01);
+
+    return nx0 + v * (nx1 - nx0);
+}
+
+static float s_sample_stage(
+    const terrain_noise_stage_t *stage,
+    uint32_t stage_seed,
+    float x,
+    float z) {
+    float frequency = stage->frequency;
+    float amplitude = stage->amplitude;
+    float height = 0.0f;
+
+    for (uint32_t o = 0; o < stage->octaves; ++o) {
+        float noise = s_gradient_noise(x * frequency, z * frequency, stage_seed + o);
+
+        if (stage->type == TNT_RIDGED) {
+            // Sharp crests where the noise crosses 0
+            float ridge = 1.0f - fabsf(noise);
+            height += ridge * ridge * amplitude;
+        }
+        else {
+            height += noise * amplitude;
+        }
+
+        frequency *= stage->lacunarity;
+        amplitude *= stage->gain;
+    }
+
+    return height;
+}
+
+float sample_terrain_height(
+    const terrain_generator_t *generator,
+    float x,
+    float z) {
+    float warp_x = x + generator->warp_amplitude * s_gradient_noise(
+        x * generator->warp_frequency, z * generator->warp_frequency, generator->seed ^ 0x68bc21ebu);
+    float warp_z = z + generator->warp_amplitude * s_gradient_noise(
+        x * generator->warp_frequency + 5.2f, z * generator->warp_frequency + 1.3f, generator->seed ^ 0x02e5be93u);
+
+    float height = generator->base_height;
+
+    for (uint32_t i = 0; i < generator->stage_count; ++i) {
+        uint32_t stage_seed = generator->seed ^ ((i + 1) * 0x9e3779b9u);
+        height += s_sample_stage(&generator->stages[i], stage_seed, warp_x, warp_z);
+    }
+
+    return height;
+}
+
+static voxel_color_t s_terrain_color(
+    const terrain_generator_t *generator,
+    float height,
+    float depth) {
+    for (uint32_t i = 0; i < generator->color_rule_count; ++i) {
+        const terrain_color_rule_t *rule = &generator->color_rules[i];
+
+        if (height >= rule->min_height && height < rule->max_height && depth <= rule->max_depth) {
+            return rule->color;
+        }
+    }
+
+    return generator->default_color;
+}
+
+static bool s_is_in_terrain(
+    const terrain_generator_t *generator,
+    const ivector3_t &chunk_coord) {
+    return
+        chunk_coord.x >= generator->min_chunk.x && chunk_coord.x <= generator->max_chunk.x &&
+        chunk_coord.y >= generator->min_chunk.y && chunk_coord.y <= generator->max_chunk.y &&
+        chunk_coord.z >= generator->min_chunk.z && chunk_coord.z <= generator->max_chunk.z;
+}
+
+bool generate_terrain_chunk_voxels(
+    const terrain_generator_t *generator,
+    const ivector3_t &chunk_coord,
+    voxel_t *linear_voxels) {
+    if (!s_is_in_terrain(generator, chunk_coord)) {
+        return 0;
+    }
+
+    ivector3_t xs_bottom_corner = chunk_coord * (int32_t)CHUNK_EDGE_LENGTH;
+    bool filled = 0;
+
+    for (uint32_t z = 0; z < CHUNK_EDGE_LENGTH; ++z) {
+        for (uint32_t x = 0; x < CHUNK_EDGE_LENGTH; ++x) {
+            float surface_height = sample_terrain_height(
+                generator,
+                (float)(xs_bottom_corner.x + (int32_t)x),
+                (float)(xs_bottom_corner.z + (int32_t)z));
+
+            for (uint32_t y = 0; y < CHUNK_EDGE_LENGTH; ++y) {
+                float height = (float)(xs_bottom_corner.y + (int32_t)y);
+                float depth = surface_height - height;
+                int32_t value = (int32_t)((float)CHUNK_SURFACE_LEVEL + depth * generator->density_gradient);
+
+                voxel_t *voxel = &linear_voxels[get_voxel_index<linear_voxel_layout_t>(x, y, z)];
+                voxel->value = (uint8_t)glm::clamp(value, 0, (int32_t)CHUNK_MAX_VOXEL_VALUE_I);
+                // Map files / packets don't keep the color of empty voxels: cached and generated chunks have to be the same
+                voxel->color = voxel->value ? s_terrain_color(generator, height, depth) : 0;
+
+                filled |= voxel->value != 0;
+            }
+        }
+    }
+
+    return filled;
+}
+
+// Writes the header of the cache file (cache starts empty)
+static void s_reset_terrain_cache() {
+    procedural_terrain_t *terrain = &g_game->terrain;
+
+    uint8_t header[8];
+    serialiser_t serialiser = {};
+    serialiser.data_buffer = header;
+    serialiser.data_buffer_head = 0;
+    serialiser.data_buffer_size = sizeof(header);
+    serialiser.serialise_uint32(TERRAIN_CACHE_MAGIC);
+    serialiser.serialise_uint32(hash_terrain_generator(&terrain->generator));
+
+    write_file_range(terrain->cache_file, 0, header, sizeof(header));
+    terrain->cache_file_size = sizeof(header);
+}
+
+// Starts again with an empty cache file (the chunks get generated again)
+static void s_discard_terrain_cache() {
+    procedural_terrain_t *terrain = &g_game->terrain;
+
+    free_file(terrain->cache_file);
+    terrain->cache_file = create_file(terrain->cache_file_path, FLF_BINARY | FLF_WRITEABLE | FLF_OVERWRITE);
+    terrain->cache_records.clear();
+    s_reset_terrain_cache();
+}
+
+// Builds the index of the chunks which are in the cache file (the voxels stay on disk)
+static void s_read_terrain_cache_index() {
+    procedural_terrain_t *terrain = &g_game->terrain;
+    uint32_t file_size = get_file_size(terrain->cache_file);
+
+    uint8_t header[8];
+    if (file_size < sizeof(header)) {
+        s_reset_terrain_cache();
+        return;
+    }
+
+    read_file_range(terrain->cache_file, 0, header, sizeof(header));
+
+    serialiser_t serialiser = {};
+    serialiser.data_buffer = header;
+    serialiser.data_buffer_head = 0;
+    serialiser.data_buffer_size = sizeof(header);
+
+    uint32_t magic = serialiser.deserialise_uint32();
+    uint32_t hash = serialiser.deserialise_uint32();
+
+    if (magic != TERRAIN_CACHE_MAGIC || hash != hash_terrain_generator(&terrain->generator)) {
+        LOG_WARNING("Terrain cache file doesn't match the generator settings, discarding it\n");
+        s_discard_terrain_cache();
+
+        return;
+    }
+
+    uint32_t offset = sizeof(header);
+
+    // A truncated entry header at the end (if the program stopped while writing it) just gets overwritten
+    while (offset + TERRAIN_CACHE_ENTRY_HEADER_SIZE <= file_size) {
+        uint8_t entry_header[TERRAIN_CACHE_ENTRY_HEADER_SIZE];
+        read_file_range(terrain->cache_file, offset, entry_header, TERRAIN_CACHE_ENTRY_HEADER_SIZE);
+
+        serialiser.data_buffer = entry_header;
+        serialiser.data_buffer_head = 0;
+        serialiser.data_buffer_size = TERRAIN_CACHE_ENTRY_HEADER_SIZE;
+
+        chunk_record_t record = {};
+        record.chunk_coord.x = serialiser.deserialise_int16();
+        record.chunk_coord.y = serialiser.deserialise_int16();
+        record.chunk_coord.z = serialiser.deserialise_int16();
+        record.size = serialiser.deserialise_uint32();
+        record.offset = offset + TERRAIN_CACHE_ENTRY_HEADER_SIZE;
+
+        // The voxels get read into a CHUNK_BYTE_SIZE buffer (see s_get_terrain_chunk_voxels)
+        if (record.size > CHUNK_BYTE_SIZE || record.offset + record.size > file_size) {
+            LOG_WARNING("Terrain cache file is corrupted, discarding it\n");
+            s_discard_terrain_cache();
+
+            return;
+        }
+
+        terrain->cache_records.insert(chunk_coord_key(record.chunk_coord), record);
+        offset = record.offset + record.size;
+    }
+
+    terrain->cache_file_size = offset;
+}
+
+// Appends the voxels of a generated chunk to the cache file (NULL if the chunk is empty)
+static void s_cache_terrain_chunk(
+    const ivector3_t &chunk_coord,
+    const voxel_t *linear_voxels) {
+    procedural_terrain_t *terrain = &g_game->terrain;
+
+    if (!does_file_exist(terrain->cache_file)) {
+        return;
+    }
+
+    uint8_t data[TERRAIN_CACHE_ENTRY_HEADER_SIZE + CHUNK_BYTE_SIZE];
+    serialiser_t serialiser = {};
+    serialiser.data_buffer = data;
+    serialiser.data_buffer_head = TERRAIN_CACHE_ENTRY_HEADER_SIZE;
+    serialiser.data_buffer_size = sizeof(data);
+
+    if (!linear_voxels || !serialise_map_chunk_voxels(&serialiser, linear_voxels)) {
+        serialiser.data_buffer_head = TERRAIN_CACHE_ENTRY_HEADER_SIZE;
+    }
+
+    chunk_record_t record = {};
+    record.chunk_coord = chunk_coord;
+    record.offset = terrain->cache_file_size + TERRAIN_CACHE_ENTRY_HEADER_SIZE;
+    record.size = serialiser.data_buffer_head - TERRAIN_CACHE_ENTRY_HEADER_SIZE;
+
+    uint32_t entry_size = serialiser.data_buffer_head;
+    serialiser.data_buffer_head = 0;
+    serialiser.serialise_int16((int16_t)chunk_coord.x);
+    serialiser.serialise_int16((int16_t)chunk_coord.y);
+    serialiser.serialise_int16((int16_t)chunk_coord.z);
+    serialiser.serialise_uint32(record.size);
+
+    write_file_range(terrain->cache_file, terrain->cache_file_size, data, entry_size);
+    terrain->cache_file_size += entry_size;
+
+    terrain->cache_records.insert(chunk_coord_key(chunk_coord), record);
+}
+
+// Generated voxels of the chunk (from the cache if possible) - returns false if the chunk is empty
+static bool s_get_terrain_chunk_voxels(
+    const ivector3_t &chunk_coord,
+    voxel_t *linear_voxels) {
+    procedural_terrain_t *terrain = &g_game->terrain;
+
+    // Chunks outside of the terrain don't get cached (raycasts etc... can go far)
+    if (!s_is_in_terrain(&terrain->generator, chunk_coord)) {
+        return 0;
+    }
+
+    chunk_record_t *record = terrain->cache_records.get(chunk_coord_key(chunk_coord));
+
+    // Records which don't fit get replaced by the generated chunk
+    if (record && record->size <= CHUNK_BYTE_SIZE && record->offset + record->size <= terrain->cache_file_size) {
+        ++terrain->cache_hit_count;
+
+        if (!record->size) {
+            return 0;
+        }
+
+        uint8_t data[CHUNK_BYTE_SIZE];
+        read_file_range(terrain->cache_file, record->offset, data, record->size);
+
+        serialiser_t serialiser = {};
+        serialiser.data_buffer = data;
+        serialiser.data_buffer_head = 0;
+        serialiser.data_buffer_size = record->size;
+
+        deserialise_map_chunk_voxels(&serialiser, linear_voxels);
+
+        return 1;
+    }
+
+    bool filled = generate_terrain_chunk_voxels(&terrain->generator, chunk_coord, linear_voxels);
+    ++terrain->generated_count;
+
+    s_cache_terrain_chunk(chunk_coord, filled ? linear_voxels : NULL);
+
+    return filled;
+}
+
+static chunk_t *s_add_terrain_chunk(
+    const ivector3_t &chunk_coord,
+    const voxel_t *linear_voxels) {
+    if (!g_game->chunks.removed_count && g_game->chunks.data_count == g_game->chunks.max_size) {
+        LOG_WARNING("Can't load terrain chunk - all the chunk slots are taken\n");
+        return NULL;
+    }
+
+    chunk_t *chunk = g_game->add_chunk(chunk_coord);
+    voxel_t *voxels = get_chunk_voxels_for_write(chunk);
+    memcpy(voxels, linear_voxels, sizeof(voxel_t) * CHUNK_VOXEL_COUNT);
+    reorder_linear_chunk_voxels(voxels);
+    compress_chunk_storage(chunk);
+
+    // Can be generated again
+    chunk->flags.needs_flush = 0;
+
+    return chunk;
+}
+
+map_t *begin_procedural_terrain(
+    const char *process_name) {
+    procedural_terrain_t *terrain = &g_game->terrain;
+    uint32_t hash = hash_terrain_generator(&terrain->generator);
+
+    terrain->cache_records.init(CHUNK_MAX_LOADED_COUNT);
+    terrain->generated_count = 0;
+    terrain->cache_hit_count = 0;
+
+    snprintf(terrain->cache_file_path, sizeof(terrain->cache_file_path), "assets/maps/terrain_%08x_%s.cache", hash, process_name);
+    terrain->cache_file = create_file(terrain->cache_file_path, FLF_BINARY | FLF_WRITEABLE | FLF_UPDATE);
+
+    if (does_file_exist(terrain->cache_file)) {
+        s_read_terrain_cache_index();
+    }
+    else {
+        LOG_ERRORV("Failed to open terrain cache file %s\n", terrain->cache_file_path);
+        terrain->cache_file_size = 0;
+    }
+
+    if (g_game->flags.page_chunks) {
+        // Modified chunks get paged out to the spill file - the others just get generated again
+        char spill_path[64] = {};
+        snprintf(spill_path, sizeof(spill_path), "assets/maps/terrain_%08x.spill", hash);
+        begin_chunk_residency(NULL, spill_path);
+    }
+
+    map_t *map = FL_MALLOC(map_t, 1);
+    memset(map, 0, sizeof(map_t));
+    map->name = "Procedural";
+    map->is_new = 0;
+
+    LOG_INFOV("Procedural terrain with seed %u: %d chunks already in %s\n",
+        terrain->generator.seed, terrain->cache_records.count, terrain->cache_file_path);
+
+    return map;
+}
+
+void end_procedural_terrain() {
+    procedural_terrain_t *terrain = &g_game->terrain;
+
+    free_file(terrain->cache_file);
+    terrain->cache_records.destroy();
+
+    g_game->flags.procedural_terrain = 0;
+}
+
+chunk_t *load_terrain_chunk(
+    const ivector3_t &chunk_coord) {
+    voxel_t linear_voxels[CHUNK_VOXEL_COUNT];
+
+    if (!s_get_terrain_chunk_voxels(chunk_coord, linear_voxels)) {
+        return NULL;
+    }
+
+    return s_add_terrain_chunk(chunk_coord, linear_voxels);
+}
+
+struct terrain_batch_t {
+    const terrain_generator_t *generator;
+    uint32_t count;
+    ivector3_t coords[TERRAIN_GENERATION_BATCH_SIZE];
+    bool filled[TERRAIN_GENERATION_BATCH_SIZE];
+    // TERRAIN_GENERATION_BATCH_SIZE chunks (linear order)
+    voxel_t *voxels;
+};
+
+static void s_generate_batch_chunk(
+    uint32_t item_index,
+    void *data) {
+    terrain_batch_t *batch = (terrain_batch_t *)data;
+
+    batch->filled[item_index] = generate_terrain_chunk_voxels(
+        batch->generator,
+        batch->coords[item_index],
+        &batch->voxels[item_index * CHUNK_VOXEL_COUNT]);
+}
+
+// Generation runs on the thread pool, caching / chunk creation on this thread
+static void s_load_terrain_batch(
+    terrain_batch_t *batch) {
+    procedural_terrain_t *terrain = &g_game->terrain;
+
+    run_parallel(batch->count, s_generate_batch_chunk, batch);
+
+    for (uint32_t i = 0; i < batch->count; ++i) {
+        const voxel_t *voxels = &batch->voxels[i * CHUNK_VOXEL_COUNT];
+        ++terrain->generated_count;
+
+        s_cache_terrain_chunk(batch->coords[i], batch->filled[i] ? voxels : NULL);
+
+        if (batch->filled[i]) {
+            s_add_terrain_chunk(batch->coords[i], voxels);
+        }
+    }
+
+    batch->count = 0;
+}
+
+void load_all_terrain_chunks() {
+    procedural_terrain_t *terrain = &g_game->terrain;
+    const terrain_generator_t *generator = &terrain->generator;
+
+    terrain_batch_t *batch = FL_MALLOC(terrain_batch_t, 1);
+    batch->generator = generator;
+    batch->count = 0;
+    batch->voxels = FL_MALLOC(voxel_t, TERRAIN_GENERATION_BATCH_SIZE * CHUNK_VOXEL_COUNT);
+
+    for (int32_t z = generator->min_chunk.z; z <= generator->max_chunk.z; ++z) {
+        for (int32_t y = generator->min_chunk.y; y <= generator->max_chunk.y; ++y) {
+            for (int32_t x = generator->min_chunk.x; x <= generator->max_chunk.x; ++x) {
+                ivector3_t chunk_coord = ivector3_t(x, y, z);
+
+                if (g_game->access_resident_chunk(chunk_coord)) {
+                    continue;
+                }
+
+                if (terrain->cache_records.get(chunk_coord_key(chunk_coord))) {
+                    load_terrain_chunk(chunk_coord);
+                }
+                else {
+                    batch->coords[batch->count++] = chunk_coord;
+
+                    if (batch->count == TERRAIN_GENERATION_BATCH_SIZE) {
+                        s_load_terrain_batch(batch);
+                    }
+                }
+            }
+        }
+    }
+
+    s_load_terrain_batch(batch);
+
+    FL_FREE(batch->voxels);
+    FL_FREE(batch);
+}
+
+bool is_terrain_chunk_modified(
+    const chunk_t *chunk) {
+    if (chunk->flags.needs_flush) {
+        return 1;
+    }
+
+    // Modified chunks which got paged out and back in have a record in the spill file
+    return g_game->flags.page_chunks && g_game->residency.records.get(chunk_coord_key(chunk->chunk_coord));
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "map.hpp"
+#include "files.hpp"
+#include "chunk.hpp"
+#include "containers.hpp"
+#include "chunk_residency.hpp"
+
+// Seeded procedural terrain (game_t::flags.procedural_terrain) - an alternative to map files
+// The voxels of a chunk only depend on the generator settings and on the chunk coordinate:
+// clients regenerate the terrain from the seed, the server only sends them the chunks which got modified
+
+#define TERRAIN_MAX_NOISE_STAGES 4
+#define TERRAIN_MAX_COLOR_RULES 6
+
+enum terrain_noise_type_t { TNT_FBM, TNT_RIDGED, TNT_INVALID };
+
+// Layer of 2D noise which gets added to the height of the surface
+struct terrain_noise_stage_t {
+    terrain_noise_type_t type;
+    uint32_t octaves;
+    // Frequency of the first octave (per voxel)
+    float frequency;
+    // Frequency / amplitude multipliers between octaves
+    float lacunarity;
+    float gain;
+    // Height (in voxels) of the first octave
+    float amplitude;
+};
+
+// Voxels in [min_height, max_height) which are at most max_depth below the surface
+struct terrain_color_rule_t {
+    float min_height;
+    float max_height;
+    float max_depth;
+    voxel_color_t color;
+};
+
+struct terrain_generator_t {
+    uint32_t seed;
+    // Chunks outside of this box (inclusive) are empty
+    ivector3_t min_chunk;
+    ivector3_t max_chunk;
+    // Height of the surface before the noise gets added
+    float base_height;
+    // Increase of the voxel values per voxel of depth (the surface is at CHUNK_SURFACE_LEVEL)
+    float density_gradient;
+    // The stages get sampled at positions which are offset by noise (domain warping)
+    float warp_frequency;
+    float warp_amplitude;
+
+    uint32_t stage_count;
+    terrain_noise_stage_t stages[TERRAIN_MAX_NOISE_STAGES];
+
+    // First rule which matches gives the color of the voxel
+    uint32_t color_rule_count;
+    terrain_color_rule_t color_rules[TERRAIN_MAX_COLOR_RULES];
+    voxel_color_t default_color;
+};
+
+// Settings of the game's terrain (all that clients need from the server is the seed)
+void make_default_terrain_generator(uint32_t seed, terrain_generator_t *generator);
+// Hash of all the settings (cached chunks are only valid for the same settings)
+uint32_t hash_terrain_generator(const terrain_generator_t *generator);
+
+// Height of the surface at (x, z) in voxel space
+float sample_terrain_height(const terrain_generator_t *generator, float x, float z);
+// Voxels of the chunk (linear order) - returns false if the chunk is empty
+// Only reads the generator, so it can run on any thread
+bool generate_terrain_chunk_voxels(const terrain_generator_t *generator, const ivector3_t &chunk_coord, voxel_t *linear_voxels);
+
+struct procedural_terrain_t {
+    terrain_generator_t generator;
+
+    // Chunks which were generated before (records with size 0 are empty chunks), see serialise_map_chunk_voxels for the format
+    open_hash_table_t<chunk_record_t> cache_records;
+    file_handle_t cache_file;
+    uint32_t cache_file_size;
+    char cache_file_path[64];
+
+    // Statistics
+    uint32_t generated_count;
+    uint32_t cache_hit_count;
+};
+
+// Called by game_t::start_session instead of load_map (opens the cache file, starts chunk paging if needed)
+// Each process gets its own cache file (process_name is "server" or "client"): they would overwrite each other's entries
+map_t *begin_procedural_terrain(const char *process_name);
+// Closes the cache file (the cache file stays on disk)
+void end_procedural_terrain();
+
+// Makes the chunk resident with its generated voxels (NULL if the chunk is empty, or if game_t::chunks is full)
+chunk_t *load_terrain_chunk(const ivector3_t &chunk_coord);
+// Loads every chunk of the terrain which isn't empty (what isn't cached yet gets generated on the thread pool)
+void load_all_terrain_chunks();
+// Whether the voxels of a resident chunk may differ from the generated ones (these have to be sent to new clients)
+bool is_terrain_chunk_modified(const chunk_t *chunk);
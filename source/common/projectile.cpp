@@ -0,0 +1,299 @@
+#include "projectile.hpp"
+#include "constant.hpp"
+#include "allocators.hpp"
+
+// s_integrate_rocks_avx2 doesn't need the build to target AVX2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PROJECTILE_AVX2 1
+#include <immintrin.h>
+#endif
+
+void rock_store_t::init(uint32_t max) {
+    max_count = max;
+    count = 0;
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        positions[i] = FL_MALLOC(float, max_count);
+        directions[i] = FL_MALLOC(float, max_count);
+        ups[i] = FL_MALLOC(float, max_count);
+    }
+
+    client_ids = FL_MALLOC(uint16_t, max_count);
+    flags = FL_MALLOC(rock_flags_t, max_count);
+    handles = FL_MALLOC(rock_handle_t, max_count);
+
+    slot_indices = FL_MALLOC(uint32_t, max_count);
+    slot_generations = FL_MALLOC(uint16_t, max_count);
+    free_slots = FL_MALLOC(uint32_t, max_count);
+
+    // First spawns get the first slots
+    free_slot_count = max_count;
+    for (uint32_t i = 0; i < max_count; ++i) {
+        slot_indices[i] = ROCK_INVALID_INDEX;
+        slot_generations[i] = 0;
+        free_slots[i] = max_count - 1 - i;
+    }
+
+    // There can't be more recent rocks alive than rocks (see spawn)
+    recent_count = 0;
+    recent = FL_MALLOC(rock_handle_t, max_count);
+    recent_removed = FL_MALLOC(rock_snapshot_t, max_count);
+    slot_recent_indices = FL_MALLOC(uint32_t, max_count);
+
+    for (uint32_t i = 0; i < max_count; ++i) {
+        slot_recent_indices[i] = ROCK_INVALID_INDEX;
+    }
+}
+
+void rock_store_t::destroy() {
+    for (uint32_t i = 0; i < 3; ++i) {
+        FL_FREE(positions[i]);
+        FL_FREE(directions[i]);
+        FL_FREE(ups[i]);
+    }
+
+    FL_FREE(client_ids);
+    FL_FREE(flags);
+    FL_FREE(handles);
+    FL_FREE(slot_indices);
+    FL_FREE(slot_generations);
+    FL_FREE(free_slots);
+    FL_FREE(recent);
+    FL_FREE(recent_removed);
+    FL_FREE(slot_recent_indices);
+
+    count = 0;
+    max_count = 0;
+}
+
+rock_handle_t rock_store_t::spawn(
+    const vector3_t &position,
+    const vector3_t &direction,
+    const vector3_t &up,
+    uint16_t client_id,
+    uint32_t ref_idx_obj,
+    uint32_t ref_idx_weapon) {
+    if (count == max_count) {
+        return ROCK_INVALID_HANDLE;
+    }
+
+    uint32_t slot = free_slots[--free_slot_count];
+    rock_handle_t handle = slot | ((uint32_t)slot_generations[slot] << ROCK_HANDLE_SLOT_BITS);
+
+    uint32_t idx = count++;
+    slot_indices[slot] = idx;
+    handles[idx] = handle;
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        positions[i][idx] = position[i];
+        directions[i][idx] = direction[i];
+        ups[i][idx] = up[i];
+    }
+
+    client_ids[idx] = client_id;
+    flags[idx].spawned_locally = 0;
+    flags[idx].ref_idx_obj = ref_idx_obj;
+    flags[idx].ref_idx_weapon = ref_idx_weapon;
+
+    // More rocks than the store holds spawned since the last snapshot: only then do the ones which were removed get dropped
+    if (recent_count == max_count) {
+        uint32_t alive_count = 0;
+        for (uint32_t i = 0; i < recent_count; ++i) {
+            uint32_t alive_idx = get_index(recent[i]);
+
+            if (alive_idx != ROCK_INVALID_INDEX) {
+                slot_recent_indices[recent[i] & ((1 << ROCK_HANDLE_SLOT_BITS) - 1)] = alive_count;
+                recent[alive_count++] = recent[i];
+            }
+        }
+
+        recent_count = alive_count;
+    }
+
+    slot_recent_indices[slot] = recent_count;
+    recent[recent_count++] = handle;
+
+    return handle;
+}
+
+uint32_t rock_store_t::get_index(rock_handle_t handle) const {
+    uint32_t slot = handle & ((1 << ROCK_HANDLE_SLOT_BITS) - 1);
+    uint32_t generation = handle >> ROCK_HANDLE_SLOT_BITS;
+
+    if (slot >= max_count || slot_generations[slot] != generation) {
+        return ROCK_INVALID_INDEX;
+    }
+
+    return slot_indices[slot];
+}
+
+rock_t rock_store_t::get(uint32_t idx) const {
+    rock_t rock;
+    rock.flags = flags[idx];
+    rock.position = get_position(idx);
+    rock.direction = vector3_t(directions[0][idx], directions[1][idx], directions[2][idx]);
+    rock.up = vector3_t(ups[0][idx], ups[1][idx], ups[2][idx]);
+    rock.client_id = client_ids[idx];
+
+    return rock;
+}
+
+vector3_t rock_store_t::get_position(uint32_t idx) const {
+    return vector3_t(positions[0][idx], positions[1][idx], positions[2][idx]);
+}
+
+void rock_store_t::remove(uint32_t idx) {
+    // The handle of the rock doesn't point to anything anymore
+    uint32_t slot = handles[idx] & ((1 << ROCK_HANDLE_SLOT_BITS) - 1);
+
+    // The next snapshot still has to spawn the rock
+    if (slot_recent_indices[slot] != ROCK_INVALID_INDEX) {
+        rock_snapshot_t *removed = &recent_removed[slot_recent_indices[slot]];
+        removed->position = get_position(idx);
+        removed->direction = vector3_t(directions[0][idx], directions[1][idx], directions[2][idx]);
+        removed->up = vector3_t(ups[0][idx], ups[1][idx], ups[2][idx]);
+        removed->client_id = client_ids[idx];
+
+        slot_recent_indices[slot] = ROCK_INVALID_INDEX;
+    }
+
+    slot_indices[slot] = ROCK_INVALID_INDEX;
+    slot_generations[slot] = (slot_generations[slot] + 1) & ROCK_HANDLE_GENERATION_MASK;
+    free_slots[free_slot_count++] = slot;
+
+    uint32_t last = --count;
+
+    if (idx != last) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            positions[i][idx] = positions[i][last];
+            directions[i][idx] = directions[i][last];
+            ups[i][idx] = ups[i][last];
+        }
+
+        client_ids[idx] = client_ids[last];
+        flags[idx] = flags[last];
+        handles[idx] = handles[last];
+
+        slot_indices[handles[idx] & ((1 << ROCK_HANDLE_SLOT_BITS) - 1)] = idx;
+    }
+}
+
+rock_snapshot_t rock_store_t::get_recent(uint32_t recent_idx) const {
+    uint32_t idx = get_index(recent[recent_idx]);
+
+    if (idx == ROCK_INVALID_INDEX) {
+        return recent_removed[recent_idx];
+    }
+
+    rock_snapshot_t snapshot;
+    snapshot.position = get_position(idx);
+    snapshot.direction = vector3_t(directions[0][idx], directions[1][idx], directions[2][idx]);
+    snapshot.up = vector3_t(ups[0][idx], ups[1][idx], ups[2][idx]);
+    snapshot.client_id = client_ids[idx];
+
+    return snapshot;
+}
+
+void rock_store_t::clear_recent() {
+    for (uint32_t i = 0; i < recent_count; ++i) {
+        uint32_t slot = recent[i] & ((1 << ROCK_HANDLE_SLOT_BITS) - 1);
+
+        // The slot may have been reused by a rock which isn't recent since
+        if (slot_recent_indices[slot] == i) {
+            slot_recent_indices[slot] = ROCK_INVALID_INDEX;
+        }
+    }
+
+    recent_count = 0;
+}
+
+void rock_store_t::integrate(float dt) {
+    get_rock_integration_kernel()(positions, directions, ups, count, dt);
+}
+
+// Same operations, in the same order as tick_rock
+static void s_integrate_rocks_scalar(
+    float *const positions[3],
+    float *const directions[3],
+    float *const ups[3],
+    uint32_t rock_count,
+    float dt) {
+    for (uint32_t i = 0; i < 3; ++i) {
+        float *p = positions[i], *d = directions[i];
+        const float *u = ups[i];
+
+        for (uint32_t r = 0; r < rock_count; ++r) {
+            p[r] = p[r] + d[r] * dt;
+            d[r] = d[r] - u[r] * dt * GRAVITY_ACCELERATION;
+        }
+    }
+}
+
+#if defined(PROJECTILE_AVX2)
+
+__attribute__((target("avx2"))) static void s_integrate_rocks_avx2(
+    float *const positions[3],
+    float *const directions[3],
+    float *const ups[3],
+    uint32_t rock_count,
+    float dt) {
+    __m256 dt_8 = _mm256_set1_ps(dt);
+    __m256 gravity = _mm256_set1_ps(GRAVITY_ACCELERATION);
+    uint32_t simd_count = rock_count & ~7u;
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        float *p = positions[i], *d = directions[i];
+        const float *u = ups[i];
+
+        for (uint32_t r = 0; r < simd_count; r += 8) {
+            __m256 direction = _mm256_loadu_ps(d + r);
+            __m256 fall = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(u + r), dt_8), gravity);
+
+            _mm256_storeu_ps(p + r, _mm256_add_ps(_mm256_loadu_ps(p + r), _mm256_mul_ps(direction, dt_8)));
+            _mm256_storeu_ps(d + r, _mm256_sub_ps(direction, fall));
+        }
+
+        for (uint32_t r = simd_count; r < rock_count; ++r) {
+            p[r] = p[r] + d[r] * dt;
+            d[r] = d[r] - u[r] * dt * GRAVITY_ACCELERATION;
+        }
+    }
+}
+
+#endif
+
+static rock_integration_kernel_t s_integration_kernel = NULL;
+
+rock_integration_kernel_t get_rock_integration_kernel() {
+    if (!s_integration_kernel) {
+        if (!set_rock_integration_kernel(RKT_AVX2)) {
+            set_rock_integration_kernel(RKT_SCALAR);
+        }
+    }
+
+    return s_integration_kernel;
+}
+
+bool set_rock_integration_kernel(rock_kernel_type_t type) {
+    switch (type) {
+    case RKT_SCALAR: {
+        s_integration_kernel = s_integrate_rocks_scalar;
+        return 1;
+    }
+
+#if defined(PROJECTILE_AVX2)
+    case RKT_AVX2: {
+        if (__builtin_cpu_supports("avx2")) {
+            s_integration_kernel = s_integrate_rocks_avx2;
+            return 1;
+        }
+
+        return 0;
+    }
+#endif
+
+    default: {
+        return 0;
+    }
+    }
+}
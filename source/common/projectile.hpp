@@ -0,0 +1,83 @@
+#pragma once
+
+#include "weapon.hpp"
+
+// Handle of a rock which stays the same while the rock is alive (rocks move around in the store when others get removed)
+// Low bits are the slot in the handle table, high bits the generation of the slot (handles of removed rocks don't point to new ones)
+// Fits in projectile_obj_reference_t::idx
+typedef uint32_t rock_handle_t;
+
+enum {
+    ROCK_HANDLE_SLOT_BITS = 16,
+    ROCK_HANDLE_GENERATION_MASK = 0x7FFF,
+    ROCK_INVALID_HANDLE = 0xFFFFFFFF,
+    ROCK_INVALID_INDEX = 0xFFFFFFFF
+};
+
+// All the rocks of the game, stored as arrays of each component
+// Rocks [0, count) are all alive - removing a rock moves the last one into its place
+struct rock_store_t {
+    uint32_t max_count;
+    uint32_t count;
+
+    // [axis][rock]
+    float *positions[3];
+    float *directions[3];
+    float *ups[3];
+    uint16_t *client_ids;
+    rock_flags_t *flags;
+    rock_handle_t *handles;
+
+    // Handle slot -> index of the rock (free slots are in a stack)
+    uint32_t *slot_indices;
+    uint16_t *slot_generations;
+    uint32_t free_slot_count;
+    uint32_t *free_slots;
+
+    // Rocks that were spawned since the last clear_recent() - they all go in the next snapshot, even the ones which have been
+    // removed since (point blank shots), with the state they were removed in
+    uint32_t recent_count;
+    rock_handle_t *recent;
+    rock_snapshot_t *recent_removed;
+    // Handle slot -> index in recent (ROCK_INVALID_INDEX if the rock of the slot isn't in there)
+    uint32_t *slot_recent_indices;
+
+    void init(uint32_t max);
+    void destroy();
+
+    // Returns ROCK_INVALID_HANDLE if every rock slot is used
+    rock_handle_t spawn(
+        const vector3_t &position,
+        const vector3_t &direction,
+        const vector3_t &up,
+        uint16_t client_id,
+        uint32_t ref_idx_obj,
+        uint32_t ref_idx_weapon);
+
+    // ROCK_INVALID_INDEX if the rock was removed
+    uint32_t get_index(rock_handle_t handle) const;
+    rock_t get(uint32_t idx) const;
+    vector3_t get_position(uint32_t idx) const;
+
+    void remove(uint32_t idx);
+    // State that the recent rock is in now, or was in when it got removed
+    rock_snapshot_t get_recent(uint32_t recent_idx) const;
+    void clear_recent();
+
+    // Moves all the rocks by a tick (same results as calling tick_rock on each rock)
+    void integrate(float dt);
+};
+
+// Integrates rock_count rocks: position += direction * dt, direction -= up * dt * gravity
+typedef void (* rock_integration_kernel_t)(
+    float *const positions[3],
+    float *const directions[3],
+    float *const ups[3],
+    uint32_t rock_count,
+    float dt);
+
+enum rock_kernel_type_t { RKT_SCALAR, RKT_AVX2, RKT_INVALID };
+
+// The AVX2 kernel moves 8 rocks per iteration (4 wide SSE2 loads and stores were slower than the scalar loop)
+rock_integration_kernel_t get_rock_integration_kernel();
+bool set_rock_integration_kernel(rock_kernel_type_t type);
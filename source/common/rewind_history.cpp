@@ -0,0 +1,205 @@
+#include "rewind_history.hpp"
+#include "game.hpp"
+#include "allocators.hpp"
+#include <float.h>
+
+void rewind_history_t::init() {
+    frames = FL_MALLOC(rewind_frame_t, NET_SERVER_REWIND_FRAME_COUNT);
+    first = 0;
+    frame_count = 0;
+    time = 0.0;
+}
+
+void rewind_history_t::destroy() {
+    FL_FREE(frames);
+    frames = NULL;
+    frame_count = 0;
+}
+
+const rewind_frame_t *rewind_history_t::get_frame(uint32_t i) const {
+    return &frames[(first + i) % NET_SERVER_REWIND_FRAME_COUNT];
+}
+
+void rewind_history_t::record(uint64_t tick, float dt) {
+    // The session got restarted
+    if (frame_count && get_frame(frame_count - 1)->tick >= tick) {
+        first = 0;
+        frame_count = 0;
+    }
+
+    time += (double)dt;
+
+    rewind_frame_t *frame;
+    if (frame_count == NET_SERVER_REWIND_FRAME_COUNT) {
+        // Overwrites the oldest frame
+        frame = &frames[first];
+        first = (first + 1) % NET_SERVER_REWIND_FRAME_COUNT;
+    }
+    else {
+        frame = &frames[(first + frame_count++) % NET_SERVER_REWIND_FRAME_COUNT];
+    }
+
+    frame->tick = tick;
+    frame->time = time;
+
+    for (uint32_t i = 0; i < PLAYER_MAX_COUNT; ++i) {
+        frame->players[i].recorded = 0;
+    }
+
+    for (uint32_t i = 0; i < g_game->players.data_count; ++i) {
+        player_t *p = g_game->players[i];
+
+        if (p) {
+            frame->players[i].ws_position = p->ws_position;
+            frame->players[i].ws_up_vector = p->ws_up_vector;
+            frame->players[i].client_id = p->client_id;
+            frame->players[i].interaction_mode = p->flags.interaction_mode;
+            frame->players[i].recorded = 1;
+        }
+    }
+}
+
+// Index of the last frame whose tick is <= tick (0 if all of them are after)
+static uint32_t s_find_frame(const rewind_history_t *history, double tick) {
+    uint32_t lo = 0, hi = history->frame_count - 1;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+
+        if ((double)history->get_frame(mid)->tick <= tick) {
+            lo = mid;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+
+    return lo;
+}
+
+double rewind_history_t::get_tick_before(float seconds) const {
+    if (!frame_count) {
+        return 0.0;
+    }
+
+    const rewind_frame_t *newest = get_frame(frame_count - 1);
+    double target = newest->time - (double)seconds;
+
+    if (target <= get_frame(0)->time) {
+        return (double)get_frame(0)->tick;
+    }
+
+    if (target >= newest->time) {
+        return (double)newest->tick;
+    }
+
+    // Last frame at or before the target time
+    uint32_t lo = 0, hi = frame_count - 1;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+
+        if (get_frame(mid)->time <= target) {
+            lo = mid;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+
+    const rewind_frame_t *a = get_frame(lo);
+    const rewind_frame_t *b = get_frame(lo + 1);
+    double progression = (target - a->time) / (b->time - a->time);
+
+    return (double)a->tick + progression * (double)(b->tick - a->tick);
+}
+
+bool rewind_history_t::rewind_world(double tick, rewind_view_t *view) const {
+    if (!frame_count) {
+        return 0;
+    }
+
+    uint32_t i = s_find_frame(this, tick);
+    view->before = get_frame(i);
+
+    if (i == frame_count - 1 || tick <= (double)view->before->tick) {
+        view->after = view->before;
+        view->progression = 0.0f;
+    }
+    else {
+        view->after = get_frame(i + 1);
+        view->progression = (float)((tick - (double)view->before->tick) / (double)(view->after->tick - view->before->tick));
+    }
+
+    return 1;
+}
+
+bool rewind_history_t::get_player(const rewind_view_t *view, uint32_t local_id, uint16_t client_id, rewound_player_t *dst) const {
+    const auto *before = &view->before->players[local_id];
+    const auto *after = &view->after->players[local_id];
+
+    bool has_before = before->recorded && before->client_id == client_id;
+    bool has_after = after->recorded && after->client_id == client_id;
+
+    if (!has_before && !has_after) {
+        return 0;
+    }
+
+    // Player joined / left between the two ticks
+    if (!has_before || !has_after) {
+        const auto *only = has_before ? before : after;
+        dst->ws_position = only->ws_position;
+        dst->ws_up_vector = only->ws_up_vector;
+        dst->interaction_mode = only->interaction_mode;
+
+        return 1;
+    }
+
+    dst->ws_position = before->ws_position + (after->ws_position - before->ws_position) * view->progression;
+
+    // The up vector / shape are the ones of the nearest tick
+    const auto *nearest = view->progression < 0.5f ? before : after;
+    dst->ws_up_vector = nearest->ws_up_vector;
+    dst->interaction_mode = nearest->interaction_mode;
+
+    return 1;
+}
+
+bool rewind_history_t::get_position_bounds(double since_tick, uint32_t local_id, uint16_t client_id, vector3_t *ws_min, vector3_t *ws_max) const {
+    if (!frame_count) {
+        return 0;
+    }
+
+    bool found = 0;
+    *ws_min = vector3_t(FLT_MAX);
+    *ws_max = vector3_t(-FLT_MAX);
+
+    // From the frame before since_tick (rewinding to since_tick interpolates between it and the next one)
+    for (uint32_t i = s_find_frame(this, since_tick); i < frame_count; ++i) {
+        const auto *state = &get_frame(i)->players[local_id];
+
+        if (state->recorded && state->client_id == client_id) {
+            *ws_min = glm::min(*ws_min, state->ws_position);
+            *ws_max = glm::max(*ws_max, state->ws_position);
+            found = 1;
+        }
+    }
+
+    return found;
+}
+
+bool collide_sphere_with_rewound_player(const rewound_player_t *player, const vector3_t &center, float radius) {
+    if (player->interaction_mode == PIM_STANDING ||
+        player->interaction_mode == PIM_FLOATING) {
+        return collide_sphere_with_standing_player(
+            player->ws_position,
+            player->ws_up_vector,
+            center,
+            radius);
+    }
+    else {
+        return collide_sphere_with_rolling_player(
+            player->ws_position,
+            center,
+            radius);
+    }
+}
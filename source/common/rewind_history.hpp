@@ -0,0 +1,65 @@
+#pragma once
+
+#include "math.hpp"
+#include "player.hpp"
+#include "constant.hpp"
+
+// What hit checks need to know about a player at a past tick
+struct rewound_player_t {
+    vector3_t ws_position;
+    vector3_t ws_up_vector;
+    uint32_t interaction_mode;
+};
+
+// State of all the players at the end of a simulation tick
+struct rewind_frame_t {
+    uint64_t tick;
+    // Accumulated dt of the ticks (ticks don't all last as long)
+    double time;
+
+    struct {
+        vector3_t ws_position;
+        vector3_t ws_up_vector;
+        uint16_t client_id;
+        uint8_t interaction_mode;
+        // Whether there was a player with this local id at that tick
+        uint8_t recorded;
+    } players[PLAYER_MAX_COUNT];
+};
+
+// Two recorded ticks around the tick that the world got rewound to
+struct rewind_view_t {
+    const rewind_frame_t *before;
+    const rewind_frame_t *after;
+    float progression;
+};
+
+// Recorded state of every player for the last NET_SERVER_REWIND_FRAME_COUNT ticks (used by the server for lag compensation)
+// Frames are in a ring, sorted by tick: lookups are binary searches
+struct rewind_history_t {
+    rewind_frame_t *frames;
+    // Index of the oldest frame
+    uint32_t first;
+    uint32_t frame_count;
+    double time;
+
+    void init();
+    void destroy();
+
+    // Records the players of g_game (has to be called once per simulation tick, after the players moved)
+    void record(uint64_t tick, float dt);
+
+    // Fractional tick at which the world was `seconds` before the last recorded tick (clamped to the recorded ticks)
+    double get_tick_before(float seconds) const;
+    // Returns false if nothing was recorded yet
+    bool rewind_world(double tick, rewind_view_t *view) const;
+    // Returns false if the player (local id / client id) wasn't there at that tick
+    bool get_player(const rewind_view_t *view, uint32_t local_id, uint16_t client_id, rewound_player_t *dst) const;
+    // Box around all the recorded positions of the player since that tick (doesn't include the player's collision shapes)
+    bool get_position_bounds(double since_tick, uint32_t local_id, uint16_t client_id, vector3_t *ws_min, vector3_t *ws_max) const;
+
+    const rewind_frame_t *get_frame(uint32_t i) const;
+};
+
+// Same checks as collide_sphere_with_player, with the state the player had at a past tick
+bool collide_sphere_with_rewound_player(const rewound_player_t *player, const vector3_t &center, float radius);
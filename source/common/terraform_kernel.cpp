@@ -0,0 +1,202 @@
+#include "terraform_kernel.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAFORM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Built with a target attribute, used if __builtin_cpu_supports says so
+#if defined(TERRAFORM_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TERRAFORM_AVX2 1
+#include <immintrin.h>
+#endif
+
+static uint32_t s_terraform_row_scalar(
+    voxel_t *row,
+    int32_t x_min,
+    int32_t x_max,
+    int32_t yz_distance_squared,
+    const terraform_brush_t *brush) {
+    uint32_t changed = 0;
+
+    for (int32_t x = x_min; x <= x_max; ++x) {
+        int32_t dx = x - brush->center_x;
+        float distance_squared = (float)(dx * dx + yz_distance_squared);
+
+        if (distance_squared <= brush->radius_squared) {
+            float proportion = 1.0f - (distance_squared / brush->radius_squared);
+            int32_t new_value = (int32_t)(proportion * brush->coeff * brush->dt * brush->speed) + (int32_t)row[x].value;
+            uint8_t value = (uint8_t)glm::clamp(new_value, 0, (int32_t)CHUNK_MAX_VOXEL_VALUE_I);
+
+            changed |= (uint32_t)(value != row[x].value) << x;
+
+            row[x].value = value;
+            row[x].color = brush->color;
+        }
+    }
+
+    return changed;
+}
+
+#if defined(TERRAFORM_SSE2)
+
+// Second half of the SIMD kernels: deltas / inside masks are 4 groups of 4 int32 lanes (x from 0 to 15)
+// The values are added with 16-bit saturation (the int32 deltas get saturated to 16 bits first, which clamps to the same values)
+static inline uint32_t s_write_terraform_row_sse2(
+    voxel_t *row,
+    int32_t x_min,
+    int32_t x_max,
+    const __m128i *deltas,
+    const __m128i *inside,
+    voxel_color_t color) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i max_value = _mm_set1_epi16(CHUNK_MAX_VOXEL_VALUE_I);
+    __m128i low_byte = _mm_set1_epi16(0xFF);
+    __m128i brush_color = _mm_set1_epi16(color);
+    __m128i lower_bound = _mm_set1_epi16((int16_t)(x_min - 1));
+    __m128i upper_bound = _mm_set1_epi16((int16_t)(x_max + 1));
+
+    __m128i changed[2];
+
+    for (uint32_t h = 0; h < 2; ++h) {
+        __m128i x = _mm_add_epi16(_mm_set_epi16(7, 6, 5, 4, 3, 2, 1, 0), _mm_set1_epi16((int16_t)(h * 8)));
+        __m128i in_range = _mm_and_si128(_mm_cmpgt_epi16(x, lower_bound), _mm_cmplt_epi16(x, upper_bound));
+        __m128i mask = _mm_and_si128(_mm_packs_epi32(inside[h * 2], inside[h * 2 + 1]), in_range);
+
+        // voxel_t is color (low byte) + value (high byte)
+        __m128i voxels = _mm_loadu_si128((const __m128i *)&row[h * 8]);
+        __m128i old_values = _mm_srli_epi16(voxels, 8);
+        __m128i old_colors = _mm_and_si128(voxels, low_byte);
+
+        __m128i delta = _mm_packs_epi32(deltas[h * 2], deltas[h * 2 + 1]);
+        __m128i new_values = _mm_min_epi16(_mm_max_epi16(_mm_adds_epi16(old_values, delta), zero), max_value);
+
+        changed[h] = _mm_andnot_si128(_mm_cmpeq_epi16(new_values, old_values), mask);
+
+        __m128i values = _mm_or_si128(_mm_and_si128(mask, new_values), _mm_andnot_si128(mask, old_values));
+        __m128i colors = _mm_or_si128(_mm_and_si128(mask, brush_color), _mm_andnot_si128(mask, old_colors));
+
+        _mm_storeu_si128((__m128i *)&row[h * 8], _mm_or_si128(_mm_slli_epi16(values, 8), colors));
+    }
+
+    return (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(changed[0], changed[1]));
+}
+
+static uint32_t s_terraform_row_sse2(
+    voxel_t *row,
+    int32_t x_min,
+    int32_t x_max,
+    int32_t yz_distance_squared,
+    const terraform_brush_t *brush) {
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 radius_squared = _mm_set1_ps(brush->radius_squared);
+    __m128 coeff = _mm_set1_ps(brush->coeff);
+    __m128 dt = _mm_set1_ps(brush->dt);
+    __m128 speed = _mm_set1_ps(brush->speed);
+    __m128 yz = _mm_set1_ps((float)yz_distance_squared);
+    __m128i center = _mm_set1_epi32(brush->center_x);
+
+    __m128i deltas[4];
+    __m128i inside[4];
+
+    for (uint32_t g = 0; g < 4; ++g) {
+        __m128i x = _mm_add_epi32(_mm_set_epi32(3, 2, 1, 0), _mm_set1_epi32(g * 4));
+        // Squares and sums of small integers are exact: same distances as the scalar kernel
+        __m128 dx = _mm_cvtepi32_ps(_mm_sub_epi32(x, center));
+        __m128 distance_squared = _mm_add_ps(_mm_mul_ps(dx, dx), yz);
+
+        inside[g] = _mm_castps_si128(_mm_cmple_ps(distance_squared, radius_squared));
+
+        __m128 proportion = _mm_sub_ps(one, _mm_div_ps(distance_squared, radius_squared));
+        __m128 amount = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(proportion, coeff), dt), speed);
+        deltas[g] = _mm_cvttps_epi32(amount);
+    }
+
+    return s_write_terraform_row_sse2(row, x_min, x_max, deltas, inside, brush->color);
+}
+
+#endif
+
+#if defined(TERRAFORM_AVX2)
+
+__attribute__((target("avx2"))) static uint32_t s_terraform_row_avx2(
+    voxel_t *row,
+    int32_t x_min,
+    int32_t x_max,
+    int32_t yz_distance_squared,
+    const terraform_brush_t *brush) {
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 radius_squared = _mm256_set1_ps(brush->radius_squared);
+    __m256 coeff = _mm256_set1_ps(brush->coeff);
+    __m256 dt = _mm256_set1_ps(brush->dt);
+    __m256 speed = _mm256_set1_ps(brush->speed);
+    __m256 yz = _mm256_set1_ps((float)yz_distance_squared);
+    __m256i center = _mm256_set1_epi32(brush->center_x);
+
+    __m128i deltas[4];
+    __m128i inside[4];
+
+    for (uint32_t g = 0; g < 2; ++g) {
+        __m256i x = _mm256_add_epi32(_mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0), _mm256_set1_epi32(g * 8));
+        __m256 dx = _mm256_cvtepi32_ps(_mm256_sub_epi32(x, center));
+        __m256 distance_squared = _mm256_add_ps(_mm256_mul_ps(dx, dx), yz);
+
+        __m256i inside_mask = _mm256_castps_si256(_mm256_cmp_ps(distance_squared, radius_squared, _CMP_LE_OQ));
+
+        __m256 proportion = _mm256_sub_ps(one, _mm256_div_ps(distance_squared, radius_squared));
+        __m256 amount = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(proportion, coeff), dt), speed);
+        __m256i delta = _mm256_cvttps_epi32(amount);
+
+        deltas[g * 2] = _mm256_castsi256_si128(delta);
+        deltas[g * 2 + 1] = _mm256_extracti128_si256(delta, 1);
+        inside[g * 2] = _mm256_castsi256_si128(inside_mask);
+        inside[g * 2 + 1] = _mm256_extracti128_si256(inside_mask, 1);
+    }
+
+    return s_write_terraform_row_sse2(row, x_min, x_max, deltas, inside, brush->color);
+}
+
+#endif
+
+static terraform_row_kernel_t s_row_kernel = NULL;
+
+terraform_row_kernel_t get_terraform_row_kernel() {
+    if (!s_row_kernel) {
+        if (!set_terraform_row_kernel(TKT_AVX2) && !set_terraform_row_kernel(TKT_SSE2)) {
+            set_terraform_row_kernel(TKT_SCALAR);
+        }
+    }
+
+    return s_row_kernel;
+}
+
+bool set_terraform_row_kernel(terraform_kernel_type_t type) {
+    switch (type) {
+    case TKT_SCALAR: {
+        s_row_kernel = s_terraform_row_scalar;
+        return 1;
+    }
+
+#if defined(TERRAFORM_SSE2)
+    case TKT_SSE2: {
+        s_row_kernel = s_terraform_row_sse2;
+        return 1;
+    }
+#endif
+
+#if defined(TERRAFORM_AVX2)
+    case TKT_AVX2: {
+        if (__builtin_cpu_supports("avx2")) {
+            s_row_kernel = s_terraform_row_avx2;
+            return 1;
+        }
+
+        return 0;
+    }
+#endif
+
+    default: {
+        return 0;
+    }
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "chunk.hpp"
+
+// Row kernels of the terraforming brush (terraform() clips the brush against each chunk and runs one of these on every row)
+
+struct terraform_brush_t {
+    // X coordinate of the brush center, relative to the chunk (may be outside of it)
+    int32_t center_x;
+    float radius_squared;
+    // (1 - distance^2 / radius^2) * coeff * dt * speed gets added to the voxels (always multiplied in that order)
+    float coeff;
+    float dt;
+    float speed;
+    voxel_color_t color;
+};
+
+// Applies the brush to the voxels [x_min, x_max] of a row of CHUNK_EDGE_LENGTH voxels (x order)
+// yz_distance_squared: squared distance between the row and the brush center on the y / z axes
+// Returns a mask of the voxels whose value changed (the color of every voxel in the brush gets set)
+typedef uint32_t (* terraform_row_kernel_t)(
+    voxel_t *row,
+    int32_t x_min,
+    int32_t x_max,
+    int32_t yz_distance_squared,
+    const terraform_brush_t *brush);
+
+enum terraform_kernel_type_t { TKT_SCALAR, TKT_SSE2, TKT_AVX2, TKT_INVALID };
+
+// The SIMD row kernels saturate the values 16 voxels at a time and write the same voxels as the scalar loop
+terraform_row_kernel_t get_terraform_row_kernel();
+bool set_terraform_row_kernel(terraform_kernel_type_t type);
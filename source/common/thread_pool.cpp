@@ -0,0 +1,150 @@
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include "thread_pool.hpp"
+#include <condition_variable>
+
+// Never gets destroyed: the server can exit() from a signal handler while the workers are waiting
+struct thread_pool_t {
+    std::thread workers[THREAD_POOL_MAX_WORKERS];
+    uint32_t worker_count;
+    bool started;
+    bool running;
+
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable job_done;
+
+    // Current job (workers wait for job_id to change)
+    uint64_t job_id;
+    parallel_proc_t proc;
+    void *data;
+    uint32_t item_count;
+    std::atomic<uint32_t> next_item;
+    // The next job can only start once every worker finished the current one
+    uint32_t finished_count;
+};
+
+static thread_pool_t *pool = NULL;
+
+static void s_do_items(parallel_proc_t proc, void *data, uint32_t item_count) {
+    for (uint32_t i = pool->next_item++; i < item_count; i = pool->next_item++) {
+        proc(i, data);
+    }
+}
+
+static void s_worker(uint64_t last_job_id) {
+    for (;;) {
+        parallel_proc_t proc;
+        void *data;
+        uint32_t item_count;
+
+        {
+            std::unique_lock<std::mutex> lock (pool->mutex);
+            pool->job_ready.wait(lock, [&last_job_id] { return !pool->running || pool->job_id != last_job_id; });
+
+            if (!pool->running) {
+                return;
+            }
+
+            last_job_id = pool->job_id;
+            proc = pool->proc;
+            data = pool->data;
+            item_count = pool->item_count;
+        }
+
+        s_do_items(proc, data, item_count);
+
+        {
+            std::unique_lock<std::mutex> lock (pool->mutex);
+            if (++pool->finished_count == pool->worker_count) {
+                pool->job_done.notify_one();
+            }
+        }
+    }
+}
+
+static void s_start_workers() {
+    if (!pool) {
+        pool = new thread_pool_t;
+        pool->job_id = 0;
+        pool->finished_count = 0;
+        pool->started = 0;
+        pool->running = 0;
+
+        // Calling thread works too
+        uint32_t hardware_threads = std::thread::hardware_concurrency();
+        pool->worker_count = MIN(MAX(hardware_threads, 1u) - 1, (uint32_t)THREAD_POOL_MAX_WORKERS);
+    }
+
+    if (!pool->started) {
+        pool->running = 1;
+        pool->started = 1;
+
+        for (uint32_t i = 0; i < pool->worker_count; ++i) {
+            pool->workers[i] = std::thread(s_worker, pool->job_id);
+        }
+    }
+}
+
+void run_parallel(uint32_t item_count, parallel_proc_t proc, void *data) {
+    s_start_workers();
+
+    if (pool->worker_count == 0 || item_count < 2) {
+        for (uint32_t i = 0; i < item_count; ++i) {
+            proc(i, data);
+        }
+
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock (pool->mutex);
+        pool->proc = proc;
+        pool->data = data;
+        pool->item_count = item_count;
+        pool->next_item = 0;
+        pool->finished_count = 0;
+        ++pool->job_id;
+    }
+
+    pool->job_ready.notify_all();
+
+    s_do_items(proc, data, item_count);
+
+    std::unique_lock<std::mutex> lock (pool->mutex);
+    pool->job_done.wait(lock, [] { return pool->finished_count == pool->worker_count; });
+}
+
+uint32_t get_worker_thread_count() {
+    s_start_workers();
+
+    return pool->worker_count;
+}
+
+void end_thread_pool() {
+    if (!pool || !pool->started) {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock (pool->mutex);
+        pool->running = 0;
+    }
+
+    pool->job_ready.notify_all();
+
+    for (uint32_t i = 0; i < pool->worker_count; ++i) {
+        pool->workers[i].join();
+    }
+
+    pool->started = 0;
+}
+
+void set_worker_thread_count(uint32_t count) {
+    s_start_workers();
+    end_thread_pool();
+
+    pool->worker_count = MIN(count, (uint32_t)THREAD_POOL_MAX_WORKERS);
+    s_start_workers();
+}
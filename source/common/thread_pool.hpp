@@ -0,0 +1,20 @@
+#pragma once
+
+#include "tools.hpp"
+
+// Worker threads for data parallel work (world generation, ...)
+// Items get handed out to whichever thread is free: a proc must only touch the data of its own item
+
+typedef void (* parallel_proc_t)(uint32_t item_index, void *data);
+
+// Calls proc for every item in [0, item_count) on the worker threads and the calling thread
+// Returns once every item is done (the workers get started by the first call)
+void run_parallel(uint32_t item_count, parallel_proc_t proc, void *data);
+// 0 if everything runs on the calling thread
+uint32_t get_worker_thread_count();
+// Forces the number of worker threads (used by the benchmarks), max is THREAD_POOL_MAX_WORKERS
+void set_worker_thread_count(uint32_t count);
+// Joins the worker threads
+void end_thread_pool();
+
+#define THREAD_POOL_MAX_WORKERS 15
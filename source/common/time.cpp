@@ -38,3 +38,45 @@ void sleep_seconds(
 }
 
 // Get global time
+
+void tick_scheduler_t::init(
+    float tick_rate,
+    uint32_t max_catch_up) {
+    tick_dt = 1.0f / tick_rate;
+    max_catch_up_ticks = max_catch_up;
+    accumulator = 0.0f;
+    dropped_tick_count = 0;
+}
+
+uint32_t tick_scheduler_t::advance(
+    float real_dt) {
+    // The clock may go backwards (not monotonic on every platform)
+    if (real_dt > 0.0f) {
+        accumulator += real_dt;
+    }
+
+    // Division instead of a loop (the process may have been stopped for a long time)
+    uint32_t tick_count = (uint32_t)(accumulator / tick_dt);
+    accumulator -= (float)tick_count * tick_dt;
+
+    // Float rounding
+    if (accumulator >= tick_dt) {
+        accumulator -= tick_dt;
+        ++tick_count;
+    }
+    else if (accumulator < 0.0f) {
+        accumulator += tick_dt;
+        --tick_count;
+    }
+
+    if (tick_count > max_catch_up_ticks) {
+        dropped_tick_count += tick_count - max_catch_up_ticks;
+        tick_count = max_catch_up_ticks;
+    }
+
+    return tick_count;
+}
+
+float tick_scheduler_t::time_until_next_tick() const {
+    return tick_dt - accumulator;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <chrono>
+#include <stdint.h>
 
 using time_stamp_t = std::chrono::high_resolution_clock::time_point;
 
@@ -12,3 +13,22 @@ float time_difference(
 
 void sleep_seconds(
     float seconds);
+
+// Runs a simulation at a fixed rate: the real time that passes gets accumulated and consumed in ticks of tick_dt
+struct tick_scheduler_t {
+    float tick_dt;
+    // If the simulation falls further behind than this, the ticks it couldn't catch up with get dropped
+    uint32_t max_catch_up_ticks;
+    float accumulator;
+    uint64_t dropped_tick_count;
+
+    void init(
+        float tick_rate,
+        uint32_t max_catch_up);
+
+    // Adds the real time that passed, returns how many ticks have to run now (at most max_catch_up_ticks)
+    uint32_t advance(
+        float real_dt);
+
+    float time_until_next_tick() const;
+};
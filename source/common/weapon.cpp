@@ -2,6 +2,8 @@
 #include "constant.hpp"
 #include "game.hpp"
 #include "containers.hpp"
+#include "allocators.hpp"
+#include "projectile.hpp"
 
 void weapon_t::init(
     uint32_t max_ammunition,
@@ -45,23 +47,19 @@ void tick_rock(rock_t *rock, float dt) {
 }
 
 bool check_projectile_players_collision(rock_t *rock, int32_t *dst_player) {
-    // Check if there was collision with players or terrain
-    ivector3_t chunk_coord = space_voxel_to_chunk(space_world_to_voxel(rock->position));
-    chunk_t *c = g_game->access_chunk(chunk_coord);
+    // Players whose box the rock touches (see update_player_broadphase)
+    uint32_t candidates[PLAYER_MAX_COUNT];
+    uint32_t candidate_count = g_game->player_broadphase.query_sphere(rock->position, rock_t::RADIUS, candidates);
 
-    if (c) {
-        for (uint32_t i = 0; i < c->players_in_chunk.data_count; ++i) {
-            uint8_t player_local_id = c->players_in_chunk[i];
+    for (uint32_t i = 0; i < candidate_count; ++i) {
+        player_t *p = g_game->get_player(candidates[i]);
 
-            player_t *p = g_game->get_player(player_local_id);
+        if (p->client_id != rock->client_id) {
+            if (collide_sphere_with_player(p, rock->position, rock_t::RADIUS)) {
+                // Collision!
+                *dst_player = (int32_t)candidates[i];
 
-            if (p->client_id != rock->client_id) {
-                if (collide_sphere_with_player(p, rock->position, 0.2f)) {
-                    // Collision!
-                    *dst_player = (int32_t)player_local_id;
-
-                    return true;
-                }
+                return true;
             }
         }
     }
@@ -69,19 +67,33 @@ bool check_projectile_players_collision(rock_t *rock, int32_t *dst_player) {
     return false;
 }
 
+static terrain_ray_t s_rock_terrain_ray(const rock_t *rock) {
+    // Distance the rock travels this tick (see tick_rock), the sphere sweep stops it where its front touches the surface
+    float speed = glm::length(rock->direction);
+
+    terrain_ray_t ray;
+    ray.ws_start = rock->position;
+    ray.ws_direction = rock->direction;
+    ray.max_distance = speed * g_game->dt;
+    ray.radius = rock_t::RADIUS;
+
+    return ray;
+}
+
 bool check_projectile_terrain_collision(rock_t *rock) {
-    terrain_collision_t collision = {};
-    collision.ws_size = vector3_t(0.2f);
-    collision.ws_position = rock->position;
-    collision.ws_velocity = rock->direction;
-    collision.es_position = collision.ws_position / collision.ws_size;
-    collision.es_velocity = collision.ws_velocity / collision.ws_size;
-
-    check_ray_terrain_collision(&collision);
-    if (collision.detected) {
-        return true;
-    }
-    else {
-        return false;
+    terrain_ray_t ray = s_rock_terrain_ray(rock);
+
+    terrain_raycast_hit_t hit;
+    return raycast_terrain_sphere(ray.ws_start, ray.ws_direction, ray.max_distance, ray.radius, &hit);
+}
+
+void check_projectiles_terrain_collision(const rock_store_t *rocks, bool *terrain_hits) {
+    terrain_ray_t *rays = LN_MALLOC(terrain_ray_t, rocks->count);
+
+    for (uint32_t i = 0; i < rocks->count; ++i) {
+        rock_t rock = rocks->get(i);
+        rays[i] = s_rock_terrain_ray(&rock);
     }
+
+    raycast_terrain_batch(rays, rocks->count, terrain_hits, NULL);
 }
@@ -3,8 +3,6 @@
 #include "tools.hpp"
 #include "containers.hpp"
 
-#include <utility>
-
 enum class firing_type_t { AUTOMATIC, SEMI_AUTOMATIC, INVALID };
 enum class bullet_type_t { PROJECTILE, HITSCAN, INVALID };
 
@@ -58,17 +56,19 @@ struct rock_snapshot_t {
     uint16_t client_id;
 };
 
+struct rock_flags_t {
+    uint32_t spawned_locally: 1;
+
+    // Index of the reference to this projectile
+    // In the weapon structure's list of active projectiles
+    uint32_t ref_idx_obj: 28;
+    uint32_t ref_idx_weapon: 2;
+};
+
 // All the different types of projectiles which will deal damage (e.g. rocks, exploding rocks, etc...)
+// The rocks of the game are in a rock_store_t (see projectile.hpp), this is a copy of one of them
 struct rock_t {
-    struct {
-        uint32_t active: 1;
-        uint32_t spawned_locally: 1;
-
-        // Index of the reference to this projectile
-        // In the weapon structure's list of active projectiles
-        uint32_t ref_idx_obj: 28;
-        uint32_t ref_idx_weapon: 2;
-    } flags;
+    rock_flags_t flags;
 
     vector3_t position;
     vector3_t direction;
@@ -86,12 +86,13 @@ struct rock_t {
         uint32_t ref_obj,
         uint32_t ref_weapon)
         : position(p), direction(d), up(u), client_id(cid) {
-        flags.active = 1;
+        flags.spawned_locally = 0;
         flags.ref_idx_obj = ref_obj;
         flags.ref_idx_weapon = ref_weapon;
     }
 
     static constexpr uint32_t DIRECT_DAMAGE = 75;
+    static constexpr float RADIUS = 0.2f;
 };
 
 // TODO
@@ -105,43 +106,12 @@ void weapons_and_bullets_memory_init();
 
 void tick_rock(rock_t *rock, float dt);
 
-template <typename T, uint32_t MAX_NEW_PROJECTILES_PER_FRAME>
-struct projectile_tracker_t {
-    stack_container_t<T> list;
-
-    // Projectiles that were spawned in the past frame
-    uint32_t recent_count;
-    uint32_t recent[MAX_NEW_PROJECTILES_PER_FRAME];
-
-    void init() {
-         // Projectiles
-        list.init(MAX_NEW_PROJECTILES_PER_FRAME);
-
-        recent_count = 0;
-        for (uint32_t i = 0; i < 50; ++i) {
-            recent[i] = 0;
-        }
-    }
-
-    template <typename ...Constr /* Constructor parameters */>
-    uint32_t spawn(Constr &&...params) {
-        // Add the projectile to the list
-        uint32_t idx = list.add();
-        T *p = &list[idx];
-        *p = T(std::forward<Constr>(params)...);
-
-        recent[recent_count++] = idx;
-
-        return idx;
-    }
-
-    void clear_recent() {
-        recent_count = 0;
-    }
-};
-
 bool check_projectile_players_collision(rock_t *rock, int32_t *dst_player);
+// Whether the rock reaches the terrain during this tick
 bool check_projectile_terrain_collision(rock_t *rock);
+struct rock_store_t;
+// Same check for all the rocks of the store at once (terrain_hits[i] is for the rock at index i)
+void check_projectiles_terrain_collision(const rock_store_t *rocks, bool *terrain_hits);
 
 struct predicted_projectile_hit_t {
     struct {
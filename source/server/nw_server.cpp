@@ -13,6 +13,8 @@
 #include <common/string.hpp>
 #include <common/meta_packet.hpp>
 #include <common/game_packet.hpp>
+#include <common/rewind_history.hpp>
+#include <common/time.hpp>
 #include <cstddef>
 
 static flexible_stack_container_t<uint32_t> clients_to_send_chunks_to;
@@ -30,8 +32,6 @@ static void s_start_server(
     event_start_server_t *data) {
     clients_to_send_chunks_to.init(50);
 
-    memset(g_net_data.dummy_voxels, CHUNK_SPECIAL_VALUE, sizeof(g_net_data.dummy_voxels));
-
     main_udp_socket_init(GAME_OUTPUT_PORT_SERVER);
 
     g_net_data.clients.init(NET_MAX_CLIENT_COUNT);
@@ -56,6 +56,8 @@ static bool s_send_packet_connection_handshake(
     uint32_t loaded_chunk_count) {
     packet_connection_handshake_t connection_handshake = {};
     connection_handshake.loaded_chunk_count = loaded_chunk_count;
+    connection_handshake.procedural_terrain = g_game->flags.procedural_terrain;
+    connection_handshake.terrain_seed = g_game->terrain.generator.seed;
 
     LOG_INFOV("Loaded chunk count: %d\n", connection_handshake.loaded_chunk_count);
 
@@ -142,57 +144,40 @@ static bool s_send_packet_connection_handshake(
 }
 
 static constexpr uint32_t s_maximum_chunks_per_packet() {
-    return ((65507 - sizeof(uint32_t)) / (sizeof(int16_t) * 3 + CHUNK_BYTE_SIZE));
+    return ((65507 - sizeof(uint32_t)) / (PACKED_CHUNK_COORD_MAX_SIZE + CHUNK_BYTE_SIZE));
 }
 
+// keep_empty: chunks without voxels get sent too (procedural terrain chunks which got emptied)
 static bool s_serialise_chunk(
     serialiser_t *serialiser,
+    chunk_coord_packer_t *packer,
     uint32_t *chunks_in_packet,
     voxel_chunk_values_t *values,
-    uint32_t i) {
+    uint32_t i,
+    bool keep_empty) {
     voxel_chunk_values_t *current_values = &values[i];
 
     uint32_t before_chunk_ptr = serialiser->data_buffer_head;
+    chunk_coord_packer_t before_chunk_packer = *packer;
 
-    serialiser->serialise_int16(current_values->x);
-    serialiser->serialise_int16(current_values->y);
-    serialiser->serialise_int16(current_values->z);
-
-    // Do a compression of the chunk values
-    for (uint32_t v_index = 0; v_index < CHUNK_VOXEL_COUNT; ++v_index) {
-        voxel_t current_voxel = current_values->voxel_values[v_index];
-        if (current_voxel.value == 0) {
-            uint32_t before_head = serialiser->data_buffer_head;
-
-            static constexpr uint32_t MAX_ZERO_COUNT_BEFORE_COMPRESSION = 3;
-
-            uint32_t zero_count = 0;
-            for (; current_values->voxel_values[v_index].value == 0 && zero_count < MAX_ZERO_COUNT_BEFORE_COMPRESSION; ++v_index, ++zero_count) {
-                serialiser->serialise_uint8(0);
-                serialiser->serialise_uint8(0);
-            }
-
-            if (zero_count == MAX_ZERO_COUNT_BEFORE_COMPRESSION) {
-                for (; current_values->voxel_values[v_index].value == 0; ++v_index, ++zero_count) {}
+    serialise_chunk_coord(ivector3_t(current_values->x, current_values->y, current_values->z), packer, serialiser);
 
-                if (zero_count == CHUNK_VOXEL_COUNT) {
-                    serialiser->data_buffer_head = before_chunk_ptr;
-                    
-                    return 0;
-                }
+    uint32_t before_voxels_ptr = serialiser->data_buffer_head;
 
-                serialiser->data_buffer_head = before_head;
-                serialiser->serialise_uint8(CHUNK_SPECIAL_VALUE);
-                serialiser->serialise_uint8(CHUNK_SPECIAL_VALUE);
-                serialiser->serialise_uint32(zero_count);
-            }
+    // Same compression as the map files
+    if (!serialise_map_chunk_voxels(serialiser, current_values->voxel_values)) {
+        if (!keep_empty) {
+            serialiser->data_buffer_head = before_chunk_ptr;
+            *packer = before_chunk_packer;
 
-            v_index -= 1;
-        }
-        else {
-            serialiser->serialise_uint8(current_voxel.value);
-            serialiser->serialise_uint8(current_voxel.color);
+            return 0;
         }
+
+        // Just one run of zeros
+        serialiser->data_buffer_head = before_voxels_ptr;
+        serialiser->serialise_uint8(CHUNK_SPECIAL_VALUE);
+        serialiser->serialise_uint8(CHUNK_SPECIAL_VALUE);
+        serialiser->serialise_uint32(CHUNK_VOXEL_COUNT);
     }
 
     *chunks_in_packet = *chunks_in_packet + 1;
@@ -207,7 +192,7 @@ static uint32_t s_prepare_packet_chunk_voxels(
     uint32_t count) {
     packet_header_t header = {};
     header.flags.packet_type = PT_CHUNK_VOXELS;
-    header.flags.total_packet_size = s_maximum_chunks_per_packet() * (3 * sizeof(int16_t) + CHUNK_BYTE_SIZE);
+    header.flags.total_packet_size = s_maximum_chunks_per_packet() * (PACKED_CHUNK_COORD_MAX_SIZE + CHUNK_BYTE_SIZE);
     header.current_tick = g_game->current_tick;
     header.current_packet_count = g_net_data.current_packet;
     
@@ -224,6 +209,7 @@ static uint32_t s_prepare_packet_chunk_voxels(
     serialiser.serialise_uint32(0);
 
     uint32_t chunk_values_start = serialiser.data_buffer_head;
+    chunk_coord_packer_t packer = {};
     
     uint32_t index = clients_to_send_chunks_to.add();
     clients_to_send_chunks_to[index] = client->client_id;
@@ -231,11 +217,11 @@ static uint32_t s_prepare_packet_chunk_voxels(
     uint32_t total_chunks_to_send = 0;
 
     for (uint32_t i = 0; i < count; ++i) {
-        if (s_serialise_chunk(&serialiser, &chunks_in_packet, values, i)) {
+        if (s_serialise_chunk(&serialiser, &packer, &chunks_in_packet, values, i, g_game->flags.procedural_terrain)) {
             ++total_chunks_to_send;
         }
 
-        if (serialiser.data_buffer_head + 3 * sizeof(int16_t) + CHUNK_BYTE_SIZE > serialiser.data_buffer_size ||
+        if (serialiser.data_buffer_head + PACKED_CHUNK_COORD_MAX_SIZE + CHUNK_BYTE_SIZE > serialiser.data_buffer_size ||
             i + 1 == count) {
             // Need to send in new packet
             serialiser.serialise_uint32(chunks_in_packet, chunk_count_byte);
@@ -246,6 +232,7 @@ static uint32_t s_prepare_packet_chunk_voxels(
             packet_to_save->size = serialiser.data_buffer_head;
 
             serialiser.data_buffer_head = chunk_values_start;
+            packer = {};
 
             LOG_INFOV("Packet contains %d chunks\n", chunks_in_packet);
             chunks_in_packet = 0;
@@ -270,24 +257,58 @@ static void s_send_game_state_to_new_client(
     uint32_t max_chunks_per_packet = s_maximum_chunks_per_packet();
     LOG_INFOV("Maximum chunks per packet: %i\n", max_chunks_per_packet);
 
-    voxel_chunk_values_t *voxel_chunks = LN_MALLOC(voxel_chunk_values_t, loaded_chunk_count);
+    // Chunks which aren't resident get sent straight from the backing store
+    open_hash_table_t<chunk_record_t> *records = &g_game->residency.records;
+    uint32_t record_count = g_game->flags.page_chunks ? records->count : 0;
+
+    voxel_chunk_values_t *voxel_chunks = LN_MALLOC(voxel_chunk_values_t, loaded_chunk_count + record_count);
+
+    // With procedural terrain, clients generate the chunks themselves: only the modified ones get sent (even if they're empty now)
+    bool procedural_terrain = g_game->flags.procedural_terrain;
 
     uint32_t count = 0;
     for (uint32_t i = 0; i < loaded_chunk_count; ++i) {
         chunk_t *c = chunks[i];
-        if (c) {
+        voxel_t uniform_voxel;
+
+        bool send_chunk = c && (procedural_terrain ?
+            is_terrain_chunk_modified(c) :
+            // Empty chunks don't get sent
+            !(is_chunk_uniform(c, &uniform_voxel) && uniform_voxel.value == 0));
+
+        if (send_chunk) {
             voxel_chunks[count].x = c->chunk_coord.x;
             voxel_chunks[count].y = c->chunk_coord.y;
             voxel_chunks[count].z = c->chunk_coord.z;
 
-            voxel_chunks[count].voxel_values = c->voxels;
+            // Chunks get sent in linear order
+            voxel_t *decoded = NULL;
+            if (!is_chunk_dense(c) || !voxel_layout_t::IS_LINEAR) {
+                decoded = LN_MALLOC(voxel_t, CHUNK_VOXEL_COUNT);
+            }
+
+            voxel_chunks[count].voxel_values = (voxel_t *)get_chunk_voxels_linear(c, decoded);
+
+            ++count;
+        }
+    }
+
+    for (uint32_t i = 0; record_count && i < records->capacity; ++i) {
+        chunk_record_t *record = &records->items[i].value;
+
+        if (records->items[i].key != records->EMPTY_KEY && !g_game->access_resident_chunk(record->chunk_coord)) {
+            voxel_chunks[count].x = record->chunk_coord.x;
+            voxel_chunks[count].y = record->chunk_coord.y;
+            voxel_chunks[count].z = record->chunk_coord.z;
+            voxel_chunks[count].voxel_values = LN_MALLOC(voxel_t, CHUNK_VOXEL_COUNT);
+            load_chunk_record(record, voxel_chunks[count].voxel_values);
 
             ++count;
         }
     }
 
     // Cannot send all of these at the same bloody time
-    uint32_t chunks_to_send = s_prepare_packet_chunk_voxels(client, voxel_chunks, loaded_chunk_count);
+    uint32_t chunks_to_send = s_prepare_packet_chunk_voxels(client, voxel_chunks, count);
 
     s_send_packet_connection_handshake(
         client_id,
@@ -350,7 +371,6 @@ static void s_receive_packet_connection_request(
     client->received_first_commands_packet = 0;
     client->predicted_chunk_mod_count = 0;
     client->predicted_modifications = (chunk_modifications_t *)g_net_data.chunk_modification_allocator.allocate_arena();
-    client->previous_locations.init();
 
     // Force a ping in the next loop
     client->ping = 0.0f;
@@ -397,7 +417,6 @@ static void s_receive_packet_client_disconnect(
     (void)serialiser;
     LOG_INFO("Client disconnected\n");
 
-    g_net_data.clients[client_id].previous_locations.destroy();
     g_net_data.clients[client_id].initialised = 0;
     g_net_data.clients.remove(client_id);
 
@@ -524,9 +543,9 @@ static void s_receive_packet_client_commands(
                         //LOG_INFOV("In chunk (%i %i %i): \n", commands.chunk_modifications[i].x, commands.chunk_modifications[i].y, commands.chunk_modifications[i].z);
                         chunk_t *c_ptr = g_game->get_chunk(ivector3_t(commands.chunk_modifications[i].x, commands.chunk_modifications[i].y, commands.chunk_modifications[i].z));
                         for (uint32_t v = 0; v < commands.chunk_modifications[i].modified_voxels_count; ++v) {
-                            uint8_t initial_value = c_ptr->voxels[commands.chunk_modifications[i].modifications[v].index].value;
-                            if (c_ptr->history.modification_pool[commands.chunk_modifications[i].modifications[v].index] != CHUNK_SPECIAL_VALUE) {
-                                //initial_value = c_ptr->history.modification_pool[commands.chunk_modifications[i].modifications[v].index];
+                            uint8_t initial_value = get_chunk_voxel(c_ptr, commands.chunk_modifications[i].modifications[v].index).value;
+                            if (c_ptr->history && c_ptr->history->modification_pool[commands.chunk_modifications[i].modifications[v].index] != CHUNK_SPECIAL_VALUE) {
+                                //initial_value = c_ptr->history->modification_pool[commands.chunk_modifications[i].modifications[v].index];
                             }
                             if (initial_value != commands.chunk_modifications[i].modifications[v].initial_value) {
                                 LOG_INFOV("(Voxel %i) INITIAL VALUES ARE NOT THE SAME: %i != %i\n", commands.chunk_modifications[i].modifications[v].index, (int32_t)initial_value, (int32_t)commands.chunk_modifications[i].modifications[v].initial_value);
@@ -598,17 +617,22 @@ static void s_receive_packet_team_select_request(
     }
 }
 
+// Client and server may compile the simulation differently (different float rounding):
+// only corrects the client if the difference is bigger than that
+static bool s_prediction_is_off(
+    const vector3_t &actual,
+    const vector3_t &predicted) {
+    vector3_t difference = glm::abs(actual - predicted);
+    vector3_t tolerance = glm::max(glm::abs(actual), vector3_t(1.0f)) * NET_PREDICTION_TOLERANCE;
+
+    return difference.x > tolerance.x || difference.y > tolerance.y || difference.z > tolerance.z;
+}
+
 static bool s_check_if_client_has_to_correct_state(
     player_t *p,
     client_t *c) {
-    vector3_t dposition = glm::abs(p->ws_position - c->ws_predicted_position);
-    vector3_t ddirection = glm::abs(p->ws_view_direction - c->ws_predicted_view_direction);
-    vector3_t dup = glm::abs(p->ws_up_vector - c->ws_predicted_up_vector);
-    vector3_t dvelocity = glm::abs(p->ws_velocity - c->ws_predicted_velocity);
-
-    float precision = 0.000001f;
     bool incorrect_position = 0;
-    if (dposition.x >= precision || dposition.y >= precision || dposition.z >= precision) {
+    if (s_prediction_is_off(p->ws_position, c->ws_predicted_position)) {
         LOG_INFOV(
             "Need to correct position: %f %f %f <- %f %f %f\n",
             p->ws_position.x,
@@ -622,7 +646,7 @@ static bool s_check_if_client_has_to_correct_state(
     }
 
     bool incorrect_direction = 0;
-    if (ddirection.x >= precision || ddirection.y >= precision || ddirection.z >= precision) {
+    if (s_prediction_is_off(p->ws_view_direction, c->ws_predicted_view_direction)) {
         LOG_INFOV(
             "Need to correct position: %f %f %f <- %f %f %f\n",
             p->ws_view_direction.x,
@@ -636,7 +660,7 @@ static bool s_check_if_client_has_to_correct_state(
     }
 
     bool incorrect_up = 0;
-    if (dup.x >= precision || dup.y >= precision || dup.z >= precision) {
+    if (s_prediction_is_off(p->ws_up_vector, c->ws_predicted_up_vector)) {
         LOG_INFOV(
             "Need to correct up vector: %f %f %f <- %f %f %f\n",
             p->ws_up_vector.x,
@@ -650,7 +674,7 @@ static bool s_check_if_client_has_to_correct_state(
     }
 
     bool incorrect_velocity = 0;
-    if (dvelocity.x >= precision || dvelocity.y >= precision || dvelocity.z >= precision) {
+    if (s_prediction_is_off(p->ws_velocity, c->ws_predicted_velocity)) {
         incorrect_velocity = 1;
         LOG_INFOV(
             "Need to correct velocity: %f %f %f <- %f %f %f\n",
@@ -697,11 +721,11 @@ static bool s_check_if_client_has_to_correct_terrain(
         for (uint32_t vm_index = 0; vm_index < cm_ptr->modified_voxels_count; ++vm_index) {
             voxel_modification_t *vm_ptr = &cm_ptr->modifications[vm_index];
 
-            voxel_t *voxel_ptr = &c_ptr->voxels[vm_ptr->index];
-            uint8_t actual_value = voxel_ptr->value;
+            voxel_t voxel = get_chunk_voxel(c_ptr, vm_ptr->index);
+            uint8_t actual_value = voxel.value;
             uint8_t predicted_value = vm_ptr->final_value;
 
-            voxel_color_t color = voxel_ptr->color;
+            voxel_color_t color = voxel.color;
 
             // Just one mistake can completely mess stuff up between the client and server
             if (actual_value != predicted_value) {
@@ -735,31 +759,14 @@ static bool s_check_if_client_has_to_correct_hits(
      * This means that for each projectile hit, we need to do lag compensation for just
      * One player and check the projectiles that the shooter shot with the player
      * At the previous position */
-    float shooter_half_roundtrip = shooter_client->ping / 2.0f;
-
     for (uint32_t i = 0; i < shooter_client->predicted_proj_hit_count; ++i) {
         predicted_projectile_hit_t *hit = &shooter_client->predicted_proj_hits[i];
 
         client_t *target = &g_net_data.clients[hit->client_id];
         player_t *target_player = g_game->get_player(g_game->client_to_local_id(target->client_id));
-        float target_half_roundtrip = target->ping / 2.0f;
-
-        // Get the two snapshots that encompass the latency of the shooting_player
-        float snapshot_from_head = (shooter_half_roundtrip + target_half_roundtrip) / NET_SERVER_SNAPSHOT_OUTPUT_INTERVAL;
-        float snapshot_from_head_trunc = floor(snapshot_from_head);
-        float progression = snapshot_from_head - snapshot_from_head_trunc;
-
-        uint32_t s1_idx = target->previous_locations.decrement_index(
-            target->previous_locations.head,
-            (uint32_t)snapshot_from_head_trunc);
 
-        uint32_t s0_idx = target->previous_locations.decrement_index(
-            s1_idx);
-
-        auto *s1 = &target->previous_locations.buffer[s1_idx];
-        auto *s0 = &target->previous_locations.buffer[s0_idx];
-
-        vector3_t approx_target_position = s0->ws_position + (s1->ws_position - s0->ws_position) * progression;
+        // Where the shooter saw the target
+        rewound_player_t rewound_target = srv_get_rewound_player(shooter_client->client_id, target_player);
 
         bool prediction_was_correct = 0;
 
@@ -776,26 +783,32 @@ static bool s_check_if_client_has_to_correct_hits(
 
                 if (ref->initialised) {
                     // TODO: Make sure to check appropriate projectile type (for now, just rocks)
-                    rock_t *r = &g_game->rocks.list[ref->idx];
+                    uint32_t rock_idx = g_game->rocks.get_index(ref->idx);
+
+                    if (rock_idx == ROCK_INVALID_INDEX) {
+                        // Already hit something
+                        continue;
+                    }
+
+                    rock_t r = g_game->rocks.get(rock_idx);
 
                     // Check collision with target
-                    bool collided = collide_sphere_with_player(target_player, r->position, 0.2f);
+                    bool collided = collide_sphere_with_rewound_player(&rewound_target, r.position, rock_t::RADIUS);
 
                     if (collided) {
                         // Remove the bullets from the game
-                        uint32_t weapon_idx = r->flags.ref_idx_weapon;
-                        uint32_t ref_idx = r->flags.ref_idx_obj;
+                        uint32_t weapon_idx = r.flags.ref_idx_weapon;
+                        uint32_t ref_idx = r.flags.ref_idx_obj;
                         player_client->weapons[weapon_idx].active_projs[ref_idx].initialised = 0;
                         player_client->weapons[weapon_idx].active_projs.remove(ref_idx);
 
-                        r->flags.active = 0;
-                        g_game->rocks.list.remove(i);
+                        g_game->rocks.remove(rock_idx);
 
                         prediction_was_correct = 1;
                         break;
                     }
                     else {
-                        LOG_INFOV("Missed: (%s) vs (%s)\n", glm::to_string(approx_target_position).c_str(), glm::to_string(r->position).c_str());
+                        LOG_INFOV("Missed: (%s) vs (%s)\n", glm::to_string(rewound_target.ws_position).c_str(), glm::to_string(r.position).c_str());
                     }
                 }
             }
@@ -833,14 +846,9 @@ static void s_add_projectiles_to_game_state_snapshot(
     snapshot->rock_count = g_game->rocks.recent_count;
     snapshot->rock_snapshots = LN_MALLOC(rock_snapshot_t, snapshot->rock_count);
 
+    // Rocks which already hit something get sent too (the other clients still have to see the shot)
     for (uint32_t i = 0; i < snapshot->rock_count; ++i) {
-        uint32_t new_rock_idx = g_game->rocks.recent[i];
-        rock_t *rock = g_game->rocks.list.get(new_rock_idx);
-
-        snapshot->rock_snapshots[i].client_id = rock->client_id;
-        snapshot->rock_snapshots[i].position = rock->position;
-        snapshot->rock_snapshots[i].direction = rock->direction;
-        snapshot->rock_snapshots[i].up = rock->up;
+        snapshot->rock_snapshots[i] = g_game->rocks.get_recent(i);
     }
 }
 
@@ -925,12 +933,6 @@ static void s_send_packet_game_state_snapshot() {
             snapshot->animated_state = p->animated_state;
             snapshot->frame_displacement = p->frame_displacement;
 
-            // Add snapshot to client's circular buffer of snapshots
-            player_position_snapshot_t s = {};
-            s.ws_position = snapshot->ws_position;
-            s.tick = snapshot->tick;
-            c->previous_locations.push_item(&s);
-            
             if (snapshot->terraformed) {
                 snapshot->terraform_tick = c->tick_at_which_client_terraformed;
             }
@@ -1032,13 +1034,22 @@ static void s_send_pending_chunks() {
     }
 }
 
+// Pings are measured in real time: several ticks can run back to back when the server catches up
+static time_stamp_t last_ping_update;
+
 static void s_ping_clients() {
+    time_stamp_t now = current_time();
+    float elapsed = time_difference(now, last_ping_update);
+    last_ping_update = now;
+
     // Send a ping
     serialiser_t serialiser = {};
     serialiser.init(30);
 
     for (uint32_t i = 0; i < g_net_data.clients.data_count; ++i) {
         client_t *c = &g_net_data.clients[i];
+        c->time_since_ping += elapsed;
+        c->ping_in_progress += elapsed;
 
         if (c->time_since_ping > NET_CLIENT_TIMEOUT) {
             // TODO: Kick the client out of the server
@@ -1063,9 +1074,6 @@ static void s_ping_clients() {
             c->received_ping = 0;
             serialiser.data_buffer_head = 0;
         }
-
-        c->time_since_ping += srv_delta_time();
-        c->ping_in_progress += srv_delta_time();
     }
 }
 
@@ -1077,7 +1085,7 @@ static void s_receive_packet_ping(
     client_t *c = &g_net_data.clients[client_id];
 
     c->received_ping = 1;
-    c->ping = c->ping_in_progress;
+    c->ping = c->ping_in_progress + time_difference(current_time(), last_ping_update);
     c->ping_in_progress = 0.0f;
 }
 
@@ -1195,6 +1203,7 @@ void nw_init(event_submissions_t *events) {
     socket_api_init();
 
     g_net_data.message_buffer = FL_MALLOC(char, NET_MAX_MESSAGE_SIZE);
+    last_ping_update = current_time();
 
     // meta_socket_init();
     nw_init_meta_connection();
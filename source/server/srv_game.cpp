@@ -2,14 +2,22 @@
 #include "common/map.hpp"
 #include "common/weapon.hpp"
 #include "srv_main.hpp"
+#include "srv_game.hpp"
 #include <common/game.hpp>
 #include <common/chunk.hpp>
 #include <common/player.hpp>
 
 #include <common/net.hpp>
+#include <common/rewind_history.hpp>
 
 static listener_t game_listener;
 
+// State of the players of the last ticks (lag compensation)
+static rewind_history_t rewind_history;
+
+static bool use_procedural_terrain = 0;
+static uint32_t terrain_seed = 0;
+
 void spawn_player(uint32_t client_id) {
     LOG_INFOV("Client %i spawned\n", client_id);
 
@@ -107,6 +115,11 @@ static float s_tube(float x, float y, float z) {
     }
 }
 
+void srv_use_procedural_terrain(uint32_t seed) {
+    use_procedural_terrain = 1;
+    terrain_seed = seed;
+}
+
 void srv_game_init(event_submissions_t *events) {
     game_listener = set_listener_callback(&s_game_listener, NULL, events);
 
@@ -115,13 +128,25 @@ void srv_game_init(event_submissions_t *events) {
     subscribe_to_event(ET_SPAWN, game_listener, events);
 
     g_game->init_memory();
+    rewind_history.init();
+    // The server holds on to a lot of chunks - keep them palette encoded
+    g_game->flags.palette_chunks = 1;
+    // Only the chunks around the players stay loaded
+    g_game->flags.page_chunks = 1;
 
     // Make this a parameter to the vkPhysics_server program
     // generate_sphere(vector3_t(0.0f), 30, 180, GT_ADDITIVE, 0b11111111);
     // load_map("nucleus.map");
 
     g_game->configure_game_mode(game_mode_t::DEATHMATCH);
-    g_game->configure_map("ice.map");
+    if (use_procedural_terrain) {
+        // Clients generate the same terrain from the seed
+        g_game->configure_procedural_terrain(terrain_seed);
+    }
+    else {
+        g_game->configure_map("ice.map");
+    }
+
     g_game->configure_team_count(2);
     g_game->configure_team(0, team_color_t::PURPLE, 10);
     g_game->configure_team(1, team_color_t::YELLOW, 10);
@@ -129,77 +154,87 @@ void srv_game_init(event_submissions_t *events) {
     g_game->start_session();
 }
 
-// Compensate for lag
-static bool s_check_projectile_player_collision_lag(
-    rock_t *rock,
-    int32_t *dst_player) {
-    ivector3_t chunk_coord = space_voxel_to_chunk(space_world_to_voxel(rock->position));
-    chunk_t *c = g_game->access_chunk(chunk_coord);
+// Latency between what the shooter saw and the server's current state
+static float s_get_hit_latency(uint16_t shooter_client_id, uint16_t target_client_id) {
+    float shooter_half_roundtrip = g_net_data.clients[shooter_client_id].ping / 2.0f;
+    float target_half_roundtrip = g_net_data.clients[target_client_id].ping / 2.0f;
 
-    bool collided = 0;
+    return shooter_half_roundtrip + target_half_roundtrip;
+}
 
-    if (c) {
-        for (uint32_t i = 0; i < c->players_in_chunk.data_count; ++i) {
-            uint8_t player_local_id = c->players_in_chunk[i];
+// Players can get hit where the shooters saw them: the box of each player covers all the positions
+// that s_check_projectile_player_collision_lag can rewind the player to
+static void s_update_player_broadphase_lag() {
+    float max_shooter_half_roundtrip = 0.0f;
 
-            player_t *target = g_game->get_player(player_local_id);
+    for (uint32_t i = 0; i < g_net_data.clients.data_count; ++i) {
+        client_t *c = &g_net_data.clients[i];
 
-            // Get lag compensated position of the player
-            auto *shooter_client = &g_net_data.clients[rock->client_id];
-            float shooter_half_roundtrip = shooter_client->ping / 2.0f;
+        if (c->initialised) {
+            max_shooter_half_roundtrip = MAX(max_shooter_half_roundtrip, c->ping / 2.0f);
+        }
+    }
 
-            auto *target_client = &g_net_data.clients[target->client_id];
-            float target_half_roundtrip = target_client->ping / 2.0f;
+    player_bounds_t *bounds = LN_MALLOC(player_bounds_t, g_game->players.data_count);
+    uint32_t count = 0;
 
-            // Get the two snapshots that encompass the latency of the shooting_player
-            float snapshot_from_head = (shooter_half_roundtrip + target_half_roundtrip) / NET_SERVER_SNAPSHOT_OUTPUT_INTERVAL;
-            float snapshot_from_head_trunc = floor(snapshot_from_head);
-            float progression = snapshot_from_head - snapshot_from_head_trunc;
+    for (uint32_t i = 0; i < g_game->players.data_count; ++i) {
+        player_t *target = g_game->get_player(i);
 
-            uint32_t s1_idx = target_client->previous_locations.decrement_index(
-                target_client->previous_locations.head,
-                (uint32_t)snapshot_from_head_trunc);
+        if (target) {
+            float target_half_roundtrip = g_net_data.clients[target->client_id].ping / 2.0f;
+            double since_tick = rewind_history.get_tick_before(max_shooter_half_roundtrip + target_half_roundtrip);
 
-            uint32_t s0_idx = target_client->previous_locations.decrement_index(
-                s1_idx);
+            // Current position is used if the player wasn't there yet at the tick of the shooter
+            player_bounds_t *b = &bounds[count++];
+            *b = make_player_bounds(target);
 
-            auto *s1 = &target_client->previous_locations.buffer[s1_idx];
-            auto *s0 = &target_client->previous_locations.buffer[s0_idx];
+            vector3_t ws_min, ws_max;
+            if (rewind_history.get_position_bounds(since_tick, i, target->client_id, &ws_min, &ws_max)) {
+                vector3_t extent = b->ws_max - target->ws_position;
+                b->ws_min = glm::min(b->ws_min, ws_min - extent);
+                b->ws_max = glm::max(b->ws_max, ws_max + extent);
+            }
+        }
+    }
 
-            vector3_t approx_target_position = s0->ws_position + (s1->ws_position - s0->ws_position) * progression;
+    g_game->player_broadphase.build(bounds, count);
+}
 
-            if (target->client_id != rock->client_id) {
-                if (target->flags.interaction_mode == PIM_STANDING ||
-                    target->flags.interaction_mode == PIM_FLOATING) {
-                    collided = collide_sphere_with_standing_player(
-                        approx_target_position,
-                        target->ws_up_vector,
-                        rock->position,
-                        0.2f);
-                }
-                else {
-                    collided = collide_sphere_with_rolling_player(
-                        approx_target_position,
-                        rock->position,
-                        0.2f);
-                }
+// Compensate for lag
+static bool s_check_projectile_player_collision_lag(
+    rock_t *rock,
+    int32_t *dst_player) {
+    // Players whose box the rock touches (see s_update_player_broadphase_lag)
+    uint32_t candidates[PLAYER_MAX_COUNT];
+    uint32_t candidate_count = g_game->player_broadphase.query_sphere(rock->position, rock_t::RADIUS, candidates);
 
-                if (collided) {
-                    LOG_INFOV("%s just got hit by projectile\n", target->name);
+    bool collided = 0;
 
-                    // Register hit and decrease client's health
-                    if (target->health < rock_t::DIRECT_DAMAGE) {
-                        LOG_INFOV("%s just got killed\n", target->name);
+    for (uint32_t i = 0; i < candidate_count; ++i) {
+        player_t *target = g_game->get_player(candidates[i]);
 
-                        // Player needs to die
-                        target->flags.alive_state = PAS_DEAD;
-                        target->frame_displacement = 0.0f;
-                    }
+        if (target->client_id != rock->client_id) {
+            // State of the player at the tick that the shooter saw
+            rewound_player_t rewound = srv_get_rewound_player(rock->client_id, target);
 
-                    target->health -= rock_t::DIRECT_DAMAGE;
+            collided = collide_sphere_with_rewound_player(&rewound, rock->position, rock_t::RADIUS);
 
-                    break;
+            if (collided) {
+                LOG_INFOV("%s just got hit by projectile\n", target->name);
+
+                // Register hit and decrease client's health
+                if (target->health < rock_t::DIRECT_DAMAGE) {
+                    LOG_INFOV("%s just got killed\n", target->name);
+
+                    // Player needs to die
+                    target->flags.alive_state = PAS_DEAD;
+                    target->frame_displacement = 0.0f;
                 }
+
+                target->health -= rock_t::DIRECT_DAMAGE;
+
+                break;
             }
         }
     }
@@ -207,12 +242,32 @@ static bool s_check_projectile_player_collision_lag(
     return collided;
 }
 
+rewound_player_t srv_get_rewound_player(uint16_t shooter_client_id, const player_t *target) {
+    rewind_view_t view;
+    double tick = rewind_history.get_tick_before(s_get_hit_latency(shooter_client_id, target->client_id));
+
+    rewound_player_t rewound;
+    if (rewind_history.rewind_world(tick, &view) &&
+        rewind_history.get_player(&view, target->local_id, target->client_id, &rewound)) {
+        return rewound;
+    }
+
+    // Target wasn't there yet at that tick
+    rewound.ws_position = target->ws_position;
+    rewound.ws_up_vector = target->ws_up_vector;
+    rewound.interaction_mode = target->flags.interaction_mode;
+
+    return rewound;
+}
+
 void srv_game_tick() {
     for (uint32_t i = 0; i < g_game->players.data_count; ++i) {
         player_t *player = g_game->get_player(i);
 
         if (player) {
             if (player->flags.alive_state == PAS_ALIVE) {
+                begin_player_terraform_commands();
+
                 // Execute all received player actions
                 for (uint32_t i = 0; i < player->player_action_count; ++i) {
                     player_action_t *action = &player->player_actions[i];
@@ -229,43 +284,52 @@ void srv_game_tick() {
         }
     }
 
-    // Still need to update all the things that update despite entities (projectiles)
-    for (uint32_t i = 0; i < g_game->rocks.list.data_count; ++i) {
-        rock_t *rock = &g_game->rocks.list[i];
+    // Brushes of every player at once (the actions ran against the terrain as it was at the start of the tick)
+    apply_terraform_commands();
 
-        if (rock->flags.active) {
-            int32_t target = -1;
+    // Players don't move anymore this tick
+    rewind_history.record(g_game->current_tick, g_game->dt);
 
-            bool collided_with_terrain = check_projectile_terrain_collision(rock);
-            bool collided_with_player = s_check_projectile_player_collision_lag(rock, &target);
+    rock_store_t *rocks = &g_game->rocks;
+    s_update_player_broadphase_lag();
 
-            if (collided_with_player) {
-                // Do something
-                uint16_t client_id = rock->client_id;
-                uint32_t weapon_idx = rock->flags.ref_idx_weapon;
-                uint32_t ref_idx = rock->flags.ref_idx_obj;
+    // Terrain checks of all the rocks at once (the terrain doesn't change while the rocks get updated)
+    bool *rock_terrain_hits = LN_MALLOC(bool, rocks->count);
+    check_projectiles_terrain_collision(rocks, rock_terrain_hits);
 
-                auto *p = g_game->get_player(g_game->client_to_local_id(client_id));
-                p->weapons[weapon_idx].active_projs[ref_idx].initialised = 0;
-                p->weapons[weapon_idx].active_projs.remove(ref_idx);
+    // Rocks which hit something get removed after the checks (removing a rock moves the last one into its place)
+    uint32_t *hit_rocks = LN_MALLOC(uint32_t, rocks->count);
+    uint32_t hit_rock_count = 0;
 
-                rock->flags.active = 0;
-                g_game->rocks.list.remove(i);
-            }
-            else if (collided_with_terrain) {
-                uint16_t client_id = rock->client_id;
-                uint32_t weapon_idx = rock->flags.ref_idx_weapon;
-                uint32_t ref_idx = rock->flags.ref_idx_obj;
+    // Still need to update all the things that update despite entities (projectiles)
+    for (uint32_t i = 0; i < rocks->count; ++i) {
+        rock_t rock = rocks->get(i);
+        int32_t target = -1;
 
-                auto *p = g_game->get_player(g_game->client_to_local_id(client_id));
-                p->weapons[weapon_idx].active_projs[ref_idx].initialised = 0;
-                p->weapons[weapon_idx].active_projs.remove(ref_idx);
+        bool collided_with_terrain = rock_terrain_hits[i];
+        bool collided_with_player = s_check_projectile_player_collision_lag(&rock, &target);
 
-                rock->flags.active = 0;
-                g_game->rocks.list.remove(i);
-            }
+        if (collided_with_player || collided_with_terrain) {
+            uint16_t client_id = rock.client_id;
+            uint32_t weapon_idx = rock.flags.ref_idx_weapon;
+            uint32_t ref_idx = rock.flags.ref_idx_obj;
 
-            tick_rock(rock, g_game->dt);
+            auto *p = g_game->get_player(g_game->client_to_local_id(client_id));
+            p->weapons[weapon_idx].active_projs[ref_idx].initialised = 0;
+            p->weapons[weapon_idx].active_projs.remove(ref_idx);
+
+            hit_rocks[hit_rock_count++] = i;
         }
     }
+
+    // Backwards, so that the rocks which still need to be removed don't move
+    for (uint32_t i = hit_rock_count; i > 0; --i) {
+        rocks->remove(hit_rocks[i - 1]);
+    }
+
+    rocks->integrate(g_game->dt);
+
+    if (g_game->flags.page_chunks) {
+        update_chunk_residency();
+    }
 }
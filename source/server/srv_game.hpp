@@ -1,5 +1,9 @@
 #pragma once
 
+// Generate the terrain from this seed instead of loading ice.map (has to be called before srv_game_init)
+void srv_use_procedural_terrain(uint32_t seed);
 void srv_game_init(struct event_submissions_t *events);
 void srv_game_tick();
 void spawn_player(uint32_t client_id);
+// State of the target at the tick that the shooter saw (see rewind_history_t) - current state if the target wasn't there yet
+struct rewound_player_t srv_get_rewound_player(uint16_t shooter_client_id, const struct player_t *target);
@@ -1,59 +1,71 @@
 #include <sha1.hpp>
 #include <signal.h>
+#include <stdlib.h>
 #include "nw_server_meta.hpp"
 #include "srv_game.hpp"
 #include "nw_server.hpp"
 #include <common/time.hpp>
 #include <common/meta.hpp>
+#include <common/constant.hpp>
 #include <common/game.hpp>
 #include <common/files.hpp>
 #include <common/event.hpp>
 #include <common/allocators.hpp>
+#include <common/thread_pool.hpp>
 
 static bool running;
 
 // All event submissions go here
 static event_submissions_t events;
 
+// Duration of a simulation tick (fixed)
 static float dt;
 
-static time_stamp_t tick_start;
-static time_stamp_t tick_end;
+static tick_scheduler_t scheduler;
+static float tick_rate = NET_SERVER_TICK_RATE;
 
-static void s_begin_time() {
-    tick_start = current_time();
-}
+static void s_tick() {
+    g_game->timestep_begin(dt);
+
+    dispatch_events(&events);
 
-static void s_end_time() {
-    tick_end = current_time();
+    LN_CLEAR();
 
-    dt = time_difference(tick_end, tick_start);
-    g_game->dt = dt;
+    srv_game_tick();
+    nw_tick(&events);
+
+    g_game->timestep_end();
 }
 
 static void s_run() {
-    while (running) {
-        s_begin_time();
+    scheduler.init(tick_rate, NET_SERVER_MAX_CATCH_UP_TICKS);
+    dt = scheduler.tick_dt;
 
-        g_game->timestep_begin(dt);
+    LOG_INFOV("Server simulating at %.1f ticks per second\n", tick_rate);
 
-        dispatch_events(&events);
+    time_stamp_t previous = current_time();
 
-        LN_CLEAR();
+    while (running) {
+        time_stamp_t now = current_time();
+        uint64_t dropped_before = scheduler.dropped_tick_count;
 
-        srv_game_tick();
-        nw_tick(&events);
+        // The world always moves forward by dt (whatever the real time between two ticks was)
+        uint32_t tick_count = scheduler.advance(time_difference(now, previous));
+        previous = now;
 
-        g_game->timestep_end();
+        if (scheduler.dropped_tick_count != dropped_before) {
+            LOG_WARNINGV("Server can't keep up, dropped %d ticks\n", (int32_t)(scheduler.dropped_tick_count - dropped_before));
+        }
 
-        // Sleep to not kill CPU usage
-        time_stamp_t current = current_time();
-        float dt = time_difference(current, tick_start);
-        if (dt < 1.0f / 100.0f) {
-            sleep_seconds((1.0f / 100.0f) - dt);
+        for (uint32_t i = 0; i < tick_count && running; ++i) {
+            s_tick();
         }
 
-        s_end_time();
+        // Sleep to not kill CPU usage
+        float time_before_tick = scheduler.time_until_next_tick() - time_difference(current_time(), now);
+        if (time_before_tick > 0.0f) {
+            sleep_seconds(time_before_tick);
+        }
     }
 }
 
@@ -65,6 +77,50 @@ static void s_handle_interrupt(int signum) {
     exit(signum);
 }
 
+static void s_parse_command_line_args(
+    int32_t argc,
+    char *argv[]) {
+    enum option_t { O_TERRAIN_SEED, O_TICK_RATE, O_INVALID };
+
+    option_t current_option = O_INVALID;
+    for (int32_t i = 1; i < argc; ++i) {
+        char *arg = argv[i];
+        if (arg[0] == '-') {
+            // This is an option
+            switch (arg[1]) {
+            case 's': {
+                current_option = O_TERRAIN_SEED;
+            } break;
+
+            case 'r': {
+                current_option = O_TICK_RATE;
+            } break;
+            }
+        }
+        else {
+            // This is information
+            switch (current_option) {
+            case O_TERRAIN_SEED: {
+                srv_use_procedural_terrain((uint32_t)strtoul(arg, NULL, 10));
+            } break;
+
+            case O_TICK_RATE: {
+                float rate = (float)strtod(arg, NULL);
+                if (rate > 0.0f) {
+                    tick_rate = rate;
+                }
+                else {
+                    LOG_ERRORV("Invalid tick rate: %s\n", arg);
+                }
+            } break;
+
+            default: {
+            } break;
+            }
+        }
+    }
+}
+
 // Entry point for client program
 int32_t main(
     int32_t argc,
@@ -76,6 +132,8 @@ int32_t main(
     running = 1;
     files_init();
 
+    s_parse_command_line_args(argc, argv);
+
     nw_init(&events);
 
     game_allocate();
@@ -88,6 +146,8 @@ int32_t main(
     dispatch_events(&events);
     dispatch_events(&events);
 
+    end_thread_pool();
+
     return 0;
 }
 